@@ -51,13 +51,22 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#include <unistd.h>
+#endif
 #include "libcpuid.h"
 
 /* Globals: */
 #define RAW_DATA_FILE_MAX 256
 #define OUT_FILE_MAX 256
 char raw_data_file[RAW_DATA_FILE_MAX] = "";
+char save_data_file[RAW_DATA_FILE_MAX] = "";
 char out_file[OUT_FILE_MAX] = "";
+#define PUBLISH_NAME_MAX 64
+char publish_name[PUBLISH_NAME_MAX] = "";
 typedef enum {
 	NEED_CPUID_PRESENT,
 	NEED_ARCHITECTURE,
@@ -122,7 +131,18 @@ int need_input = 0,
     need_cpulist = 0,
     need_sgx = 0,
     need_hypervisor = 0,
-    need_identify = 0;
+    need_identify = 0,
+    need_bench_raw = 0,
+    need_cpuid_driver = 0,
+    need_lazy = 0,
+    need_compact = 0,
+    need_binary = 0,
+    need_bench_load = 0,
+    need_bench_identify = 0,
+    need_publish = 0,
+    need_topology = 0,
+    need_caches = 0,
+    raw_data_workers = 1;
 
 #define MAX_REQUESTS 64
 int num_requests = 0;
@@ -198,12 +218,32 @@ static void usage(void)
 	printf("  -h, --help       - Show this help\n");
 	printf("  --load=<file>    - Load raw CPUID data from file\n");
 	printf("  --save=<file>    - Acquire raw CPUID data and write it to file\n");
+	printf("                     (with --load: convert the loaded data)\n");
 	printf("  --report, --all  - Report all decoded CPU info (w/o clock)\n");
 	printf("  --clock          - in conjunction to --report: print CPU clock as well\n");
 	printf("  --clock-rdtsc    - same as --clock, but use RDTSC for clock detection\n");
 	printf("  --cpulist        - list all known CPUs\n");
 	printf("  --sgx            - list SGX leaf data, if SGX is supported.\n");
 	printf("  --hypervisor     - print hypervisor vendor if detected.\n");
+	printf("  --topology       - print the tree of packages, dies, core complexes, tiles,\n");
+	printf("                     modules, cores and threads, with their caches\n");
+	printf("                     and the NUMA nodes (of the current system)\n");
+	printf("  --caches         - print every cache instance, with its geometry, the\n");
+	printf("                     logical CPUs sharing it and its NUMA node\n");
+	printf("  --workers=<n>    - read raw CPUID data with <n> threads (0 = one per CPU)\n");
+	printf("  --bench-raw      - measure raw CPUID data acquisition with 1..N threads\n");
+	printf("  --cpuid-driver   - read raw CPUID data through the kernel driver if possible\n");
+	printf("  --lazy           - only query the CPUID leaves reported by the CPU\n");
+	printf("  --compact        - in conjunction to --save: store each core type once,\n");
+	printf("                     and only the differences for each logical CPU\n");
+	printf("  --binary         - in conjunction to --save: write a binary raw dump\n");
+	printf("                     (binary dumps are recognized by --load automatically)\n");
+	printf("  --bench-load     - in conjunction to --load: compare the loading times\n");
+	printf("                     of the text and binary raw dump formats\n");
+	printf("  --bench-identify - measure the decoding of the raw CPUID data (given by --load\n");
+	printf("                     or read from the CPU) by cpu_identify_all\n");
+	printf("  --publish[=name] - publish the CPU identification in shared memory for\n");
+	printf("                     the other processes (default name: libcpuid)\n");
 	printf("  --quiet          - disable warnings\n");
 	printf("  --outfile=<file> - redirect all output to this file, instead of stdout\n");
 	printf("  --verbose, -v    - be extra verbose (more keys increase verbosiness level)\n");
@@ -241,7 +281,7 @@ static int parse_cmdline(int argc, char** argv)
 	if (argc == 1) {
 		/* Default command line options */
 		need_output = 1;
-		strncpy(raw_data_file, "raw.txt", RAW_DATA_FILE_MAX);
+		strncpy(save_data_file, "raw.txt", RAW_DATA_FILE_MAX);
 		strncpy(out_file, "report.txt", OUT_FILE_MAX);
 		need_report = 1;
 		verbose_level = 1;
@@ -258,9 +298,6 @@ static int parse_cmdline(int argc, char** argv)
 			if (need_input) {
 				xerror("Too many `--load' options!");
 			}
-			if (need_output) {
-				xerror("Cannot have both `--load' and `--save' options!");
-			}
 			if (strlen(arg) <= 7) {
 				xerror("--load: bad file specification!");
 			}
@@ -272,14 +309,11 @@ static int parse_cmdline(int argc, char** argv)
 			if (need_output) {
 				xerror("Too many `--save' options!");
 			}
-			if (need_input) {
-				xerror("Cannot have both `--load' and `--save' options!");
-			}
 			if (strlen(arg) <= 7) {
 				xerror("--save: bad file specification!");
 			}
 			need_output = 1;
-			strncpy(raw_data_file, arg + 7, RAW_DATA_FILE_MAX);
+			strncpy(save_data_file, arg + 7, RAW_DATA_FILE_MAX);
 			recog = 1;
 		}
 		if (!strncmp(arg, "--outfile=", 10)) {
@@ -323,11 +357,61 @@ static int parse_cmdline(int argc, char** argv)
 			need_identify = 1;
 			recog = 1;
 		}
+		if (!strcmp(arg, "--topology")) {
+			need_topology = 1;
+			recog = 1;
+		}
+		if (!strcmp(arg, "--caches")) {
+			need_caches = 1;
+			recog = 1;
+		}
 		if (!strcmp(arg, "--hypervisor")) {
 			need_hypervisor = 1;
 			need_identify = 1;
 			recog = 1;
 		}
+		if (!strncmp(arg, "--workers=", 10)) {
+			if (sscanf(arg + 10, "%d", &raw_data_workers) != 1 || raw_data_workers < 0) {
+				xerror("--workers: bad number of threads!");
+			}
+			recog = 1;
+		}
+		if (!strcmp(arg, "--bench-raw")) {
+			need_bench_raw = 1;
+			recog = 1;
+		}
+		if (!strcmp(arg, "--cpuid-driver")) {
+			need_cpuid_driver = 1;
+			recog = 1;
+		}
+		if (!strcmp(arg, "--lazy")) {
+			need_lazy = 1;
+			recog = 1;
+		}
+		if (!strcmp(arg, "--compact")) {
+			need_compact = 1;
+			recog = 1;
+		}
+		if (!strcmp(arg, "--binary")) {
+			need_binary = 1;
+			recog = 1;
+		}
+		if (!strcmp(arg, "--bench-load")) {
+			need_bench_load = 1;
+			recog = 1;
+		}
+		if (!strcmp(arg, "--bench-identify")) {
+			need_bench_identify = 1;
+			recog = 1;
+		}
+		if (!strcmp(arg, "--publish") || !strncmp(arg, "--publish=", 10)) {
+			if ((arg[9] == '=') && (strlen(arg) <= 10)) {
+				xerror("--publish: bad name!");
+			}
+			need_publish = 1;
+			strncpy(publish_name, (arg[9] == '=') ? arg + 10 : "libcpuid", PUBLISH_NAME_MAX - 1);
+			recog = 1;
+		}
 		if (arg[0] == '-' && arg[1] == 'v') {
 			num_vs = 1;
 			while (arg[num_vs] == 'v')
@@ -365,7 +449,7 @@ static int check_need_raw_data(void)
 {
 	int i, j;
 
-	if (need_output || need_report || need_identify) return 1;
+	if (need_output || need_report || need_identify || need_publish || need_topology || need_caches) return 1;
 	for (i = 0; i < num_requests; i++) {
 		for (j = 0; j < sz_match; j++)
 			if (requests[i] == matchtable[j].sw &&
@@ -374,6 +458,14 @@ static int check_need_raw_data(void)
 	return 0;
 }
 
+/* Same output as affinity_mask_str(), for cpu_id_t::affinity */
+static const char* affinity_set_str(const struct cpu_affinity_set_t* set)
+{
+	static cpu_affinity_mask_t affinity_mask;
+	cpuid_affinity_set_to_mask(set, &affinity_mask);
+	return affinity_mask_str(&affinity_mask);
+}
+
 static void print_info(output_data_switch query, struct cpu_id_t* data)
 {
 	int i, value;
@@ -444,7 +536,7 @@ static void print_info(output_data_switch query, struct cpu_id_t* data)
 			fprintf(fout, "%d\n", cpuid_get_total_cpus());
 			break;
 		case NEED_AFFI_MASK:
-			fprintf(fout, "0x%s\n", affinity_mask_str(&data->affinity_mask));
+			fprintf(fout, "0x%s\n", affinity_set_str(&data->affinity));
 			break;
 		case NEED_L1D_SIZE:
 			fprintf(fout, "%d\n", data->l1_data_cache);
@@ -624,6 +716,172 @@ static void print_cpulist(void)
 	}
 }
 
+static double wall_clock_ms(void)
+{
+#ifdef _WIN32
+	LARGE_INTEGER frequency, counter;
+	QueryPerformanceFrequency(&frequency);
+	QueryPerformanceCounter(&counter);
+	return (double) counter.QuadPart * 1000.0 / (double) frequency.QuadPart;
+#else
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double) ts.tv_sec * 1000.0 + (double) ts.tv_nsec / 1000000.0;
+#endif
+}
+
+static void bench_raw_data(void)
+{
+	const int rounds = 5;
+	int workers, round, identical;
+	int total_cpus = cpuid_get_total_cpus();
+	double start, elapsed, best, serial_best = 0.0;
+	struct cpu_raw_data_array_t reference, raw;
+
+	cpuid_set_raw_data_workers(1);
+	if (cpuid_get_all_raw_data(&reference) < 0) {
+		fprintf(fout, "Cannot obtain raw CPU data: %s\n", cpuid_error());
+		return;
+	}
+
+	fprintf(fout, "Raw data acquisition for %d logical CPUs (best of %d rounds):\n", reference.num_raw, rounds);
+	fprintf(fout, "  workers |  time (ms) | speedup | same data\n");
+	for (workers = 1; ; workers *= 2) {
+		if (workers > total_cpus)
+			workers = total_cpus;
+		cpuid_set_raw_data_workers(workers);
+		best = -1.0;
+		identical = 1;
+		for (round = 0; round < rounds; round++) {
+			start = wall_clock_ms();
+			if (cpuid_get_all_raw_data(&raw) < 0) {
+				fprintf(fout, "Cannot obtain raw CPU data with %d workers: %s\n", workers, cpuid_error());
+				cpuid_free_raw_data_array(&reference);
+				cpuid_set_raw_data_workers(raw_data_workers);
+				return;
+			}
+			elapsed = wall_clock_ms() - start;
+			if ((best < 0.0) || (elapsed < best))
+				best = elapsed;
+			if ((raw.num_raw != reference.num_raw) || memcmp(raw.raw, reference.raw, sizeof(struct cpu_raw_data_t) * raw.num_raw))
+				identical = 0;
+			cpuid_free_raw_data_array(&raw);
+		}
+		if (workers == 1)
+			serial_best = best;
+		fprintf(fout, "  %7d | %10.3f | %6.2fx | %s\n", workers, best, (best > 0.0) ? serial_best / best : 0.0, identical ? "yes" : "no");
+		if (workers >= total_cpus)
+			break;
+	}
+
+	cpuid_free_raw_data_array(&reference);
+	cpuid_set_raw_data_workers(raw_data_workers);
+}
+
+/* Creates an empty temporary file and stores its name in `filename' */
+static int make_temp_file(char* filename, size_t size)
+{
+#ifdef _WIN32
+	char dir[MAX_PATH], name[MAX_PATH];
+	if (!GetTempPathA(MAX_PATH, dir) || !GetTempFileNameA(dir, "cpu", 0, name))
+		return 0;
+	snprintf(filename, size, "%s", name);
+	return strlen(name) < size;
+#else
+	int fd;
+	const char* dir = getenv("TMPDIR");
+	snprintf(filename, size, "%s/cpuid_tool_bench.XXXXXX", dir ? dir : "/tmp");
+	fd = mkstemp(filename);
+	if (fd < 0)
+		return 0;
+	close(fd);
+	return 1;
+#endif
+}
+
+static void bench_load_raw_data(void)
+{
+	const int rounds = 20;
+	char binary_file[1024];
+	int round, identical;
+	double start, elapsed, text_best = -1.0, binary_best = -1.0;
+	struct cpu_raw_data_array_t text_raw, binary_raw;
+
+	if (!need_input || !strcmp(raw_data_file, "-")) {
+		fprintf(fout, "--bench-load needs a raw dump file given by --load\n");
+		return;
+	}
+	if (!make_temp_file(binary_file, sizeof(binary_file))) {
+		fprintf(fout, "Cannot create a temporary file\n");
+		return;
+	}
+	if ((cpuid_deserialize_all_raw_data(&text_raw, raw_data_file) < 0) ||
+	    (cpuid_serialize_all_raw_data_binary(&text_raw, binary_file) < 0)) {
+		fprintf(fout, "Cannot convert `%s' to the binary format: %s\n", raw_data_file, cpuid_error());
+		remove(binary_file);
+		return;
+	}
+	cpuid_free_raw_data_array(&text_raw);
+
+	identical = 1;
+	for (round = 0; round < rounds; round++) {
+		start = wall_clock_ms();
+		cpuid_deserialize_all_raw_data(&text_raw, raw_data_file);
+		elapsed = wall_clock_ms() - start;
+		if ((text_best < 0.0) || (elapsed < text_best))
+			text_best = elapsed;
+
+		start = wall_clock_ms();
+		cpuid_deserialize_all_raw_data(&binary_raw, binary_file);
+		elapsed = wall_clock_ms() - start;
+		if ((binary_best < 0.0) || (elapsed < binary_best))
+			binary_best = elapsed;
+
+		if ((text_raw.num_raw != binary_raw.num_raw) || memcmp(text_raw.raw, binary_raw.raw, sizeof(struct cpu_raw_data_t) * text_raw.num_raw))
+			identical = 0;
+		cpuid_free_raw_data_array(&text_raw);
+		cpuid_free_raw_data_array(&binary_raw);
+	}
+	remove(binary_file);
+
+	fprintf(fout, "Raw dump loading of `%s' (best of %d rounds):\n", raw_data_file, rounds);
+	fprintf(fout, "  text   : %10.3f ms\n", text_best);
+	fprintf(fout, "  binary : %10.3f ms (%.1fx faster)\n", binary_best, (binary_best > 0.0) ? text_best / binary_best : 0.0);
+	fprintf(fout, "  same data: %s\n", identical ? "yes" : "no");
+}
+
+static void bench_identify(struct cpu_raw_data_array_t* raw_array)
+{
+	const int rounds = 20;
+	const int iterations = 100;
+	int round, i;
+	double start, elapsed, best = -1.0;
+	struct system_id_t system;
+
+	if ((raw_array->num_raw == 0) && (cpuid_get_all_raw_data(raw_array) < 0)) {
+		fprintf(fout, "Cannot obtain raw CPU data: %s\n", cpuid_error());
+		return;
+	}
+
+	for (round = 0; round < rounds; round++) {
+		start = wall_clock_ms();
+		for (i = 0; i < iterations; i++) {
+			if (cpu_identify_all(raw_array, &system) < 0) {
+				fprintf(fout, "Error identifying the CPU: %s\n", cpuid_error());
+				return;
+			}
+			cpuid_free_system_id(&system);
+		}
+		elapsed = (wall_clock_ms() - start) / iterations;
+		if ((best < 0.0) || (elapsed < best))
+			best = elapsed;
+	}
+
+	fprintf(fout, "Decoding of %d logical CPUs (best of %d rounds):\n", raw_array->num_raw, rounds);
+	fprintf(fout, "  cpu_identify_all : %10.3f ms\n", best);
+	fprintf(fout, "  per logical CPU  : %10.3f us\n", (raw_array->num_raw > 0) ? best * 1000.0 / raw_array->num_raw : 0.0);
+}
+
 static void print_sgx_data(const struct cpu_raw_data_t* raw, const struct cpu_id_t* data)
 {
 	int i;
@@ -645,6 +903,90 @@ static void print_sgx_data(const struct cpu_raw_data_t* raw, const struct cpu_id
 	}
 }
 
+static void print_topology_node(const struct cpu_topology_t* topology, int32_t node, int depth)
+{
+	int32_t i;
+	const struct cpu_topology_node_t* n = &topology->nodes[node];
+	const char* level_names[NUM_TOPOLOGY_LEVELS] = { "package", "die", "complex", "tile", "module", "core", "thread" };
+	const char* cache_names[NUM_CACHE_LEVELS]    = { "L1I", "L1D", "L2", "L3", "L4" };
+
+	/* Skip the levels which the CPU does not report */
+	if ((n->id < 0) && (n->num_caches == 0) && (n->level != TOPOLOGY_PACKAGE) && (n->level != TOPOLOGY_THREAD)) {
+		for (i = n->first_child; i < n->first_child + n->num_children; i++)
+			print_topology_node(topology, i, depth);
+		return;
+	}
+	fprintf(fout, "%*s%s ", depth * 2, "", level_names[n->level]);
+	if (n->id < 0)
+		fprintf(fout, "-");
+	else
+		fprintf(fout, "%d", n->id);
+	fprintf(fout, ": logical CPU%s", (n->num_cpus > 1) ? "s" : "");
+	for (i = n->first_cpu; i < n->first_cpu + n->num_cpus; i++)
+		fprintf(fout, "%s%u", (i == n->first_cpu) ? " " : ",", topology->logical_cpus[i]);
+	for (i = n->first_cache; i < n->first_cache + n->num_caches; i++)
+		fprintf(fout, "%s%s (%d CPU%s)", (i == n->first_cache) ? "; caches: " : ", ", cache_names[topology->caches[i].level], topology->caches[i].num_cpus, (topology->caches[i].num_cpus > 1) ? "s" : "");
+	fprintf(fout, "\n");
+	if (n->level != TOPOLOGY_THREAD)
+		for (i = n->first_child; i < n->first_child + n->num_children; i++)
+			print_topology_node(topology, i, depth + 1);
+}
+
+static void print_topology(struct cpu_raw_data_array_t* raw_array)
+{
+	int32_t i, j, cpu, count;
+	struct cpu_topology_t topology;
+
+	if (cpuid_get_topology(raw_array, NULL, &topology) < 0) {
+		fprintf(fout, "Cannot build the CPU topology: %s\n", cpuid_error());
+		return;
+	}
+	for (i = 0; i < topology.num_level_nodes[TOPOLOGY_PACKAGE]; i++)
+		print_topology_node(&topology, topology.first_node[TOPOLOGY_PACKAGE] + i, 0);
+	for (i = 0; i < topology.num_numa_nodes; i++) {
+		fprintf(fout, "NUMA node %d: logical CPUs", topology.numa_node_ids[i]);
+		for (cpu = 0, count = 0; cpu < topology.num_cpus; cpu++)
+			if (topology.cpu_numa_node[cpu] == topology.numa_node_ids[i])
+				fprintf(fout, "%s%d", (count++ == 0) ? " " : ",", cpu);
+		fprintf(fout, "%s; distances", (count == 0) ? " none" : "");
+		for (j = 0; j < topology.num_numa_nodes; j++)
+			fprintf(fout, "%s%d", (j == 0) ? " " : ",", cpuid_get_numa_distance(&topology, topology.numa_node_ids[i], topology.numa_node_ids[j]));
+		fprintf(fout, "\n");
+	}
+	cpuid_free_topology(&topology);
+}
+
+static void print_caches(struct cpu_raw_data_array_t* raw_array)
+{
+	int32_t i, cpu;
+	struct system_id_t system;
+	const struct cpu_cache_map_t* map;
+	const struct cpu_cache_instance_t* cache;
+	const char* cache_names[NUM_CACHE_LEVELS] = { "L1I", "L1D", "L2", "L3", "L4" };
+
+	if (cpu_identify_all(raw_array, &system) < 0) {
+		fprintf(fout, "Cannot identify the CPUs: %s\n", cpuid_error());
+		cpuid_free_system_id(&system);
+		return;
+	}
+	if ((map = system.cache_map) == NULL) {
+		fprintf(fout, "Cannot build the cache map: the raw data has no affinity or cache topology information\n");
+		cpuid_free_system_id(&system);
+		return;
+	}
+	for (i = 0; i < map->num_caches; i++) {
+		cache = &map->caches[i];
+		fprintf(fout, "%s #%d: %d KB, %d-way, %d-byte lines; logical CPU%s", cache_names[cache->level], cache->id,
+			cache->geometry.size, cache->geometry.assoc, cache->geometry.linesize, (cpuid_affinity_set_count(&cache->affinity) > 1) ? "s" : "");
+		for (cpu = cpuid_affinity_set_next(&cache->affinity, -1); cpu >= 0; cpu = cpuid_affinity_set_next(&cache->affinity, cpu))
+			fprintf(fout, "%s%d", (cpu == cpuid_affinity_set_next(&cache->affinity, -1)) ? " " : ",", cpu);
+		if (cache->numa_node >= 0)
+			fprintf(fout, "; NUMA node %d", cache->numa_node);
+		fprintf(fout, "\n");
+	}
+	cpuid_free_system_id(&system);
+}
+
 static void print_hypervisor(struct cpu_raw_data_t* raw, struct cpu_id_t* data)
 {
 	int i;
@@ -681,7 +1023,8 @@ int main(int argc, char** argv)
 	struct cpu_raw_data_array_t raw_array = {
 		.with_affinity = false,
 		.num_raw       = 0,
-		.raw           = NULL
+		.raw           = NULL,
+		.capacity      = 0
 	};
 	struct system_id_t data = {
 		.num_cpu_types = 0
@@ -695,6 +1038,10 @@ int main(int argc, char** argv)
 		cpuid_set_warn_function(NULL);
 
 	cpuid_set_verbosiness_level(verbose_level);
+	cpuid_set_raw_data_workers(raw_data_workers);
+	if (need_cpuid_driver)
+		cpuid_set_raw_data_method(RAW_DATA_METHOD_DRIVER);
+	cpuid_set_raw_data_lazy(need_lazy);
 
 	/* Redirect output, if necessary: */
 	if (strcmp(out_file, "") && strcmp(out_file, "-")) {
@@ -744,30 +1091,55 @@ int main(int argc, char** argv)
 				}
 				return -1;
 			}
+			if (need_lazy && (verbose_level >= 1))
+				fprintf(fout, "Lazy enumeration saved %d CPUID instructions\n", cpuid_get_raw_data_skipped());
 		}
 	}
 
 	/* Need to dump raw CPUID data to file: */
 	if (need_output) {
-		if (!strcmp(raw_data_file, "-"))
-			/* Serialize to stdout */
-			writeres = cpuid_serialize_all_raw_data(&raw_array, "");
+		const char* filename = !strcmp(save_data_file, "-") ? "" : save_data_file;
+		if (need_compact) {
+			struct cpu_raw_data_compact_t compact;
+			writeres = cpuid_compact_raw_data_array(&raw_array, &compact);
+			if (writeres == 0)
+				writeres = cpuid_serialize_raw_data_compact(&compact, filename);
+			cpuid_free_raw_data_compact(&compact);
+		}
+		else if (need_binary)
+			writeres = cpuid_serialize_all_raw_data_binary(&raw_array, filename);
 		else
-			/* Serialize to file */
-			writeres = cpuid_serialize_all_raw_data(&raw_array, raw_data_file);
+			writeres = cpuid_serialize_all_raw_data(&raw_array, filename);
 		if (writeres < 0) {
 			if (!need_quiet) {
 				fprintf(stderr, "Cannot serialize raw data to ");
-				if (!strcmp(raw_data_file, "-"))
+				if (!strcmp(save_data_file, "-"))
 					fprintf(stderr, "stdout\n");
 				else
-					fprintf(stderr, "file `%s'\n", raw_data_file);
+					fprintf(stderr, "file `%s'\n", save_data_file);
 				/* Print the error message */
 				fprintf(stderr, "Error: %s\n", cpuid_error());
 			}
 			return -1;
 		}
 	}
+	/* Need to publish the identification in shared memory: */
+	if (need_publish) {
+		if (need_input) {
+			if (!need_quiet)
+				fprintf(stderr, "Cannot publish raw data loaded from a file\n");
+			return -1;
+		}
+		if (cpuid_publish_system_id(publish_name, &raw_array) < 0) {
+			if (!need_quiet) {
+				fprintf(stderr, "Cannot publish the CPU identification as `%s'\n", publish_name);
+				fprintf(stderr, "Error: %s\n", cpuid_error());
+			}
+			return -1;
+		}
+		if (verbose_level >= 1)
+			printf("Published the CPU identification as `%s'\n", publish_name);
+	}
 	if (need_report) {
 		if (verbose_level >= 1) {
 			printf("Writing decoded CPU report to `%s'\n", out_file);
@@ -808,7 +1180,7 @@ int main(int argc, char** argv)
 				fprintf(fout, "  num_cores  : %d\n", data.cpu_types[cpu_type_index].num_cores);
 				fprintf(fout, "  num_logical: %d\n", data.cpu_types[cpu_type_index].num_logical_cpus);
 				fprintf(fout, "  tot_logical: %d\n", data.cpu_types[cpu_type_index].total_logical_cpus);
-				fprintf(fout, "  affi_mask  : 0x%s\n", affinity_mask_str(&data.cpu_types[cpu_type_index].affinity_mask));
+				fprintf(fout, "  affi_mask  : 0x%s\n", affinity_set_str(&data.cpu_types[cpu_type_index].affinity));
 				if (data.cpu_types[cpu_type_index].architecture == ARCHITECTURE_X86) {
 					fprintf(fout, "  L1 D cache : %d KB\n", data.cpu_types[cpu_type_index].l1_data_cache);
 					fprintf(fout, "  L1 I cache : %d KB\n", data.cpu_types[cpu_type_index].l1_instruction_cache);
@@ -898,9 +1270,24 @@ int main(int argc, char** argv)
 	if (need_cpulist) {
 		print_cpulist();
 	}
+	if (need_bench_raw) {
+		bench_raw_data();
+	}
+	if (need_bench_load) {
+		bench_load_raw_data();
+	}
+	if (need_bench_identify) {
+		bench_identify(&raw_array);
+	}
 	if (need_sgx) {
 		print_sgx_data(&raw_array.raw[0], &data.cpu_types[0]);
 	}
+	if (need_topology) {
+		print_topology(need_input ? &raw_array : NULL);
+	}
+	if (need_caches) {
+		print_caches(need_input ? &raw_array : NULL);
+	}
 	if (need_hypervisor) {
 		print_hypervisor(&raw_array.raw[0], &data.cpu_types[0]);
 	}
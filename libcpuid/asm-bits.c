@@ -27,6 +27,9 @@
 #include "libcpuid.h"
 #include "libcpuid_util.h"
 #include "asm-bits.h"
+#ifdef COMPILER_MICROSOFT
+#  include <immintrin.h> /* _xgetbv() */
+#endif
 
 int cpuid_exists_by_eflags(void)
 {
@@ -156,6 +159,32 @@ void cpu_rdtsc(uint64_t* result)
 }
 #endif /* INLINE_ASM_SUPPORTED */
 
+/*
+ * XGETBV is only valid if the OS enabled it (CPUID.1:ECX.OSXSAVE), the caller checks it.
+ * With MSVC, the intrinsic is used on both x86 and AMD64
+ */
+uint64_t exec_xgetbv(uint32_t xcr)
+{
+#if defined(PLATFORM_X86) || defined(PLATFORM_X64)
+#  if defined(COMPILER_GCC) || defined(COMPILER_CLANG)
+	uint32_t low_part, hi_part;
+	/* The opcode of XGETBV, which old assemblers do not know */
+	__asm __volatile (
+		".byte 0x0f, 0x01, 0xd0"
+		: "=a"(low_part), "=d"(hi_part) : "c"(xcr)
+	);
+	return (uint64_t)low_part + (((uint64_t) hi_part) << 32);
+#  elif defined(COMPILER_MICROSOFT)
+	return _xgetbv(xcr);
+#  else
+#    error "Unsupported compiler"
+#  endif /* COMPILER_GCC */
+#else
+	UNUSED(xcr);
+	return 0;
+#endif /* PLATFORM_X86 */
+}
+
 #ifdef INLINE_ASM_SUPPORTED
 void busy_sse_loop(int cycles)
 {
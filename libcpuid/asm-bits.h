@@ -81,6 +81,7 @@
 
 int cpuid_exists_by_eflags(void);
 void exec_cpuid(uint32_t *regs);
+uint64_t exec_xgetbv(uint32_t xcr);
 void busy_sse_loop(int cycles);
 
 #endif /* __ASM_BITS_H__ */
@@ -31,14 +31,16 @@
 #include "recog_intel.h"
 #include "asm-bits.h"
 #include "libcpuid_util.h"
-#if defined(PLATFORM_ARM) || defined(PLATFORM_AARCH64)
-# include "libcpuid_arm_driver.h"
-# include "rdcpuid.h"
-#endif /* ARM */
+#include "libcpuid_arm_driver.h"
+#include "rdcpuid.h"
+#include "rdtsc.h"
 #ifdef HAVE_CONFIG_H
 # include "config.h"
 #endif /* HAVE_CONFIG_H */
 #include <stdio.h>
+#include <stddef.h>
+#include <stdarg.h>
+#include <ctype.h>
 #include <string.h>
 #include <stdlib.h>
 #include <stdbool.h>
@@ -49,13 +51,32 @@
 #ifdef HAVE_ELF_AUX_INFO
 # include <sys/auxv.h>
 #endif /* HAVE_ELF_AUX_INFO */
+#ifdef _WIN32
+# include <io.h>
+# include <fcntl.h>
+#else
+# define MMAP_RAW_DATA
+# include <fcntl.h>
+# include <unistd.h>
+# include <sys/mman.h>
+# include <sys/stat.h>
+#endif /* _WIN32 */
+#if defined linux || defined __linux__
+# define SHARED_SYSTEM_ID
+# include <fcntl.h>
+# include <sched.h>
+# include <unistd.h>
+# include <sys/file.h>
+#endif /* linux */
 
 /* Implementation: */
 
-#if defined(__STDC_VERSION__) && __STDC_VERSION__ == 201112L
+#if defined(__STDC_VERSION__) && __STDC_VERSION__ >= 201112L
 #define INTERNAL_SCOPE _Thread_local
 #elif defined(__GNUC__) // Also works for clang
 #define INTERNAL_SCOPE __thread
+#elif defined(_MSC_VER)
+#define INTERNAL_SCOPE __declspec(thread)
 #else
 #define INTERNAL_SCOPE static
 #endif
@@ -463,6 +484,24 @@ static bool set_cpu_affinity(logical_cpu_t logical_cpu)
 }
 #endif /* SET_CPU_AFFINITY */
 
+/* On these systems, set_cpu_affinity() only binds the calling thread, so raw data can be collected by several threads at once */
+#if defined(SET_CPU_AFFINITY) && (defined linux || defined __linux__ || defined __FreeBSD__ || defined __DragonFly__ || defined __NetBSD__)
+#include <pthread.h>
+#define PARALLEL_RAW_DATA
+#endif /* PARALLEL_RAW_DATA */
+
+/* Number of threads used by cpuid_get_all_raw_data(): 0 means one per logical CPU, 1 means no extra thread */
+static int _raw_data_workers = 1;
+
+/* Method used by cpuid_get_raw_data_core() and cpuid_get_all_raw_data() to reach a given logical CPU */
+static cpu_raw_data_method_t _raw_data_method = RAW_DATA_METHOD_AFFINITY;
+
+/* When true, only the leaves and sub-leaves reported by the CPU are queried */
+static bool _raw_data_lazy = false;
+
+/* Number of CPUID instructions saved by the lazy enumeration, see cpuid_get_raw_data_skipped() */
+INTERNAL_SCOPE int _raw_data_skipped = 0;
+
 int cpuid_set_error(cpu_error_t err)
 {
 	_libcpuid_errno = (int) err;
@@ -479,6 +518,15 @@ static void raw_data_t_constructor(struct cpu_raw_data_t* raw)
 	memset(raw, 0, sizeof(struct cpu_raw_data_t));
 }
 
+#define AFFINITY_SET_WORDS(num_cpus) (((num_cpus) + 63) / 64)
+
+static void affinity_set_t_constructor(struct cpu_affinity_set_t* set)
+{
+	set->version  = CPU_AFFINITY_SET_VERSION;
+	set->num_cpus = 0;
+	set->words    = NULL;
+}
+
 static void cpu_id_t_constructor(struct cpu_id_t* id)
 {
 	memset(id, 0, sizeof(struct cpu_id_t));
@@ -490,7 +538,7 @@ static void cpu_id_t_constructor(struct cpu_id_t* id)
 	id->l1_data_cacheline = id->l1_instruction_cacheline = id->l2_cacheline = id->l3_cacheline = id->l4_cacheline = -1;
 	id->l1_data_instances = id->l1_instruction_instances = id->l2_instances = id->l3_instances = id->l4_instances = -1;
 	id->x86.sse_size = -1;
-	init_affinity_mask(&id->affinity_mask);
+	affinity_set_t_constructor(&id->affinity);
 	id->purpose = PURPOSE_GENERAL;
 }
 
@@ -502,8 +550,14 @@ static void cpu_raw_data_array_t_constructor(struct cpu_raw_data_array_t* raw_ar
 	UNUSED(with_affinity);
 	raw_array->with_affinity = false;
 #endif
-	raw_array->num_raw = 0;
-	raw_array->raw = NULL;
+	raw_array->num_raw  = 0;
+	raw_array->raw      = NULL;
+	raw_array->capacity = 0;
+}
+
+static void cpu_raw_data_compact_t_constructor(struct cpu_raw_data_compact_t* compact)
+{
+	memset(compact, 0, sizeof(struct cpu_raw_data_compact_t));
 }
 
 static void system_id_t_constructor(struct system_id_t* system)
@@ -515,6 +569,11 @@ static void system_id_t_constructor(struct system_id_t* system)
 	system->l2_total_instances             = -1;
 	system->l3_total_instances             = -1;
 	system->l4_total_instances             = -1;
+	system->die_total_instances            = -1;
+	system->tile_total_instances           = -1;
+	system->module_total_instances         = -1;
+	system->cache_map                      = NULL;
+	system->topology                       = NULL;
 }
 
 static void topology_t_constructor(struct internal_topology_t* topology, logical_cpu_t logical_cpu)
@@ -522,21 +581,41 @@ static void topology_t_constructor(struct internal_topology_t* topology, logical
 	memset(topology, 0, sizeof(struct internal_topology_t));
 	topology->apic_id     = -1;
 	topology->package_id  = -1;
+	topology->die_id      = -1;
+	topology->complex_id  = -1;
+	topology->tile_id     = -1;
+	topology->module_id   = -1;
 	topology->core_id     = -1;
 	topology->smt_id      = -1;
 	topology->logical_cpu = logical_cpu;
 }
 
-static void core_instances_t_constructor(struct internal_core_instances_t* data)
+static void instances_t_constructor(struct internal_instances_t* data)
+{
+	data->instances     = 0;
+	data->capacity      = 0;
+	data->capacity_bits = 0;
+	data->htable        = NULL;
+}
+
+static void instances_t_destructor(struct internal_instances_t* data)
 {
-	data->instances = 0;
-	memset(data->htable, 0, sizeof(data->htable));
+	free(data->htable);
+	instances_t_constructor(data);
 }
 
 static void cache_instances_t_constructor(struct internal_cache_instances_t* data)
 {
-	memset(data->instances, 0, sizeof(data->instances));
-	memset(data->htable,    0, sizeof(data->htable));
+	cache_type_t level;
+	for (level = 0; level < NUM_CACHE_TYPES; level++)
+		instances_t_constructor(&data->levels[level]);
+}
+
+static void cache_instances_t_destructor(struct internal_cache_instances_t* data)
+{
+	cache_type_t level;
+	for (level = 0; level < NUM_CACHE_TYPES; level++)
+		instances_t_destructor(&data->levels[level]);
 }
 
 static void type_info_array_t_constructor(struct internal_type_info_array_t* data)
@@ -564,73 +643,138 @@ static int16_t cpuid_find_index_system_id(struct system_id_t* system, cpu_purpos
 	return -1;
 }
 
+/* Number of items allocated for a raw array of n items:
+ * the storage grows by powers of two, so that parsing a dump CPU by CPU does not realloc() for every CPU */
+static int32_t cpuid_raw_data_array_capacity(int32_t n)
+{
+	int32_t capacity = 1;
+	if (n <= 0) return 0;
+	while (capacity < n)
+		capacity <<= 1;
+	return capacity;
+}
+
 static void cpuid_grow_raw_data_array(struct cpu_raw_data_array_t* raw_array, logical_cpu_t n)
 {
 	logical_cpu_t i;
+	int32_t capacity;
 	struct cpu_raw_data_t *tmp = NULL;
 
 	if ((n <= 0) || (n < raw_array->num_raw)) return;
-	debugf(3, "Growing cpu_raw_data_array_t from %u to %u items\n", raw_array->num_raw, n);
-	tmp = realloc(raw_array->raw, sizeof(struct cpu_raw_data_t) * n);
-	if (tmp == NULL) { /* Memory allocation failure */
-		cpuid_set_error(ERR_NO_MEM);
-		return;
+	if (n > raw_array->capacity) {
+		capacity = cpuid_raw_data_array_capacity(n);
+		debugf(3, "Growing cpu_raw_data_array_t from %u to %u items\n", raw_array->num_raw, n);
+		tmp = realloc(raw_array->raw, sizeof(struct cpu_raw_data_t) * capacity);
+		if (tmp == NULL) { /* Memory allocation failure */
+			cpuid_set_error(ERR_NO_MEM);
+			return;
+		}
+		raw_array->raw      = tmp;
+		raw_array->capacity = capacity;
 	}
 
 	for (i = raw_array->num_raw; i < n; i++)
-		raw_data_t_constructor(&tmp[i]);
+		raw_data_t_constructor(&raw_array->raw[i]);
 	raw_array->num_raw = n;
-	raw_array->raw     = tmp;
 }
 
-static void cpuid_grow_system_id(struct system_id_t* system, uint8_t n)
+/* Compact raw arrays see struct cpu_raw_data_t as an array of 32-bit words */
+#define RAW_DATA_WORDS ((uint32_t) (sizeof(struct cpu_raw_data_t) / sizeof(uint32_t)))
+
+static uint32_t cpuid_get_raw_data_word(const struct cpu_raw_data_t* raw, uint32_t word)
 {
-	uint8_t i;
+	uint32_t value;
+	memcpy(&value, (const uint8_t*) raw + word * sizeof(uint32_t), sizeof(uint32_t));
+	return value;
+}
+
+static void cpuid_set_raw_data_word(struct cpu_raw_data_t* raw, uint32_t word, uint32_t value)
+{
+	memcpy((uint8_t*) raw + word * sizeof(uint32_t), &value, sizeof(uint32_t));
+}
+
+static bool cpuid_raw_data_same_core_type(const struct cpu_raw_data_t* a, const struct cpu_raw_data_t* b)
+{
+	/* Signature, hybrid core type (leaf 1Ah) on x86 and MIDR on ARM */
+	return (a->basic_cpuid[0x01][EAX] == b->basic_cpuid[0x01][EAX]) &&
+	       (a->basic_cpuid[0x1a][EAX] == b->basic_cpuid[0x1a][EAX]) &&
+	       (a->arm_midr               == b->arm_midr);
+}
+
+/* Makes room for one more item in a buffer which grows by powers of two */
+static bool cpuid_reserve_item(void** buffer, uint32_t num, size_t item_size)
+{
+	void* tmp;
+	uint32_t capacity;
+
+	if (num & (num - 1)) /* not a power of two, there is room left */
+		return true;
+	capacity = (num == 0) ? 1 : num * 2;
+	tmp = realloc(*buffer, item_size * capacity);
+	if (tmp == NULL) /* Memory allocation failure */
+		return false;
+	*buffer = tmp;
+	return true;
+}
+
+static int cpuid_grow_system_id(struct system_id_t* system, int32_t n)
+{
+	int32_t i;
 	struct cpu_id_t *tmp = NULL;
 
-	if ((n <= 0) || (n < system->num_cpu_types)) return;
+	if ((n <= 0) || (n < system->num_cpu_types)) return ERR_OK;
+	if (n > UINT8_MAX) { /* num_cpu_types is 8-bit wide */
+		warnf("Warning: more than %u CPU types, the remaining ones are ignored\n", UINT8_MAX);
+		return cpuid_set_error(ERR_INVRANGE);
+	}
 	debugf(3, "Growing system_id_t from %u to %u items\n", system->num_cpu_types, n);
 	tmp = realloc(system->cpu_types, sizeof(struct cpu_id_t) * n);
-	if (tmp == NULL) { /* Memory allocation failure */
-		cpuid_set_error(ERR_NO_MEM);
-		return;
-	}
+	if (tmp == NULL) /* Memory allocation failure */
+		return cpuid_set_error(ERR_NO_MEM);
 
 	for (i = system->num_cpu_types; i < n; i++)
 		cpu_id_t_constructor(&tmp[i]);
-	system->num_cpu_types = n;
+	system->num_cpu_types = (uint8_t) n;
 	system->cpu_types     = tmp;
+	return ERR_OK;
 }
 
-static void cpuid_grow_type_info(struct internal_type_info_array_t* type_info, uint8_t n)
+static int cpuid_grow_type_info(struct internal_type_info_array_t* type_info, int32_t n)
 {
-	uint8_t i;
+	int32_t i;
 	struct internal_type_info_t *tmp = NULL;
 
-	if ((n <= 0) || (n < type_info->num)) return;
+	if ((n <= 0) || (n < type_info->num)) return ERR_OK;
+	if (n > UINT8_MAX)
+		return cpuid_set_error(ERR_INVRANGE);
 	debugf(3, "Growing internal_type_info_t from %u to %u items\n", type_info->num, n);
 	tmp = realloc(type_info->data, sizeof(struct internal_type_info_t) * n);
-	if (tmp == NULL) { /* Memory allocation failure */
-		cpuid_set_error(ERR_NO_MEM);
-		return;
-	}
+	if (tmp == NULL) /* Memory allocation failure */
+		return cpuid_set_error(ERR_NO_MEM);
 
 	for (i = type_info->num; i < n; i++) {
-		core_instances_t_constructor(&tmp[i].core_instances);
+		instances_t_constructor(&tmp[i].core_instances);
 		cache_instances_t_constructor(&tmp[i].cache_instances);
 	}
-	type_info->num  = n;
+	type_info->num  = (uint8_t) n;
 	type_info->data = tmp;
+	return ERR_OK;
 }
 
 static void cpuid_free_type_info(struct internal_type_info_array_t* type_info)
 {
+	uint8_t i;
+
 	if (type_info->num <= 0) return;
+	for (i = 0; i < type_info->num; i++) {
+		instances_t_destructor(&type_info->data[i].core_instances);
+		cache_instances_t_destructor(&type_info->data[i].cache_instances);
+	}
 	free(type_info->data);
 	type_info->num = 0;
 }
 
-static cpu_architecture_t cpuid_architecture_identify(struct cpu_raw_data_t* raw)
+static cpu_architecture_t cpuid_architecture_identify(const struct cpu_raw_data_t* raw)
 {
 	if (raw->basic_cpuid[0][EAX] != 0x0 || raw->basic_cpuid[0][EBX] != 0x0 || raw->basic_cpuid[0][ECX] != 0x0 || raw->basic_cpuid[0][EDX] != 0x0)
 		return ARCHITECTURE_X86;
@@ -640,103 +784,202 @@ static cpu_architecture_t cpuid_architecture_identify(struct cpu_raw_data_t* raw
 	return ARCHITECTURE_UNKNOWN;
 }
 
-static int cpuid_serialize_raw_data_internal(struct cpu_raw_data_t* single_raw, struct cpu_raw_data_array_t* raw_array, const char* filename)
+/* Text raw dumps are written either to a FILE, or by chunks to a callback */
+#define RAW_WRITER_BUFFER_SIZE 4096
+struct raw_writer_t {
+	FILE* f;
+	libcpuid_write_fn_t write_fn;
+	void* userdata;
+	bool error;
+	size_t len;
+	char buffer[RAW_WRITER_BUFFER_SIZE];
+};
+
+static void raw_writer_init(struct raw_writer_t* w, FILE* f, libcpuid_write_fn_t write_fn, void* userdata)
 {
-	int i;
-	bool end_loop = false;
-	const bool use_raw_array = (raw_array != NULL) && raw_array->num_raw > 0;
-	logical_cpu_t logical_cpu = 0;
-	struct cpu_raw_data_t* raw_ptr = use_raw_array ? &raw_array->raw[0] : single_raw;
-	const cpu_architecture_t architecture = cpuid_architecture_identify(raw_ptr);
-	FILE *f;
+	w->f        = f;
+	w->write_fn = write_fn;
+	w->userdata = userdata;
+	w->error    = false;
+	w->len      = 0;
+}
 
-	/* Open file descriptor */
-	f = !strcmp(filename, "") ? stdout : fopen(filename, "wt");
-	if (!f)
-		return cpuid_set_error(ERR_OPEN);
-	debugf(1, "Writing raw CPUID dump to '%s'\n", f == stdout ? "stdout" : filename);
+static void raw_writer_flush(struct raw_writer_t* w)
+{
+	if ((w->write_fn != NULL) && (w->len > 0) && !w->error)
+		w->error = w->write_fn(w->buffer, w->len, w->userdata) != w->len;
+	w->len = 0;
+}
 
-	/* Write raw data to output file */
-	fprintf(f, "version=%s\n", VERSION);
-	while (!end_loop) {
-		if (use_raw_array) {
-			debugf(2, "Writing raw dump for logical CPU %i\n", logical_cpu);
-			fprintf(f, "\n_________________ Logical CPU #%" PRIi16 " _________________\n", logical_cpu);
-			raw_ptr = &raw_array->raw[logical_cpu];
-		}
-		switch (architecture) {
-			case ARCHITECTURE_X86:
-				for (i = 0; i < MAX_CPUID_LEVEL; i++)
-					fprintf(f, "basic_cpuid[%d]=%08" PRIx32 " %08" PRIx32 " %08" PRIx32 " %08" PRIx32 "\n", i,
+static void raw_printf(struct raw_writer_t* w, const char* format, ...)
+{
+	int n;
+	va_list va;
+
+	va_start(va, format);
+	if (w->f != NULL) {
+		if (vfprintf(w->f, format, va) < 0)
+			w->error = true;
+	}
+	else {
+		/* Every line is much shorter than the buffer */
+		if (RAW_WRITER_BUFFER_SIZE - w->len < 256)
+			raw_writer_flush(w);
+		n = vsnprintf(w->buffer + w->len, RAW_WRITER_BUFFER_SIZE - w->len, format, va);
+		if ((n < 0) || ((size_t) n >= RAW_WRITER_BUFFER_SIZE - w->len))
+			w->error = true;
+		else
+			w->len += (size_t) n;
+	}
+	va_end(va);
+}
+
+/* Write the lines of a raw CPUID record; when base is not NULL, only the lines which differ from base are written */
+#define RAW_LINE_DIFFERS(__field) ((base == NULL) || memcmp(&raw_ptr->__field, &base->__field, sizeof(raw_ptr->__field)))
+static void cpuid_write_raw_data_lines(struct raw_writer_t* w, const struct cpu_raw_data_t* raw_ptr, const struct cpu_raw_data_t* base, cpu_architecture_t architecture)
+{
+	int i;
+
+	switch (architecture) {
+		case ARCHITECTURE_X86:
+			for (i = 0; i < MAX_CPUID_LEVEL; i++)
+				if (RAW_LINE_DIFFERS(basic_cpuid[i]))
+					raw_printf(w, "basic_cpuid[%d]=%08" PRIx32 " %08" PRIx32 " %08" PRIx32 " %08" PRIx32 "\n", i,
 						raw_ptr->basic_cpuid[i][EAX], raw_ptr->basic_cpuid[i][EBX],
 						raw_ptr->basic_cpuid[i][ECX], raw_ptr->basic_cpuid[i][EDX]);
-				for (i = 0; i < MAX_EXT_CPUID_LEVEL; i++)
-					fprintf(f, "ext_cpuid[%d]=%08" PRIx32 " %08" PRIx32 " %08" PRIx32 " %08" PRIx32 "\n", i,
+			for (i = 0; i < MAX_EXT_CPUID_LEVEL; i++)
+				if (RAW_LINE_DIFFERS(ext_cpuid[i]))
+					raw_printf(w, "ext_cpuid[%d]=%08" PRIx32 " %08" PRIx32 " %08" PRIx32 " %08" PRIx32 "\n", i,
 						raw_ptr->ext_cpuid[i][EAX], raw_ptr->ext_cpuid[i][EBX],
 						raw_ptr->ext_cpuid[i][ECX], raw_ptr->ext_cpuid[i][EDX]);
-				for (i = 0; i < MAX_INTELFN4_LEVEL; i++)
-					fprintf(f, "intel_fn4[%d]=%08" PRIx32 " %08" PRIx32 " %08" PRIx32 " %08" PRIx32 "\n", i,
+			for (i = 0; i < MAX_INTELFN4_LEVEL; i++)
+				if (RAW_LINE_DIFFERS(intel_fn4[i]))
+					raw_printf(w, "intel_fn4[%d]=%08" PRIx32 " %08" PRIx32 " %08" PRIx32 " %08" PRIx32 "\n", i,
 						raw_ptr->intel_fn4[i][EAX], raw_ptr->intel_fn4[i][EBX],
 						raw_ptr->intel_fn4[i][ECX], raw_ptr->intel_fn4[i][EDX]);
-				for (i = 0; i < MAX_INTELFN11_LEVEL; i++)
-					fprintf(f, "intel_fn11[%d]=%08" PRIx32 " %08" PRIx32 " %08" PRIx32 " %08" PRIx32 "\n", i,
+			for (i = 0; i < MAX_INTELFN11_LEVEL; i++)
+				if (RAW_LINE_DIFFERS(intel_fn11[i]))
+					raw_printf(w, "intel_fn11[%d]=%08" PRIx32 " %08" PRIx32 " %08" PRIx32 " %08" PRIx32 "\n", i,
 						raw_ptr->intel_fn11[i][EAX], raw_ptr->intel_fn11[i][EBX],
 						raw_ptr->intel_fn11[i][ECX], raw_ptr->intel_fn11[i][EDX]);
-				for (i = 0; i < MAX_INTELFN12H_LEVEL; i++)
-					fprintf(f, "intel_fn12h[%d]=%08" PRIx32 " %08" PRIx32 " %08" PRIx32 " %08" PRIx32 "\n", i,
+			for (i = 0; i < MAX_INTELFN12H_LEVEL; i++)
+				if (RAW_LINE_DIFFERS(intel_fn12h[i]))
+					raw_printf(w, "intel_fn12h[%d]=%08" PRIx32 " %08" PRIx32 " %08" PRIx32 " %08" PRIx32 "\n", i,
 						raw_ptr->intel_fn12h[i][EAX], raw_ptr->intel_fn12h[i][EBX],
 						raw_ptr->intel_fn12h[i][ECX], raw_ptr->intel_fn12h[i][EDX]);
-				for (i = 0; i < MAX_INTELFN14H_LEVEL; i++)
-					fprintf(f, "intel_fn14h[%d]=%08" PRIx32 " %08" PRIx32 " %08" PRIx32 " %08" PRIx32 "\n", i,
+			for (i = 0; i < MAX_INTELFN14H_LEVEL; i++)
+				if (RAW_LINE_DIFFERS(intel_fn14h[i]))
+					raw_printf(w, "intel_fn14h[%d]=%08" PRIx32 " %08" PRIx32 " %08" PRIx32 " %08" PRIx32 "\n", i,
 						raw_ptr->intel_fn14h[i][EAX], raw_ptr->intel_fn14h[i][EBX],
 						raw_ptr->intel_fn14h[i][ECX], raw_ptr->intel_fn14h[i][EDX]);
-				for (i = 0; i < MAX_AMDFN8000001DH_LEVEL; i++)
-					fprintf(f, "amd_fn8000001dh[%d]=%08" PRIx32 " %08" PRIx32 " %08" PRIx32 " %08" PRIx32 "\n", i,
+			for (i = 0; i < MAX_INTELFN1FH_LEVEL; i++)
+				if (RAW_LINE_DIFFERS(intel_fn1fh[i]))
+					raw_printf(w, "intel_fn1fh[%d]=%08" PRIx32 " %08" PRIx32 " %08" PRIx32 " %08" PRIx32 "\n", i,
+						raw_ptr->intel_fn1fh[i][EAX], raw_ptr->intel_fn1fh[i][EBX],
+						raw_ptr->intel_fn1fh[i][ECX], raw_ptr->intel_fn1fh[i][EDX]);
+			for (i = 0; i < MAX_AMDFN8000001DH_LEVEL; i++)
+				if (RAW_LINE_DIFFERS(amd_fn8000001dh[i]))
+					raw_printf(w, "amd_fn8000001dh[%d]=%08" PRIx32 " %08" PRIx32 " %08" PRIx32 " %08" PRIx32 "\n", i,
 						raw_ptr->amd_fn8000001dh[i][EAX], raw_ptr->amd_fn8000001dh[i][EBX],
 						raw_ptr->amd_fn8000001dh[i][ECX], raw_ptr->amd_fn8000001dh[i][EDX]);
-				for (i = 0; i < MAX_AMDFN80000026H_LEVEL; i++)
-					fprintf(f, "amd_fn80000026h[%d]=%08" PRIx32 " %08" PRIx32 " %08" PRIx32 " %08" PRIx32 "\n", i,
+			for (i = 0; i < MAX_AMDFN80000026H_LEVEL; i++)
+				if (RAW_LINE_DIFFERS(amd_fn80000026h[i]))
+					raw_printf(w, "amd_fn80000026h[%d]=%08" PRIx32 " %08" PRIx32 " %08" PRIx32 " %08" PRIx32 "\n", i,
 						raw_ptr->amd_fn80000026h[i][EAX], raw_ptr->amd_fn80000026h[i][EBX],
 						raw_ptr->amd_fn80000026h[i][ECX], raw_ptr->amd_fn80000026h[i][EDX]);
-				break;
-			case ARCHITECTURE_ARM:
-				fprintf(f, "arm_midr=%016" PRIx64 "\n", raw_ptr->arm_midr);
-				fprintf(f, "arm_mpidr=%016" PRIx64 "\n", raw_ptr->arm_mpidr);
-				fprintf(f, "arm_revidr=%016" PRIx64 "\n", raw_ptr->arm_revidr);
-				for (i = 0; i < MAX_ARM_ID_AFR_REGS; i++)
-					fprintf(f, "arm_id_afr%d=%08" PRIx32 "\n", i, raw_ptr->arm_id_afr[i]);
-				for (i = 0; i < MAX_ARM_ID_DFR_REGS; i++)
-					fprintf(f, "arm_id_dfr%d=%08" PRIx32 "\n", i, raw_ptr->arm_id_dfr[i]);
-				for (i = 0; i < MAX_ARM_ID_ISAR_REGS; i++)
-					fprintf(f, "arm_id_isar%d=%08" PRIx32 "\n", i, raw_ptr->arm_id_isar[i]);
-				for (i = 0; i < MAX_ARM_ID_MMFR_REGS; i++)
-					fprintf(f, "arm_id_mmfr%d=%08" PRIx32 "\n", i, raw_ptr->arm_id_mmfr[i]);
-				for (i = 0; i < MAX_ARM_ID_PFR_REGS; i++)
-					fprintf(f, "arm_id_pfr%d=%08" PRIx32 "\n", i, raw_ptr->arm_id_pfr[i]);
-				for (i = 0; i < MAX_ARM_ID_AA64AFR_REGS; i++)
-					fprintf(f, "arm_id_aa64afr%d=%016" PRIx64 "\n", i, raw_ptr->arm_id_aa64afr[i]);
-				for (i = 0; i < MAX_ARM_ID_AA64DFR_REGS; i++)
-					fprintf(f, "arm_id_aa64dfr%d=%016" PRIx64 "\n", i, raw_ptr->arm_id_aa64dfr[i]);
-				for (i = 0; i < MAX_ARM_ID_AA64FPFR_REGS; i++)
-					fprintf(f, "arm_id_aa64fpfr%d=%016" PRIx64 "\n", i, raw_ptr->arm_id_aa64fpfr[i]);
-				for (i = 0; i < MAX_ARM_ID_AA64ISAR_REGS; i++)
-					fprintf(f, "arm_id_aa64isar%d=%016" PRIx64 "\n", i, raw_ptr->arm_id_aa64isar[i]);
-				for (i = 0; i < MAX_ARM_ID_AA64MMFR_REGS; i++)
-					fprintf(f, "arm_id_aa64mmfr%d=%016" PRIx64 "\n", i, raw_ptr->arm_id_aa64mmfr[i]);
-				for (i = 0; i < MAX_ARM_ID_AA64PFR_REGS; i++)
-					fprintf(f, "arm_id_aa64pfr%d=%016" PRIx64 "\n", i, raw_ptr->arm_id_aa64pfr[i]);
-				for (i = 0; i < MAX_ARM_ID_AA64SMFR_REGS; i++)
-					fprintf(f, "arm_id_aa64smfr%d=%016" PRIx64 "\n", i, raw_ptr->arm_id_aa64smfr[i]);
-				for (i = 0; i < MAX_ARM_ID_AA64ZFR_REGS; i++)
-					fprintf(f, "arm_id_aa64zfr%d=%016" PRIx64 "\n", i, raw_ptr->arm_id_aa64zfr[i]);
-				break;
-			default:
-				break;
+			if ((raw_ptr->valid_groups != 0) && ((raw_ptr->valid_groups & RAW_GROUP_ALL) != RAW_GROUP_ALL) && RAW_LINE_DIFFERS(valid_groups))
+				raw_printf(w, "raw_groups=%08" PRIx32 "\n", raw_ptr->valid_groups);
+			break;
+		case ARCHITECTURE_ARM:
+			if (RAW_LINE_DIFFERS(arm_midr))
+				raw_printf(w, "arm_midr=%016" PRIx64 "\n", raw_ptr->arm_midr);
+			if (RAW_LINE_DIFFERS(arm_mpidr))
+				raw_printf(w, "arm_mpidr=%016" PRIx64 "\n", raw_ptr->arm_mpidr);
+			if (RAW_LINE_DIFFERS(arm_revidr))
+				raw_printf(w, "arm_revidr=%016" PRIx64 "\n", raw_ptr->arm_revidr);
+			for (i = 0; i < MAX_ARM_ID_AFR_REGS; i++)
+				if (RAW_LINE_DIFFERS(arm_id_afr[i]))
+					raw_printf(w, "arm_id_afr%d=%08" PRIx32 "\n", i, raw_ptr->arm_id_afr[i]);
+			for (i = 0; i < MAX_ARM_ID_DFR_REGS; i++)
+				if (RAW_LINE_DIFFERS(arm_id_dfr[i]))
+					raw_printf(w, "arm_id_dfr%d=%08" PRIx32 "\n", i, raw_ptr->arm_id_dfr[i]);
+			for (i = 0; i < MAX_ARM_ID_ISAR_REGS; i++)
+				if (RAW_LINE_DIFFERS(arm_id_isar[i]))
+					raw_printf(w, "arm_id_isar%d=%08" PRIx32 "\n", i, raw_ptr->arm_id_isar[i]);
+			for (i = 0; i < MAX_ARM_ID_MMFR_REGS; i++)
+				if (RAW_LINE_DIFFERS(arm_id_mmfr[i]))
+					raw_printf(w, "arm_id_mmfr%d=%08" PRIx32 "\n", i, raw_ptr->arm_id_mmfr[i]);
+			for (i = 0; i < MAX_ARM_ID_PFR_REGS; i++)
+				if (RAW_LINE_DIFFERS(arm_id_pfr[i]))
+					raw_printf(w, "arm_id_pfr%d=%08" PRIx32 "\n", i, raw_ptr->arm_id_pfr[i]);
+			for (i = 0; i < MAX_ARM_ID_AA64AFR_REGS; i++)
+				if (RAW_LINE_DIFFERS(arm_id_aa64afr[i]))
+					raw_printf(w, "arm_id_aa64afr%d=%016" PRIx64 "\n", i, raw_ptr->arm_id_aa64afr[i]);
+			for (i = 0; i < MAX_ARM_ID_AA64DFR_REGS; i++)
+				if (RAW_LINE_DIFFERS(arm_id_aa64dfr[i]))
+					raw_printf(w, "arm_id_aa64dfr%d=%016" PRIx64 "\n", i, raw_ptr->arm_id_aa64dfr[i]);
+			for (i = 0; i < MAX_ARM_ID_AA64FPFR_REGS; i++)
+				if (RAW_LINE_DIFFERS(arm_id_aa64fpfr[i]))
+					raw_printf(w, "arm_id_aa64fpfr%d=%016" PRIx64 "\n", i, raw_ptr->arm_id_aa64fpfr[i]);
+			for (i = 0; i < MAX_ARM_ID_AA64ISAR_REGS; i++)
+				if (RAW_LINE_DIFFERS(arm_id_aa64isar[i]))
+					raw_printf(w, "arm_id_aa64isar%d=%016" PRIx64 "\n", i, raw_ptr->arm_id_aa64isar[i]);
+			for (i = 0; i < MAX_ARM_ID_AA64MMFR_REGS; i++)
+				if (RAW_LINE_DIFFERS(arm_id_aa64mmfr[i]))
+					raw_printf(w, "arm_id_aa64mmfr%d=%016" PRIx64 "\n", i, raw_ptr->arm_id_aa64mmfr[i]);
+			for (i = 0; i < MAX_ARM_ID_AA64PFR_REGS; i++)
+				if (RAW_LINE_DIFFERS(arm_id_aa64pfr[i]))
+					raw_printf(w, "arm_id_aa64pfr%d=%016" PRIx64 "\n", i, raw_ptr->arm_id_aa64pfr[i]);
+			for (i = 0; i < MAX_ARM_ID_AA64SMFR_REGS; i++)
+				if (RAW_LINE_DIFFERS(arm_id_aa64smfr[i]))
+					raw_printf(w, "arm_id_aa64smfr%d=%016" PRIx64 "\n", i, raw_ptr->arm_id_aa64smfr[i]);
+			for (i = 0; i < MAX_ARM_ID_AA64ZFR_REGS; i++)
+				if (RAW_LINE_DIFFERS(arm_id_aa64zfr[i]))
+					raw_printf(w, "arm_id_aa64zfr%d=%016" PRIx64 "\n", i, raw_ptr->arm_id_aa64zfr[i]);
+			break;
+		default:
+			break;
+	}
+}
+#undef RAW_LINE_DIFFERS
+
+static void cpuid_serialize_raw_data_writer(struct cpu_raw_data_t* single_raw, struct cpu_raw_data_array_t* raw_array, struct raw_writer_t* w)
+{
+	bool end_loop = false;
+	const bool use_raw_array = (raw_array != NULL) && raw_array->num_raw > 0;
+	logical_cpu_t logical_cpu = 0;
+	struct cpu_raw_data_t* raw_ptr = use_raw_array ? &raw_array->raw[0] : single_raw;
+	const cpu_architecture_t architecture = cpuid_architecture_identify(raw_ptr);
+
+	/* Write raw data to output */
+	raw_printf(w, "version=%s\n", VERSION);
+	while (!end_loop) {
+		if (use_raw_array) {
+			debugf(2, "Writing raw dump for logical CPU %i\n", logical_cpu);
+			raw_printf(w, "\n_________________ Logical CPU #%" PRIi16 " _________________\n", logical_cpu);
+			raw_ptr = &raw_array->raw[logical_cpu];
 		}
+		cpuid_write_raw_data_lines(w, raw_ptr, NULL, architecture);
 
 		logical_cpu++;
 		end_loop = ((use_raw_array && (logical_cpu >= raw_array->num_raw)) || !use_raw_array);
 	}
+	raw_writer_flush(w);
+}
+
+static int cpuid_serialize_raw_data_internal(struct cpu_raw_data_t* single_raw, struct cpu_raw_data_array_t* raw_array, const char* filename)
+{
+	struct raw_writer_t w;
+	FILE *f;
+
+	/* Open file descriptor */
+	f = !strcmp(filename, "") ? stdout : fopen(filename, "wt");
+	if (!f)
+		return cpuid_set_error(ERR_OPEN);
+	debugf(1, "Writing raw CPUID dump to '%s'\n", f == stdout ? "stdout" : filename);
+
+	raw_writer_init(&w, f, NULL, NULL);
+	cpuid_serialize_raw_data_writer(single_raw, raw_array, &w);
 
 	/* Close file descriptor */
 	if (strcmp(filename, ""))
@@ -744,10 +987,515 @@ static int cpuid_serialize_raw_data_internal(struct cpu_raw_data_t* single_raw,
 	return cpuid_set_error(ERR_OK);
 }
 
+/* Binary raw dump: a header, a table of sections, an index with the offset of each
+ * logical CPU record, then fixed-width records of registers in native byte order.
+ * The file can be mapped in memory and each record is copied without any parsing.
+ * Sections are only appended in new versions, so that a reader skips the ones it does not know. */
+#define RAW_BINARY_MAGIC      "\177CPUIDRB"
+#define RAW_BINARY_MAGIC_LEN  8
+#define RAW_BINARY_BYTE_ORDER 0x01020304
+#define RAW_BINARY_VERSION    1
+#define RAW_BINARY_ALIGN      8
+#define RAW_BINARY_WITH_AFFINITY (1 << 0)
+
+struct raw_binary_header_t {
+	char     magic[RAW_BINARY_MAGIC_LEN];
+	uint32_t byte_order;
+	uint32_t format_version;
+	uint32_t header_size;    /* this header, without the section table */
+	uint32_t flags;
+	uint32_t num_cpus;
+	uint32_t record_size;
+	uint32_t num_sections;
+	uint32_t reserved;
+	char     lib_version[32];
+};
+
+struct raw_binary_section_t {
+	uint32_t count;
+	uint32_t width;
+};
+
+struct raw_binary_field_t {
+	size_t offset;
+	size_t size;
+	size_t width;
+};
+
+#define RAW_BINARY_FIELD(__field) { offsetof(struct cpu_raw_data_t, __field), sizeof(((struct cpu_raw_data_t*) 0)->__field), sizeof(((struct cpu_raw_data_t*) 0)->__field[0]) }
+#define RAW_BINARY_SCALAR(__field) { offsetof(struct cpu_raw_data_t, __field), sizeof(((struct cpu_raw_data_t*) 0)->__field), sizeof(((struct cpu_raw_data_t*) 0)->__field) }
+static const struct raw_binary_field_t raw_binary_fields[] = {
+	RAW_BINARY_FIELD(basic_cpuid),
+	RAW_BINARY_FIELD(ext_cpuid),
+	RAW_BINARY_FIELD(intel_fn4),
+	RAW_BINARY_FIELD(intel_fn11),
+	RAW_BINARY_FIELD(intel_fn12h),
+	RAW_BINARY_FIELD(intel_fn14h),
+	RAW_BINARY_FIELD(amd_fn8000001dh),
+	RAW_BINARY_FIELD(amd_fn80000026h),
+	RAW_BINARY_SCALAR(arm_midr),
+	RAW_BINARY_SCALAR(arm_mpidr),
+	RAW_BINARY_SCALAR(arm_revidr),
+	RAW_BINARY_FIELD(arm_id_afr),
+	RAW_BINARY_FIELD(arm_id_dfr),
+	RAW_BINARY_FIELD(arm_id_isar),
+	RAW_BINARY_FIELD(arm_id_mmfr),
+	RAW_BINARY_FIELD(arm_id_pfr),
+	RAW_BINARY_FIELD(arm_id_aa64afr),
+	RAW_BINARY_FIELD(arm_id_aa64dfr),
+	RAW_BINARY_FIELD(arm_id_aa64fpfr),
+	RAW_BINARY_FIELD(arm_id_aa64isar),
+	RAW_BINARY_FIELD(arm_id_aa64mmfr),
+	RAW_BINARY_FIELD(arm_id_aa64pfr),
+	RAW_BINARY_FIELD(arm_id_aa64smfr),
+	RAW_BINARY_FIELD(arm_id_aa64zfr),
+	RAW_BINARY_SCALAR(valid_groups),
+	RAW_BINARY_FIELD(intel_fn1fh),
+};
+#undef RAW_BINARY_FIELD
+#undef RAW_BINARY_SCALAR
+
+#define RAW_BINARY_ALIGN_UP(__n) (((__n) + RAW_BINARY_ALIGN - 1) & ~((size_t) RAW_BINARY_ALIGN - 1))
+
+static int cpuid_serialize_raw_data_binary_internal(struct cpu_raw_data_t* single_raw, struct cpu_raw_data_array_t* raw_array, const char* filename)
+{
+	int i;
+	bool ok;
+	uint32_t offset;
+	logical_cpu_t logical_cpu;
+	const bool use_raw_array = (raw_array != NULL) && raw_array->num_raw > 0;
+	const logical_cpu_t num_cpus = use_raw_array ? raw_array->num_raw : 1;
+	const uint8_t padding[RAW_BINARY_ALIGN] = { 0 };
+	struct raw_binary_header_t header;
+	struct raw_binary_section_t section;
+	struct cpu_raw_data_t* raw_ptr;
+	size_t record_size = 0, index_size;
+	FILE *f;
+
+	for (i = 0; i < (int) COUNT_OF(raw_binary_fields); i++)
+		record_size += raw_binary_fields[i].size;
+	record_size = RAW_BINARY_ALIGN_UP(record_size);
+	index_size  = RAW_BINARY_ALIGN_UP(sizeof(uint32_t) * num_cpus);
+
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, RAW_BINARY_MAGIC, RAW_BINARY_MAGIC_LEN);
+	header.byte_order     = RAW_BINARY_BYTE_ORDER;
+	header.format_version = RAW_BINARY_VERSION;
+	header.header_size    = sizeof(header);
+	header.flags          = (use_raw_array && raw_array->with_affinity) ? RAW_BINARY_WITH_AFFINITY : 0;
+	header.num_cpus       = (uint32_t) num_cpus;
+	header.record_size    = (uint32_t) record_size;
+	header.num_sections   = COUNT_OF(raw_binary_fields);
+	snprintf(header.lib_version, sizeof(header.lib_version), "%s", VERSION);
+
+	/* Open file descriptor */
+	f = !strcmp(filename, "") ? stdout : fopen(filename, "wb");
+	if (!f)
+		return cpuid_set_error(ERR_OPEN);
+	debugf(1, "Writing binary raw CPUID dump to '%s'\n", f == stdout ? "stdout" : filename);
+#ifdef _WIN32
+	if (f == stdout)
+		_setmode(_fileno(stdout), _O_BINARY);
+#endif /* _WIN32 */
+
+	/* Header, section table and index */
+	ok = fwrite(&header, sizeof(header), 1, f) == 1;
+	for (i = 0; ok && (i < (int) COUNT_OF(raw_binary_fields)); i++) {
+		section.count = (uint32_t) (raw_binary_fields[i].size / raw_binary_fields[i].width);
+		section.width = (uint32_t) raw_binary_fields[i].width;
+		ok = fwrite(&section, sizeof(section), 1, f) == 1;
+	}
+	offset = (uint32_t) (sizeof(header) + sizeof(section) * COUNT_OF(raw_binary_fields) + index_size);
+	for (logical_cpu = 0; ok && (logical_cpu < num_cpus); logical_cpu++, offset += (uint32_t) record_size)
+		ok = fwrite(&offset, sizeof(offset), 1, f) == 1;
+	if (ok && (index_size > sizeof(uint32_t) * num_cpus))
+		ok = fwrite(padding, index_size - sizeof(uint32_t) * num_cpus, 1, f) == 1;
+
+	/* Records */
+	for (logical_cpu = 0; ok && (logical_cpu < num_cpus); logical_cpu++) {
+		raw_ptr = use_raw_array ? &raw_array->raw[logical_cpu] : single_raw;
+		for (i = 0; ok && (i < (int) COUNT_OF(raw_binary_fields)); i++)
+			ok = fwrite((const uint8_t*) raw_ptr + raw_binary_fields[i].offset, raw_binary_fields[i].size, 1, f) == 1;
+		if (ok && (record_size % RAW_BINARY_ALIGN))
+			ok = fwrite(padding, RAW_BINARY_ALIGN - (record_size % RAW_BINARY_ALIGN), 1, f) == 1;
+	}
+
+	/* Close file descriptor */
+	if (strcmp(filename, ""))
+		ok = (fclose(f) == 0) && ok;
+	return cpuid_set_error(ok ? ERR_OK : ERR_OPEN);
+}
+
+/* Reads a binary raw dump from memory */
+static int cpuid_deserialize_raw_data_binary_buf(const uint8_t* buf, size_t size, struct cpu_raw_data_t* single_raw, struct cpu_raw_data_array_t* raw_array)
+{
+	uint32_t i, offset;
+	size_t pos, len, sections_size = 0;
+	logical_cpu_t logical_cpu;
+	struct raw_binary_header_t header;
+	struct raw_binary_section_t section;
+	struct cpu_raw_data_t* raw_ptr;
+	const uint8_t* sections;
+	const uint8_t* index;
+
+	if (raw_array != NULL)
+		cpu_raw_data_array_t_constructor(raw_array, false);
+	if (size < sizeof(header))
+		return cpuid_set_error(ERR_BADFMT);
+	memcpy(&header, buf, sizeof(header));
+	if (memcmp(header.magic, RAW_BINARY_MAGIC, RAW_BINARY_MAGIC_LEN) || (header.byte_order != RAW_BINARY_BYTE_ORDER)) {
+		debugf(1, "Binary raw dump has a bad magic or a different byte order\n");
+		return cpuid_set_error(ERR_BADFMT);
+	}
+	if ((header.format_version > RAW_BINARY_VERSION) || (header.header_size < sizeof(header)) || (header.num_cpus == 0) ||
+	    (header.num_cpus > (uint32_t) INT16_MAX + 1) || (header.header_size > size) ||
+	    ((size - header.header_size) / sizeof(section) < header.num_sections)) {
+		debugf(1, "Unsupported binary raw dump (format version %u)\n", header.format_version);
+		return cpuid_set_error(ERR_BADFMT);
+	}
+	debugf(2, "Recognized binary raw dump version %u from libcpuid %.32s, %u logical CPUs\n",
+		header.format_version, header.lib_version, header.num_cpus);
+
+	/* Check the sections against the known fields */
+	sections = buf + header.header_size;
+	for (i = 0; i < header.num_sections; i++) {
+		memcpy(&section, sections + i * sizeof(section), sizeof(section));
+		if ((i < COUNT_OF(raw_binary_fields)) && (section.width != raw_binary_fields[i].width))
+			return cpuid_set_error(ERR_BADFMT);
+		sections_size += (size_t) section.count * section.width;
+	}
+	if (sections_size > header.record_size)
+		return cpuid_set_error(ERR_BADFMT);
+	index = sections + header.num_sections * sizeof(section);
+	if ((size_t) (index - buf) + sizeof(uint32_t) * header.num_cpus > size)
+		return cpuid_set_error(ERR_BADFMT);
+
+	if (raw_array != NULL) {
+		cpu_raw_data_array_t_constructor(raw_array, (header.flags & RAW_BINARY_WITH_AFFINITY) != 0);
+		cpuid_grow_raw_data_array(raw_array, (logical_cpu_t) header.num_cpus);
+		if (raw_array->num_raw != (logical_cpu_t) header.num_cpus)
+			return cpuid_set_error(ERR_NO_MEM);
+	}
+	for (logical_cpu = 0; logical_cpu < (logical_cpu_t) header.num_cpus; logical_cpu++) {
+		raw_ptr = (raw_array != NULL) ? &raw_array->raw[logical_cpu] : single_raw;
+		memcpy(&offset, index + logical_cpu * sizeof(uint32_t), sizeof(offset));
+		if (((size_t) offset > size) || (size - offset < header.record_size))
+			goto bad_format;
+		raw_data_t_constructor(raw_ptr);
+		for (i = 0, pos = offset; i < header.num_sections; i++, pos += len) {
+			memcpy(&section, sections + i * sizeof(section), sizeof(section));
+			len = (size_t) section.count * section.width;
+			if (i < COUNT_OF(raw_binary_fields))
+				memcpy((uint8_t*) raw_ptr + raw_binary_fields[i].offset, buf + pos,
+				       (len < raw_binary_fields[i].size) ? len : raw_binary_fields[i].size);
+		}
+		if (raw_array == NULL)
+			break;
+	}
+
+	return cpuid_set_error(ERR_OK);
+bad_format:
+	if (raw_array != NULL)
+		cpuid_free_raw_data_array(raw_array);
+	return cpuid_set_error(ERR_BADFMT);
+}
+
+/* Reads a binary raw dump from a file stream, or maps it in memory when possible */
+static int cpuid_deserialize_raw_data_binary_file(FILE* f, const char* filename, struct cpu_raw_data_t* single_raw, struct cpu_raw_data_array_t* raw_array)
+{
+	int r;
+	size_t size = 0, capacity = 0, n;
+	uint8_t *buf = NULL, *tmp;
+
+#ifdef MMAP_RAW_DATA
+	struct stat st;
+	if (strcmp(filename, "") && (fstat(fileno(f), &st) == 0) && S_ISREG(st.st_mode) && (st.st_size > 0)) {
+		buf = mmap(NULL, (size_t) st.st_size, PROT_READ, MAP_PRIVATE, fileno(f), 0);
+		if (buf != MAP_FAILED) {
+			debugf(2, "Mapped %lld bytes of binary raw dump\n", (long long) st.st_size);
+			r = cpuid_deserialize_raw_data_binary_buf(buf, (size_t) st.st_size, single_raw, raw_array);
+			munmap(buf, (size_t) st.st_size);
+			return r;
+		}
+		buf = NULL;
+	}
+#endif /* MMAP_RAW_DATA */
+
+	/* Fallback: read the whole stream */
+#ifdef _WIN32
+	_setmode(_fileno(f), _O_BINARY);
+	if (strcmp(filename, ""))
+		rewind(f);
+#endif /* _WIN32 */
+	do {
+		if (size == capacity) {
+			capacity = (capacity == 0) ? 65536 : capacity * 2;
+			tmp = realloc(buf, capacity);
+			if (tmp == NULL) {
+				free(buf);
+				return cpuid_set_error(ERR_NO_MEM);
+			}
+			buf = tmp;
+		}
+		n = fread(buf + size, 1, capacity - size, f);
+		size += n;
+	} while (n > 0);
+
+	r = cpuid_deserialize_raw_data_binary_buf(buf, size, single_raw, raw_array);
+	free(buf);
+	return r;
+}
+
+/* Single-pass tokenizer for the canonical lines of the text raw dumps.
+ * The key is read once and looked up in raw_line_keys, then the registers are read with a
+ * simple hex parser. Lines which are not in the canonical form (extra signs, "0x" prefixes,
+ * too many digits, out of range indexes...) are rejected here and handed to the sscanf()
+ * calls of cpuid_deserialize_raw_data_internal, so that the accepted inputs and the
+ * warnings stay the same. */
+typedef enum {
+	RAW_LINE_X86,      /* key[index]=eax ebx ecx edx */
+	RAW_LINE_AARCH32,  /* key<index>=value (32-bit) */
+	RAW_LINE_AARCH64,  /* key<index>=value (64-bit) */
+	RAW_LINE_SCALAR32, /* key=value (32-bit) */
+	RAW_LINE_SCALAR64, /* key=value (64-bit) */
+} raw_line_type_t;
+
+struct raw_line_key_t {
+	const char* key;
+	size_t key_len;
+	raw_line_type_t type;
+	size_t offset;
+	int count;
+};
+
+#define RAW_LINE_KEY(__key, __type, __field, __count) { __key, sizeof(__key) - 1, __type, offsetof(struct cpu_raw_data_t, __field), __count }
+static const struct raw_line_key_t raw_line_keys[] = {
+	RAW_LINE_KEY("basic_cpuid",      RAW_LINE_X86,      basic_cpuid,      MAX_CPUID_LEVEL),
+	RAW_LINE_KEY("ext_cpuid",        RAW_LINE_X86,      ext_cpuid,        MAX_EXT_CPUID_LEVEL),
+	RAW_LINE_KEY("intel_fn4",        RAW_LINE_X86,      intel_fn4,        MAX_INTELFN4_LEVEL),
+	RAW_LINE_KEY("intel_fn11",       RAW_LINE_X86,      intel_fn11,       MAX_INTELFN11_LEVEL),
+	RAW_LINE_KEY("intel_fn12h",      RAW_LINE_X86,      intel_fn12h,      MAX_INTELFN12H_LEVEL),
+	RAW_LINE_KEY("intel_fn14h",      RAW_LINE_X86,      intel_fn14h,      MAX_INTELFN14H_LEVEL),
+	RAW_LINE_KEY("intel_fn1fh",      RAW_LINE_X86,      intel_fn1fh,      MAX_INTELFN1FH_LEVEL),
+	RAW_LINE_KEY("amd_fn8000001dh",  RAW_LINE_X86,      amd_fn8000001dh,  MAX_AMDFN8000001DH_LEVEL),
+	RAW_LINE_KEY("amd_fn80000026h",  RAW_LINE_X86,      amd_fn80000026h,  MAX_AMDFN80000026H_LEVEL),
+	RAW_LINE_KEY("raw_groups",       RAW_LINE_SCALAR32, valid_groups,     1),
+	RAW_LINE_KEY("arm_midr",         RAW_LINE_SCALAR64, arm_midr,         1),
+	RAW_LINE_KEY("arm_mpidr",        RAW_LINE_SCALAR64, arm_mpidr,        1),
+	RAW_LINE_KEY("arm_revidr",       RAW_LINE_SCALAR64, arm_revidr,       1),
+	RAW_LINE_KEY("arm_id_afr",       RAW_LINE_AARCH32,  arm_id_afr,       MAX_ARM_ID_AFR_REGS),
+	RAW_LINE_KEY("arm_id_dfr",       RAW_LINE_AARCH32,  arm_id_dfr,       MAX_ARM_ID_DFR_REGS),
+	RAW_LINE_KEY("arm_id_isar",      RAW_LINE_AARCH32,  arm_id_isar,      MAX_ARM_ID_ISAR_REGS),
+	RAW_LINE_KEY("arm_id_mmfr",      RAW_LINE_AARCH32,  arm_id_mmfr,      MAX_ARM_ID_MMFR_REGS),
+	RAW_LINE_KEY("arm_id_pfr",       RAW_LINE_AARCH32,  arm_id_pfr,       MAX_ARM_ID_PFR_REGS),
+	RAW_LINE_KEY("arm_id_aa64afr",   RAW_LINE_AARCH64,  arm_id_aa64afr,   MAX_ARM_ID_AA64AFR_REGS),
+	RAW_LINE_KEY("arm_id_aa64dfr",   RAW_LINE_AARCH64,  arm_id_aa64dfr,   MAX_ARM_ID_AA64DFR_REGS),
+	RAW_LINE_KEY("arm_id_aa64fpfr",  RAW_LINE_AARCH64,  arm_id_aa64fpfr,  MAX_ARM_ID_AA64FPFR_REGS),
+	RAW_LINE_KEY("arm_id_aa64isar",  RAW_LINE_AARCH64,  arm_id_aa64isar,  MAX_ARM_ID_AA64ISAR_REGS),
+	RAW_LINE_KEY("arm_id_aa64mmfr",  RAW_LINE_AARCH64,  arm_id_aa64mmfr,  MAX_ARM_ID_AA64MMFR_REGS),
+	RAW_LINE_KEY("arm_id_aa64pfr",   RAW_LINE_AARCH64,  arm_id_aa64pfr,   MAX_ARM_ID_AA64PFR_REGS),
+	RAW_LINE_KEY("arm_id_aa64smfr",  RAW_LINE_AARCH64,  arm_id_aa64smfr,  MAX_ARM_ID_AA64SMFR_REGS),
+	RAW_LINE_KEY("arm_id_aa64zfr",   RAW_LINE_AARCH64,  arm_id_aa64zfr,   MAX_ARM_ID_AA64ZFR_REGS),
+};
+#undef RAW_LINE_KEY
+
+static int raw_hex_digit(char c)
+{
+	if ((c >= '0') && (c <= '9')) return c - '0';
+	if ((c >= 'a') && (c <= 'f')) return c - 'a' + 10;
+	if ((c >= 'A') && (c <= 'F')) return c - 'A' + 10;
+	return -1;
+}
+
+/* Reads 1 to max_digits hex digits; returns NULL if there are none or too many */
+static const char* raw_parse_hex(const char* p, int max_digits, uint64_t* value)
+{
+	int digit, num_digits = 0;
+
+	*value = 0;
+	while ((digit = raw_hex_digit(*p)) >= 0) {
+		if (++num_digits > max_digits)
+			return NULL;
+		*value = (*value << 4) | (uint64_t) digit;
+		p++;
+	}
+	return (num_digits > 0) ? p : NULL;
+}
+
+/* Reads 1 to 9 decimal digits; returns NULL if there are none or too many */
+static const char* raw_parse_index(const char* p, int* value)
+{
+	int num_digits = 0;
+
+	*value = 0;
+	while ((*p >= '0') && (*p <= '9')) {
+		if (++num_digits > 9)
+			return NULL;
+		*value = *value * 10 + (*p - '0');
+		p++;
+	}
+	return (num_digits > 0) ? p : NULL;
+}
+
+static const char* raw_skip_spaces(const char* p)
+{
+	while (isspace((unsigned char) *p))
+		p++;
+	return p;
+}
+
+/* Tokenizes a "key[index]=regs" or "key<index>=value" line of a libcpuid raw dump */
+static bool cpuid_tokenize_raw_line(const char* line, struct cpu_raw_data_t* raw)
+{
+	int k, index = -1;
+	size_t i, key_len;
+	uint64_t value;
+	uint32_t regs[NUM_REGS];
+	const char* p = line;
+	const char* key_end;
+	const struct raw_line_key_t* key = NULL;
+
+	if (raw == NULL)
+		return false;
+	while (((*p >= 'a') && (*p <= 'z')) || ((*p >= '0') && (*p <= '9')) || (*p == '_'))
+		p++;
+	key_end = p;
+	if (*p == '[') {
+		p = raw_parse_index(p + 1, &index);
+		if ((p == NULL) || (p[0] != ']') || (p[1] != '='))
+			return false;
+		p += 2;
+	}
+	else if (*p == '=') {
+		/* ARM registers have their index right after the key */
+		while ((key_end > line) && (key_end[-1] >= '0') && (key_end[-1] <= '9'))
+			key_end--;
+		if ((key_end < p) && ((raw_parse_index(key_end, &index) != p)))
+			return false;
+		p++;
+	}
+	else
+		return false;
+
+	key_len = (size_t) (key_end - line);
+	for (i = 0; (i < COUNT_OF(raw_line_keys)) && (key == NULL); i++)
+		if ((raw_line_keys[i].key_len == key_len) && !memcmp(raw_line_keys[i].key, line, key_len))
+			key = &raw_line_keys[i];
+	if (key == NULL)
+		return false;
+
+	switch (key->type) {
+		case RAW_LINE_X86:
+			if ((*key_end != '[') || (index >= key->count))
+				return false;
+			for (k = 0; k < NUM_REGS; k++) {
+				p = raw_parse_hex(raw_skip_spaces(p), 8, &value);
+				if ((p == NULL) || ((k < NUM_REGS - 1) && !isspace((unsigned char) *p)))
+					return false;
+				regs[k] = (uint32_t) value;
+			}
+			memcpy((uint8_t*) raw + key->offset + sizeof(regs) * index, regs, sizeof(regs));
+			break;
+		case RAW_LINE_AARCH32:
+		case RAW_LINE_SCALAR32:
+			if ((*key_end != '=') || (index >= key->count) || ((key->type == RAW_LINE_AARCH32) != (index >= 0)))
+				return false;
+			if (raw_parse_hex(raw_skip_spaces(p), 8, &value) == NULL)
+				return false;
+			regs[0] = (uint32_t) value;
+			memcpy((uint8_t*) raw + key->offset + sizeof(uint32_t) * (index < 0 ? 0 : index), &regs[0], sizeof(uint32_t));
+			break;
+		case RAW_LINE_AARCH64:
+		case RAW_LINE_SCALAR64:
+			if ((*key_end != '=') || (index >= key->count) || ((key->type == RAW_LINE_AARCH64) != (index >= 0)))
+				return false;
+			if (raw_parse_hex(raw_skip_spaces(p), 16, &value) == NULL)
+				return false;
+			memcpy((uint8_t*) raw + key->offset + sizeof(uint64_t) * (index < 0 ? 0 : index), &value, sizeof(uint64_t));
+			break;
+	}
+	return true;
+}
+
+/* Tokenizes a "CPUID <addr>: <eax>-<ebx>-<ecx>-<edx> [SL <subleaf>]" line of an AIDA64 raw dump.
+ * Returns the number of assigned items like sscanf() would, or 0 if the line is left to sscanf() */
+static int cpuid_tokenize_aida64_line(const char* line, uint32_t* addr, uint32_t* eax, uint32_t* ebx, uint32_t* ecx, uint32_t* edx, int* subleaf)
+{
+	int k, sl;
+	uint64_t value;
+	uint32_t tokens[1 + NUM_REGS];
+	const char* p;
+
+	if (strncmp(line, "CPUID ", 6))
+		return 0;
+	p = line + 6;
+	for (k = 0; k < 1 + NUM_REGS; k++) {
+		if (k == 1)
+			p = raw_skip_spaces(p + 1);
+		else if (k > 1)
+			p++;
+		p = raw_parse_hex(p, 8, &value);
+		if ((p == NULL) || ((k == 0) && (*p != ':')) || ((k > 0) && (k < NUM_REGS) && (*p != '-')))
+			return 0;
+		tokens[k] = (uint32_t) value;
+	}
+
+	/* Optional " [SL %02i]": with %i, a leading 0 means octal */
+	p = raw_skip_spaces(p);
+	if ((p[0] != '[') || (p[1] != 'S') || (p[2] != 'L'))
+		k = 5;
+	else {
+		p = raw_skip_spaces(p + 3);
+		if ((p[0] < '0') || (p[0] > '9') || (p[1] < '0') || (p[1] > '9'))
+			return 0;
+		if (p[0] != '0')
+			sl = (p[0] - '0') * 10 + (p[1] - '0');
+		else
+			sl = (p[1] <= '7') ? p[1] - '0' : 0;
+		*subleaf = sl;
+		k = 6;
+	}
+	*addr = tokens[0];
+	*eax  = tokens[1];
+	*ebx  = tokens[2];
+	*ecx  = tokens[3];
+	*edx  = tokens[4];
+	return k;
+}
+
+/* Text raw dumps are read either from a FILE, or in place from a memory buffer */
+struct raw_reader_t {
+	FILE* f;
+	const char* buf;
+	size_t size;
+	size_t pos;
+};
+
+/* Same semantics as fgets() */
+static char* raw_gets(char* line, int size, struct raw_reader_t* r)
+{
+	size_t len, max_len;
+	const char* end;
+
+	if (r->f != NULL)
+		return fgets(line, size, r->f);
+	if (r->pos >= r->size)
+		return NULL;
+	max_len = (size_t) size - 1;
+	if (max_len > r->size - r->pos)
+		max_len = r->size - r->pos;
+	end = memchr(r->buf + r->pos, '\n', max_len);
+	len = (end != NULL) ? (size_t) (end - (r->buf + r->pos)) + 1 : max_len;
+	memcpy(line, r->buf + r->pos, len);
+	line[len] = '\0';
+	r->pos += len;
+	return line;
+}
+
 #define RAW_ASSIGN_LINE_X86(__line) __line[EAX] = eax ; __line[EBX] = ebx ; __line[ECX] = ecx ; __line[EDX] = edx
 #define RAW_ASSIGN_LINE_AARCH32(__line) __line = aarch32_reg
 #define RAW_ASSIGN_LINE_AARCH64(__line) __line = aarch64_reg
-static int cpuid_deserialize_raw_data_internal(struct cpu_raw_data_t* single_raw, struct cpu_raw_data_array_t* raw_array, const char* filename)
+static int cpuid_parse_raw_data_text(struct raw_reader_t* reader, const char* filename, struct cpu_raw_data_t* single_raw, struct cpu_raw_data_array_t* raw_array)
 {
 	int i;
 	int cur_line = 0;
@@ -758,24 +1506,19 @@ static int cpuid_deserialize_raw_data_internal(struct cpu_raw_data_t* single_raw
 	bool is_aida64_dump = false;
 	const bool use_raw_array = (raw_array != NULL);
 	logical_cpu_t logical_cpu = 0, logical_cpu_offset = 0;
+	uint16_t base, num_bases = 0;
 	uint32_t addr, eax, ebx, ecx, edx, aarch32_reg;
 	uint64_t aarch64_reg;
 	char version[8] = "";
 	char line[100];
 	struct cpu_raw_data_t* raw_ptr = single_raw;
-	FILE *f;
-
-	/* Open file descriptor */
-	f = !strcmp(filename, "") ? stdin : fopen(filename, "rt");
-	if (!f)
-		return cpuid_set_error(ERR_OPEN);
-	debugf(1, "Opening raw dump from '%s'\n", f == stdin ? "stdin" : filename);
+	struct cpu_raw_data_t* bases = NULL;
 
 	if (use_raw_array)
 		cpu_raw_data_array_t_constructor(raw_array, false);
 
 	/* Parse file and store data in cpu_raw_data_t */
-	while (fgets(line, sizeof(line), f) != NULL) {
+	while (raw_gets(line, sizeof(line), reader) != NULL) {
 		i = -1;
 		line[strcspn(line, "\n")] = '\0';
 		if (line[0] == '\0') // Skip empty lines
@@ -814,13 +1557,41 @@ static int cpuid_deserialize_raw_data_internal(struct cpu_raw_data_t* single_raw
 		}
 
 		if (is_libcpuid_dump) {
-			if (use_raw_array && (sscanf(line, "_________________ Logical CPU #%" SCNu16 " _________________", &logical_cpu) >= 1)) {
+			if (cpuid_tokenize_raw_line(line, raw_ptr)) {
+				/* Canonical line, already stored */
+			}
+			else if (use_raw_array && (sscanf(line, "_________________ Logical CPU #%" SCNu16 " _________________", &logical_cpu) >= 1)) {
 				debugf(2, "Parsing raw dump for logical CPU %i\n", logical_cpu);
 				is_header = false;
 				cpuid_grow_raw_data_array(raw_array, logical_cpu + 1);
 				raw_ptr = &raw_array->raw[logical_cpu];
 				raw_array->with_affinity = true;
 			}
+			else if (sscanf(line, "_________________ Base #%" SCNu16 " _________________", &base) >= 1) {
+				/* Compact dump: base records are followed by the lines which differ for each logical CPU */
+				debugf(2, "Parsing base record #%u\n", base);
+				is_header = false;
+				if (base >= num_bases) {
+					raw_ptr = realloc(bases, sizeof(struct cpu_raw_data_t) * (base + 1));
+					if (raw_ptr == NULL) {
+						free(bases);
+						return cpuid_set_error(ERR_NO_MEM);
+					}
+					bases = raw_ptr;
+					for (; num_bases <= base; num_bases++)
+						raw_data_t_constructor(&bases[num_bases]);
+				}
+				raw_ptr = &bases[base];
+			}
+			else if (!use_raw_array && (num_bases > 0) && (sscanf(line, "_________________ Logical CPU #%" SCNu16 " _________________", &logical_cpu) >= 1)) {
+				raw_ptr = single_raw;
+			}
+			else if (sscanf(line, "base=%" SCNu16, &base) >= 1) {
+				if ((base < num_bases) && (raw_ptr != NULL))
+					memcpy(raw_ptr, &bases[base], sizeof(struct cpu_raw_data_t));
+				else
+					warnf("Warning: file '%s', line %d: base record #%u is not defined!\n", filename, cur_line, base);
+			}
 			else if ((sscanf(line, "basic_cpuid[%d]=%" SCNx32 "%" SCNx32 "%" SCNx32 "%" SCNx32, &i, &eax, &ebx, &ecx, &edx) >= 5) && (i >= 0) && (i < MAX_CPUID_LEVEL)) {
 				RAW_ASSIGN_LINE_X86(raw_ptr->basic_cpuid[i]);
 			}
@@ -839,12 +1610,18 @@ static int cpuid_deserialize_raw_data_internal(struct cpu_raw_data_t* single_raw
 			else if ((sscanf(line, "intel_fn14h[%d]=%" SCNx32 "%" SCNx32 "%" SCNx32 "%" SCNx32, &i, &eax, &ebx, &ecx, &edx) >= 5) && (i >= 0) && (i < MAX_INTELFN14H_LEVEL)) {
 				RAW_ASSIGN_LINE_X86(raw_ptr->intel_fn14h[i]);
 			}
+			else if ((sscanf(line, "intel_fn1fh[%d]=%" SCNx32 "%" SCNx32 "%" SCNx32 "%" SCNx32, &i, &eax, &ebx, &ecx, &edx) >= 5) && (i >= 0) && (i < MAX_INTELFN1FH_LEVEL)) {
+				RAW_ASSIGN_LINE_X86(raw_ptr->intel_fn1fh[i]);
+			}
 			else if ((sscanf(line, "amd_fn8000001dh[%d]=%" SCNx32 "%" SCNx32 "%" SCNx32 "%" SCNx32, &i, &eax, &ebx, &ecx, &edx) >= 5) && (i >= 0) && (i < MAX_AMDFN8000001DH_LEVEL)) {
 				RAW_ASSIGN_LINE_X86(raw_ptr->amd_fn8000001dh[i]);
 			}
 			else if ((sscanf(line, "amd_fn80000026h[%d]=%" SCNx32 "%" SCNx32 "%" SCNx32 "%" SCNx32, &i, &eax, &ebx, &ecx, &edx) >= 5) && (i >= 0) && (i < MAX_AMDFN80000026H_LEVEL)) {
 				RAW_ASSIGN_LINE_X86(raw_ptr->amd_fn80000026h[i]);
 			}
+			else if ((sscanf(line, "raw_groups=%" SCNx32, &eax) >= 1)) {
+				raw_ptr->valid_groups = eax;
+			}
 			else if ((sscanf(line, "arm_midr=%" SCNx64, &aarch64_reg) >= 1)) {
 				RAW_ASSIGN_LINE_AARCH64(raw_ptr->arm_midr);
 			}
@@ -898,7 +1675,9 @@ static int cpuid_deserialize_raw_data_internal(struct cpu_raw_data_t* single_raw
 			}
 		}
 		else if (is_aida64_dump) {
-			if (use_raw_array && ((sscanf(line, "------[ Logical CPU #%" SCNu16 " ]------", &logical_cpu) >= 1) ||
+			subleaf = 0;
+			assigned = cpuid_tokenize_aida64_line(line, &addr, &eax, &ebx, &ecx, &edx, &subleaf);
+			if ((assigned == 0) && use_raw_array && ((sscanf(line, "------[ Logical CPU #%" SCNu16 " ]------", &logical_cpu) >= 1) ||
 			                      (sscanf(line, "------[ CPUID Registers / Logical CPU #%" SCNu16 " ]------", &logical_cpu) >= 1) ||
 			                      (sscanf(line, "CPUID Registers (CPU #%" SCNu16, &logical_cpu) >= 1) ||
 			                      (sscanf(line, "CPU#%" SCNu16 " AffMask: 0x%*x", &logical_cpu) >= 1))) {
@@ -912,10 +1691,11 @@ static int cpuid_deserialize_raw_data_internal(struct cpu_raw_data_t* single_raw
 				raw_array->with_affinity = true;
 				continue;
 			}
-			subleaf = 0;
-			assigned = sscanf(line, "CPUID %" SCNx32 ": %" SCNx32 "-%" SCNx32 "-%" SCNx32 "-%" SCNx32 " [SL %02i]", &addr, &eax, &ebx, &ecx, &edx, &subleaf);
-			if (assigned == 1)
-				assigned = sscanf(line, "CPUID %" SCNx32 "  	 %" SCNx32 "-%" SCNx32 "-%" SCNx32 "-%" SCNx32 " [SL %02i]", &addr, &eax, &ebx, &ecx, &edx, &subleaf);
+			if (assigned == 0) {
+				assigned = sscanf(line, "CPUID %" SCNx32 ": %" SCNx32 "-%" SCNx32 "-%" SCNx32 "-%" SCNx32 " [SL %02i]", &addr, &eax, &ebx, &ecx, &edx, &subleaf);
+				if (assigned == 1)
+					assigned = sscanf(line, "CPUID %" SCNx32 "  	 %" SCNx32 "-%" SCNx32 "-%" SCNx32 "-%" SCNx32 " [SL %02i]", &addr, &eax, &ebx, &ecx, &edx, &subleaf);
+			}
 			debugf(3, "raw line %d: %i items assigned for string '%s'\n", cur_line, assigned, line);
 			if ((assigned >= 5) && (subleaf == 0)) {
 				if (addr < MAX_CPUID_LEVEL) {
@@ -934,6 +1714,7 @@ static int cpuid_deserialize_raw_data_internal(struct cpu_raw_data_t* single_raw
 					case 0x0000000B: RAW_ASSIGN_LINE_X86(raw_ptr->intel_fn11[i]);      break;
 					case 0x00000012: RAW_ASSIGN_LINE_X86(raw_ptr->intel_fn12h[i]);     break;
 					case 0x00000014: RAW_ASSIGN_LINE_X86(raw_ptr->intel_fn14h[i]);     break;
+					case 0x0000001F: if (i < MAX_INTELFN1FH_LEVEL) { RAW_ASSIGN_LINE_X86(raw_ptr->intel_fn1fh[i]); } break;
 					case 0x8000001D: RAW_ASSIGN_LINE_X86(raw_ptr->amd_fn8000001dh[i]); break;
 					case 0x80000026: RAW_ASSIGN_LINE_X86(raw_ptr->amd_fn80000026h[i]); break;
 					default: break;
@@ -942,26 +1723,74 @@ static int cpuid_deserialize_raw_data_internal(struct cpu_raw_data_t* single_raw
 		}
 	}
 
-	/* Close file descriptor */
-	if (strcmp(filename, ""))
-		fclose(f);
+	free(bases);
 	return cpuid_set_error((use_raw_array && (raw_array->num_raw == 0)) ? ERR_BADFMT : ERR_OK);
 }
 #undef RAW_ASSIGN_LINE_X86
 #undef RAW_ASSIGN_LINE_ARM
 
-static void load_features_common(struct cpu_raw_data_t* raw, struct cpu_id_t* data)
+static int cpuid_deserialize_raw_data_internal(struct cpu_raw_data_t* single_raw, struct cpu_raw_data_array_t* raw_array, const char* filename)
 {
-	const struct feature_map_t matchtable_edx1[] = {
-		{  0, CPU_FEATURE_FPU },
-		{  1, CPU_FEATURE_VME },
-		{  2, CPU_FEATURE_DE },
-		{  3, CPU_FEATURE_PSE },
-		{  4, CPU_FEATURE_TSC },
-		{  5, CPU_FEATURE_MSR },
-		{  6, CPU_FEATURE_PAE },
-		{  7, CPU_FEATURE_MCE },
-		{  8, CPU_FEATURE_CX8 },
+	int r;
+	struct raw_reader_t reader = { NULL, NULL, 0, 0 };
+	FILE *f;
+
+	/* Open file descriptor */
+	f = !strcmp(filename, "") ? stdin : fopen(filename, "rt");
+	if (!f)
+		return cpuid_set_error(ERR_OPEN);
+	debugf(1, "Opening raw dump from '%s'\n", f == stdin ? "stdin" : filename);
+
+	/* Binary dumps start with a non-printable character */
+	r = getc(f);
+	if (r != EOF)
+		ungetc(r, f);
+	if (r == RAW_BINARY_MAGIC[0]) {
+		r = cpuid_deserialize_raw_data_binary_file(f, filename, single_raw, raw_array);
+	}
+	else {
+		reader.f = f;
+		r = cpuid_parse_raw_data_text(&reader, filename, single_raw, raw_array);
+	}
+
+	/* Close file descriptor */
+	if (strcmp(filename, ""))
+		fclose(f);
+	return r;
+}
+
+static int cpuid_deserialize_raw_data_buf_internal(const char* buf, size_t size, struct cpu_raw_data_t* single_raw, struct cpu_raw_data_array_t* raw_array)
+{
+	struct raw_reader_t reader = { NULL, NULL, 0, 0 };
+
+	if (buf == NULL) {
+		if (raw_array != NULL)
+			cpu_raw_data_array_t_constructor(raw_array, false);
+		return cpuid_set_error(ERR_HANDLE);
+	}
+	debugf(1, "Reading raw dump from memory (%lu bytes)\n", (unsigned long) size);
+
+	/* The binary format is decoded in place, no copy is made */
+	if ((size > 0) && (buf[0] == RAW_BINARY_MAGIC[0]))
+		return cpuid_deserialize_raw_data_binary_buf((const uint8_t*) buf, size, single_raw, raw_array);
+
+	reader.buf  = buf;
+	reader.size = size;
+	return cpuid_parse_raw_data_text(&reader, "<memory>", single_raw, raw_array);
+}
+
+static void load_features_common(struct cpu_raw_data_t* raw, struct cpu_id_t* data)
+{
+	const struct feature_map_t matchtable_edx1[] = {
+		{  0, CPU_FEATURE_FPU },
+		{  1, CPU_FEATURE_VME },
+		{  2, CPU_FEATURE_DE },
+		{  3, CPU_FEATURE_PSE },
+		{  4, CPU_FEATURE_TSC },
+		{  5, CPU_FEATURE_MSR },
+		{  6, CPU_FEATURE_PAE },
+		{  7, CPU_FEATURE_MCE },
+		{  8, CPU_FEATURE_CX8 },
 		{  9, CPU_FEATURE_APIC },
 		{ 11, CPU_FEATURE_SEP },
 		{ 12, CPU_FEATURE_MTRR },
@@ -1167,6 +1996,32 @@ static void make_list_from_string(const char* csv, struct cpu_list_t* list)
 	}
 }
 
+static void decode_intel_v2_extended_topology(struct cpu_raw_data_t* raw, struct internal_topology_t* topology)
+{
+	int subleaf;
+	uint8_t level_type;
+	uint32_t shift, prev_shift = 0, level_mask;
+	const int32_t apic_id = (int32_t) raw->intel_fn1fh[0][EDX];
+
+	/* Each sub-leaf gives the shift of the x2APIC ID to the next level, so the ID bits of a level
+	   are between the shift of the level below and its own shift. The SMT and core IDs are
+	   already known from leaf 0Bh, where the core ID spans all the bits below the package. */
+	for (subleaf = 0; (subleaf < MAX_INTELFN1FH_LEVEL) && ((level_type = EXTRACTS_BITS(raw->intel_fn1fh[subleaf][ECX], 15, 8)) != 0); subleaf++) {
+		shift      = EXTRACTS_BITS(raw->intel_fn1fh[subleaf][EAX], 4, 0);
+		level_mask = ~(UINT32_MAX << shift) & (UINT32_MAX << prev_shift);
+		switch (level_type) {
+			case 0x03: topology->module_id = apic_id & level_mask; break;
+			case 0x04: topology->tile_id   = apic_id & level_mask; break;
+			case 0x05: topology->die_id    = apic_id & level_mask; break;
+			default: break; /* SMT, core and die group */
+		}
+		prev_shift = shift;
+	}
+	topology->package_id = apic_id & (UINT32_MAX << prev_shift);
+	debugf(3, "Logical CPU %u: x2APIC ID %08x, package %08x, die %08x, tile %08x, module %08x\n", topology->logical_cpu, apic_id,
+		topology->package_id, topology->die_id, topology->tile_id, topology->module_id);
+}
+
 static bool cpu_ident_id_x86(struct cpu_raw_data_t* raw, struct internal_topology_t* topology)
 {
 	bool is_apic_id_supported = false;
@@ -1198,17 +2053,20 @@ static bool cpu_ident_id_x86(struct cpu_raw_data_t* raw, struct internal_topolog
 	*/
 
 	/* Check if leaf 0Bh is supported and if number of logical processors at this level type is greater than 0 */
-	if (!is_apic_id_supported || (raw->basic_cpuid[0][EAX] < 11) || (EXTRACTS_BITS(raw->basic_cpuid[11][EBX], 15, 0) == 0)) {
+	if (!is_apic_id_supported || !RAW_HAS_GROUP(raw, RAW_GROUP_TOPOLOGY) || (raw->basic_cpuid[0][EAX] < 11) || (EXTRACTS_BITS(raw->basic_cpuid[11][EBX], 15, 0) == 0)) {
+		/* AMD CPUs without leaf 0Bh report their extended APIC ID in leaf 8000001Eh */
+		if (is_apic_id_supported && (vendor == VENDOR_AMD) && cpuid_identify_topology_amd(raw, topology))
+			return true;
 		warnf("Warning: APIC ID are not supported, core count can be wrong if SMT is disabled and cache instances count will not be available.\n");
 		return false;
 	}
 
-	/* Derive core mask offsets */
-	for (subleaf = 0; (raw->intel_fn11[subleaf][EAX] != 0x0) && (raw->intel_fn11[subleaf][EBX] != 0x0) && (subleaf < MAX_INTELFN11_LEVEL); subleaf++)
+	/* Derive core mask offsets (the list ends on an invalid level type: the SMT shift is 0 without SMT, notably in VMs) */
+	for (subleaf = 0; (subleaf < MAX_INTELFN11_LEVEL) && (EXTRACTS_BITS(raw->intel_fn11[subleaf][ECX], 15, 8) != 0x0) && (raw->intel_fn11[subleaf][EBX] != 0x0); subleaf++)
 		mask_core_shift = EXTRACTS_BITS(raw->intel_fn11[subleaf][EAX], 4, 0);
 
 	/* Find mask and ID for SMT and cores */
-	for (subleaf = 0; (raw->intel_fn11[subleaf][EAX] != 0x0) && (raw->intel_fn11[subleaf][EBX] != 0x0) && (subleaf < MAX_INTELFN11_LEVEL); subleaf++) {
+	for (subleaf = 0; (subleaf < MAX_INTELFN11_LEVEL) && (EXTRACTS_BITS(raw->intel_fn11[subleaf][ECX], 15, 8) != 0x0) && (raw->intel_fn11[subleaf][EBX] != 0x0); subleaf++) {
 		level_type        = EXTRACTS_BITS(raw->intel_fn11[subleaf][ECX], 15, 8);
 		topology->apic_id = raw->intel_fn11[subleaf][EDX];
 		switch (level_type) {
@@ -1231,6 +2089,12 @@ static bool cpu_ident_id_x86(struct cpu_raw_data_t* raw, struct internal_topolog
 	package_mask          = (-1) << mask_core_shift;
 	topology->package_id  = topology->apic_id & package_mask;
 
+	/* Leaf 1Fh is a superset of leaf 0Bh, with the module, tile and die levels between the cores and the package */
+	if ((level_type > 0) && (raw->basic_cpuid[0][EAX] >= 0x1F) && (EXTRACTS_BITS(raw->intel_fn1fh[0][EBX], 15, 0) != 0))
+		decode_intel_v2_extended_topology(raw, topology);
+	else if ((level_type > 0) && (vendor == VENDOR_AMD))
+		cpuid_identify_topology_amd(raw, topology);
+
 	return (level_type > 0);
 }
 
@@ -1346,70 +2210,189 @@ int cpuid_get_raw_data(struct cpu_raw_data_t* data)
 	return(cpuid_get_raw_data_core(data, -1));
 }
 
-int cpuid_get_raw_data_core(struct cpu_raw_data_t* data, logical_cpu_t logical_cpu)
+#if defined(PLATFORM_X86) || defined(PLATFORM_X64)
+/* Number of CPUID instructions used to fill cpu_raw_data_t when all the leaves are queried */
+#define RAW_DATA_X86_LEAVES (MAX_CPUID_LEVEL + MAX_EXT_CPUID_LEVEL + MAX_INTELFN4_LEVEL + MAX_INTELFN11_LEVEL + \
+	MAX_INTELFN12H_LEVEL + MAX_INTELFN14H_LEVEL + MAX_INTELFN1FH_LEVEL + MAX_AMDFN8000001DH_LEVEL + MAX_AMDFN80000026H_LEVEL)
+
+struct raw_exec_t {
+	struct cpuid_driver_t* handle; /* if not NULL, CPUID is executed through the cpuid driver */
+	int count;                     /* number of executed CPUID instructions */
+};
+
+static int raw_exec_cpuid(struct raw_exec_t* exec, uint32_t eax, uint32_t ecx, uint32_t* regs)
 {
-	bool affinity_saved = false;
+	memset(regs, 0, NUM_REGS * sizeof(uint32_t));
+	regs[EAX] = eax;
+	regs[ECX] = ecx;
+	exec->count++;
+	if (exec->handle != NULL)
+		return cpu_read_cpuid_x86(exec->handle, regs);
+	cpu_exec_cpuid_ext(regs);
+	return ERR_OK;
+}
 
-	if (logical_cpu != (logical_cpu_t) -1) {
-		debugf(2, "Getting raw dump for logical CPU %u\n", logical_cpu);
-		if (set_cpu_affinity(logical_cpu))
-			affinity_saved = save_cpu_affinity();
-		else
-			/* Never return ERR_INVCNB for logical CPU 0 (in case set_cpu_affinity() is not supported) */
-			if (logical_cpu > 0)
-				return cpuid_set_error(ERR_INVCNB);
+static int cpuid_get_raw_data_x86(struct cpu_raw_data_t* data, struct cpuid_driver_t* handle, uint32_t groups)
+{
+	unsigned i;
+	int r;
+	uint32_t max_basic = UINT32_MAX;
+	uint32_t max_ext   = UINT32_MAX;
+	uint32_t regs[NUM_REGS] = { 0 };
+	const bool lazy    = _raw_data_lazy;
+	struct raw_exec_t exec = { handle, 0 };
+
+	/* Leaves and sub-leaves which are not queried are left zeroed */
+	if (lazy || !(groups & RAW_GROUP_BASIC))
+		memset(data->basic_cpuid, 0, sizeof(data->basic_cpuid));
+	if (lazy || !(groups & RAW_GROUP_EXT))
+		memset(data->ext_cpuid, 0, sizeof(data->ext_cpuid));
+	if (lazy || !(groups & RAW_GROUP_CACHE)) {
+		memset(data->intel_fn4, 0, sizeof(data->intel_fn4));
+		memset(data->amd_fn8000001dh, 0, sizeof(data->amd_fn8000001dh));
+	}
+	if (lazy || !(groups & RAW_GROUP_TOPOLOGY)) {
+		memset(data->intel_fn11, 0, sizeof(data->intel_fn11));
+		memset(data->intel_fn1fh, 0, sizeof(data->intel_fn1fh));
+		memset(data->amd_fn80000026h, 0, sizeof(data->amd_fn80000026h));
 	}
+	if (lazy || !(groups & RAW_GROUP_SGX))
+		memset(data->intel_fn12h, 0, sizeof(data->intel_fn12h));
+	if (lazy || !(groups & RAW_GROUP_PT))
+		memset(data->intel_fn14h, 0, sizeof(data->intel_fn14h));
+	data->valid_groups = groups;
+
+	/* Leaf 80000000h is also needed to know if the AMD cache and topology leaves exist */
+	if ((r = raw_exec_cpuid(&exec, 0, 0, data->basic_cpuid[0])) != ERR_OK)
+		return r;
+	if ((groups & (RAW_GROUP_EXT | RAW_GROUP_CACHE | RAW_GROUP_TOPOLOGY)) &&
+	    ((r = raw_exec_cpuid(&exec, ADDRESS_EXT_CPUID_START, 0, regs)) != ERR_OK))
+		return r;
+	if (groups & RAW_GROUP_EXT)
+		memcpy(data->ext_cpuid[0], regs, sizeof(regs));
+	if (lazy) {
+		max_basic = data->basic_cpuid[0][EAX];
+		/* No extended leaf is available if 80000000h returns a value out of range */
+		max_ext   = (regs[EAX] & ADDRESS_EXT_CPUID_START) ? regs[EAX] : ADDRESS_EXT_CPUID_START;
+	}
+
+	for (i = 1; (i < MAX_CPUID_LEVEL) && (i <= max_basic) && (groups & RAW_GROUP_BASIC); i++)
+		if ((r = raw_exec_cpuid(&exec, i, 0, data->basic_cpuid[i])) != ERR_OK)
+			return r;
+	/* The E-cores and LP E-cores of Intel hybrid CPUs only differ by their L3 cache, so leaf 4 is always needed on them */
+	if (!(groups & RAW_GROUP_CACHE) && (data->basic_cpuid[0][EAX] >= 0x1A) && !memcmp(&data->basic_cpuid[0][EBX], "Genu", 4) &&
+	    (EXTRACTS_BIT(data->basic_cpuid[7][EDX], 15) == 0x1)) {
+		groups             |= RAW_GROUP_CACHE;
+		data->valid_groups  = groups;
+	}
+	for (i = 1; (i < MAX_EXT_CPUID_LEVEL) && (ADDRESS_EXT_CPUID_START + i <= max_ext) && (groups & RAW_GROUP_EXT); i++)
+		if ((r = raw_exec_cpuid(&exec, ADDRESS_EXT_CPUID_START + i, 0, data->ext_cpuid[i])) != ERR_OK)
+			return r;
+	/* Deterministic cache parameters: stop after cache type 0 (null) */
+	for (i = 0; (i < MAX_INTELFN4_LEVEL) && (max_basic >= 0x4) && (groups & RAW_GROUP_CACHE); i++) {
+		if ((r = raw_exec_cpuid(&exec, 0x4, i, data->intel_fn4[i])) != ERR_OK)
+			return r;
+		if (lazy && (EXTRACTS_BITS(data->intel_fn4[i][EAX], 4, 0) == 0))
+			break;
+	}
+	/* Extended topology enumeration: stop after level type 0 (invalid) */
+	for (i = 0; (i < MAX_INTELFN11_LEVEL) && (max_basic >= 0xB) && (groups & RAW_GROUP_TOPOLOGY); i++) {
+		if ((r = raw_exec_cpuid(&exec, 0xB, i, data->intel_fn11[i])) != ERR_OK)
+			return r;
+		if (lazy && (EXTRACTS_BITS(data->intel_fn11[i][ECX], 15, 8) == 0))
+			break;
+	}
+	/* V2 extended topology enumeration: stop after level type 0 (invalid) */
+	for (i = 0; (i < MAX_INTELFN1FH_LEVEL) && (max_basic >= 0x1F) && (groups & RAW_GROUP_TOPOLOGY); i++) {
+		if ((r = raw_exec_cpuid(&exec, 0x1F, i, data->intel_fn1fh[i])) != ERR_OK)
+			return r;
+		if (lazy && (EXTRACTS_BITS(data->intel_fn1fh[i][ECX], 15, 8) == 0))
+			break;
+	}
+	/* SGX capability: sub-leaves 0 and 1, then EPC sections until sub-leaf type 0 (invalid) */
+	for (i = 0; (i < MAX_INTELFN12H_LEVEL) && (max_basic >= 0x12) && (groups & RAW_GROUP_SGX); i++) {
+		if ((r = raw_exec_cpuid(&exec, 0x12, i, data->intel_fn12h[i])) != ERR_OK)
+			return r;
+		if (lazy && (i >= 2) && (EXTRACTS_BITS(data->intel_fn12h[i][EAX], 3, 0) == 0))
+			break;
+	}
+	/* Processor trace: sub-leaf 0 reports the maximum sub-leaf */
+	for (i = 0; (i < MAX_INTELFN14H_LEVEL) && (max_basic >= 0x14) && (groups & RAW_GROUP_PT); i++) {
+		if ((r = raw_exec_cpuid(&exec, 0x14, i, data->intel_fn14h[i])) != ERR_OK)
+			return r;
+		if (lazy && (i >= data->intel_fn14h[0][EAX]))
+			break;
+	}
+	/* AMD cache topology: stop after cache type 0 (null) */
+	for (i = 0; (i < MAX_AMDFN8000001DH_LEVEL) && (max_ext >= 0x8000001D) && (groups & RAW_GROUP_CACHE); i++) {
+		if ((r = raw_exec_cpuid(&exec, 0x8000001D, i, data->amd_fn8000001dh[i])) != ERR_OK)
+			return r;
+		if (lazy && (EXTRACTS_BITS(data->amd_fn8000001dh[i][EAX], 4, 0) == 0))
+			break;
+	}
+	/* AMD extended CPU topology: stop after level type 0 (invalid) */
+	for (i = 0; (i < MAX_AMDFN80000026H_LEVEL) && (max_ext >= 0x80000026) && (groups & RAW_GROUP_TOPOLOGY); i++) {
+		if ((r = raw_exec_cpuid(&exec, 0x80000026, i, data->amd_fn80000026h[i])) != ERR_OK)
+			return r;
+		if (lazy && (EXTRACTS_BITS(data->amd_fn80000026h[i][ECX], 15, 8) == 0))
+			break;
+	}
+
+	_raw_data_skipped += RAW_DATA_X86_LEAVES - exec.count;
+	debugf(3, "Executed %i CPUID instructions, %i skipped\n", exec.count, RAW_DATA_X86_LEAVES - exec.count);
+	return ERR_OK;
+}
+#endif /* PLATFORM_X86 */
 
+/* Reads all the registers of a logical CPU through the cpuid kernel driver, without changing the CPU affinity.
+   Returns false when the driver cannot be used, so the caller has to fall back to set_cpu_affinity(). */
+static bool cpuid_get_raw_data_from_driver(struct cpu_raw_data_t* data, logical_cpu_t logical_cpu, uint32_t groups)
+{
 #if defined(PLATFORM_X86) || defined(PLATFORM_X64)
-	unsigned i;
+	int r;
+	struct cpuid_driver_t *handle;
+
+	if ((_raw_data_method != RAW_DATA_METHOD_DRIVER) || (logical_cpu == (logical_cpu_t) -1) || !cpuid_present())
+		return false;
+	if ((handle = cpu_cpuid_driver_open_core(logical_cpu)) == NULL) {
+		debugf(2, "Cannot open cpuid driver for logical CPU %u (%s), falling back to CPU affinity\n", logical_cpu, cpuid_error());
+		return false;
+	}
+	debugf(2, "Using kernel driver to read CPUID on logical CPU %u\n", logical_cpu);
+	r = cpuid_get_raw_data_x86(data, handle, groups);
+	cpu_cpuid_driver_close(handle);
+	if (r != ERR_OK) {
+		debugf(2, "Cannot read CPUID through driver on logical CPU %u, falling back to CPU affinity\n", logical_cpu);
+		return false;
+	}
+	return true;
+#else
+	UNUSED(data);
+	UNUSED(logical_cpu);
+	UNUSED(groups);
+	return false;
+#endif /* PLATFORM_X86 */
+}
+
+/* Reads all the registers on the CPU the calling thread is currently running on.
+   The caller is responsible for the CPU affinity. */
+static int cpuid_get_raw_data_here(struct cpu_raw_data_t* data, logical_cpu_t logical_cpu, uint32_t groups)
+{
+#if defined(PLATFORM_X86) || defined(PLATFORM_X64)
+	UNUSED(logical_cpu);
 
 	if (!cpuid_present())
 		return cpuid_set_error(ERR_NO_CPUID);
 
-	for (i = 0; i < 32; i++)
-		cpu_exec_cpuid(i, data->basic_cpuid[i]);
-	for (i = 0; i < 32; i++)
-		cpu_exec_cpuid(0x80000000 + i, data->ext_cpuid[i]);
-	for (i = 0; i < MAX_INTELFN4_LEVEL; i++) {
-		memset(data->intel_fn4[i], 0, sizeof(data->intel_fn4[i]));
-		data->intel_fn4[i][EAX] = 4;
-		data->intel_fn4[i][ECX] = i;
-		cpu_exec_cpuid_ext(data->intel_fn4[i]);
-	}
-	for (i = 0; i < MAX_INTELFN11_LEVEL; i++) {
-		memset(data->intel_fn11[i], 0, sizeof(data->intel_fn11[i]));
-		data->intel_fn11[i][EAX] = 11;
-		data->intel_fn11[i][ECX] = i;
-		cpu_exec_cpuid_ext(data->intel_fn11[i]);
-	}
-	for (i = 0; i < MAX_INTELFN12H_LEVEL; i++) {
-		memset(data->intel_fn12h[i], 0, sizeof(data->intel_fn12h[i]));
-		data->intel_fn12h[i][EAX] = 0x12;
-		data->intel_fn12h[i][ECX] = i;
-		cpu_exec_cpuid_ext(data->intel_fn12h[i]);
-	}
-	for (i = 0; i < MAX_INTELFN14H_LEVEL; i++) {
-		memset(data->intel_fn14h[i], 0, sizeof(data->intel_fn14h[i]));
-		data->intel_fn14h[i][EAX] = 0x14;
-		data->intel_fn14h[i][ECX] = i;
-		cpu_exec_cpuid_ext(data->intel_fn14h[i]);
-	}
-	for (i = 0; i < MAX_AMDFN8000001DH_LEVEL; i++) {
-		memset(data->amd_fn8000001dh[i], 0, sizeof(data->amd_fn8000001dh[i]));
-		data->amd_fn8000001dh[i][EAX] = 0x8000001d;
-		data->amd_fn8000001dh[i][ECX] = i;
-		cpu_exec_cpuid_ext(data->amd_fn8000001dh[i]);
-	}
-	for (i = 0; i < MAX_AMDFN80000026H_LEVEL; i++) {
-		memset(data->amd_fn80000026h[i], 0, sizeof(data->amd_fn80000026h[i]));
-		data->amd_fn80000026h[i][EAX] = 0x80000026;
-		data->amd_fn80000026h[i][ECX] = i;
-		cpu_exec_cpuid_ext(data->amd_fn80000026h[i]);
-	}
+	cpuid_get_raw_data_x86(data, NULL, groups);
 #elif defined(PLATFORM_ARM) || defined(PLATFORM_AARCH64)
 	unsigned i;
 	struct cpuid_driver_t *handle;
 
+	/* Leaf groups only apply to x86 CPUs */
+	UNUSED(groups);
+	data->valid_groups = 0;
+
 	/* Try to use cpuid kernel driver on AArch32/AArch64 states */
 	if ((handle = cpu_cpuid_driver_open_core(logical_cpu)) != NULL) {
 		debugf(2, "Using kernel driver to read register on logical CPU %u\n", logical_cpu);
@@ -1487,24 +2470,54 @@ int cpuid_get_raw_data_core(struct cpu_raw_data_t* data, logical_cpu_t logical_c
         #warning This CPU architecture is not supported by libcpuid
     #endif
     UNUSED(data);
+    UNUSED(logical_cpu);
+    UNUSED(groups);
 #endif
 
+	return cpuid_set_error(ERR_OK);
+}
+
+static int cpuid_get_raw_data_internal(struct cpu_raw_data_t* data, logical_cpu_t logical_cpu, uint32_t groups)
+{
+	int r;
+	bool affinity_saved = false;
+
+	if (logical_cpu != (logical_cpu_t) -1) {
+		debugf(2, "Getting raw dump for logical CPU %u\n", logical_cpu);
+		if (cpuid_get_raw_data_from_driver(data, logical_cpu, groups))
+			return cpuid_set_error(ERR_OK);
+		if (set_cpu_affinity(logical_cpu))
+			affinity_saved = save_cpu_affinity();
+		else
+			/* Never return ERR_INVCNB for logical CPU 0 (in case set_cpu_affinity() is not supported) */
+			if (logical_cpu > 0)
+				return cpuid_set_error(ERR_INVCNB);
+	}
+
+	r = cpuid_get_raw_data_here(data, logical_cpu, groups);
+
 	if (affinity_saved)
 		restore_cpu_affinity();
 
-	return cpuid_set_error(ERR_OK);
+	return r;
 }
 
-int cpuid_get_all_raw_data(struct cpu_raw_data_array_t* data)
+int cpuid_get_raw_data_core(struct cpu_raw_data_t* data, logical_cpu_t logical_cpu)
+{
+	return cpuid_get_raw_data_internal(data, logical_cpu, RAW_GROUP_ALL);
+}
+
+int cpuid_get_raw_data_groups(struct cpu_raw_data_t* data, logical_cpu_t logical_cpu, uint32_t groups)
+{
+	/* The basic leaves are always needed to identify the CPU */
+	return cpuid_get_raw_data_internal(data, logical_cpu, (groups & RAW_GROUP_ALL) | RAW_GROUP_BASIC);
+}
+
+static int cpuid_get_all_raw_data_serial(struct cpu_raw_data_array_t* data, logical_cpu_t logical_cpu)
 {
 	int r = ERR_OK;
-	logical_cpu_t logical_cpu = 0;
 	struct cpu_raw_data_t raw_tmp;
 
-	if (data == NULL)
-		return cpuid_set_error(ERR_HANDLE);
-
-	cpu_raw_data_array_t_constructor(data, true);
 	do {
 		memset(&raw_tmp, 0, sizeof(struct cpu_raw_data_t));
 		if ((r = cpuid_get_raw_data_core(&raw_tmp, logical_cpu)) != ERR_OK)
@@ -1517,9 +2530,163 @@ int cpuid_get_all_raw_data(struct cpu_raw_data_array_t* data)
 	/* On ERR_INVCNB, it means that logical_cpu value is out of bounds and we must break the loop, but it is a normal behavior. */
 	if (r == ERR_INVCNB)
 		r = ERR_OK;
+	return r;
+}
+
+#ifdef PARALLEL_RAW_DATA
+#define RAW_DATA_PENDING 1
+
+struct raw_data_worker_t {
+	pthread_t thread;
+	struct cpu_raw_data_array_t* data;
+	int* results;
+	logical_cpu_t first;
+	logical_cpu_t stride;
+	int skipped;
+};
+
+static void* raw_data_worker(void* arg)
+{
+	struct raw_data_worker_t* worker = (struct raw_data_worker_t*) arg;
+	logical_cpu_t logical_cpu;
+
+	/* The worker thread is discarded afterwards, so its affinity does not need to be restored */
+	for (logical_cpu = worker->first; logical_cpu < worker->data->num_raw; logical_cpu += worker->stride) {
+		debugf(2, "Getting raw dump for logical CPU %u (worker %u)\n", logical_cpu, worker->first);
+		memset(&worker->data->raw[logical_cpu], 0, sizeof(struct cpu_raw_data_t));
+		if (cpuid_get_raw_data_from_driver(&worker->data->raw[logical_cpu], logical_cpu, RAW_GROUP_ALL)) {
+			worker->results[logical_cpu] = ERR_OK;
+			continue;
+		}
+		/* Never return ERR_INVCNB for logical CPU 0 (in case set_cpu_affinity() is not supported) */
+		if (!set_cpu_affinity(logical_cpu) && (logical_cpu > 0)) {
+			worker->results[logical_cpu] = ERR_INVCNB;
+			continue;
+		}
+		worker->results[logical_cpu] = cpuid_get_raw_data_here(&worker->data->raw[logical_cpu], logical_cpu, RAW_GROUP_ALL);
+	}
+	worker->skipped = _raw_data_skipped;
+	return NULL;
+}
+
+static int cpuid_get_all_raw_data_parallel(struct cpu_raw_data_array_t* data, int num_workers)
+{
+	int r = ERR_OK;
+	int i, num_started;
+	const int total_cpus = get_total_cpus();
+	int* results = NULL;
+	struct raw_data_worker_t* workers = NULL;
+	logical_cpu_t logical_cpu;
+
+	if ((num_workers == 0) || (num_workers > total_cpus))
+		num_workers = total_cpus;
+	if (num_workers <= 1)
+		return cpuid_get_all_raw_data_serial(data, 0);
+
+	cpuid_grow_raw_data_array(data, (logical_cpu_t) total_cpus);
+	results = malloc(sizeof(int) * total_cpus);
+	workers = malloc(sizeof(struct raw_data_worker_t) * num_workers);
+	if ((data->num_raw != total_cpus) || (results == NULL) || (workers == NULL)) {
+		free(results);
+		free(workers);
+		return ERR_NO_MEM;
+	}
+
+	/* Each worker takes every num_workers-th logical CPU, so that the sets are disjoint */
+	debugf(2, "Getting raw dump for %i logical CPUs with %i workers\n", total_cpus, num_workers);
+	for (i = 0; i < total_cpus; i++)
+		results[i] = RAW_DATA_PENDING;
+	for (num_started = 0; num_started < num_workers; num_started++) {
+		workers[num_started].data    = data;
+		workers[num_started].results = results;
+		workers[num_started].first   = (logical_cpu_t) num_started;
+		workers[num_started].stride  = (logical_cpu_t) num_workers;
+		workers[num_started].skipped = 0;
+		if (pthread_create(&workers[num_started].thread, NULL, raw_data_worker, &workers[num_started]) != 0) {
+			debugf(1, "Cannot start raw data worker %i, the remaining CPUs will be read serially\n", num_started);
+			break;
+		}
+	}
+	for (i = 0; i < num_started; i++) {
+		pthread_join(workers[i].thread, NULL);
+		_raw_data_skipped += workers[i].skipped;
+	}
+
+	/* Keep the same result as the serial loop: stop at the first logical CPU which failed */
+	for (logical_cpu = 0; logical_cpu < total_cpus; logical_cpu++) {
+		if (results[logical_cpu] == RAW_DATA_PENDING) {
+			memset(&data->raw[logical_cpu], 0, sizeof(struct cpu_raw_data_t));
+			results[logical_cpu] = cpuid_get_raw_data_core(&data->raw[logical_cpu], logical_cpu);
+		}
+		if (results[logical_cpu] != ERR_OK) {
+			r = results[logical_cpu];
+			break;
+		}
+	}
+	data->num_raw = logical_cpu;
+	if (data->num_raw == 0) {
+		free(data->raw);
+		data->raw      = NULL;
+		data->capacity = 0;
+	}
+	free(results);
+	free(workers);
+
+	if (r == ERR_INVCNB)
+		r = ERR_OK;
+	else if ((r == ERR_OK) && (logical_cpu == total_cpus))
+		/* Logical CPUs beyond the online count may still be reachable */
+		r = cpuid_get_all_raw_data_serial(data, logical_cpu);
+	return r;
+}
+#endif /* PARALLEL_RAW_DATA */
+
+int cpuid_get_all_raw_data(struct cpu_raw_data_array_t* data)
+{
+	int r;
+
+	if (data == NULL)
+		return cpuid_set_error(ERR_HANDLE);
+
+	cpu_raw_data_array_t_constructor(data, true);
+#ifdef PARALLEL_RAW_DATA
+	if (_raw_data_workers != 1)
+		r = cpuid_get_all_raw_data_parallel(data, _raw_data_workers);
+	else
+#endif /* PARALLEL_RAW_DATA */
+		r = cpuid_get_all_raw_data_serial(data, 0);
 	return cpuid_set_error(r);
 }
 
+int cpuid_set_raw_data_workers(int workers)
+{
+	const int prev = _raw_data_workers;
+	_raw_data_workers = (workers < 0) ? 0 : workers;
+	return prev;
+}
+
+cpu_raw_data_method_t cpuid_set_raw_data_method(cpu_raw_data_method_t method)
+{
+	const cpu_raw_data_method_t prev = _raw_data_method;
+	if (((int) method >= 0) && (method < NUM_RAW_DATA_METHODS))
+		_raw_data_method = method;
+	return prev;
+}
+
+int cpuid_set_raw_data_lazy(int enabled)
+{
+	const int prev = _raw_data_lazy;
+	_raw_data_lazy = (enabled != 0);
+	return prev;
+}
+
+int cpuid_get_raw_data_skipped(void)
+{
+	const int skipped = _raw_data_skipped;
+	_raw_data_skipped = 0;
+	return skipped;
+}
+
 int cpuid_serialize_raw_data(struct cpu_raw_data_t* data, const char* filename)
 {
 	return cpuid_serialize_raw_data_internal(data, NULL, filename);
@@ -1530,6 +2697,16 @@ int cpuid_serialize_all_raw_data(struct cpu_raw_data_array_t* data, const char*
 	return cpuid_serialize_raw_data_internal(NULL, data, filename);
 }
 
+int cpuid_serialize_raw_data_binary(struct cpu_raw_data_t* data, const char* filename)
+{
+	return cpuid_serialize_raw_data_binary_internal(data, NULL, filename);
+}
+
+int cpuid_serialize_all_raw_data_binary(struct cpu_raw_data_array_t* data, const char* filename)
+{
+	return cpuid_serialize_raw_data_binary_internal(NULL, data, filename);
+}
+
 int cpuid_deserialize_raw_data(struct cpu_raw_data_t* data, const char* filename)
 {
 	raw_data_t_constructor(data);
@@ -1541,58 +2718,603 @@ int cpuid_deserialize_all_raw_data(struct cpu_raw_data_array_t* data, const char
 	return cpuid_deserialize_raw_data_internal(NULL, data, filename);
 }
 
-int cpu_ident_internal(struct cpu_raw_data_t* raw, struct cpu_id_t* data, struct internal_id_info_t* internal)
+int cpuid_serialize_raw_data_cb(struct cpu_raw_data_t* data, libcpuid_write_fn_t write_fn, void* userdata)
 {
-	int r;
-	struct cpu_raw_data_t myraw;
-	if (!raw) {
-		if ((r = cpuid_get_raw_data(&myraw)) < 0)
-			return cpuid_set_error(r);
-		raw = &myraw;
-	}
-	cpu_id_t_constructor(data);
-	memset(internal->cache_mask, 0, sizeof(internal->cache_mask));
-	data->architecture = cpuid_architecture_identify(raw);
+	struct raw_writer_t w;
 
-	switch (data->architecture) {
-		case ARCHITECTURE_X86:
-			if ((r = cpuid_basic_identify(raw, data)) < 0)
-				return cpuid_set_error(r);
-			switch (data->vendor) {
-				case VENDOR_INTEL:
-					r = cpuid_identify_intel(raw, data, internal);
-					break;
-				case VENDOR_AMD:
-				case VENDOR_HYGON:
-					r = cpuid_identify_amd(raw, data, internal);
-					break;
-				case VENDOR_CENTAUR:
-					r = cpuid_identify_centaur(raw, data, internal);
-					break;
-				default:
-					break;
-			}
-			break;
-		case ARCHITECTURE_ARM:
-			r = cpuid_identify_arm(raw, data);
-			break;
-		default:
-			r = ERR_CPU_UNKN;
-			break;
-	}
+	if (write_fn == NULL)
+		return cpuid_set_error(ERR_HANDLE);
+	raw_writer_init(&w, NULL, write_fn, userdata);
+	cpuid_serialize_raw_data_writer(data, NULL, &w);
+	return cpuid_set_error(w.error ? ERR_OPEN : ERR_OK);
+}
 
-#ifndef LIBCPUID_DISABLE_DEPRECATED
-#  if defined(__GNUC__) || defined(GNUC)
-#    pragma GCC diagnostic ignored "-Wdeprecated-declarations"
-#  elif defined(__clang__)
-#    pragma clang diagnostic ignored "-Wdeprecated-declarations"
-#  endif
-	/* Backward compatibility */
-	/* - Deprecated since v0.5.0 */
-	data->l1_assoc     = data->l1_data_assoc;
-	data->l1_cacheline = data->l1_data_cacheline;
-	/* - Deprecated since v0.7.0 */
-	data->family     = data->x86.family;
+int cpuid_serialize_all_raw_data_cb(struct cpu_raw_data_array_t* data, libcpuid_write_fn_t write_fn, void* userdata)
+{
+	struct raw_writer_t w;
+
+	if (write_fn == NULL)
+		return cpuid_set_error(ERR_HANDLE);
+	raw_writer_init(&w, NULL, write_fn, userdata);
+	cpuid_serialize_raw_data_writer(NULL, data, &w);
+	return cpuid_set_error(w.error ? ERR_OPEN : ERR_OK);
+}
+
+int cpuid_deserialize_raw_data_buf(const char* buf, size_t size, struct cpu_raw_data_t* data)
+{
+	raw_data_t_constructor(data);
+	return cpuid_deserialize_raw_data_buf_internal(buf, size, data, NULL);
+}
+
+int cpuid_deserialize_all_raw_data_buf(const char* buf, size_t size, struct cpu_raw_data_array_t* data)
+{
+	return cpuid_deserialize_raw_data_buf_internal(buf, size, NULL, data);
+}
+
+int cpuid_compact_raw_data_array(const struct cpu_raw_data_array_t* raw_array, struct cpu_raw_data_compact_t* compact)
+{
+	uint16_t base;
+	uint32_t word, value;
+	logical_cpu_t logical_cpu;
+	const struct cpu_raw_data_t* raw;
+	struct cpu_raw_data_compact_cpu_t* cpu;
+
+	if ((raw_array == NULL) || (compact == NULL))
+		return cpuid_set_error(ERR_HANDLE);
+	cpu_raw_data_compact_t_constructor(compact);
+	compact->with_affinity = raw_array->with_affinity;
+	if (raw_array->num_raw <= 0)
+		return cpuid_set_error(ERR_OK);
+
+	compact->cpus = malloc(sizeof(struct cpu_raw_data_compact_cpu_t) * raw_array->num_raw);
+	if (compact->cpus == NULL)
+		return cpuid_set_error(ERR_NO_MEM);
+	compact->num_raw = raw_array->num_raw;
+
+	for (logical_cpu = 0; logical_cpu < raw_array->num_raw; logical_cpu++) {
+		raw = &raw_array->raw[logical_cpu];
+		for (base = 0; (base < compact->num_bases) && !cpuid_raw_data_same_core_type(&compact->bases[base], raw); base++);
+		if (base == compact->num_bases) {
+			if (!cpuid_reserve_item((void**) &compact->bases, compact->num_bases, sizeof(struct cpu_raw_data_t)))
+				goto no_mem;
+			debugf(2, "Logical CPU %i is the base record #%u\n", logical_cpu, base);
+			memcpy(&compact->bases[base], raw, sizeof(struct cpu_raw_data_t));
+			compact->num_bases++;
+		}
+
+		cpu              = &compact->cpus[logical_cpu];
+		cpu->base        = base;
+		cpu->num_deltas  = 0;
+		cpu->first_delta = compact->num_deltas;
+		for (word = 0; word < RAW_DATA_WORDS; word++) {
+			value = cpuid_get_raw_data_word(raw, word);
+			if (value == cpuid_get_raw_data_word(&compact->bases[base], word))
+				continue;
+			if (!cpuid_reserve_item((void**) &compact->deltas, compact->num_deltas, sizeof(struct cpu_raw_data_delta_t)))
+				goto no_mem;
+			compact->deltas[compact->num_deltas].word  = word;
+			compact->deltas[compact->num_deltas].value = value;
+			compact->num_deltas++;
+			cpu->num_deltas++;
+		}
+	}
+	debugf(2, "Compacted %i logical CPUs into %u base records and %u deltas\n", compact->num_raw, compact->num_bases, compact->num_deltas);
+
+	return cpuid_set_error(ERR_OK);
+no_mem:
+	cpuid_free_raw_data_compact(compact);
+	return cpuid_set_error(ERR_NO_MEM);
+}
+
+int cpuid_get_compact_raw_data(const struct cpu_raw_data_compact_t* compact, logical_cpu_t logical_cpu, struct cpu_raw_data_t* data)
+{
+	uint32_t i;
+	const struct cpu_raw_data_compact_cpu_t* cpu;
+	const struct cpu_raw_data_delta_t* delta;
+
+	if ((compact == NULL) || (data == NULL))
+		return cpuid_set_error(ERR_HANDLE);
+	if (logical_cpu >= compact->num_raw)
+		return cpuid_set_error(ERR_INVCNB);
+
+	cpu = &compact->cpus[logical_cpu];
+	memcpy(data, &compact->bases[cpu->base], sizeof(struct cpu_raw_data_t));
+	for (i = 0, delta = &compact->deltas[cpu->first_delta]; i < cpu->num_deltas; i++, delta++)
+		cpuid_set_raw_data_word(data, delta->word, delta->value);
+
+	return cpuid_set_error(ERR_OK);
+}
+
+int cpuid_expand_raw_data_compact(const struct cpu_raw_data_compact_t* compact, struct cpu_raw_data_array_t* raw_array)
+{
+	logical_cpu_t logical_cpu;
+
+	if ((compact == NULL) || (raw_array == NULL))
+		return cpuid_set_error(ERR_HANDLE);
+	cpu_raw_data_array_t_constructor(raw_array, compact->with_affinity);
+	cpuid_grow_raw_data_array(raw_array, compact->num_raw);
+	if (raw_array->num_raw != compact->num_raw)
+		return cpuid_set_error(ERR_NO_MEM);
+
+	for (logical_cpu = 0; logical_cpu < compact->num_raw; logical_cpu++)
+		cpuid_get_compact_raw_data(compact, logical_cpu, &raw_array->raw[logical_cpu]);
+
+	return cpuid_set_error(ERR_OK);
+}
+
+int cpuid_serialize_raw_data_compact(const struct cpu_raw_data_compact_t* compact, const char* filename)
+{
+	uint16_t base;
+	logical_cpu_t logical_cpu;
+	cpu_architecture_t architecture;
+	struct cpu_raw_data_t raw;
+	struct raw_writer_t w;
+	FILE *f;
+
+	if ((compact == NULL) || (compact->num_raw <= 0))
+		return cpuid_set_error(ERR_HANDLE);
+	architecture = cpuid_architecture_identify(&compact->bases[0]);
+
+	/* Open file descriptor */
+	f = !strcmp(filename, "") ? stdout : fopen(filename, "wt");
+	if (!f)
+		return cpuid_set_error(ERR_OPEN);
+	debugf(1, "Writing compact raw CPUID dump to '%s'\n", f == stdout ? "stdout" : filename);
+
+	raw_writer_init(&w, f, NULL, NULL);
+
+	/* Write the base records in full, then only the lines which differ for each logical CPU */
+	raw_printf(&w, "version=%s\n", VERSION);
+	for (base = 0; base < compact->num_bases; base++) {
+		raw_printf(&w, "\n_________________ Base #%" PRIu16 " _________________\n", base);
+		cpuid_write_raw_data_lines(&w, &compact->bases[base], NULL, architecture);
+	}
+	for (logical_cpu = 0; logical_cpu < compact->num_raw; logical_cpu++) {
+		base = compact->cpus[logical_cpu].base;
+		cpuid_get_compact_raw_data(compact, logical_cpu, &raw);
+		raw_printf(&w, "\n_________________ Logical CPU #%" PRIi16 " _________________\n", logical_cpu);
+		raw_printf(&w, "base=%" PRIu16 "\n", base);
+		cpuid_write_raw_data_lines(&w, &raw, &compact->bases[base], architecture);
+	}
+
+	/* Close file descriptor */
+	if (strcmp(filename, ""))
+		fclose(f);
+	return cpuid_set_error(ERR_OK);
+}
+
+/* On-disk cache of the identifications, see cpuid_set_identify_cache_file(): a header, then
+ * fixed-size entries with the raw data and its identification, in native byte order.
+ * Entries are only appended, under an exclusive lock of the file, and the file is read under
+ * the same lock. It is never truncated, since other processes may have mapped it: when another
+ * version of the library wrote it, a new file replaces it, so that a new version never returns
+ * the identification of an older one. */
+#define IDENT_FILE_MAGIC     "\177CPUIDIC"
+#define IDENT_FILE_MAGIC_LEN 8
+#define IDENT_FILE_VERSION   1
+
+struct ident_file_header_t {
+	char     magic[IDENT_FILE_MAGIC_LEN];
+	uint32_t byte_order;
+	uint32_t format_version;
+	uint32_t raw_size;
+	uint32_t id_size;
+	uint32_t entry_size;
+	uint32_t reserved;
+	char     lib_version[32];
+};
+
+struct ident_file_entry_t {
+	uint64_t key;                       /* ident_file_key() of raw */
+	struct internal_id_info_t internal; /* matchtable score and cache masks */
+	struct cpu_raw_data_t raw;          /* without the IDs of the logical CPU, see ident_file_strip_raw() */
+	struct cpu_id_t id;
+};
+
+struct ident_file_cache_t {
+	bool enabled;
+	FILE* f;                            /* opened for appending, NULL when the file is read-only */
+	uint8_t* buf;                       /* contents of the file when it was opened */
+	size_t buf_size;
+	bool mapped;
+	struct ident_file_entry_t** added;  /* entries added by this process */
+	uint32_t num_added;
+	const struct ident_file_entry_t** htable;
+	uint32_t capacity;
+	uint32_t num_entries;
+	uint64_t seed;                      /* hash of the library version */
+};
+
+/* Guarded by cpuid_lock() */
+static struct ident_file_cache_t _ident_file_cache;
+
+/* The logical CPUs of the same type only differ by their IDs, which the identification does not use */
+static void ident_file_strip_raw(const struct cpu_raw_data_t* raw, struct cpu_raw_data_t* stripped)
+{
+	int i;
+
+	*stripped = *raw;
+	stripped->basic_cpuid[0x01][EBX] &= 0x00ffffff; /* initial APIC ID */
+	stripped->basic_cpuid[0x0b][EDX] = 0;           /* x2APIC ID */
+	stripped->basic_cpuid[0x1f][EDX] = 0;           /* x2APIC ID */
+	for (i = 0; i < MAX_INTELFN11_LEVEL; i++)
+		stripped->intel_fn11[i][EDX] = 0;           /* x2APIC ID */
+	for (i = 0; i < MAX_INTELFN1FH_LEVEL; i++)
+		stripped->intel_fn1fh[i][EDX] = 0;          /* x2APIC ID */
+	for (i = 0; i < MAX_AMDFN80000026H_LEVEL; i++)
+		stripped->amd_fn80000026h[i][EDX] = 0;      /* x2APIC ID */
+	stripped->ext_cpuid[0x1e][EAX] = 0;             /* extended APIC ID */
+	stripped->ext_cpuid[0x1e][EBX] &= 0xffffff00;   /* compute unit ID, but not ThreadsPerComputeUnit */
+	stripped->ext_cpuid[0x1e][ECX] &= 0xffffff00;   /* node ID, but not NodesPerProcessor */
+	stripped->arm_mpidr = 0;
+}
+
+static uint64_t ident_file_key(const struct cpu_raw_data_t* stripped)
+{
+	uint32_t word;
+	uint64_t hash = _ident_file_cache.seed;
+	for (word = 0; word < RAW_DATA_WORDS; word++)
+		hash = (hash ^ cpuid_get_raw_data_word(stripped, word)) * UINT64_C(1099511628211);
+	return hash;
+}
+
+static void ident_file_header(struct ident_file_header_t* header)
+{
+	memset(header, 0, sizeof(struct ident_file_header_t));
+	memcpy(header->magic, IDENT_FILE_MAGIC, IDENT_FILE_MAGIC_LEN);
+	header->byte_order     = 0x01020304;
+	header->format_version = IDENT_FILE_VERSION;
+	header->raw_size       = sizeof(struct cpu_raw_data_t);
+	header->id_size        = sizeof(struct cpu_id_t);
+	header->entry_size     = sizeof(struct ident_file_entry_t);
+	snprintf(header->lib_version, sizeof(header->lib_version), "%s", VERSION);
+}
+
+static const struct ident_file_entry_t* ident_file_find(uint64_t key, const struct cpu_raw_data_t* stripped)
+{
+	uint32_t i;
+	const struct ident_file_entry_t* entry;
+
+	if (_ident_file_cache.capacity == 0)
+		return NULL;
+	for (i = (uint32_t) key & (_ident_file_cache.capacity - 1); (entry = _ident_file_cache.htable[i]) != NULL; i = (i + 1) & (_ident_file_cache.capacity - 1))
+		if ((entry->key == key) && !memcmp(&entry->raw, stripped, sizeof(struct cpu_raw_data_t)))
+			return entry;
+	return NULL;
+}
+
+/* Adds an entry to the hash table, which is kept at most half full */
+static bool ident_file_index(const struct ident_file_entry_t* entry)
+{
+	uint32_t i, j, capacity;
+	const struct ident_file_entry_t** htable;
+
+	if ((_ident_file_cache.num_entries + 1) * 2 > _ident_file_cache.capacity) {
+		capacity = (_ident_file_cache.capacity == 0) ? 64 : _ident_file_cache.capacity * 2;
+		htable = calloc(capacity, sizeof(const struct ident_file_entry_t*));
+		if (htable == NULL) /* Memory allocation failure */
+			return false;
+		for (i = 0; i < _ident_file_cache.capacity; i++) {
+			if (_ident_file_cache.htable[i] == NULL)
+				continue;
+			for (j = (uint32_t) _ident_file_cache.htable[i]->key & (capacity - 1); htable[j] != NULL; j = (j + 1) & (capacity - 1));
+			htable[j] = _ident_file_cache.htable[i];
+		}
+		free((void*) _ident_file_cache.htable);
+		_ident_file_cache.htable   = htable;
+		_ident_file_cache.capacity = capacity;
+	}
+	for (i = (uint32_t) entry->key & (_ident_file_cache.capacity - 1); _ident_file_cache.htable[i] != NULL; i = (i + 1) & (_ident_file_cache.capacity - 1));
+	_ident_file_cache.htable[i] = entry;
+	_ident_file_cache.num_entries++;
+	return true;
+}
+
+/* Locks the whole file against the other processes: shared to read it, exclusive to write it */
+static bool ident_file_lock(FILE* f, bool exclusive)
+{
+#ifdef _WIN32
+	OVERLAPPED overlapped;
+	memset(&overlapped, 0, sizeof(overlapped));
+	return LockFileEx((HANDLE) _get_osfhandle(_fileno(f)), exclusive ? LOCKFILE_EXCLUSIVE_LOCK : 0, 0, MAXDWORD, MAXDWORD, &overlapped) != 0;
+#else
+	struct flock lock;
+	memset(&lock, 0, sizeof(lock));
+	lock.l_type   = exclusive ? F_WRLCK : F_RDLCK;
+	lock.l_whence = SEEK_SET;
+	return fcntl(fileno(f), F_SETLKW, &lock) == 0;
+#endif /* _WIN32 */
+}
+
+static void ident_file_unlock(FILE* f)
+{
+#ifdef _WIN32
+	OVERLAPPED overlapped;
+	memset(&overlapped, 0, sizeof(overlapped));
+	UnlockFileEx((HANDLE) _get_osfhandle(_fileno(f)), 0, MAXDWORD, MAXDWORD, &overlapped);
+#else
+	struct flock lock;
+	memset(&lock, 0, sizeof(lock));
+	lock.l_type   = F_UNLCK;
+	lock.l_whence = SEEK_SET;
+	fcntl(fileno(f), F_SETLK, &lock);
+#endif /* _WIN32 */
+}
+
+/* Must be called with cpuid_lock() held */
+static void ident_file_close(void)
+{
+	uint32_t i;
+
+	if (_ident_file_cache.f != NULL)
+		fclose(_ident_file_cache.f);
+#ifdef MMAP_RAW_DATA
+	if (_ident_file_cache.mapped)
+		munmap(_ident_file_cache.buf, _ident_file_cache.buf_size);
+	else
+#endif /* MMAP_RAW_DATA */
+	free(_ident_file_cache.buf);
+	for (i = 0; i < _ident_file_cache.num_added; i++)
+		free(_ident_file_cache.added[i]);
+	free(_ident_file_cache.added);
+	free((void*) _ident_file_cache.htable);
+	memset(&_ident_file_cache, 0, sizeof(_ident_file_cache));
+}
+
+/* Maps the file in memory when possible, otherwise reads it */
+static void ident_file_load(FILE* f)
+{
+	size_t n, capacity = 0;
+	uint8_t* tmp;
+
+#ifdef MMAP_RAW_DATA
+	struct stat st;
+	if ((fstat(fileno(f), &st) == 0) && S_ISREG(st.st_mode) && (st.st_size > 0)) {
+		_ident_file_cache.buf = mmap(NULL, (size_t) st.st_size, PROT_READ, MAP_PRIVATE, fileno(f), 0);
+		if (_ident_file_cache.buf != MAP_FAILED) {
+			_ident_file_cache.buf_size = (size_t) st.st_size;
+			_ident_file_cache.mapped   = true;
+			return;
+		}
+		_ident_file_cache.buf = NULL;
+	}
+#endif /* MMAP_RAW_DATA */
+	do {
+		if (_ident_file_cache.buf_size == capacity) {
+			capacity = (capacity == 0) ? 65536 : capacity * 2;
+			if ((tmp = realloc(_ident_file_cache.buf, capacity)) == NULL)
+				return;
+			_ident_file_cache.buf = tmp;
+		}
+		n = fread(_ident_file_cache.buf + _ident_file_cache.buf_size, 1, capacity - _ident_file_cache.buf_size, f);
+		_ident_file_cache.buf_size += n;
+	} while (n > 0);
+}
+
+/* Replaces a file written by another version of the library by a new one, which only has a header */
+static bool ident_file_restart(const char* filename, const struct ident_file_header_t* header)
+{
+#ifdef MMAP_RAW_DATA
+	int fd;
+	FILE* f;
+	bool ok;
+	char* tmpname;
+
+	if ((tmpname = malloc(strlen(filename) + 8)) == NULL)
+		return false;
+	sprintf(tmpname, "%s.XXXXXX", filename);
+	if ((fd = mkstemp(tmpname)) < 0) {
+		free(tmpname);
+		return false;
+	}
+	if ((fchmod(fd, 0644) != 0) || ((f = fdopen(fd, "wb")) == NULL)) {
+		close(fd);
+		ok = false;
+	}
+	else {
+		ok = (fwrite(header, sizeof(struct ident_file_header_t), 1, f) == 1);
+		ok = (fclose(f) == 0) && ok;
+	}
+	ok = ok && (rename(tmpname, filename) == 0);
+	if (!ok)
+		remove(tmpname);
+	free(tmpname);
+	return ok;
+#else
+	/* The file cannot be replaced atomically */
+	UNUSED(filename);
+	UNUSED(header);
+	return false;
+#endif /* MMAP_RAW_DATA */
+}
+
+/* Loads the file, under a lock, and checks its header. Returns false if another version of the library wrote it */
+static bool ident_file_read(FILE* f, bool writable, const struct ident_file_header_t* header)
+{
+	bool ok = true;
+
+	if (!ident_file_lock(f, writable))
+		debugf(1, "Cannot lock the identification cache\n");
+	rewind(f);
+	ident_file_load(f);
+	if (writable && (_ident_file_cache.buf_size == 0)) {
+		/* New file */
+		ok = (fseek(f, 0, SEEK_END) == 0) && (fwrite(header, sizeof(struct ident_file_header_t), 1, f) == 1) && (fflush(f) == 0);
+	}
+	else if ((_ident_file_cache.buf_size < sizeof(struct ident_file_header_t)) || memcmp(_ident_file_cache.buf, header, sizeof(struct ident_file_header_t)))
+		ok = false;
+	ident_file_unlock(f);
+	return ok;
+}
+
+/* Must be called with cpuid_lock() held */
+static int ident_file_open(const char* filename)
+{
+	FILE* f;
+	int attempt;
+	bool writable;
+	size_t offset;
+	const char* version = VERSION;
+	const struct ident_file_entry_t* entry;
+	struct ident_file_header_t header;
+
+	ident_file_header(&header);
+	for (attempt = 0; ; attempt++) {
+		/* The file is used read-only when it cannot be written */
+		writable = ((f = fopen(filename, "a+b")) != NULL);
+		if (!writable && ((f = fopen(filename, "rb")) == NULL))
+			return ERR_OPEN;
+		if (ident_file_read(f, writable, &header))
+			break;
+		fclose(f);
+		ident_file_close();
+		/* Written by another version of the library */
+		if ((attempt > 0) || !ident_file_restart(filename, &header))
+			return ERR_OPEN;
+		debugf(2, "Starting the identification cache '%s' again\n", filename);
+	}
+
+	_ident_file_cache.enabled = true;
+	_ident_file_cache.seed    = UINT64_C(14695981039346656037);
+	for (; *version; version++)
+		_ident_file_cache.seed = (_ident_file_cache.seed ^ (uint8_t) *version) * UINT64_C(1099511628211);
+	for (offset = sizeof(header); offset + sizeof(struct ident_file_entry_t) <= _ident_file_cache.buf_size; offset += sizeof(struct ident_file_entry_t)) {
+		entry = (const struct ident_file_entry_t*) (_ident_file_cache.buf + offset);
+		if ((entry->key == ident_file_key(&entry->raw)) && !ident_file_find(entry->key, &entry->raw) && !ident_file_index(entry)) {
+			fclose(f);
+			return ERR_NO_MEM;
+		}
+	}
+	debugf(2, "Loaded %u identifications from '%s'%s\n", _ident_file_cache.num_entries, filename, writable ? "" : " (read-only)");
+	if (writable)
+		_ident_file_cache.f = f;
+	else
+		fclose(f);
+	return ERR_OK;
+}
+
+int cpuid_set_identify_cache_file(const char* filename)
+{
+	int r = ERR_OK;
+
+	cpuid_lock();
+	ident_file_close();
+	if ((filename != NULL) && ((r = ident_file_open(filename)) != ERR_OK))
+		ident_file_close();
+	cpuid_unlock();
+	return cpuid_set_error(r);
+}
+
+static bool ident_file_get(const struct cpu_raw_data_t* stripped, uint64_t key, struct cpu_id_t* data, struct internal_id_info_t* internal)
+{
+	const struct ident_file_entry_t* entry;
+
+	cpuid_lock();
+	if ((entry = ident_file_find(key, stripped)) != NULL) {
+		*data     = entry->id;
+		affinity_set_t_constructor(&data->affinity); /* the entries are identified with cpu_identify() */
+		*internal = entry->internal;
+	}
+	cpuid_unlock();
+	return entry != NULL;
+}
+
+static void ident_file_put(const struct cpu_raw_data_t* stripped, uint64_t key, const struct cpu_id_t* data, const struct internal_id_info_t* internal)
+{
+	struct ident_file_entry_t* entry;
+
+	cpuid_lock();
+	if ((_ident_file_cache.f != NULL) && !ident_file_find(key, stripped) &&
+	    ((entry = calloc(1, sizeof(struct ident_file_entry_t))) != NULL)) {
+		entry->key      = key;
+		entry->internal = *internal;
+		entry->raw      = *stripped;
+		entry->id       = *data;
+		if (cpuid_reserve_item((void**) &_ident_file_cache.added, _ident_file_cache.num_added, sizeof(struct ident_file_entry_t*)) &&
+		    ident_file_index(entry)) {
+			_ident_file_cache.added[_ident_file_cache.num_added++] = entry;
+			/* Whole entries only, even if other processes append to the file too */
+			if (!ident_file_lock(_ident_file_cache.f, true) || (fseek(_ident_file_cache.f, 0, SEEK_END) != 0) ||
+			    (fwrite(entry, sizeof(struct ident_file_entry_t), 1, _ident_file_cache.f) != 1) || (fflush(_ident_file_cache.f) != 0))
+				debugf(1, "Cannot write to the identification cache\n");
+			ident_file_unlock(_ident_file_cache.f);
+		}
+		else
+			free(entry);
+	}
+	cpuid_unlock();
+}
+
+static bool ident_file_enabled(void)
+{
+	bool enabled;
+
+	cpuid_lock();
+	enabled = _ident_file_cache.enabled;
+	cpuid_unlock();
+	return enabled;
+}
+
+int cpu_ident_internal(struct cpu_raw_data_t* raw, struct cpu_id_t* data, struct internal_id_info_t* internal)
+{
+	int r;
+	uint64_t key = 0;
+	bool use_file_cache;
+	struct cpu_raw_data_t myraw, stripped;
+	if (!raw) {
+		if ((r = cpuid_get_raw_data(&myraw)) < 0)
+			return cpuid_set_error(r);
+		raw = &myraw;
+	}
+	if ((use_file_cache = ident_file_enabled())) {
+		ident_file_strip_raw(raw, &stripped);
+		key = ident_file_key(&stripped);
+		if (ident_file_get(&stripped, key, data, internal))
+			return cpuid_set_error(ERR_OK);
+	}
+	cpu_id_t_constructor(data);
+	memset(internal->cache_mask, 0, sizeof(internal->cache_mask));
+	data->architecture = cpuid_architecture_identify(raw);
+
+	switch (data->architecture) {
+		case ARCHITECTURE_X86:
+			if ((r = cpuid_basic_identify(raw, data)) < 0)
+				return cpuid_set_error(r);
+			switch (data->vendor) {
+				case VENDOR_INTEL:
+					r = cpuid_identify_intel(raw, data, internal);
+					break;
+				case VENDOR_AMD:
+				case VENDOR_HYGON:
+					r = cpuid_identify_amd(raw, data, internal);
+					break;
+				case VENDOR_CENTAUR:
+					r = cpuid_identify_centaur(raw, data, internal);
+					break;
+				default:
+					break;
+			}
+			break;
+		case ARCHITECTURE_ARM:
+			r = cpuid_identify_arm(raw, data);
+			break;
+		default:
+			r = ERR_CPU_UNKN;
+			break;
+	}
+
+#ifndef LIBCPUID_DISABLE_DEPRECATED
+#  if defined(__GNUC__) || defined(GNUC)
+#    pragma GCC diagnostic ignored "-Wdeprecated-declarations"
+#  elif defined(__clang__)
+#    pragma clang diagnostic ignored "-Wdeprecated-declarations"
+#  endif
+	/* Backward compatibility */
+	/* - Deprecated since v0.5.0 */
+	data->l1_assoc     = data->l1_data_assoc;
+	data->l1_cacheline = data->l1_data_cacheline;
+	/* - Deprecated since v0.7.0 */
+	data->family     = data->x86.family;
 	data->model      = data->x86.model;
 	data->stepping   = data->x86.stepping;
 	data->ext_family = data->x86.ext_family;
@@ -1601,74 +3323,890 @@ int cpu_ident_internal(struct cpu_raw_data_t* raw, struct cpu_id_t* data, struct
 	data->sgx        = data->x86.sgx;
 #endif /* LIBCPUID_DISABLE_DEPRECATED */
 
-	return cpuid_set_error(r);
+	if (use_file_cache && (r == ERR_OK))
+		ident_file_put(&stripped, key, data, internal);
+	return cpuid_set_error(r);
+}
+
+static cpu_purpose_t cpu_ident_purpose(struct cpu_raw_data_t* raw)
+{
+	cpu_vendor_t vendor = VENDOR_UNKNOWN;
+	cpu_purpose_t purpose = PURPOSE_GENERAL;
+	char vendor_str[VENDOR_STR_MAX];
+
+	const cpu_architecture_t architecture = cpuid_architecture_identify(raw);
+	switch (architecture) {
+		case ARCHITECTURE_X86:
+			vendor = cpuid_vendor_identify(raw->basic_cpuid[0], vendor_str);
+			switch (vendor) {
+				case VENDOR_AMD:
+					purpose = cpuid_identify_purpose_amd(raw);
+					break;
+				case VENDOR_INTEL:
+					purpose = cpuid_identify_purpose_intel(raw);
+					break;
+				default:
+					break;
+			}
+			break;
+		case ARCHITECTURE_ARM:
+			purpose = cpuid_identify_purpose_arm(raw);
+			break;
+		default:
+			break;
+	}
+
+	debugf(3, "Identified a '%s' CPU core type\n", cpu_purpose_str(purpose));
+
+	return purpose;
+}
+
+/* Results of cpu_identify(NULL, ...) and cpu_identify_all(NULL, ...), see cpuid_set_identify_cache() */
+#define IDENTIFY_CACHE_CHECK_US 100000 /* how often the online CPUs and NUMA nodes are checked */
+#define ONLINE_CPUS_STR_MAX     4096
+#define SYSFS_PATH_MAX          256
+#define NUMA_NODES_PATH         "/sys/devices/system/node"
+
+struct identify_cache_t {
+	bool enabled;
+	bool has_id;
+	bool has_system;
+	struct cpu_id_t id;
+	struct system_id_t system; /* with its topology tree, if any */
+	uint32_t generation;       /* incremented when the results are dropped */
+	uint64_t checked_at;
+	char online_cpus[ONLINE_CPUS_STR_MAX];
+	char online_nodes[ONLINE_CPUS_STR_MAX];
+};
+
+/* Guarded by cpuid_lock() */
+static struct identify_cache_t _identify_cache;
+
+/* Reads a small sysfs file, the buffer is empty if it cannot be read.
+ * The LIBCPUID_SYSFS_ROOT environment variable is prepended to the path, so that the tests can use a fake tree.
+ * It is ignored in setuid and setgid programs, where the environment cannot be trusted */
+static void read_sysfs_file(const char* path, char* buffer, size_t size)
+{
+	size_t len = 0;
+#if defined linux || defined __linux__
+	FILE* f;
+	char full_path[SYSFS_PATH_MAX];
+# ifdef HAVE_SECURE_GETENV
+	const char* root = secure_getenv("LIBCPUID_SYSFS_ROOT");
+# else
+	const char* root = ((getuid() == geteuid()) && (getgid() == getegid())) ? getenv("LIBCPUID_SYSFS_ROOT") : NULL;
+# endif /* HAVE_SECURE_GETENV */
+
+	snprintf(full_path, sizeof(full_path), "%s%s", (root != NULL) ? root : "", path);
+	if ((f = fopen(full_path, "r")) != NULL) {
+		len = fread(buffer, 1, size - 1, f);
+		fclose(f);
+	}
+#else
+	UNUSED(path);
+#endif /* linux */
+	buffer[len] = '\0';
+}
+
+static void read_online_cpus(char* buffer, size_t size)
+{
+	read_sysfs_file("/sys/devices/system/cpu/online", buffer, size);
+}
+
+/* Must be called with cpuid_lock() held */
+static void identify_cache_drop(void)
+{
+	if (_identify_cache.has_system)
+		cpuid_free_system_id(&_identify_cache.system);
+	_identify_cache.has_id     = false;
+	_identify_cache.has_system = false;
+	_identify_cache.generation++;
+}
+
+/* Drops the cached results when the set of online CPUs or NUMA nodes changed (the topology has the NUMA nodes).
+ * Must be called with cpuid_lock() held */
+static void identify_cache_check(void)
+{
+	uint64_t now;
+	char online_cpus[ONLINE_CPUS_STR_MAX], online_nodes[ONLINE_CPUS_STR_MAX];
+
+	sys_precise_clock(&now);
+	if ((now >= _identify_cache.checked_at) && (now - _identify_cache.checked_at < IDENTIFY_CACHE_CHECK_US))
+		return;
+	_identify_cache.checked_at = now;
+	read_online_cpus(online_cpus, sizeof(online_cpus));
+	read_sysfs_file(NUMA_NODES_PATH "/online", online_nodes, sizeof(online_nodes));
+	if (strcmp(online_cpus, _identify_cache.online_cpus) || strcmp(online_nodes, _identify_cache.online_nodes)) {
+		debugf(2, "Online CPUs changed to %s and NUMA nodes to %s, dropping the identification cache\n", online_cpus, online_nodes);
+		identify_cache_drop();
+		strcpy(_identify_cache.online_cpus, online_cpus);
+		strcpy(_identify_cache.online_nodes, online_nodes);
+	}
+}
+
+/* The get functions return the generation of the cache after checking the online CPUs and NUMA nodes,
+ * the results identified after a miss are only put if it did not change meanwhile (e.g. the online CPUs
+ * changed during the identification) */
+static bool identify_cache_get_id(struct cpu_id_t* data, uint32_t* generation)
+{
+	bool found = false;
+
+	cpuid_lock();
+	if (_identify_cache.enabled) {
+		identify_cache_check();
+		if ((found = _identify_cache.has_id))
+			*data = _identify_cache.id;
+	}
+	*generation = _identify_cache.generation;
+	cpuid_unlock();
+	return found;
+}
+
+/* Must be called with cpuid_lock() held */
+static bool identify_cache_can_put(uint32_t generation)
+{
+	if (!_identify_cache.enabled)
+		return false;
+	identify_cache_check();
+	return _identify_cache.generation == generation;
+}
+
+/* On hybrid CPUs, the result of cpu_identify(NULL, ...) depends on the core type of the
+ * logical CPU which runs the thread, so it is not cached */
+static void identify_cache_put_id(const struct cpu_id_t* data, uint32_t generation)
+{
+	if (data->purpose != PURPOSE_GENERAL)
+		return;
+	cpuid_lock();
+	if (identify_cache_can_put(generation) && !_identify_cache.has_id) {
+		_identify_cache.id     = *data;
+		_identify_cache.has_id = true;
+	}
+	cpuid_unlock();
+}
+
+static void* copy_array(const void* src, size_t size)
+{
+	void* dest;
+
+	if ((src == NULL) || ((dest = malloc(size > 0 ? size : 1)) == NULL))
+		return NULL;
+	memcpy(dest, src, size);
+	return dest;
+}
+
+static bool copy_affinity_set(struct cpu_affinity_set_t* dest, const struct cpu_affinity_set_t* src)
+{
+	affinity_set_t_constructor(dest);
+	if (src->num_cpus == 0)
+		return true;
+	if (cpuid_affinity_set_init(dest, src->num_cpus) != ERR_OK)
+		return false;
+	memcpy(dest->words, src->words, sizeof(uint64_t) * AFFINITY_SET_WORDS(src->num_cpus));
+	return true;
+}
+
+static struct cpu_cache_map_t* copy_cache_map(const struct cpu_cache_map_t* src)
+{
+	int32_t i;
+	struct cpu_cache_map_t* dest;
+
+	if ((dest = malloc(sizeof(struct cpu_cache_map_t))) == NULL)
+		return NULL;
+	*dest = *src;
+	dest->caches     = copy_array(src->caches,     sizeof(struct cpu_cache_instance_t) * src->num_caches);
+	dest->cpu_caches = copy_array(src->cpu_caches, sizeof(int32_t) * src->num_cpus * NUM_CACHE_LEVELS);
+	if ((dest->caches == NULL) || (dest->cpu_caches == NULL)) { /* Memory allocation failure */
+		dest->num_caches = 0;
+		cpuid_free_cache_map(dest);
+		free(dest);
+		return NULL;
+	}
+	for (i = 0; i < src->num_caches; i++)
+		if (!copy_affinity_set(&dest->caches[i].affinity, &src->caches[i].affinity)) {
+			/* The caches after i still point to the sets of src */
+			dest->num_caches = i + 1;
+			cpuid_free_cache_map(dest);
+			free(dest);
+			return NULL;
+		}
+	return dest;
+}
+
+static bool copy_topology(struct cpu_topology_t* dest, const struct cpu_topology_t* src)
+{
+	*dest = *src;
+	dest->nodes          = copy_array(src->nodes,          sizeof(struct cpu_topology_node_t) * src->num_nodes);
+	dest->logical_cpus   = copy_array(src->logical_cpus,   sizeof(logical_cpu_t) * src->num_cpus);
+	dest->cpu_node       = copy_array(src->cpu_node,       sizeof(int32_t) * src->num_cpus);
+	dest->caches         = copy_array(src->caches,         sizeof(struct cpu_topology_cache_t) * src->num_caches);
+	dest->cpu_numa_node  = copy_array(src->cpu_numa_node,  sizeof(int32_t) * src->num_cpus);
+	dest->numa_node_ids  = copy_array(src->numa_node_ids,  sizeof(int32_t) * src->num_numa_nodes);
+	dest->numa_distances = copy_array(src->numa_distances, sizeof(int32_t) * src->num_numa_nodes * src->num_numa_nodes);
+	if (((src->nodes          != NULL) && (dest->nodes          == NULL)) ||
+	    ((src->logical_cpus   != NULL) && (dest->logical_cpus   == NULL)) ||
+	    ((src->cpu_node       != NULL) && (dest->cpu_node       == NULL)) ||
+	    ((src->caches         != NULL) && (dest->caches         == NULL)) ||
+	    ((src->cpu_numa_node  != NULL) && (dest->cpu_numa_node  == NULL)) ||
+	    ((src->numa_node_ids  != NULL) && (dest->numa_node_ids  == NULL)) ||
+	    ((src->numa_distances != NULL) && (dest->numa_distances == NULL))) { /* Memory allocation failure */
+		cpuid_free_topology(dest);
+		return false;
+	}
+	return true;
+}
+
+/* Deep copy, dest is freed with cpuid_free_system_id() */
+static bool copy_system_id(struct system_id_t* dest, const struct system_id_t* src)
+{
+	uint8_t i;
+
+	*dest = *src;
+	dest->cpu_types = NULL;
+	dest->cache_map = NULL;
+	dest->topology  = NULL;
+	if (src->num_cpu_types > 0) {
+		dest->cpu_types = malloc(sizeof(struct cpu_id_t) * src->num_cpu_types);
+		if (dest->cpu_types == NULL) { /* Memory allocation failure */
+			dest->num_cpu_types = 0;
+			return false;
+		}
+		memcpy(dest->cpu_types, src->cpu_types, sizeof(struct cpu_id_t) * src->num_cpu_types);
+		for (i = 0; i < src->num_cpu_types; i++)
+			if (!copy_affinity_set(&dest->cpu_types[i].affinity, &src->cpu_types[i].affinity)) {
+				/* The types after i still point to the sets of src */
+				dest->num_cpu_types = i + 1;
+				cpuid_free_system_id(dest);
+				return false;
+			}
+	}
+	if ((src->cache_map != NULL) && ((dest->cache_map = copy_cache_map(src->cache_map)) == NULL)) {
+		cpuid_free_system_id(dest);
+		return false;
+	}
+	if (src->topology != NULL) {
+		if ((dest->topology = malloc(sizeof(struct cpu_topology_t))) == NULL) {
+			cpuid_free_system_id(dest);
+			return false;
+		}
+		if (!copy_topology(dest->topology, src->topology)) {
+			free(dest->topology);
+			dest->topology = NULL;
+			cpuid_free_system_id(dest);
+			return false;
+		}
+	}
+	return true;
+}
+
+static bool identify_cache_get_system(struct system_id_t* system, uint32_t* generation)
+{
+	bool found = false;
+
+	cpuid_lock();
+	if (_identify_cache.enabled) {
+		identify_cache_check();
+		found = _identify_cache.has_system && copy_system_id(system, &_identify_cache.system);
+	}
+	*generation = _identify_cache.generation;
+	cpuid_unlock();
+	return found;
+}
+
+static void identify_cache_put_system(const struct system_id_t* system, uint32_t generation)
+{
+	cpuid_lock();
+	if (identify_cache_can_put(generation) && !_identify_cache.has_system)
+		_identify_cache.has_system = copy_system_id(&_identify_cache.system, system);
+	cpuid_unlock();
+}
+
+/* The topology is copied from the kept system, so that they come from the same identification */
+static bool identify_cache_get_topology(struct system_id_t* system, struct cpu_topology_t* topology, uint32_t* generation)
+{
+	bool found = false;
+
+	cpuid_lock();
+	if (_identify_cache.enabled) {
+		identify_cache_check();
+		if (_identify_cache.has_system && (_identify_cache.system.topology != NULL) && copy_topology(topology, _identify_cache.system.topology)) {
+			if (!(found = copy_system_id(system, &_identify_cache.system)))
+				cpuid_free_topology(topology);
+		}
+	}
+	*generation = _identify_cache.generation;
+	cpuid_unlock();
+	return found;
+}
+
+int cpuid_set_identify_cache(int enabled)
+{
+	int prev;
+
+	cpuid_lock();
+	prev = _identify_cache.enabled;
+	_identify_cache.enabled = (enabled != 0);
+	if (!_identify_cache.enabled)
+		identify_cache_drop();
+	cpuid_unlock();
+	return prev;
+}
+
+void cpuid_refresh_identify_cache(void)
+{
+	cpuid_lock();
+	identify_cache_drop();
+	cpuid_unlock();
+}
+
+/* Identification published in shared memory by cpuid_publish_system_id(): a header with a
+ * sequence counter, then a payload with a checksum. The publisher makes the sequence odd while
+ * it writes the payload (seqlock), so the readers retry when the sequence is odd or changed
+ * during their copy. The payload is valid for the same boot, online CPUs and library only. */
+#define SHARED_SYSTEM_ID_MAGIC   0x44495043 /* "CPID" */
+#define SHARED_SYSTEM_ID_VERSION 3
+#define SHARED_SYSTEM_ID_NAME_MAX 64
+#define SHARED_SYSTEM_ID_RETRIES 100
+#define BOOT_ID_STR_MAX          40
+
+struct shared_system_id_header_t {
+	uint32_t magic;
+	uint32_t format_version;
+	volatile uint32_t sequence;
+	uint32_t payload_size;
+	uint64_t checksum;       /* FNV-1a of the payload */
+};
+
+struct shared_system_id_payload_t {
+	char     lib_version[32];
+	char     boot_id[BOOT_ID_STR_MAX];
+	char     online_cpus[ONLINE_CPUS_STR_MAX];
+	uint32_t cpu_id_size;    /* sizeof(struct cpu_id_t) */
+	uint32_t system_id_size; /* sizeof(struct system_id_t) */
+	uint32_t has_id;         /* all logical CPUs have the same type: id is the result of cpu_identify(NULL, ...) */
+	uint32_t has_cache_map;  /* system.cache_map was not NULL */
+	uint32_t has_topology;   /* system.topology was not NULL */
+	struct cpu_id_t id;
+	struct system_id_t system; /* followed by the arrays it points to, see shared_system_id_pack() */
+};
+
+/* Name given to cpuid_use_published_system_id(), guarded by cpuid_lock() */
+static char _published_system_id_name[SHARED_SYSTEM_ID_NAME_MAX] = "";
+
+#ifdef SHARED_SYSTEM_ID
+static bool shared_system_id_path(const char* name, char* path, size_t size)
+{
+	if ((name == NULL) || (name[0] == '\0') || strchr(name, '/') || (strlen(name) >= SHARED_SYSTEM_ID_NAME_MAX))
+		return false;
+	snprintf(path, size, "/dev/shm/%s", name);
+	return true;
+}
+
+static void read_boot_id(char* buffer, size_t size)
+{
+	size_t len = 0;
+	FILE* f = fopen("/proc/sys/kernel/random/boot_id", "r");
+	if (f) {
+		len = fread(buffer, 1, size - 1, f);
+		fclose(f);
+	}
+	buffer[len] = '\0';
+}
+
+/* FNV-1a over 64-bit words, then over the remaining bytes */
+static uint64_t shared_system_id_checksum(const uint8_t* buf, size_t size)
+{
+	size_t i;
+	uint64_t word, hash = UINT64_C(14695981039346656037);
+	for (i = 0; i + sizeof(word) <= size; i += sizeof(word)) {
+		memcpy(&word, buf + i, sizeof(word));
+		hash = (hash ^ word) * UINT64_C(1099511628211);
+	}
+	for (; i < size; i++)
+		hash = (hash ^ buf[i]) * UINT64_C(1099511628211);
+	return hash;
+}
+
+static void shared_system_id_stamp(struct shared_system_id_payload_t* payload)
+{
+	snprintf(payload->lib_version, sizeof(payload->lib_version), "%s", VERSION);
+	read_boot_id(payload->boot_id, sizeof(payload->boot_id));
+	read_online_cpus(payload->online_cpus, sizeof(payload->online_cpus));
+	payload->cpu_id_size    = sizeof(struct cpu_id_t);
+	payload->system_id_size = sizeof(struct system_id_t);
+}
+
+/* Cursor over the arrays which follow the payload, each one aligned on 8 bytes.
+ * When packing, buf is NULL during the first pass, which only measures the size */
+struct shared_cursor_t {
+	uint8_t* buf;
+	size_t pos;
+	size_t size;
+};
+
+/* Appends count items, and returns the copy (NULL during the first pass) */
+static void* shared_put(struct shared_cursor_t* cursor, const void* src, size_t count, size_t item_size)
+{
+	void* dest = (cursor->buf != NULL) ? cursor->buf + cursor->pos : NULL;
+
+	if ((dest != NULL) && (count > 0))
+		memcpy(dest, src, count * item_size);
+	cursor->pos += (count * item_size + 7) & ~(size_t) 7;
+	return dest;
+}
+
+/* Returns the next count items, or NULL if they do not fit in the payload */
+static void* shared_get(struct shared_cursor_t* cursor, int64_t count, size_t item_size)
+{
+	void* src = cursor->buf + cursor->pos;
+	const size_t left = cursor->size - cursor->pos;
+
+	if ((count < 0) || ((uint64_t) count > left / item_size) || (((size_t) count * item_size + 7) & ~(size_t) 7) > left)
+		return NULL;
+	cursor->pos += ((size_t) count * item_size + 7) & ~(size_t) 7;
+	return src;
+}
+
+static void shared_put_set(struct shared_cursor_t* cursor, struct cpu_affinity_set_t* copy, const struct cpu_affinity_set_t* set)
+{
+	shared_put(cursor, set->words, AFFINITY_SET_WORDS(set->num_cpus), sizeof(uint64_t));
+	if (copy != NULL)
+		copy->words = NULL;
+}
+
+static bool shared_get_set(struct shared_cursor_t* cursor, struct cpu_affinity_set_t* set)
+{
+	if ((set->version != CPU_AFFINITY_SET_VERSION) || (set->num_cpus > (1UL << (sizeof(logical_cpu_t) * 8))))
+		return false;
+	set->words = NULL;
+	return (set->num_cpus == 0) || ((set->words = shared_get(cursor, AFFINITY_SET_WORDS(set->num_cpus), sizeof(uint64_t))) != NULL);
+}
+
+/* Appends the arrays of system after the payload. The pointers of the copies are cleared, the readers set them again */
+static void shared_system_id_pack(struct shared_cursor_t* cursor, struct shared_system_id_payload_t* payload, const struct system_id_t* system)
+{
+	int32_t i;
+	struct cpu_id_t* types;
+	struct cpu_cache_map_t* map;
+	struct cpu_cache_instance_t* caches;
+	struct cpu_topology_t* topology;
+	const struct cpu_topology_t* tree = system->topology;
+
+	if (payload != NULL) {
+		payload->system           = *system;
+		payload->system.cpu_types = NULL;
+		payload->system.cache_map = NULL;
+		payload->system.topology  = NULL;
+		payload->has_cache_map    = (system->cache_map != NULL);
+		payload->has_topology     = (tree != NULL);
+	}
+	types = shared_put(cursor, system->cpu_types, system->num_cpu_types, sizeof(struct cpu_id_t));
+	for (i = 0; i < system->num_cpu_types; i++)
+		shared_put_set(cursor, types ? &types[i].affinity : NULL, &system->cpu_types[i].affinity);
+	if (system->cache_map != NULL) {
+		map    = shared_put(cursor, system->cache_map, 1, sizeof(struct cpu_cache_map_t));
+		caches = shared_put(cursor, system->cache_map->caches, system->cache_map->num_caches, sizeof(struct cpu_cache_instance_t));
+		shared_put(cursor, system->cache_map->cpu_caches, (size_t) system->cache_map->num_cpus * NUM_CACHE_LEVELS, sizeof(int32_t));
+		for (i = 0; i < system->cache_map->num_caches; i++)
+			shared_put_set(cursor, caches ? &caches[i].affinity : NULL, &system->cache_map->caches[i].affinity);
+		if (map != NULL) {
+			map->caches     = NULL;
+			map->cpu_caches = NULL;
+		}
+	}
+	if (tree != NULL) {
+		topology = shared_put(cursor, tree, 1, sizeof(struct cpu_topology_t));
+		shared_put(cursor, tree->nodes,          tree->num_nodes, sizeof(struct cpu_topology_node_t));
+		shared_put(cursor, tree->logical_cpus,   tree->num_cpus, sizeof(logical_cpu_t));
+		shared_put(cursor, tree->cpu_node,       tree->num_cpus, sizeof(int32_t));
+		shared_put(cursor, tree->caches,         tree->num_caches, sizeof(struct cpu_topology_cache_t));
+		shared_put(cursor, tree->cpu_numa_node,  tree->num_cpus, sizeof(int32_t));
+		shared_put(cursor, tree->numa_node_ids,  tree->num_numa_nodes, sizeof(int32_t));
+		shared_put(cursor, tree->numa_distances, (size_t) tree->num_numa_nodes * tree->num_numa_nodes, sizeof(int32_t));
+		if (topology != NULL) {
+			topology->nodes          = NULL;
+			topology->logical_cpus   = NULL;
+			topology->cpu_node       = NULL;
+			topology->caches         = NULL;
+			topology->cpu_numa_node  = NULL;
+			topology->numa_node_ids  = NULL;
+			topology->numa_distances = NULL;
+		}
+	}
+}
+
+/* Points the system of the payload to the arrays which follow it, they must fill exactly the rest of it */
+static bool shared_system_id_attach(struct shared_system_id_payload_t* p, size_t payload_size)
+{
+	int32_t i;
+	struct cpu_cache_map_t* map = NULL;
+	struct cpu_topology_t* tree = NULL;
+	struct shared_cursor_t cursor = { (uint8_t*) p, sizeof(struct shared_system_id_payload_t), payload_size };
+
+	if ((p->system.cpu_types = shared_get(&cursor, p->system.num_cpu_types, sizeof(struct cpu_id_t))) == NULL)
+		return false;
+	for (i = 0; i < p->system.num_cpu_types; i++)
+		if (!shared_get_set(&cursor, &p->system.cpu_types[i].affinity))
+			return false;
+	p->system.cache_map = NULL;
+	if (p->has_cache_map) {
+		if (((map = shared_get(&cursor, 1, sizeof(struct cpu_cache_map_t))) == NULL) ||
+		    ((map->caches = shared_get(&cursor, map->num_caches, sizeof(struct cpu_cache_instance_t))) == NULL) ||
+		    ((map->cpu_caches = shared_get(&cursor, (int64_t) map->num_cpus * NUM_CACHE_LEVELS, sizeof(int32_t))) == NULL))
+			return false;
+		for (i = 0; i < map->num_caches; i++)
+			if (!shared_get_set(&cursor, &map->caches[i].affinity))
+				return false;
+		p->system.cache_map = map;
+	}
+	p->system.topology = NULL;
+	if (p->has_topology) {
+		if (((tree = shared_get(&cursor, 1, sizeof(struct cpu_topology_t))) == NULL) ||
+		    ((tree->nodes          = shared_get(&cursor, tree->num_nodes, sizeof(struct cpu_topology_node_t))) == NULL) ||
+		    ((tree->logical_cpus   = shared_get(&cursor, tree->num_cpus, sizeof(logical_cpu_t))) == NULL) ||
+		    ((tree->cpu_node       = shared_get(&cursor, tree->num_cpus, sizeof(int32_t))) == NULL) ||
+		    ((tree->caches         = shared_get(&cursor, tree->num_caches, sizeof(struct cpu_topology_cache_t))) == NULL) ||
+		    ((tree->cpu_numa_node  = shared_get(&cursor, tree->num_cpus, sizeof(int32_t))) == NULL) ||
+		    ((tree->numa_node_ids  = shared_get(&cursor, tree->num_numa_nodes, sizeof(int32_t))) == NULL) ||
+		    ((tree->numa_distances = shared_get(&cursor, (int64_t) tree->num_numa_nodes * tree->num_numa_nodes, sizeof(int32_t))) == NULL))
+			return false;
+		if (tree->num_numa_nodes == 0) {
+			tree->numa_node_ids  = NULL;
+			tree->numa_distances = NULL;
+		}
+		p->system.topology = tree;
+	}
+	return cursor.pos == payload_size;
+}
+
+/* A segment is only trusted if nobody but root and the current user can have written it */
+static bool shared_system_id_trusted(const struct stat* st)
+{
+	return S_ISREG(st->st_mode) && ((st->st_uid == 0) || (st->st_uid == geteuid())) && ((st->st_mode & (S_IWGRP | S_IWOTH)) == 0);
+}
+
+static int shared_system_id_write(const char* path, const uint8_t* payload, size_t payload_size)
+{
+	int fd;
+	bool ok;
+	uint32_t sequence;
+	struct stat st;
+	struct shared_system_id_header_t* header;
+	const size_t map_size = sizeof(struct shared_system_id_header_t) + payload_size;
+
+	fd = open(path, O_RDWR | O_CREAT | O_NOFOLLOW, 0644);
+	if (fd < 0)
+		return cpuid_set_error(ERR_OPEN);
+	/* One publisher at a time. The segment never shrinks, since readers may map its previous size */
+	ok = (flock(fd, LOCK_EX) == 0) && (fstat(fd, &st) == 0) && shared_system_id_trusted(&st) &&
+	     (((size_t) st.st_size >= map_size) || (ftruncate(fd, (off_t) map_size) == 0));
+	header = ok ? mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0) : MAP_FAILED;
+	if (header == MAP_FAILED) {
+		close(fd);
+		return cpuid_set_error(ERR_OPEN);
+	}
+
+	sequence = (header->sequence + 1) | 1;
+	header->sequence = sequence;
+	cpuid_memory_barrier();
+	header->magic          = SHARED_SYSTEM_ID_MAGIC;
+	header->format_version = SHARED_SYSTEM_ID_VERSION;
+	header->payload_size   = (uint32_t) payload_size;
+	header->checksum       = shared_system_id_checksum(payload, payload_size);
+	memcpy(header + 1, payload, payload_size);
+	cpuid_memory_barrier();
+	header->sequence = sequence + 1;
+
+	munmap(header, map_size);
+	close(fd);
+	return cpuid_set_error(ERR_OK);
+}
+
+/* Copies a consistent payload from the segment, and checks that it is current */
+static int shared_system_id_read(const char* name, struct shared_system_id_payload_t** payload_out)
+{
+	int fd, r = ERR_STALE, retries;
+	uint32_t sequence;
+	uint8_t* payload = NULL;
+	size_t map_size, payload_size = 0, copied = 0;
+	char path[SHARED_SYSTEM_ID_NAME_MAX + 16];
+	struct stat st;
+	struct shared_system_id_header_t header;
+	const struct shared_system_id_header_t* shared;
+	struct shared_system_id_payload_t* p;
+	struct shared_system_id_payload_t* current;
+
+	if (!shared_system_id_path(name, path, sizeof(path)))
+		return cpuid_set_error(ERR_INVRANGE);
+	fd = open(path, O_RDONLY | O_NOFOLLOW);
+	if (fd < 0)
+		return cpuid_set_error(ERR_OPEN);
+	if ((fstat(fd, &st) != 0) || !shared_system_id_trusted(&st)) {
+		debugf(2, "The published identification '%s' is not a file owned by root or the current user, or others can write it\n", name);
+		close(fd);
+		return cpuid_set_error(ERR_OPEN);
+	}
+	if ((size_t) st.st_size < sizeof(header)) {
+		close(fd);
+		return cpuid_set_error(ERR_BADFMT);
+	}
+	map_size = (size_t) st.st_size;
+	shared = mmap(NULL, map_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (shared == MAP_FAILED)
+		return cpuid_set_error(ERR_OPEN);
+
+	for (retries = 0; retries < SHARED_SYSTEM_ID_RETRIES; retries++) {
+		sequence = shared->sequence;
+		cpuid_memory_barrier();
+		if (sequence & 1) {
+			sched_yield();
+			continue;
+		}
+		memcpy(&header, (const void*) shared, sizeof(header));
+		copied = 0;
+		if ((header.payload_size <= map_size - sizeof(header)) && (header.payload_size >= sizeof(struct shared_system_id_payload_t))) {
+			if (header.payload_size > payload_size) {
+				free(payload);
+				payload_size = header.payload_size;
+				if ((payload = malloc(payload_size)) == NULL) {
+					r = ERR_NO_MEM;
+					break;
+				}
+			}
+			memcpy(payload, shared + 1, header.payload_size);
+			copied = header.payload_size;
+		}
+		cpuid_memory_barrier();
+		if (shared->sequence == sequence) {
+			r = ERR_OK;
+			break;
+		}
+	}
+	munmap((void*) shared, map_size);
+	if (r != ERR_OK) {
+		free(payload);
+		return cpuid_set_error(r);
+	}
+
+	/* Format and checksum */
+	p = (struct shared_system_id_payload_t*) payload;
+	if ((header.magic != SHARED_SYSTEM_ID_MAGIC) || (header.format_version != SHARED_SYSTEM_ID_VERSION) ||
+	    (copied == 0) || (copied != header.payload_size) ||
+	    (shared_system_id_checksum(payload, header.payload_size) != header.checksum) ||
+	    (p->cpu_id_size != sizeof(struct cpu_id_t)) || (p->system_id_size != sizeof(struct system_id_t)) ||
+	    !shared_system_id_attach(p, header.payload_size)) {
+		debugf(2, "The published identification '%s' is corrupted or has an unknown format\n", name);
+		free(payload);
+		return cpuid_set_error(ERR_BADFMT);
+	}
+
+	/* Same boot, same online CPUs and same library */
+	if ((current = calloc(1, sizeof(struct shared_system_id_payload_t))) == NULL) {
+		free(payload);
+		return cpuid_set_error(ERR_NO_MEM);
+	}
+	shared_system_id_stamp(current);
+	if ((current->boot_id[0] == '\0') || strncmp(p->boot_id, current->boot_id, BOOT_ID_STR_MAX) ||
+	    strncmp(p->online_cpus, current->online_cpus, ONLINE_CPUS_STR_MAX) ||
+	    strncmp(p->lib_version, current->lib_version, sizeof(current->lib_version))) {
+		debugf(2, "The published identification '%s' is stale\n", name);
+		r = ERR_STALE;
+	}
+	free(current);
+	if (r != ERR_OK) {
+		free(payload);
+		return cpuid_set_error(r);
+	}
+	*payload_out = p;
+	return cpuid_set_error(ERR_OK);
 }
+#endif /* SHARED_SYSTEM_ID */
 
-static cpu_purpose_t cpu_ident_purpose(struct cpu_raw_data_t* raw)
+static int cpu_identify_all_internal(struct cpu_raw_data_array_t* raw_array, struct system_id_t* system, struct cpu_topology_t* tree, bool current_system);
+
+int cpuid_publish_system_id(const char* name, struct cpu_raw_data_array_t* raw_array)
 {
-	cpu_vendor_t vendor = VENDOR_UNKNOWN;
-	cpu_purpose_t purpose = PURPOSE_GENERAL;
-	char vendor_str[VENDOR_STR_MAX];
+#ifdef SHARED_SYSTEM_ID
+	int r;
+	size_t payload_size;
+	char path[SHARED_SYSTEM_ID_NAME_MAX + 16];
+	struct cpu_raw_data_array_t my_raw_array;
+	struct system_id_t system;
+	struct shared_cursor_t cursor = { NULL, sizeof(struct shared_system_id_payload_t), 0 };
+	struct shared_system_id_payload_t* payload;
 
-	const cpu_architecture_t architecture = cpuid_architecture_identify(raw);
-	switch (architecture) {
-		case ARCHITECTURE_X86:
-			vendor = cpuid_vendor_identify(raw->basic_cpuid[0], vendor_str);
-			switch (vendor) {
-				case VENDOR_AMD:
-					purpose = cpuid_identify_purpose_amd(raw);
-					break;
-				case VENDOR_INTEL:
-					purpose = cpuid_identify_purpose_intel(raw);
-					break;
-				default:
-					break;
-			}
-			break;
-		case ARCHITECTURE_ARM:
-			purpose = cpuid_identify_purpose_arm(raw);
-			break;
-		default:
-			break;
+	if (!shared_system_id_path(name, path, sizeof(path)))
+		return cpuid_set_error(ERR_INVRANGE);
+	if (!raw_array) {
+		if ((r = cpuid_get_all_raw_data(&my_raw_array)) < 0)
+			return r;
+		raw_array = &my_raw_array;
+	}
+	if ((r = cpu_identify_all_internal(raw_array, &system, NULL, raw_array == &my_raw_array)) != ERR_OK)
+		goto cleanup_raw;
+
+	shared_system_id_pack(&cursor, NULL, &system);
+	payload_size = cursor.pos;
+	if ((payload = calloc(1, payload_size)) == NULL) {
+		r = cpuid_set_error(ERR_NO_MEM);
+		goto cleanup_system;
 	}
+	shared_system_id_stamp(payload);
+	/* The result of cpu_identify(NULL, ...) depends on the calling CPU for hybrid and multi-package systems */
+	if ((system.num_cpu_types == 1) && (raw_array->num_raw > 0))
+		payload->has_id = (cpu_identify(&raw_array->raw[0], &payload->id) == ERR_OK);
+	cursor.buf = (uint8_t*) payload;
+	cursor.pos = sizeof(struct shared_system_id_payload_t);
+	shared_system_id_pack(&cursor, payload, &system);
+	debugf(1, "Publishing the identification of %d CPU types to '%s'\n", system.num_cpu_types, path);
+	r = shared_system_id_write(path, (const uint8_t*) payload, payload_size);
+	free(payload);
+
+cleanup_system:
+	cpuid_free_system_id(&system);
+cleanup_raw:
+	if (raw_array == &my_raw_array)
+		cpuid_free_raw_data_array(&my_raw_array);
+	return r;
+#else
+	UNUSED(name);
+	UNUSED(raw_array);
+	return cpuid_set_error(ERR_NOT_IMP);
+#endif /* SHARED_SYSTEM_ID */
+}
 
-	debugf(3, "Identified a '%s' CPU core type\n", cpu_purpose_str(purpose));
+int cpuid_read_published_system_id(const char* name, struct system_id_t* system)
+{
+#ifdef SHARED_SYSTEM_ID
+	int r;
+	struct shared_system_id_payload_t* payload;
 
-	return purpose;
+	if (system == NULL)
+		return cpuid_set_error(ERR_HANDLE);
+	if ((r = shared_system_id_read(name, &payload)) != ERR_OK)
+		return r;
+	r = copy_system_id(system, &payload->system) ? ERR_OK : ERR_NO_MEM;
+	free(payload);
+	return cpuid_set_error(r);
+#else
+	UNUSED(name);
+	UNUSED(system);
+	return cpuid_set_error(ERR_NOT_IMP);
+#endif /* SHARED_SYSTEM_ID */
+}
+
+int cpuid_use_published_system_id(const char* name)
+{
+	if ((name != NULL) && ((name[0] == '\0') || strchr(name, '/') || (strlen(name) >= SHARED_SYSTEM_ID_NAME_MAX)))
+		return cpuid_set_error(ERR_INVRANGE);
+	cpuid_lock();
+	snprintf(_published_system_id_name, sizeof(_published_system_id_name), "%s", name ? name : "");
+	cpuid_unlock();
+	return cpuid_set_error(ERR_OK);
+}
+
+/* Reads the identification published under the name given to cpuid_use_published_system_id(), if any */
+static struct shared_system_id_payload_t* get_published_system_id(void)
+{
+	struct shared_system_id_payload_t* payload = NULL;
+#ifdef SHARED_SYSTEM_ID
+	char name[SHARED_SYSTEM_ID_NAME_MAX];
+
+	cpuid_lock();
+	memcpy(name, _published_system_id_name, sizeof(name));
+	cpuid_unlock();
+	if ((name[0] != '\0') && (shared_system_id_read(name, &payload) != ERR_OK)) {
+		debugf(2, "Cannot use the published identification '%s' (%s), identifying the CPU\n", name, cpuid_error());
+		payload = NULL;
+	}
+#endif /* SHARED_SYSTEM_ID */
+	return payload;
 }
 
 int cpu_identify(struct cpu_raw_data_t* raw, struct cpu_id_t* data)
 {
 	int r;
+	uint32_t generation = 0;
 	struct internal_id_info_t throwaway;
+	struct shared_system_id_payload_t* published;
+	if ((raw == NULL) && (data != NULL) && identify_cache_get_id(data, &generation))
+		return cpuid_set_error(ERR_OK);
+	if ((raw == NULL) && (data != NULL) && ((published = get_published_system_id()) != NULL)) {
+		if (published->has_id) {
+			*data = published->id;
+			free(published);
+			identify_cache_put_id(data, generation);
+			return cpuid_set_error(ERR_OK);
+		}
+		free(published);
+	}
 	r = cpu_ident_internal(raw, data, &throwaway);
+	if ((raw == NULL) && (r == ERR_OK))
+		identify_cache_put_id(data, generation);
 	return r;
 }
 
-static void update_core_instances(struct internal_core_instances_t* cores,
-                                   struct internal_topology_t* topology)
+/* Fibonacci hashing: IDs are APIC IDs with some bits masked, so their low bits are often constant */
+static uint32_t instance_hash(int32_t id, uint8_t bits)
+{
+	return (uint32_t) (((uint32_t) id * UINT32_C(2654435769)) >> (32 - bits));
+}
+
+static bool resize_instances(struct internal_instances_t* instances, uint8_t bits)
 {
-	uint32_t core_id_index = 0;
+	uint32_t i, j;
+	const uint32_t capacity = UINT32_C(1) << bits;
+	struct internal_instance_t* htable;
 
-	core_id_index = topology->core_id % CORES_HTABLE_SIZE;
-	if ((cores->htable[core_id_index].core_id == 0) || (cores->htable[core_id_index].core_id == topology->core_id)) {
-		if (cores->htable[core_id_index].num_logical_cpu == 0)
-			cores->instances++;
-		cores->htable[core_id_index].core_id = topology->core_id;
-		cores->htable[core_id_index].num_logical_cpu++;
+	htable = calloc(capacity, sizeof(struct internal_instance_t));
+	if (htable == NULL) /* Memory allocation failure */
+		return false;
+	for (i = 0; i < instances->capacity; i++) {
+		if (instances->htable[i].num_logical_cpu == 0)
+			continue;
+		for (j = instance_hash(instances->htable[i].id, bits); htable[j].num_logical_cpu != 0; j = (j + 1) & (capacity - 1));
+		htable[j] = instances->htable[i];
 	}
-	else {
-		warnf("update_core_instances: collision at index %u (core ID is %i, not %i)\n",
-			core_id_index, cores->htable[core_id_index].core_id, topology->core_id);
+	free(instances->htable);
+	instances->htable        = htable;
+	instances->capacity      = capacity;
+	instances->capacity_bits = bits;
+	return true;
+}
+
+/* Counts one more logical CPU for the given ID; the table is kept at most half full */
+static bool add_instance(struct internal_instances_t* instances, int32_t id)
+{
+	uint32_t i;
+
+	if ((instances->instances + 1) * 2 > instances->capacity) {
+		if (!resize_instances(instances, (instances->capacity_bits > 0) ? instances->capacity_bits + 1 : 4))
+			return false;
+	}
+	for (i = instance_hash(id, instances->capacity_bits); instances->htable[i].num_logical_cpu != 0; i = (i + 1) & (instances->capacity - 1)) {
+		if (instances->htable[i].id == id) {
+			instances->htable[i].num_logical_cpu++;
+			return true;
+		}
 	}
+	instances->htable[i].id              = id;
+	instances->htable[i].num_logical_cpu = 1;
+	instances->instances++;
+	return true;
+}
+
+static bool update_core_instances(struct internal_instances_t* cores,
+                                  struct internal_topology_t* topology)
+{
+	return add_instance(cores, topology->core_id);
 }
 
-static void update_cache_instances(struct internal_cache_instances_t* caches,
+static bool update_cache_instances(struct internal_cache_instances_t* caches,
                                    struct internal_topology_t* topology,
                                    struct internal_id_info_t* id_info,
                                    bool debugf_is_needed)
 {
-	uint32_t cache_id_index = 0;
 	cache_type_t level;
 
 	for (level = 0; level < NUM_CACHE_TYPES; level++) {
@@ -1676,27 +4214,67 @@ static void update_cache_instances(struct internal_cache_instances_t* caches,
 			topology->cache_id[level] = -1;
 			continue;
 		}
-		topology->cache_id[level] = topology->apic_id & id_info->cache_mask[level];
-		cache_id_index             = topology->cache_id[level] % CACHES_HTABLE_SIZE;
-		if ((caches->htable[level][cache_id_index].cache_id == 0) || (caches->htable[level][cache_id_index].cache_id == topology->cache_id[level])) {
-			if (caches->htable[level][cache_id_index].num_logical_cpu == 0)
-				caches->instances[level]++;
-			caches->htable[level][cache_id_index].cache_id = topology->cache_id[level];
-			caches->htable[level][cache_id_index].num_logical_cpu++;
-		}
-		else {
-			warnf("update_cache_instances: collision at index %u (cache ID is %i, not %i)\n",
-				cache_id_index, caches->htable[level][cache_id_index].cache_id, topology->cache_id[level]);
-		}
+		/* The L3 cache belongs to a core complex, when the CPU reports them */
+		if ((level == L3) && (topology->complex_id >= 0))
+			topology->cache_id[level] = topology->complex_id;
+		else
+			topology->cache_id[level] = topology->apic_id & id_info->cache_mask[level];
+		if (!add_instance(&caches->levels[level], topology->cache_id[level]))
+			return false;
 	}
 
 	if (debugf_is_needed)
 		debugf(3, "Logical CPU %4u: APIC ID %4i, package ID %4i, core ID %4i, thread %i, L1I$ ID %4i, L1D$ ID %4i, L2$ ID %4i, L3$ ID %4i, L4$ ID %4i\n",
 			topology->logical_cpu, topology->apic_id, topology->package_id, topology->core_id, topology->smt_id,
 			topology->cache_id[L1I], topology->cache_id[L1D], topology->cache_id[L2], topology->cache_id[L3], topology->cache_id[L4]);
+	return true;
 }
 
-int cpu_identify_all(struct cpu_raw_data_array_t* raw_array, struct system_id_t* system)
+static int build_topology(const struct internal_topology_t* per_cpu, logical_cpu_t num_cpus, struct cpu_topology_t* topology);
+static int read_numa_nodes(struct cpu_topology_t* topology);
+
+/* Number of nodes of a level of the tree, -1 if the CPU does not report that level */
+static int32_t topology_level_instances(const struct cpu_topology_t* topology, cpu_topology_level_t level)
+{
+	int32_t i;
+
+	for (i = topology->first_node[level]; i < topology->first_node[level] + topology->num_level_nodes[level]; i++)
+		if (topology->nodes[i].id < 0)
+			return -1;
+	return topology->num_level_nodes[level];
+}
+
+/* Builds system->cache_map, which stays NULL if the CPU does not report its cache topology */
+static int build_system_cache_map(struct system_id_t* system, const struct cpu_topology_t* topology)
+{
+	int r;
+
+	if ((system->cache_map = malloc(sizeof(struct cpu_cache_map_t))) == NULL)
+		return ERR_NO_MEM;
+	if ((r = cpuid_get_cache_map(system, topology, system->cache_map)) != ERR_OK) {
+		free(system->cache_map);
+		system->cache_map = NULL;
+	}
+	return (r == ERR_NOT_FOUND) ? ERR_OK : r;
+}
+
+/* Keeps the tree in system->topology: it is moved if the caller did not ask for it, copied otherwise */
+static int keep_system_topology(struct system_id_t* system, struct cpu_topology_t* tree, bool move)
+{
+	if ((system->topology = malloc(sizeof(struct cpu_topology_t))) == NULL)
+		return ERR_NO_MEM;
+	if (move)
+		*system->topology = *tree;
+	else if (!copy_topology(system->topology, tree)) {
+		free(system->topology);
+		system->topology = NULL;
+		return ERR_NO_MEM;
+	}
+	return ERR_OK;
+}
+
+/* The NUMA nodes are read if raw_array comes from the current system (it is NULL or was collected by the caller) */
+static int cpu_identify_all_internal(struct cpu_raw_data_array_t* raw_array, struct system_id_t* system, struct cpu_topology_t* tree, bool current_system)
 {
 	int r = ERR_OK;
 	double smt_divisor;
@@ -1706,25 +4284,26 @@ int cpu_identify_all(struct cpu_raw_data_array_t* raw_array, struct system_id_t*
 	int32_t cur_package_id = 0;
 	logical_cpu_t logical_cpu = 0;
 	cpu_purpose_t purpose;
-	cpu_affinity_mask_t affinity_mask;
 	struct cpu_raw_data_array_t my_raw_array;
 	struct internal_topology_t topology;
 	struct internal_type_info_array_t type_info;
 	struct internal_cache_instances_t caches_all;
+	struct internal_topology_t* per_cpu = NULL;
+	struct cpu_topology_t my_tree;
 
-	/* Init variables */
-	if (system == NULL)
-		return cpuid_set_error(ERR_HANDLE);
+	/* Init variables, the system first: the callers free it on error */
+	system_id_t_constructor(system);
 	if (!raw_array) {
 		if ((r = cpuid_get_all_raw_data(&my_raw_array)) < 0)
 			return r;
 		raw_array = &my_raw_array;
 	}
-	system_id_t_constructor(system);
 	type_info_array_t_constructor(&type_info);
 	cache_instances_t_constructor(&caches_all);
-	if (raw_array->with_affinity)
-		init_affinity_mask(&affinity_mask);
+	if (raw_array->with_affinity && (raw_array->num_raw > 0) && ((per_cpu = malloc(sizeof(struct internal_topology_t) * raw_array->num_raw)) == NULL)) {
+		r = cpuid_set_error(ERR_NO_MEM);
+		goto cleanup;
+	}
 
 	/* Iterate over all raw */
 	for (logical_cpu = 0; logical_cpu < raw_array->num_raw; logical_cpu++) {
@@ -1745,26 +4324,33 @@ int cpu_identify_all(struct cpu_raw_data_array_t* raw_array, struct system_id_t*
 		cpu_type_index = cpuid_find_index_system_id(system, purpose, &type_info, cur_package_id, is_topology_supported);
 		if (cpu_type_index < 0) {
 			cpu_type_index = system->num_cpu_types;
-			cpuid_grow_system_id(system, system->num_cpu_types + 1);
-			cpuid_grow_type_info(&type_info, type_info.num + 1);
-			if ((r = cpu_ident_internal(&raw_array->raw[logical_cpu], &system->cpu_types[cpu_type_index], &type_info.data[cpu_type_index].id_info)) != ERR_OK)
-				return r;
+			if (((r = cpuid_grow_system_id(system, system->num_cpu_types + 1)) != ERR_OK) ||
+			    ((r = cpuid_grow_type_info(&type_info, type_info.num + 1)) != ERR_OK) ||
+			    ((r = cpu_ident_internal(&raw_array->raw[logical_cpu], &system->cpu_types[cpu_type_index], &type_info.data[cpu_type_index].id_info)) != ERR_OK))
+				goto cleanup;
 			type_info.data[cpu_type_index].purpose = purpose;
 			if (is_topology_supported)
 				type_info.data[cpu_type_index].package_id = cur_package_id;
-			if (raw_array->with_affinity)
+			if (raw_array->with_affinity) {
 				system->cpu_types[cpu_type_index].num_logical_cpus = 0;
+				if ((r = cpuid_affinity_set_init(&system->cpu_types[cpu_type_index].affinity, raw_array->num_raw)) != ERR_OK)
+					goto cleanup;
+			}
 		}
 
 		/* Increment counters */
 		if (raw_array->with_affinity) {
-			set_affinity_mask_bit(logical_cpu, &system->cpu_types[cpu_type_index].affinity_mask);
+			cpuid_affinity_set_add(&system->cpu_types[cpu_type_index].affinity, logical_cpu);
 			system->cpu_types[cpu_type_index].num_logical_cpus++;
-			if (is_topology_supported) {
-				update_core_instances(&type_info.data[cpu_type_index].core_instances, &topology);
-				update_cache_instances(&type_info.data[cpu_type_index].cache_instances, &topology, &type_info.data[cpu_type_index].id_info, true);
-				update_cache_instances(&caches_all,  &topology, &type_info.data[cpu_type_index].id_info, false);
+			if (is_topology_supported &&
+			    (!update_core_instances(&type_info.data[cpu_type_index].core_instances, &topology) ||
+			     !update_cache_instances(&type_info.data[cpu_type_index].cache_instances, &topology, &type_info.data[cpu_type_index].id_info, true) ||
+			     !update_cache_instances(&caches_all,  &topology, &type_info.data[cpu_type_index].id_info, false))) {
+				r = cpuid_set_error(ERR_NO_MEM);
+				goto cleanup;
 			}
+			if (per_cpu && is_topology_supported)
+				per_cpu[logical_cpu] = topology;
 		}
 	}
 
@@ -1773,12 +4359,12 @@ int cpu_identify_all(struct cpu_raw_data_array_t* raw_array, struct system_id_t*
 		/* Overwrite core and cache counters when information is available per core */
 		if (raw_array->with_affinity) {
 			if (is_topology_supported) {
-				system->cpu_types[cpu_type_index].num_cores                = type_info.data[cpu_type_index].core_instances.instances;
-				system->cpu_types[cpu_type_index].l1_instruction_instances = type_info.data[cpu_type_index].cache_instances.instances[L1I];
-				system->cpu_types[cpu_type_index].l1_data_instances        = type_info.data[cpu_type_index].cache_instances.instances[L1D];
-				system->cpu_types[cpu_type_index].l2_instances             = type_info.data[cpu_type_index].cache_instances.instances[L2];
-				system->cpu_types[cpu_type_index].l3_instances             = type_info.data[cpu_type_index].cache_instances.instances[L3];
-				system->cpu_types[cpu_type_index].l4_instances             = type_info.data[cpu_type_index].cache_instances.instances[L4];
+				system->cpu_types[cpu_type_index].num_cores                = (int32_t) type_info.data[cpu_type_index].core_instances.instances;
+				system->cpu_types[cpu_type_index].l1_instruction_instances = (int32_t) type_info.data[cpu_type_index].cache_instances.levels[L1I].instances;
+				system->cpu_types[cpu_type_index].l1_data_instances        = (int32_t) type_info.data[cpu_type_index].cache_instances.levels[L1D].instances;
+				system->cpu_types[cpu_type_index].l2_instances             = (int32_t) type_info.data[cpu_type_index].cache_instances.levels[L2].instances;
+				system->cpu_types[cpu_type_index].l3_instances             = (int32_t) type_info.data[cpu_type_index].cache_instances.levels[L3].instances;
+				system->cpu_types[cpu_type_index].l4_instances             = (int32_t) type_info.data[cpu_type_index].cache_instances.levels[L4].instances;
 			}
 			else {
 				/* Note: if SMT is disabled by BIOS, smt_divisor will no reflect the current state properly */
@@ -1791,18 +4377,371 @@ int cpu_identify_all(struct cpu_raw_data_array_t* raw_array, struct system_id_t*
 		/* Update the total_logical_cpus value for each purpose */
 		system->cpu_types[cpu_type_index].total_logical_cpus = logical_cpu;
 	}
-	cpuid_free_type_info(&type_info);
 
 	/* Update the grand total of cache instances */
 	if (is_topology_supported) {
-		system->l1_instruction_total_instances = caches_all.instances[L1I];
-		system->l1_data_total_instances        = caches_all.instances[L1D];
-		system->l2_total_instances             = caches_all.instances[L2];
-		system->l3_total_instances             = caches_all.instances[L3];
-		system->l4_total_instances             = caches_all.instances[L4];
+		system->l1_instruction_total_instances = (int32_t) caches_all.levels[L1I].instances;
+		system->l1_data_total_instances        = (int32_t) caches_all.levels[L1D].instances;
+		system->l2_total_instances             = (int32_t) caches_all.levels[L2].instances;
+		system->l3_total_instances             = (int32_t) caches_all.levels[L3].instances;
+		system->l4_total_instances             = (int32_t) caches_all.levels[L4].instances;
+	}
+	if (tree && (!raw_array->with_affinity || !is_topology_supported || (raw_array->num_raw == 0))) {
+		r = cpuid_set_error(ERR_NOT_IMP);
+		goto cleanup;
 	}
 
-	return cpuid_set_error(ERR_OK);
+	/* The dies, tiles and modules and the cache map come from the topology tree, which is kept in the system */
+	if (raw_array->with_affinity && is_topology_supported && (raw_array->num_raw > 0)) {
+		if (!tree)
+			tree = &my_tree;
+		if ((r = build_topology(per_cpu, raw_array->num_raw, tree)) != ERR_OK) {
+			r = cpuid_set_error(r);
+			goto cleanup;
+		}
+		system->die_total_instances    = topology_level_instances(tree, TOPOLOGY_DIE);
+		system->tile_total_instances   = topology_level_instances(tree, TOPOLOGY_TILE);
+		system->module_total_instances = topology_level_instances(tree, TOPOLOGY_MODULE);
+		if ((current_system && ((r = read_numa_nodes(tree)) != ERR_OK)) ||
+		    ((r = build_system_cache_map(system, tree)) != ERR_OK) ||
+		    ((r = keep_system_topology(system, tree, tree == &my_tree)) != ERR_OK)) {
+			cpuid_free_topology(tree);
+			r = cpuid_set_error(r);
+			goto cleanup;
+		}
+	}
+	r = cpuid_set_error(ERR_OK);
+
+cleanup:
+	free(per_cpu);
+	cpuid_free_type_info(&type_info);
+	cache_instances_t_destructor(&caches_all);
+	if (raw_array == &my_raw_array)
+		cpuid_free_raw_data_array(&my_raw_array);
+	return r;
+}
+
+/* ID of a logical CPU at each level of the topology tree */
+static int32_t topology_level_id(const struct internal_topology_t* cpu, cpu_topology_level_t level)
+{
+	switch (level) {
+		case TOPOLOGY_PACKAGE: return cpu->package_id;
+		case TOPOLOGY_DIE:     return cpu->die_id;
+		/* The last level cache below the memory-side L4 */
+		case TOPOLOGY_COMPLEX: return (cpu->complex_id >= 0) ? cpu->complex_id : (cpu->cache_id[L3] >= 0) ? cpu->cache_id[L3] : cpu->cache_id[L2];
+		case TOPOLOGY_TILE:    return cpu->tile_id;
+		case TOPOLOGY_MODULE:  return cpu->module_id;
+		case TOPOLOGY_CORE:    return cpu->core_id;
+		case TOPOLOGY_THREAD:  return cpu->smt_id;
+		default:               return -1;
+	}
+}
+
+static uint32_t topology_digit(const struct internal_topology_t* cpu, cpu_topology_level_t level, int shift)
+{
+	/* Flip the sign bit, so that -1 comes first */
+	return ((((uint32_t) topology_level_id(cpu, level)) ^ UINT32_C(0x80000000)) >> shift) & 0xff;
+}
+
+/* Sorts the logical CPUs by their IDs at each level, from the package to the thread, with a LSD radix sort */
+static void topology_sort(const struct internal_topology_t* per_cpu, logical_cpu_t num_cpus, logical_cpu_t* order, logical_cpu_t* tmp)
+{
+	int level, shift;
+	uint32_t digit, count[257];
+	logical_cpu_t i;
+
+	for (i = 0; i < num_cpus; i++)
+		order[i] = i;
+	for (level = NUM_TOPOLOGY_LEVELS - 1; level >= 0; level--) {
+		for (shift = 0; shift < 32; shift += 8) {
+			memset(count, 0, sizeof(count));
+			for (i = 0; i < num_cpus; i++)
+				count[topology_digit(&per_cpu[order[i]], level, shift) + 1]++;
+			if (count[topology_digit(&per_cpu[order[0]], level, shift) + 1] == num_cpus)
+				continue; /* same digit everywhere */
+			for (digit = 0; digit < 256; digit++)
+				count[digit + 1] += count[digit];
+			for (i = 0; i < num_cpus; i++)
+				tmp[count[topology_digit(&per_cpu[order[i]], level, shift)]++] = order[i];
+			memcpy(order, tmp, sizeof(logical_cpu_t) * num_cpus);
+		}
+	}
+}
+
+/* Smallest node which contains two nodes */
+static int32_t topology_common_node(const struct cpu_topology_t* topology, int32_t a, int32_t b)
+{
+	while (topology->nodes[a].level > topology->nodes[b].level)
+		a = topology->nodes[a].parent;
+	while (topology->nodes[b].level > topology->nodes[a].level)
+		b = topology->nodes[b].parent;
+	while (a != b) {
+		a = topology->nodes[a].parent;
+		b = topology->nodes[b].parent;
+	}
+	return a;
+}
+
+static int build_topology(const struct internal_topology_t* per_cpu, logical_cpu_t num_cpus, struct cpu_topology_t* topology)
+{
+	int r = ERR_NO_MEM;
+	int level;
+	cache_type_t cache;
+	int32_t id, node, parent, pos, i, *node_of = NULL, *cache_count = NULL;
+	logical_cpu_t *order = NULL, *tmp = NULL;
+	struct cpu_topology_cache_t* caches = NULL;
+	struct cpu_topology_node_t* n;
+
+	memset(topology, 0, sizeof(struct cpu_topology_t));
+	if (((order    = malloc(sizeof(logical_cpu_t) * num_cpus)) == NULL) ||
+	    ((tmp      = malloc(sizeof(logical_cpu_t) * num_cpus)) == NULL) ||
+	    ((node_of  = malloc(sizeof(int32_t) * num_cpus)) == NULL) ||
+	    ((caches   = malloc(sizeof(struct cpu_topology_cache_t) * num_cpus * NUM_CACHE_TYPES)) == NULL) ||
+	    ((topology->nodes        = malloc(sizeof(struct cpu_topology_node_t) * num_cpus * NUM_TOPOLOGY_LEVELS)) == NULL) ||
+	    ((topology->logical_cpus = malloc(sizeof(logical_cpu_t) * num_cpus)) == NULL) ||
+	    ((topology->cpu_node     = malloc(sizeof(int32_t) * num_cpus)) == NULL) ||
+	    ((topology->cpu_numa_node = malloc(sizeof(int32_t) * num_cpus)) == NULL))
+		goto cleanup;
+	topology_sort(per_cpu, num_cpus, order, tmp);
+	topology->num_cpus = num_cpus;
+	for (pos = 0; pos < num_cpus; pos++) {
+		topology->logical_cpus[pos]  = per_cpu[order[pos]].logical_cpu;
+		topology->cpu_numa_node[pos] = -1;
+	}
+
+	/* One pass per level: a node starts where the parent or the ID changes */
+	for (level = 0; level < NUM_TOPOLOGY_LEVELS; level++) {
+		topology->first_node[level] = topology->num_nodes;
+		for (pos = 0; pos < num_cpus; pos++) {
+			parent = (level == 0) ? -1 : node_of[pos];
+			id     = topology_level_id(&per_cpu[order[pos]], level);
+			if ((pos == 0) || (topology->nodes[topology->num_nodes - 1].parent != parent) || (topology->nodes[topology->num_nodes - 1].id != id)) {
+				n = &topology->nodes[topology->num_nodes++];
+				n->level        = level;
+				n->id           = id;
+				n->parent       = parent;
+				n->first_child  = -1;
+				n->num_children = 0;
+				n->first_cpu    = pos;
+				n->num_cpus     = 0;
+				if (parent >= 0) {
+					if (topology->nodes[parent].first_child < 0)
+						topology->nodes[parent].first_child = topology->num_nodes - 1;
+					topology->nodes[parent].num_children++;
+				}
+			}
+			topology->nodes[topology->num_nodes - 1].num_cpus++;
+			node_of[pos] = topology->num_nodes - 1;
+		}
+		topology->num_level_nodes[level] = topology->num_nodes - topology->first_node[level];
+	}
+	for (pos = 0; pos < num_cpus; pos++)
+		topology->cpu_node[order[pos]] = node_of[pos];
+
+	/* Cache instances: the logical CPUs sharing a cache are consecutive, since its ID is a prefix of their APIC IDs */
+	for (cache = 0; cache < NUM_CACHE_TYPES; cache++) {
+		for (pos = 0; pos < num_cpus; pos++) {
+			id = per_cpu[order[pos]].cache_id[cache];
+			if (id < 0)
+				continue;
+			if ((topology->num_caches == 0) || (caches[topology->num_caches - 1].level != (cpu_cache_level_t) cache) ||
+			    (caches[topology->num_caches - 1].id != id)) {
+				caches[topology->num_caches].level     = (cpu_cache_level_t) cache;
+				caches[topology->num_caches].id        = id;
+				caches[topology->num_caches].node      = node_of[pos];
+				caches[topology->num_caches].first_cpu = pos;
+				caches[topology->num_caches].num_cpus  = 0;
+				caches[topology->num_caches].numa_node = -1;
+				topology->num_caches++;
+			}
+			caches[topology->num_caches - 1].num_cpus++;
+			caches[topology->num_caches - 1].node = topology_common_node(topology, caches[topology->num_caches - 1].node, node_of[pos]);
+		}
+	}
+
+	/* Move the caches out of the levels which the CPU does not report, to the highest node with the same logical CPUs */
+	for (i = 0; i < topology->num_caches; i++)
+		for (node = caches[i].node; (topology->nodes[node].id < 0) && (topology->nodes[node].parent >= 0) &&
+		     (topology->nodes[topology->nodes[node].parent].num_cpus == topology->nodes[node].num_cpus); node = topology->nodes[node].parent)
+			caches[i].node = topology->nodes[node].parent;
+
+	/* Group the caches by node, with a counting sort */
+	if (((cache_count = calloc(topology->num_nodes + 1, sizeof(int32_t))) == NULL) ||
+	    ((topology->caches = malloc(sizeof(struct cpu_topology_cache_t) * (topology->num_caches > 0 ? topology->num_caches : 1))) == NULL))
+		goto cleanup;
+	for (i = 0; i < topology->num_caches; i++)
+		cache_count[caches[i].node + 1]++;
+	for (node = 0; node < topology->num_nodes; node++) {
+		cache_count[node + 1]               += cache_count[node];
+		topology->nodes[node].first_cache = cache_count[node];
+		topology->nodes[node].num_caches  = cache_count[node + 1] - cache_count[node];
+	}
+	for (i = 0; i < topology->num_caches; i++)
+		topology->caches[cache_count[caches[i].node]++] = caches[i];
+	r = ERR_OK;
+
+cleanup:
+	free(order);
+	free(tmp);
+	free(node_of);
+	free(caches);
+	free(cache_count);
+	if (r != ERR_OK)
+		cpuid_free_topology(topology);
+	return r;
+}
+
+#define NUMA_NODES_MAX   1024 /* MAX_NUMNODES of the Linux kernel */
+#define NUMA_STR_MAX     (NUMA_NODES_MAX * 4 + 1)
+
+/* Parses the next range of a sysfs list like "0-3,8,10-11", returns NULL at the end of the list */
+static const char* parse_sysfs_range(const char* s, int32_t* first, int32_t* last)
+{
+	char* end;
+
+	while ((*s == ',') || isspace((unsigned char) *s))
+		s++;
+	if (!isdigit((unsigned char) *s))
+		return NULL;
+	*first = *last = (int32_t) strtol(s, &end, 10);
+	if (*end == '-')
+		*last = (int32_t) strtol(end + 1, &end, 10);
+	return ((*first >= 0) && (*last >= *first) && (*last < NUMA_NODES_MAX * 64)) ? end : NULL;
+}
+
+/* Reads the NUMA nodes of the current system: their logical CPUs and distances */
+static int read_numa_nodes(struct cpu_topology_t* topology)
+{
+	int32_t first, last, cpu, i, j, n = 0;
+	long distance;
+	char path[64], buffer[NUMA_STR_MAX];
+	char* end;
+	const char* s;
+	struct cpu_topology_cache_t* cache;
+
+	read_sysfs_file(NUMA_NODES_PATH "/online", buffer, sizeof(buffer));
+	for (s = buffer; (s = parse_sysfs_range(s, &first, &last)) != NULL;)
+		n += last - first + 1;
+	if ((n == 0) || (n > NUMA_NODES_MAX)) {
+		debugf(2, "No NUMA nodes in " NUMA_NODES_PATH "\n");
+		return ERR_OK;
+	}
+	if (((topology->numa_node_ids  = malloc(sizeof(int32_t) * n)) == NULL) ||
+	    ((topology->numa_distances = malloc(sizeof(int32_t) * n * n)) == NULL))
+		return ERR_NO_MEM;
+	topology->num_numa_nodes = n;
+	for (i = 0, s = buffer; (s = parse_sysfs_range(s, &first, &last)) != NULL;)
+		while (first <= last)
+			topology->numa_node_ids[i++] = first++;
+
+	for (i = 0; i < n; i++) {
+		snprintf(path, sizeof(path), NUMA_NODES_PATH "/node%" PRId32 "/cpulist", topology->numa_node_ids[i]);
+		read_sysfs_file(path, buffer, sizeof(buffer));
+		for (s = buffer; (s = parse_sysfs_range(s, &first, &last)) != NULL;)
+			for (cpu = first; (cpu <= last) && (cpu < topology->num_cpus); cpu++)
+				topology->cpu_numa_node[cpu] = topology->numa_node_ids[i];
+
+		/* One distance per node, in the same order as the online nodes */
+		snprintf(path, sizeof(path), NUMA_NODES_PATH "/node%" PRId32 "/distance", topology->numa_node_ids[i]);
+		read_sysfs_file(path, buffer, sizeof(buffer));
+		for (j = 0, s = buffer; j < n; j++, s = end) {
+			distance = strtol(s, &end, 10);
+			topology->numa_distances[i * n + j] = ((end != s) && (distance > 0) && (distance <= INT32_MAX)) ? (int32_t) distance : -1;
+		}
+	}
+
+	/* A cache belongs to a node when all the logical CPUs sharing it do */
+	for (i = 0; i < topology->num_caches; i++) {
+		cache = &topology->caches[i];
+		cache->numa_node = topology->cpu_numa_node[topology->logical_cpus[cache->first_cpu]];
+		for (j = cache->first_cpu + 1; (j < cache->first_cpu + cache->num_cpus) && (cache->numa_node >= 0); j++)
+			if (topology->cpu_numa_node[topology->logical_cpus[j]] != cache->numa_node)
+				cache->numa_node = -1;
+	}
+	debugf(2, "%" PRId32 " NUMA node(s)\n", n);
+	return ERR_OK;
+}
+
+int cpuid_get_topology(struct cpu_raw_data_array_t* raw_array, struct system_id_t* system, struct cpu_topology_t* topology)
+{
+	int r;
+	uint32_t generation = 0;
+	struct system_id_t my_system;
+
+	if (topology == NULL)
+		return cpuid_set_error(ERR_HANDLE);
+	memset(topology, 0, sizeof(struct cpu_topology_t));
+	if (system == NULL)
+		system = &my_system;
+	if (!raw_array && identify_cache_get_topology(system, topology, &generation))
+		r = cpuid_set_error(ERR_OK);
+	else if (((r = cpu_identify_all_internal(raw_array, system, topology, !raw_array)) == ERR_OK) && !raw_array)
+		identify_cache_put_system(system, generation);
+	if ((r != ERR_OK) || (system == &my_system))
+		cpuid_free_system_id(system);
+	return r;
+}
+
+const struct cpu_topology_node_t* cpuid_get_topology_node(const struct cpu_topology_t* topology, logical_cpu_t logical_cpu, cpu_topology_level_t level)
+{
+	int32_t node;
+
+	if ((topology == NULL) || (logical_cpu >= (logical_cpu_t) topology->num_cpus) || ((int) level >= NUM_TOPOLOGY_LEVELS))
+		return NULL;
+	for (node = topology->cpu_node[logical_cpu]; topology->nodes[node].level > level; node = topology->nodes[node].parent);
+	return &topology->nodes[node];
+}
+
+int cpuid_get_numa_distance(const struct cpu_topology_t* topology, int32_t node_a, int32_t node_b)
+{
+	int32_t i, a = -1, b = -1;
+
+	if (topology == NULL)
+		return -1;
+	for (i = 0; i < topology->num_numa_nodes; i++) {
+		if (topology->numa_node_ids[i] == node_a)
+			a = i;
+		if (topology->numa_node_ids[i] == node_b)
+			b = i;
+	}
+	return ((a >= 0) && (b >= 0)) ? topology->numa_distances[a * topology->num_numa_nodes + b] : -1;
+}
+
+void cpuid_free_topology(struct cpu_topology_t* topology)
+{
+	if (topology == NULL)
+		return;
+	free(topology->nodes);
+	free(topology->logical_cpus);
+	free(topology->cpu_node);
+	free(topology->caches);
+	free(topology->numa_node_ids);
+	free(topology->cpu_numa_node);
+	free(topology->numa_distances);
+	memset(topology, 0, sizeof(struct cpu_topology_t));
+}
+
+int cpu_identify_all(struct cpu_raw_data_array_t* raw_array, struct system_id_t* system)
+{
+	int r;
+	uint32_t generation = 0;
+	struct shared_system_id_payload_t* published;
+
+	if (system == NULL)
+		return cpuid_set_error(ERR_HANDLE);
+	if (!raw_array && identify_cache_get_system(system, &generation))
+		return cpuid_set_error(ERR_OK);
+	if (!raw_array && ((published = get_published_system_id()) != NULL)) {
+		r = copy_system_id(system, &published->system) ? ERR_OK : ERR_NO_MEM;
+		free(published);
+		if (r == ERR_OK)
+			identify_cache_put_system(system, generation);
+		return cpuid_set_error(r);
+	}
+	r = cpu_identify_all_internal(raw_array, system, NULL, !raw_array);
+	if (!raw_array && (r == ERR_OK))
+		identify_cache_put_system(system, generation);
+	return r;
 }
 
 int cpu_request_core_type(cpu_purpose_t purpose, struct cpu_raw_data_array_t* raw_array, struct cpu_id_t* data)
@@ -1926,32 +4865,190 @@ const char* cpu_purpose_str(cpu_purpose_t purpose)
 	return "";
 }
 
-char* affinity_mask_str_r(cpu_affinity_mask_t* affinity_mask, char* buffer, uint32_t buffer_len)
+char* affinity_mask_str_r(cpu_affinity_mask_t* affinity_mask, char* buffer, uint32_t buffer_len)
+{
+	logical_cpu_t mask_index = __MASK_SETSIZE - 1;
+	logical_cpu_t str_index = 0;
+	bool do_print = false;
+
+	while (((uint32_t) str_index) + 1 < buffer_len) {
+		if (do_print || (mask_index < 4) || (affinity_mask->__bits[mask_index] != 0x00)) {
+			snprintf(&buffer[str_index], 3, "%02X", affinity_mask->__bits[mask_index]);
+			do_print = true;
+			str_index += 2;
+		}
+		/* mask_index in unsigned, so we cannot decrement it beyond 0 */
+		if (mask_index == 0)
+			break;
+		mask_index--;
+	}
+	buffer[str_index] = '\0';
+
+	return buffer;
+}
+
+char* affinity_mask_str(cpu_affinity_mask_t* affinity_mask)
+{
+	static char buffer[__MASK_SETSIZE + 1] = "";
+	return affinity_mask_str_r(affinity_mask, buffer, __MASK_SETSIZE + 1);
+}
+
+static int popcount64(uint64_t x)
+{
+#if defined(__GNUC__) || defined(__clang__)
+	return __builtin_popcountll(x);
+#else
+	x = x - ((x >> 1) & UINT64_C(0x5555555555555555));
+	x = (x & UINT64_C(0x3333333333333333)) + ((x >> 2) & UINT64_C(0x3333333333333333));
+	x = (x + (x >> 4)) & UINT64_C(0x0f0f0f0f0f0f0f0f);
+	return (int) ((x * UINT64_C(0x0101010101010101)) >> 56);
+#endif
+}
+
+static int ctz64(uint64_t x)
+{
+#if defined(__GNUC__) || defined(__clang__)
+	return __builtin_ctzll(x);
+#else
+	int n = 0;
+	while (!(x & 1)) {
+		x >>= 1;
+		n++;
+	}
+	return n;
+#endif
+}
+
+static uint32_t affinity_set_default_size(void)
+{
+	const int total_cpus = cpuid_get_total_cpus();
+	return (total_cpus > 0) ? (uint32_t) total_cpus : 1;
+}
+
+static bool is_valid_affinity_set(const struct cpu_affinity_set_t* set)
+{
+	return (set != NULL) && (set->version == CPU_AFFINITY_SET_VERSION) && ((set->words != NULL) || (set->num_cpus == 0));
+}
+
+int cpuid_affinity_set_init(struct cpu_affinity_set_t* set, uint32_t num_cpus)
+{
+	if (set == NULL)
+		return cpuid_set_error(ERR_HANDLE);
+	if (num_cpus == 0)
+		num_cpus = affinity_set_default_size();
+	if (num_cpus > (1UL << (sizeof(logical_cpu_t) * 8)))
+		return cpuid_set_error(ERR_INVRANGE);
+	set->version  = CPU_AFFINITY_SET_VERSION;
+	set->num_cpus = num_cpus;
+	set->words    = (num_cpus > 0) ? calloc(AFFINITY_SET_WORDS(num_cpus), sizeof(uint64_t)) : NULL;
+	if ((num_cpus > 0) && (set->words == NULL)) {
+		set->num_cpus = 0;
+		return cpuid_set_error(ERR_NO_MEM);
+	}
+	return cpuid_set_error(ERR_OK);
+}
+
+void cpuid_affinity_set_free(struct cpu_affinity_set_t* set)
+{
+	if (set == NULL)
+		return;
+	free(set->words);
+	set->words    = NULL;
+	set->num_cpus = 0;
+}
+
+int cpuid_affinity_set_add(struct cpu_affinity_set_t* set, logical_cpu_t logical_cpu)
+{
+	if (!is_valid_affinity_set(set))
+		return cpuid_set_error(ERR_HANDLE);
+	if (logical_cpu >= set->num_cpus)
+		return cpuid_set_error(ERR_INVRANGE);
+	set->words[logical_cpu / 64] |= UINT64_C(1) << (logical_cpu % 64);
+	return cpuid_set_error(ERR_OK);
+}
+
+bool cpuid_affinity_set_contains(const struct cpu_affinity_set_t* set, logical_cpu_t logical_cpu)
 {
-	logical_cpu_t mask_index = __MASK_SETSIZE - 1;
-	logical_cpu_t str_index = 0;
-	bool do_print = false;
+	if (!is_valid_affinity_set(set) || (logical_cpu >= set->num_cpus))
+		return false;
+	return (set->words[logical_cpu / 64] >> (logical_cpu % 64)) & 1;
+}
 
-	while (((uint32_t) str_index) + 1 < buffer_len) {
-		if (do_print || (mask_index < 4) || (affinity_mask->__bits[mask_index] != 0x00)) {
-			snprintf(&buffer[str_index], 3, "%02X", affinity_mask->__bits[mask_index]);
-			do_print = true;
-			str_index += 2;
-		}
-		/* mask_index in unsigned, so we cannot decrement it beyond 0 */
-		if (mask_index == 0)
-			break;
-		mask_index--;
+uint32_t cpuid_affinity_set_count(const struct cpu_affinity_set_t* set)
+{
+	uint32_t i, count = 0;
+
+	if (!is_valid_affinity_set(set))
+		return 0;
+	for (i = 0; i < AFFINITY_SET_WORDS(set->num_cpus); i++)
+		count += popcount64(set->words[i]);
+	return count;
+}
+
+int32_t cpuid_affinity_set_next(const struct cpu_affinity_set_t* set, int32_t logical_cpu)
+{
+	uint32_t i, start;
+	uint64_t word;
+
+	if (!is_valid_affinity_set(set) || (logical_cpu + 1 >= (int32_t) set->num_cpus))
+		return -1;
+	start = (logical_cpu < 0) ? 0 : (uint32_t) logical_cpu + 1;
+	/* Mask out the logical CPUs before start in the first word */
+	word = set->words[start / 64] & (~UINT64_C(0) << (start % 64));
+	for (i = start / 64; ; ) {
+		if (word != 0)
+			return (int32_t) (i * 64 + ctz64(word));
+		if (++i >= AFFINITY_SET_WORDS(set->num_cpus))
+			return -1;
+		word = set->words[i];
 	}
-	buffer[str_index] = '\0';
+}
 
-	return buffer;
+int cpuid_affinity_set_intersect(struct cpu_affinity_set_t* dest, const struct cpu_affinity_set_t* src)
+{
+	uint32_t i, num_common_words;
+
+	if (!is_valid_affinity_set(dest) || !is_valid_affinity_set(src))
+		return cpuid_set_error(ERR_HANDLE);
+	num_common_words = AFFINITY_SET_WORDS((dest->num_cpus < src->num_cpus) ? dest->num_cpus : src->num_cpus);
+	for (i = 0; i < num_common_words; i++)
+		dest->words[i] &= src->words[i];
+	for (; i < AFFINITY_SET_WORDS(dest->num_cpus); i++)
+		dest->words[i] = 0;
+	return cpuid_set_error(ERR_OK);
 }
 
-char* affinity_mask_str(cpu_affinity_mask_t* affinity_mask)
+int cpuid_affinity_set_from_mask(struct cpu_affinity_set_t* set, const cpu_affinity_mask_t* affinity_mask)
 {
-	static char buffer[__MASK_SETSIZE + 1] = "";
-	return affinity_mask_str_r(affinity_mask, buffer, __MASK_SETSIZE + 1);
+	int r;
+	uint32_t i, num_cpus;
+	uint32_t num_bytes = __MASK_SETSIZE;
+
+	if (affinity_mask == NULL)
+		return cpuid_set_error(ERR_HANDLE);
+	while ((num_bytes > 0) && (affinity_mask->__bits[num_bytes - 1] == 0x00))
+		num_bytes--;
+	num_cpus = affinity_set_default_size();
+	if (num_cpus < num_bytes * __MASK_NCPUBITS)
+		num_cpus = num_bytes * __MASK_NCPUBITS;
+	if ((r = cpuid_affinity_set_init(set, num_cpus)) != ERR_OK)
+		return r;
+	for (i = 0; i < num_bytes; i++)
+		set->words[i / 8] |= (uint64_t) affinity_mask->__bits[i] << ((i % 8) * 8);
+	return cpuid_set_error(ERR_OK);
+}
+
+int cpuid_affinity_set_to_mask(const struct cpu_affinity_set_t* set, cpu_affinity_mask_t* affinity_mask)
+{
+	uint32_t i;
+
+	if (!is_valid_affinity_set(set) || (affinity_mask == NULL))
+		return cpuid_set_error(ERR_HANDLE);
+	init_affinity_mask(affinity_mask);
+	/* cpuid_affinity_set_init() never makes a set larger than the mask */
+	for (i = 0; (i < AFFINITY_SET_WORDS(set->num_cpus) * 8) && (i < __MASK_SETSIZE); i++)
+		affinity_mask->__bits[i] = (uint8_t) (set->words[i / 8] >> ((i % 8) * 8));
+	return cpuid_set_error(ERR_OK);
 }
 
 const char* cpu_feature_str(cpu_feature_t feature)
@@ -2351,6 +5448,745 @@ const char* cpu_feature_str(cpu_feature_t feature)
 	return "";
 }
 
+void cpuid_get_feature_set(const struct cpu_id_t* id, struct cpu_feature_set_t* set)
+{
+	*set = id->features;
+}
+
+void cpuid_feature_set_clear(struct cpu_feature_set_t* set)
+{
+	memset(set->words, 0, sizeof(set->words));
+}
+
+void cpuid_feature_set_add(struct cpu_feature_set_t* set, cpu_feature_t feature)
+{
+	if ((feature >= 0) && (feature < NUM_CPU_FEATURES))
+		set->words[feature / 64] |= UINT64_C(1) << (feature % 64);
+}
+
+bool cpuid_feature_set_contains(const struct cpu_feature_set_t* set, cpu_feature_t feature)
+{
+	if ((feature < 0) || (feature >= NUM_CPU_FEATURES))
+		return false;
+	return (set->words[feature / 64] >> (feature % 64)) & 1;
+}
+
+void cpuid_feature_set_and(struct cpu_feature_set_t* dest, const struct cpu_feature_set_t* a, const struct cpu_feature_set_t* b)
+{
+	int i;
+	for (i = 0; i < CPU_FEATURE_SET_WORDS; i++)
+		dest->words[i] = a->words[i] & b->words[i];
+}
+
+void cpuid_feature_set_or(struct cpu_feature_set_t* dest, const struct cpu_feature_set_t* a, const struct cpu_feature_set_t* b)
+{
+	int i;
+	for (i = 0; i < CPU_FEATURE_SET_WORDS; i++)
+		dest->words[i] = a->words[i] | b->words[i];
+}
+
+void cpuid_feature_set_andnot(struct cpu_feature_set_t* dest, const struct cpu_feature_set_t* a, const struct cpu_feature_set_t* b)
+{
+	int i;
+	for (i = 0; i < CPU_FEATURE_SET_WORDS; i++)
+		dest->words[i] = a->words[i] & ~b->words[i];
+}
+
+bool cpuid_feature_set_is_subset(const struct cpu_feature_set_t* subset, const struct cpu_feature_set_t* set)
+{
+	int i;
+	uint64_t missing = 0;
+	for (i = 0; i < CPU_FEATURE_SET_WORDS; i++)
+		missing |= subset->words[i] & ~set->words[i];
+	return missing == 0;
+}
+
+int cpuid_feature_set_count(const struct cpu_feature_set_t* set)
+{
+	int i, count = 0;
+	for (i = 0; i < CPU_FEATURE_SET_WORDS; i++)
+		count += popcount64(set->words[i]);
+	return count;
+}
+
+int cpuid_feature_set_next(const struct cpu_feature_set_t* set, int feature)
+{
+	int i, start;
+	uint64_t word;
+
+	if (feature + 1 >= NUM_CPU_FEATURES)
+		return -1;
+	start = (feature < 0) ? 0 : feature + 1;
+	word  = set->words[start / 64] & (~UINT64_C(0) << (start % 64));
+	for (i = start / 64; ; ) {
+		if (word != 0)
+			return i * 64 + ctz64(word);
+		if (++i >= CPU_FEATURE_SET_WORDS)
+			return -1;
+		word = set->words[i];
+	}
+}
+
+/* What the fleet baseline needs to know about a host */
+struct baseline_host_t {
+	struct cpu_feature_set_t features;
+	cpu_architecture_t architecture;
+	cpu_feature_level_t feature_level;
+	int32_t l1_data_cache;
+	int32_t l1_instruction_cache;
+	int32_t l2_cache;
+	int32_t l3_cache;
+};
+
+static void baseline_host_from_id(const struct cpu_id_t* id, struct baseline_host_t* host)
+{
+	cpuid_get_feature_set(id, &host->features);
+	host->architecture         = id->architecture;
+	host->feature_level        = id->feature_level;
+	host->l1_data_cache        = id->l1_data_cache;
+	host->l1_instruction_cache = id->l1_instruction_cache;
+	host->l2_cache             = id->l2_cache;
+	host->l3_cache             = id->l3_cache;
+}
+
+/* Feature levels of different profiles never imply each other */
+typedef enum {
+	LEVEL_PROFILE_X86,
+	LEVEL_PROFILE_ARM,   /* ARMv1 to ARMv6, before the A/M/R split */
+	LEVEL_PROFILE_ARM_A,
+	LEVEL_PROFILE_ARM_M,
+	LEVEL_PROFILE_ARM_R,
+} feature_level_profile_t;
+
+struct feature_level_info_t {
+	cpu_feature_level_t level;
+	feature_level_profile_t profile;
+	/* highest levels implied by this one (FEATURE_LEVEL_UNKNOWN if none), the ones they imply are implied too */
+	cpu_feature_level_t implied[2];
+};
+
+static const struct feature_level_info_t feature_level_table[] = {
+	{ FEATURE_LEVEL_I386,        LEVEL_PROFILE_X86,   { FEATURE_LEVEL_UNKNOWN,     FEATURE_LEVEL_UNKNOWN } },
+	{ FEATURE_LEVEL_I486,        LEVEL_PROFILE_X86,   { FEATURE_LEVEL_I386,        FEATURE_LEVEL_UNKNOWN } },
+	{ FEATURE_LEVEL_I586,        LEVEL_PROFILE_X86,   { FEATURE_LEVEL_I486,        FEATURE_LEVEL_UNKNOWN } },
+	{ FEATURE_LEVEL_I686,        LEVEL_PROFILE_X86,   { FEATURE_LEVEL_I586,        FEATURE_LEVEL_UNKNOWN } },
+	{ FEATURE_LEVEL_X86_64_V1,   LEVEL_PROFILE_X86,   { FEATURE_LEVEL_I686,        FEATURE_LEVEL_UNKNOWN } },
+	{ FEATURE_LEVEL_X86_64_V2,   LEVEL_PROFILE_X86,   { FEATURE_LEVEL_X86_64_V1,   FEATURE_LEVEL_UNKNOWN } },
+	{ FEATURE_LEVEL_X86_64_V3,   LEVEL_PROFILE_X86,   { FEATURE_LEVEL_X86_64_V2,   FEATURE_LEVEL_UNKNOWN } },
+	{ FEATURE_LEVEL_X86_64_V4,   LEVEL_PROFILE_X86,   { FEATURE_LEVEL_X86_64_V3,   FEATURE_LEVEL_UNKNOWN } },
+	{ FEATURE_LEVEL_ARM_V1,      LEVEL_PROFILE_ARM,   { FEATURE_LEVEL_UNKNOWN,     FEATURE_LEVEL_UNKNOWN } },
+	{ FEATURE_LEVEL_ARM_V2,      LEVEL_PROFILE_ARM,   { FEATURE_LEVEL_ARM_V1,      FEATURE_LEVEL_UNKNOWN } },
+	{ FEATURE_LEVEL_ARM_V3,      LEVEL_PROFILE_ARM,   { FEATURE_LEVEL_ARM_V2,      FEATURE_LEVEL_UNKNOWN } },
+	{ FEATURE_LEVEL_ARM_V4,      LEVEL_PROFILE_ARM,   { FEATURE_LEVEL_ARM_V3,      FEATURE_LEVEL_UNKNOWN } },
+	{ FEATURE_LEVEL_ARM_V4T,     LEVEL_PROFILE_ARM,   { FEATURE_LEVEL_ARM_V4,      FEATURE_LEVEL_UNKNOWN } },
+	{ FEATURE_LEVEL_ARM_V5,      LEVEL_PROFILE_ARM,   { FEATURE_LEVEL_ARM_V4,      FEATURE_LEVEL_UNKNOWN } },
+	{ FEATURE_LEVEL_ARM_V5T,     LEVEL_PROFILE_ARM,   { FEATURE_LEVEL_ARM_V5,      FEATURE_LEVEL_ARM_V4T } },
+	{ FEATURE_LEVEL_ARM_V5TE,    LEVEL_PROFILE_ARM,   { FEATURE_LEVEL_ARM_V5T,     FEATURE_LEVEL_UNKNOWN } },
+	{ FEATURE_LEVEL_ARM_V5TEJ,   LEVEL_PROFILE_ARM,   { FEATURE_LEVEL_ARM_V5TE,    FEATURE_LEVEL_UNKNOWN } },
+	{ FEATURE_LEVEL_ARM_V6,      LEVEL_PROFILE_ARM,   { FEATURE_LEVEL_ARM_V5TEJ,   FEATURE_LEVEL_UNKNOWN } },
+	{ FEATURE_LEVEL_ARM_V6_M,    LEVEL_PROFILE_ARM_M, { FEATURE_LEVEL_UNKNOWN,     FEATURE_LEVEL_UNKNOWN } },
+	{ FEATURE_LEVEL_ARM_V7_A,    LEVEL_PROFILE_ARM_A, { FEATURE_LEVEL_UNKNOWN,     FEATURE_LEVEL_UNKNOWN } },
+	{ FEATURE_LEVEL_ARM_V7_M,    LEVEL_PROFILE_ARM_M, { FEATURE_LEVEL_ARM_V6_M,    FEATURE_LEVEL_UNKNOWN } },
+	{ FEATURE_LEVEL_ARM_V7_R,    LEVEL_PROFILE_ARM_R, { FEATURE_LEVEL_UNKNOWN,     FEATURE_LEVEL_UNKNOWN } },
+	{ FEATURE_LEVEL_ARM_V7E_M,   LEVEL_PROFILE_ARM_M, { FEATURE_LEVEL_ARM_V7_M,    FEATURE_LEVEL_UNKNOWN } },
+	{ FEATURE_LEVEL_ARM_V8_0_A,  LEVEL_PROFILE_ARM_A, { FEATURE_LEVEL_ARM_V7_A,    FEATURE_LEVEL_UNKNOWN } },
+	/* ARMv8.0-M covers the Baseline (an ARMv6-M successor) as well as the Mainline */
+	{ FEATURE_LEVEL_ARM_V8_0_M,  LEVEL_PROFILE_ARM_M, { FEATURE_LEVEL_ARM_V6_M,    FEATURE_LEVEL_UNKNOWN } },
+	{ FEATURE_LEVEL_ARM_V8_0_R,  LEVEL_PROFILE_ARM_R, { FEATURE_LEVEL_ARM_V7_R,    FEATURE_LEVEL_UNKNOWN } },
+	{ FEATURE_LEVEL_ARM_V8_1_A,  LEVEL_PROFILE_ARM_A, { FEATURE_LEVEL_ARM_V8_0_A,  FEATURE_LEVEL_UNKNOWN } },
+	{ FEATURE_LEVEL_ARM_V8_1_M,  LEVEL_PROFILE_ARM_M, { FEATURE_LEVEL_ARM_V8_0_M,  FEATURE_LEVEL_UNKNOWN } },
+	{ FEATURE_LEVEL_ARM_V8_2_A,  LEVEL_PROFILE_ARM_A, { FEATURE_LEVEL_ARM_V8_1_A,  FEATURE_LEVEL_UNKNOWN } },
+	{ FEATURE_LEVEL_ARM_V8_3_A,  LEVEL_PROFILE_ARM_A, { FEATURE_LEVEL_ARM_V8_2_A,  FEATURE_LEVEL_UNKNOWN } },
+	{ FEATURE_LEVEL_ARM_V8_4_A,  LEVEL_PROFILE_ARM_A, { FEATURE_LEVEL_ARM_V8_3_A,  FEATURE_LEVEL_UNKNOWN } },
+	{ FEATURE_LEVEL_ARM_V8_5_A,  LEVEL_PROFILE_ARM_A, { FEATURE_LEVEL_ARM_V8_4_A,  FEATURE_LEVEL_UNKNOWN } },
+	{ FEATURE_LEVEL_ARM_V8_6_A,  LEVEL_PROFILE_ARM_A, { FEATURE_LEVEL_ARM_V8_5_A,  FEATURE_LEVEL_UNKNOWN } },
+	{ FEATURE_LEVEL_ARM_V8_7_A,  LEVEL_PROFILE_ARM_A, { FEATURE_LEVEL_ARM_V8_6_A,  FEATURE_LEVEL_UNKNOWN } },
+	{ FEATURE_LEVEL_ARM_V8_8_A,  LEVEL_PROFILE_ARM_A, { FEATURE_LEVEL_ARM_V8_7_A,  FEATURE_LEVEL_UNKNOWN } },
+	{ FEATURE_LEVEL_ARM_V8_9_A,  LEVEL_PROFILE_ARM_A, { FEATURE_LEVEL_ARM_V8_8_A,  FEATURE_LEVEL_UNKNOWN } },
+	/* ARMv9.x-A is aligned with ARMv8.(x+5)-A, but ARMv8.x-A does not imply ARMv9.0-A */
+	{ FEATURE_LEVEL_ARM_V9_0_A,  LEVEL_PROFILE_ARM_A, { FEATURE_LEVEL_ARM_V8_5_A,  FEATURE_LEVEL_UNKNOWN } },
+	{ FEATURE_LEVEL_ARM_V9_1_A,  LEVEL_PROFILE_ARM_A, { FEATURE_LEVEL_ARM_V9_0_A,  FEATURE_LEVEL_ARM_V8_6_A } },
+	{ FEATURE_LEVEL_ARM_V9_2_A,  LEVEL_PROFILE_ARM_A, { FEATURE_LEVEL_ARM_V9_1_A,  FEATURE_LEVEL_ARM_V8_7_A } },
+	{ FEATURE_LEVEL_ARM_V9_3_A,  LEVEL_PROFILE_ARM_A, { FEATURE_LEVEL_ARM_V9_2_A,  FEATURE_LEVEL_ARM_V8_8_A } },
+	{ FEATURE_LEVEL_ARM_V9_4_A,  LEVEL_PROFILE_ARM_A, { FEATURE_LEVEL_ARM_V9_3_A,  FEATURE_LEVEL_ARM_V8_9_A } },
+	{ FEATURE_LEVEL_ARM_V9_5_A,  LEVEL_PROFILE_ARM_A, { FEATURE_LEVEL_ARM_V9_4_A,  FEATURE_LEVEL_UNKNOWN } },
+};
+
+static const struct feature_level_info_t* get_feature_level_info(cpu_feature_level_t level)
+{
+	unsigned i;
+
+	for (i = 0; i < COUNT_OF(feature_level_table); i++)
+		if (feature_level_table[i].level == level)
+			return &feature_level_table[i];
+	return NULL;
+}
+
+/* Checks if a CPU of level `a' has every feature of level `b' */
+static bool feature_level_implies(cpu_feature_level_t a, cpu_feature_level_t b)
+{
+	int i;
+	const struct feature_level_info_t* info;
+
+	if ((a == FEATURE_LEVEL_UNKNOWN) || (b == FEATURE_LEVEL_UNKNOWN))
+		return false;
+	if (a == b)
+		return true;
+	if ((info = get_feature_level_info(a)) == NULL)
+		return false;
+	for (i = 0; i < 2; i++)
+		if (feature_level_implies(info->implied[i], b))
+			return true;
+	return false;
+}
+
+/* Highest level implied by both `a' and `b', FEATURE_LEVEL_UNKNOWN if they have different profiles */
+static cpu_feature_level_t common_feature_level(cpu_feature_level_t a, cpu_feature_level_t b)
+{
+	unsigned i;
+	cpu_feature_level_t level, common = FEATURE_LEVEL_UNKNOWN;
+	const struct feature_level_info_t *info_a, *info_b;
+
+	info_a = get_feature_level_info(a);
+	info_b = get_feature_level_info(b);
+	if ((info_a == NULL) || (info_b == NULL) || (info_a->profile != info_b->profile))
+		return FEATURE_LEVEL_UNKNOWN;
+	if (feature_level_implies(a, b))
+		return b;
+	if (feature_level_implies(b, a))
+		return a;
+	for (i = 0; i < COUNT_OF(feature_level_table); i++) {
+		level = feature_level_table[i].level;
+		if (feature_level_implies(a, level) && feature_level_implies(b, level) && ((common == FEATURE_LEVEL_UNKNOWN) || feature_level_implies(level, common)))
+			common = level;
+	}
+	return common;
+}
+
+static int32_t min_cache_size(int32_t a, int32_t b)
+{
+	return (a < b) ? a : b;
+}
+
+/* Host i of the fleet is hosts[host_map[i]], or hosts[i] when host_map is NULL */
+static int compute_baseline(const struct baseline_host_t* hosts, const int32_t* host_map, int count, struct cpu_baseline_t* baseline)
+{
+	int i, j, f;
+	int32_t total, cursor[CPU_FLAGS_MAX];
+	uint64_t lacking;
+	struct cpu_feature_set_t any;
+	const struct baseline_host_t* host;
+
+	memset(baseline, 0, sizeof(struct cpu_baseline_t));
+	memset(&any, 0, sizeof(struct cpu_feature_set_t));
+	memset(&baseline->features, 0xff, sizeof(struct cpu_feature_set_t));
+	host                           = &hosts[host_map ? host_map[0] : 0];
+	baseline->num_hosts            = count;
+	baseline->architecture         = host->architecture;
+	baseline->feature_level        = host->feature_level;
+	baseline->l1_data_cache        = host->l1_data_cache;
+	baseline->l1_instruction_cache = host->l1_instruction_cache;
+	baseline->l2_cache             = host->l2_cache;
+	baseline->l3_cache             = host->l3_cache;
+
+	/* First pass: common values */
+	for (i = 0; i < count; i++) {
+		host = &hosts[host_map ? host_map[i] : i];
+		cpuid_feature_set_and(&baseline->features, &baseline->features, &host->features);
+		cpuid_feature_set_or(&any, &any, &host->features);
+		if (host->architecture != baseline->architecture)
+			baseline->architecture = ARCHITECTURE_UNKNOWN;
+		baseline->feature_level        = common_feature_level(baseline->feature_level, host->feature_level);
+		baseline->l1_data_cache        = min_cache_size(baseline->l1_data_cache,        host->l1_data_cache);
+		baseline->l1_instruction_cache = min_cache_size(baseline->l1_instruction_cache, host->l1_instruction_cache);
+		baseline->l2_cache             = min_cache_size(baseline->l2_cache,             host->l2_cache);
+		baseline->l3_cache             = min_cache_size(baseline->l3_cache,             host->l3_cache);
+	}
+	cpuid_feature_set_andnot(&baseline->missing_features, &any, &baseline->features);
+	if (cpuid_feature_set_count(&baseline->missing_features) == 0)
+		return cpuid_set_error(ERR_OK);
+
+	/* Second pass: count the hosts lacking each missing feature */
+	for (i = 0; i < count; i++) {
+		host = &hosts[host_map ? host_map[i] : i];
+		for (j = 0; j < CPU_FEATURE_SET_WORDS; j++)
+			for (lacking = baseline->missing_features.words[j] & ~host->features.words[j]; lacking != 0; lacking &= lacking - 1)
+				baseline->num_lacking_hosts[j * 64 + ctz64(lacking)]++;
+	}
+	for (f = 0, total = 0; f < CPU_FLAGS_MAX; f++) {
+		baseline->lacking_hosts_start[f] = cursor[f] = total;
+		total += baseline->num_lacking_hosts[f];
+	}
+	baseline->lacking_hosts = malloc(sizeof(int32_t) * total);
+	if (baseline->lacking_hosts == NULL) /* Memory allocation failure */
+		return cpuid_set_error(ERR_NO_MEM);
+
+	/* Third pass: list them */
+	for (i = 0; i < count; i++) {
+		host = &hosts[host_map ? host_map[i] : i];
+		for (j = 0; j < CPU_FEATURE_SET_WORDS; j++)
+			for (lacking = baseline->missing_features.words[j] & ~host->features.words[j]; lacking != 0; lacking &= lacking - 1)
+				baseline->lacking_hosts[cursor[j * 64 + ctz64(lacking)]++] = i;
+	}
+	debugf(2, "Baseline of %i hosts: %s, %i features, %i missing features\n", count,
+		cpu_feature_level_str(baseline->feature_level), cpuid_feature_set_count(&baseline->features),
+		cpuid_feature_set_count(&baseline->missing_features));
+	return cpuid_set_error(ERR_OK);
+}
+
+int cpuid_compute_baseline(const struct cpu_id_t* ids, int count, struct cpu_baseline_t* baseline)
+{
+	int i, r;
+	struct baseline_host_t* hosts;
+
+	if ((ids == NULL) || (baseline == NULL))
+		return cpuid_set_error(ERR_HANDLE);
+	if (count <= 0)
+		return cpuid_set_error(ERR_INVRANGE);
+
+	hosts = malloc(sizeof(struct baseline_host_t) * count);
+	if (hosts == NULL) /* Memory allocation failure */
+		return cpuid_set_error(ERR_NO_MEM);
+	for (i = 0; i < count; i++)
+		baseline_host_from_id(&ids[i], &hosts[i]);
+	r = compute_baseline(hosts, NULL, count, baseline);
+	free(hosts);
+	return r;
+}
+
+/* FNV-1a over the 32-bit words of the raw data */
+static uint32_t raw_data_hash(const struct cpu_raw_data_t* raw)
+{
+	uint32_t word, hash = UINT32_C(2166136261);
+
+	for (word = 0; word < RAW_DATA_WORDS; word++)
+		hash = (hash ^ cpuid_get_raw_data_word(raw, word)) * UINT32_C(16777619);
+	return hash;
+}
+
+int cpuid_compute_baseline_raw(struct cpu_raw_data_t* raws, int count, struct cpu_baseline_t* baseline)
+{
+	int i, r = ERR_OK;
+	int32_t d, num_distinct = 0;
+	uint32_t hash, slot, capacity;
+	int32_t *host_map = NULL, *htable = NULL, *representative = NULL;
+	uint32_t* hashes = NULL;
+	struct baseline_host_t* hosts = NULL;
+	struct cpu_id_t id;
+
+	if ((raws == NULL) || (baseline == NULL))
+		return cpuid_set_error(ERR_HANDLE);
+	if (count <= 0)
+		return cpuid_set_error(ERR_INVRANGE);
+
+	/* Open addressing table of distinct raw data, kept at most half full */
+	for (capacity = 16; capacity < (uint32_t) count * 2; capacity *= 2);
+	host_map = malloc(sizeof(int32_t) * count);
+	htable   = malloc(sizeof(int32_t) * capacity);
+	if ((host_map == NULL) || (htable == NULL)) { /* Memory allocation failure */
+		r = cpuid_set_error(ERR_NO_MEM);
+		goto cleanup;
+	}
+	memset(htable, 0xff, sizeof(int32_t) * capacity);
+
+	for (i = 0; i < count; i++) {
+		hash = raw_data_hash(&raws[i]);
+		for (slot = hash & (capacity - 1); (d = htable[slot]) >= 0; slot = (slot + 1) & (capacity - 1))
+			if ((hashes[d] == hash) && !memcmp(&raws[representative[d]], &raws[i], sizeof(struct cpu_raw_data_t)))
+				break;
+		if (d < 0) {
+			if (!cpuid_reserve_item((void**) &hosts,          num_distinct, sizeof(struct baseline_host_t)) ||
+			    !cpuid_reserve_item((void**) &hashes,         num_distinct, sizeof(uint32_t)) ||
+			    !cpuid_reserve_item((void**) &representative, num_distinct, sizeof(int32_t))) {
+				r = cpuid_set_error(ERR_NO_MEM);
+				goto cleanup;
+			}
+			r = cpu_identify(&raws[i], &id);
+			if (r != ERR_OK)
+				goto cleanup;
+			d = htable[slot]      = num_distinct++;
+			hashes[d]             = hash;
+			representative[d]     = i;
+			baseline_host_from_id(&id, &hosts[d]);
+		}
+		host_map[i] = d;
+	}
+	debugf(2, "Baseline: %i hosts, %i distinct raw data\n", count, num_distinct);
+	r = compute_baseline(hosts, host_map, count, baseline);
+
+cleanup:
+	free(host_map);
+	free(htable);
+	free(representative);
+	free(hashes);
+	free(hosts);
+	return r;
+}
+
+void cpuid_free_baseline(struct cpu_baseline_t* baseline)
+{
+	if (baseline == NULL)
+		return;
+	free(baseline->lacking_hosts);
+	baseline->lacking_hosts = NULL;
+}
+
+uint64_t cpuid_get_xcr0(void)
+{
+	uint32_t regs[NUM_REGS];
+
+	if (!cpuid_present())
+		return 0;
+	cpu_exec_cpuid(0, regs);
+	if (regs[EAX] < 1)
+		return 0;
+	cpu_exec_cpuid(1, regs);
+	if (!EXTRACTS_BIT(regs[ECX], 27)) /* OSXSAVE: XGETBV is not enabled */
+		return 0;
+	return exec_xgetbv(0);
+}
+
+/* x86: the register state of the AVX and AVX-512 instructions must also be enabled by the OS in XCR0,
+ * else they raise #UD (SIGILL). No state can be enabled without OSXSAVE */
+#define XCR0_AVX_STATE    0x06 /* SSE, YMM_Hi128 */
+#define XCR0_AVX512_STATE 0xe6 /* SSE, YMM_Hi128, opmask, ZMM_Hi256, Hi16_ZMM */
+
+static const cpu_feature_t avx_state_features[] = {
+	CPU_FEATURE_AVX, CPU_FEATURE_XOP, CPU_FEATURE_FMA3, CPU_FEATURE_FMA4, CPU_FEATURE_F16C, CPU_FEATURE_AVX2,
+};
+static const cpu_feature_t avx512_state_features[] = {
+	CPU_FEATURE_AVX512F, CPU_FEATURE_AVX512DQ, CPU_FEATURE_AVX512PF, CPU_FEATURE_AVX512ER, CPU_FEATURE_AVX512CD,
+	CPU_FEATURE_AVX512BW, CPU_FEATURE_AVX512VL, CPU_FEATURE_AVX512VNNI, CPU_FEATURE_AVX512VBMI, CPU_FEATURE_AVX512VBMI2,
+};
+
+static void dispatch_get_usable(const struct cpu_id_t* id, uint64_t xcr0, cpu_feature_level_t* level, struct cpu_feature_set_t* features)
+{
+	int i;
+	bool avx_state, avx512_state;
+	struct cpu_feature_set_t disabled;
+
+	*level = id->feature_level;
+	cpuid_get_feature_set(id, features);
+	if (id->architecture != ARCHITECTURE_X86)
+		return;
+
+	if (!id->flags[CPU_FEATURE_OSXSAVE])
+		xcr0 = 0;
+	avx_state    = ((xcr0 & XCR0_AVX_STATE)    == XCR0_AVX_STATE);
+	avx512_state = ((xcr0 & XCR0_AVX512_STATE) == XCR0_AVX512_STATE);
+	cpuid_feature_set_clear(&disabled);
+	for (i = 0; !avx_state && (i < (int) COUNT_OF(avx_state_features)); i++)
+		cpuid_feature_set_add(&disabled, avx_state_features[i]);
+	for (i = 0; !avx512_state && (i < (int) COUNT_OF(avx512_state_features)); i++)
+		cpuid_feature_set_add(&disabled, avx512_state_features[i]);
+	cpuid_feature_set_andnot(features, features, &disabled);
+	if (!avx_state && feature_level_implies(*level, FEATURE_LEVEL_X86_64_V3))
+		*level = FEATURE_LEVEL_X86_64_V2;
+	else if (!avx512_state && feature_level_implies(*level, FEATURE_LEVEL_X86_64_V4))
+		*level = FEATURE_LEVEL_X86_64_V3;
+	debugf(3, "Dispatch: XCR0 is %016" PRIx64 ", AVX state %s, AVX-512 state %s\n", xcr0,
+		avx_state ? "enabled" : "disabled", avx512_state ? "enabled" : "disabled");
+}
+
+/* The current CPU is identified once, by get_cached_cpuid() */
+static void dispatch_get_host(cpu_feature_level_t* level, struct cpu_feature_set_t* features)
+{
+	const struct cpu_id_t* id = get_cached_cpuid();
+
+	dispatch_get_usable(id, (id->architecture == ARCHITECTURE_X86) ? cpuid_get_xcr0() : 0, level, features);
+}
+
+static bool dispatch_impl_supported(const struct cpu_dispatch_impl_t* impl, cpu_feature_level_t level, const struct cpu_feature_set_t* features)
+{
+	int i;
+
+	if ((impl->feature_level != FEATURE_LEVEL_UNKNOWN) && !feature_level_implies(level, impl->feature_level))
+		return false;
+	for (i = 0; (impl->features != NULL) && (impl->features[i] != NUM_CPU_FEATURES); i++)
+		if (!cpuid_feature_set_contains(features, impl->features[i]))
+			return false;
+	return true;
+}
+
+bool cpuid_dispatch_supported(const struct cpu_dispatch_impl_t* impl)
+{
+	cpu_feature_level_t level;
+	struct cpu_feature_set_t features;
+
+	if (impl == NULL)
+		return false;
+	dispatch_get_host(&level, &features);
+	return dispatch_impl_supported(impl, level, &features);
+}
+
+bool cpuid_dispatch_supported_by(const struct cpu_dispatch_impl_t* impl, const struct cpu_id_t* id, uint64_t xcr0)
+{
+	cpu_feature_level_t level;
+	struct cpu_feature_set_t features;
+
+	if ((impl == NULL) || (id == NULL))
+		return false;
+	dispatch_get_usable(id, xcr0, &level, &features);
+	return dispatch_impl_supported(impl, level, &features);
+}
+
+cpu_dispatch_fn_t cpuid_dispatch_resolve(struct cpu_dispatch_t* dispatch)
+{
+	int i;
+	cpu_dispatch_fn_t fn;
+	cpu_feature_level_t level;
+	struct cpu_feature_set_t features;
+
+	if (dispatch == NULL) {
+		cpuid_set_error(ERR_HANDLE);
+		return NULL;
+	}
+
+	/* Fast path: fn is written before resolved is set */
+	if (cpuid_atomic_load(&dispatch->resolved)) {
+		fn = dispatch->fn;
+		cpuid_set_error((fn != NULL) ? ERR_OK : ERR_NOT_FOUND);
+		return fn;
+	}
+
+	dispatch_get_host(&level, &features);
+	cpuid_lock();
+	if (!dispatch->resolved) {
+		dispatch->selected = -1;
+		for (i = 0; i < dispatch->num_impls; i++) {
+			if (dispatch_impl_supported(&dispatch->impls[i], level, &features)) {
+				dispatch->selected = i;
+				break;
+			}
+		}
+		dispatch->fn = (dispatch->selected >= 0) ? dispatch->impls[dispatch->selected].fn : NULL;
+		cpuid_atomic_store(&dispatch->resolved, 1);
+		debugf(2, "Dispatch: selected implementation %i of %i (%s)\n", dispatch->selected, dispatch->num_impls,
+			((dispatch->selected >= 0) && (dispatch->impls[dispatch->selected].name != NULL)) ? dispatch->impls[dispatch->selected].name : "none");
+	}
+	fn = dispatch->fn;
+	cpuid_unlock();
+
+	cpuid_set_error((fn != NULL) ? ERR_OK : ERR_NOT_FOUND);
+	return fn;
+}
+
+static void cache_geometry_init(struct cpu_cache_geometry_t* geometry, int32_t size, int32_t assoc, int32_t linesize, int32_t instances)
+{
+	geometry->size      = size;
+	geometry->assoc     = assoc;
+	geometry->linesize  = linesize;
+	geometry->instances = instances;
+}
+
+/* Packages with the same purpose have the same caches, only the instances add up */
+static void cache_geometry_merge(struct cpu_cache_geometry_t* geometry, int32_t instances)
+{
+	if ((geometry->instances >= 0) && (instances >= 0))
+		geometry->instances += instances;
+	else
+		geometry->instances = -1;
+}
+
+int cpuid_get_core_types(const struct system_id_t* system, struct cpu_core_types_t* core_types)
+{
+	int r;
+	int i, j;
+	uint32_t k, num_cpus;
+	struct cpu_feature_set_t features;
+	const struct cpu_id_t* id;
+	struct cpu_core_type_t* type;
+
+	if ((system == NULL) || (core_types == NULL))
+		return cpuid_set_error(ERR_HANDLE);
+	memset(core_types, 0, sizeof(struct cpu_core_types_t));
+	if (system->num_cpu_types == 0)
+		return cpuid_set_error(ERR_NOT_FOUND);
+	core_types->types = calloc(system->num_cpu_types, sizeof(struct cpu_core_type_t));
+	if (core_types->types == NULL) /* Memory allocation failure */
+		return cpuid_set_error(ERR_NO_MEM);
+
+	for (i = 0; i < system->num_cpu_types; i++) {
+		id = &system->cpu_types[i];
+		cpuid_get_feature_set(id, &features);
+		for (j = 0; (j < core_types->num_types) && (core_types->types[j].purpose != id->purpose); j++);
+		type = &core_types->types[j];
+		if (j < core_types->num_types) {
+			type->num_cores        += id->num_cores;
+			type->num_logical_cpus += id->num_logical_cpus;
+			cpuid_feature_set_and(&type->features, &type->features, &features);
+			type->feature_level = common_feature_level(type->feature_level, id->feature_level);
+			cache_geometry_merge(&type->l1_data,        id->l1_data_instances);
+			cache_geometry_merge(&type->l1_instruction, id->l1_instruction_instances);
+			cache_geometry_merge(&type->l2,             id->l2_instances);
+			cache_geometry_merge(&type->l3,             id->l3_instances);
+			cache_geometry_merge(&type->l4,             id->l4_instances);
+			continue;
+		}
+		core_types->num_types++;
+		type->purpose          = id->purpose;
+		type->num_cores        = id->num_cores;
+		type->num_logical_cpus = id->num_logical_cpus;
+		type->features         = features;
+		type->feature_level    = id->feature_level;
+		cache_geometry_init(&type->l1_data,        id->l1_data_cache,        id->l1_data_assoc,        id->l1_data_cacheline,        id->l1_data_instances);
+		cache_geometry_init(&type->l1_instruction, id->l1_instruction_cache, id->l1_instruction_assoc, id->l1_instruction_cacheline, id->l1_instruction_instances);
+		cache_geometry_init(&type->l2,             id->l2_cache,             id->l2_assoc,             id->l2_cacheline,             id->l2_instances);
+		cache_geometry_init(&type->l3,             id->l3_cache,             id->l3_assoc,             id->l3_cacheline,             id->l3_instances);
+		cache_geometry_init(&type->l4,             id->l4_cache,             id->l4_assoc,             id->l4_cacheline,             id->l4_instances);
+	}
+
+	for (j = 0; j < core_types->num_types; j++) {
+		type = &core_types->types[j];
+		/* Logical CPUs of all the packages with this purpose */
+		num_cpus = 0;
+		for (i = 0; i < system->num_cpu_types; i++)
+			if ((system->cpu_types[i].purpose == type->purpose) && (system->cpu_types[i].affinity.num_cpus > num_cpus))
+				num_cpus = system->cpu_types[i].affinity.num_cpus;
+		if ((r = cpuid_affinity_set_init(&type->affinity, num_cpus)) != ERR_OK) {
+			cpuid_free_core_types(core_types);
+			return r;
+		}
+		for (i = 0; i < system->num_cpu_types; i++)
+			if (system->cpu_types[i].purpose == type->purpose)
+				for (k = 0; k < AFFINITY_SET_WORDS(system->cpu_types[i].affinity.num_cpus); k++)
+					type->affinity.words[k] |= system->cpu_types[i].affinity.words[k];
+		if (j == 0) {
+			core_types->common_features      = type->features;
+			core_types->common_feature_level = type->feature_level;
+		}
+		else {
+			cpuid_feature_set_and(&core_types->common_features, &core_types->common_features, &type->features);
+			core_types->common_feature_level = common_feature_level(core_types->common_feature_level, type->feature_level);
+		}
+		debugf(2, "Core type %s: %i logical CPUs, %i features\n", cpu_purpose_str(type->purpose),
+			type->num_logical_cpus, cpuid_feature_set_count(&type->features));
+	}
+	return cpuid_set_error(ERR_OK);
+}
+
+const struct cpu_core_type_t* cpuid_find_core_type(const struct cpu_core_types_t* core_types, cpu_purpose_t purpose)
+{
+	int32_t i;
+
+	if ((core_types == NULL) || (core_types->types == NULL))
+		return NULL;
+	for (i = 0; i < core_types->num_types; i++)
+		if (core_types->types[i].purpose == purpose)
+			return &core_types->types[i];
+	return NULL;
+}
+
+void cpuid_free_core_types(struct cpu_core_types_t* core_types)
+{
+	int32_t i;
+
+	if ((core_types == NULL) || (core_types->types == NULL))
+		return;
+	for (i = 0; i < core_types->num_types; i++)
+		cpuid_affinity_set_free(&core_types->types[i].affinity);
+	free(core_types->types);
+	core_types->types     = NULL;
+	core_types->num_types = 0;
+}
+
+static void cache_geometry_of_level(const struct cpu_id_t* id, cpu_cache_level_t level, int32_t instances, struct cpu_cache_geometry_t* geometry)
+{
+	switch (level) {
+		case CACHE_L1_INSTRUCTION: cache_geometry_init(geometry, id->l1_instruction_cache, id->l1_instruction_assoc, id->l1_instruction_cacheline, instances); break;
+		case CACHE_L1_DATA:        cache_geometry_init(geometry, id->l1_data_cache,        id->l1_data_assoc,        id->l1_data_cacheline,        instances); break;
+		case CACHE_L2:             cache_geometry_init(geometry, id->l2_cache,             id->l2_assoc,             id->l2_cacheline,             instances); break;
+		case CACHE_L3:             cache_geometry_init(geometry, id->l3_cache,             id->l3_assoc,             id->l3_cacheline,             instances); break;
+		case CACHE_L4:             cache_geometry_init(geometry, id->l4_cache,             id->l4_assoc,             id->l4_cacheline,             instances); break;
+		default:                   cache_geometry_init(geometry, -1, -1, -1, instances); break;
+	}
+}
+
+int cpuid_get_cache_map(const struct system_id_t* system, const struct cpu_topology_t* topology, struct cpu_cache_map_t* map)
+{
+	int r;
+	int32_t i, j, pos, type, count[NUM_CACHE_LEVELS + 1];
+	logical_cpu_t logical_cpu;
+	const struct cpu_topology_cache_t* cache;
+	struct cpu_cache_instance_t* instance;
+
+	if ((system == NULL) || (topology == NULL) || (map == NULL))
+		return cpuid_set_error(ERR_HANDLE);
+	memset(map, 0, sizeof(struct cpu_cache_map_t));
+	if ((topology->num_cpus == 0) || (topology->num_caches == 0))
+		return cpuid_set_error(ERR_NOT_FOUND);
+	if (((map->caches     = calloc(topology->num_caches, sizeof(struct cpu_cache_instance_t))) == NULL) ||
+	    ((map->cpu_caches = malloc(sizeof(int32_t) * topology->num_cpus * NUM_CACHE_LEVELS)) == NULL)) {
+		cpuid_free_cache_map(map);
+		return cpuid_set_error(ERR_NO_MEM);
+	}
+	map->num_caches = topology->num_caches;
+	map->num_cpus   = topology->num_cpus;
+	for (i = 0; i < topology->num_cpus * NUM_CACHE_LEVELS; i++)
+		map->cpu_caches[i] = -1;
+
+	/* The topology groups the caches by node: sort them by level, with a counting sort */
+	memset(count, 0, sizeof(count));
+	for (i = 0; i < topology->num_caches; i++)
+		count[topology->caches[i].level + 1]++;
+	for (j = 0; j < NUM_CACHE_LEVELS; j++) {
+		map->first_cache[j]      = count[j];
+		map->num_level_caches[j] = count[j + 1];
+		count[j + 1]            += count[j];
+	}
+
+	for (i = 0; i < topology->num_caches; i++) {
+		cache    = &topology->caches[i];
+		j        = count[cache->level]++;
+		instance = &map->caches[j];
+		instance->level     = cache->level;
+		instance->id        = cache->id;
+		instance->numa_node = cache->numa_node;
+		if ((r = cpuid_affinity_set_init(&instance->affinity, topology->num_cpus)) != ERR_OK) {
+			cpuid_free_cache_map(map);
+			return r;
+		}
+		for (pos = cache->first_cpu; pos < cache->first_cpu + cache->num_cpus; pos++) {
+			logical_cpu = topology->logical_cpus[pos];
+			cpuid_affinity_set_add(&instance->affinity, logical_cpu);
+			map->cpu_caches[logical_cpu * NUM_CACHE_LEVELS + cache->level] = j;
+		}
+
+		/* Geometry of the CPU type of the logical CPUs sharing the cache */
+		logical_cpu = topology->logical_cpus[cache->first_cpu];
+		for (type = 0; (type < system->num_cpu_types) && !cpuid_affinity_set_contains(&system->cpu_types[type].affinity, logical_cpu); type++);
+		instance->cpu_type = (type < system->num_cpu_types) ? type : -1;
+		if (instance->cpu_type >= 0)
+			cache_geometry_of_level(&system->cpu_types[type], cache->level, map->num_level_caches[cache->level], &instance->geometry);
+		else
+			cache_geometry_init(&instance->geometry, -1, -1, -1, map->num_level_caches[cache->level]);
+	}
+	return cpuid_set_error(ERR_OK);
+}
+
+const struct cpu_cache_instance_t* cpuid_get_cpu_cache(const struct cpu_cache_map_t* map, logical_cpu_t logical_cpu, cpu_cache_level_t level)
+{
+	int32_t i;
+
+	if ((map == NULL) || (logical_cpu >= (logical_cpu_t) map->num_cpus) || ((int) level < 0) || ((int) level >= NUM_CACHE_LEVELS))
+		return NULL;
+	i = map->cpu_caches[logical_cpu * NUM_CACHE_LEVELS + level];
+	return (i >= 0) ? &map->caches[i] : NULL;
+}
+
+void cpuid_free_cache_map(struct cpu_cache_map_t* map)
+{
+	int32_t i;
+
+	if (map == NULL)
+		return;
+	for (i = 0; (map->caches != NULL) && (i < map->num_caches); i++)
+		cpuid_affinity_set_free(&map->caches[i].affinity);
+	free(map->caches);
+	free(map->cpu_caches);
+	memset(map, 0, sizeof(struct cpu_cache_map_t));
+}
+
 const char* cpuid_error(void)
 {
 	const struct { cpu_error_t error; const char *description; }
@@ -2375,6 +6211,7 @@ const char* cpuid_error(void)
 		{ ERR_NOT_FOUND, "Requested type not found"},
 		{ ERR_IOCTL,     "Error on ioctl"},
 		{ ERR_REQUEST,   "Invalid request"},
+		{ ERR_STALE,     "Published data is stale"},
 	};
 	unsigned i;
 	for (i = 0; i < COUNT_OF(matchtable); i++)
@@ -2556,12 +6393,31 @@ void cpuid_free_raw_data_array(struct cpu_raw_data_array_t* raw_array)
 {
 	if (raw_array->num_raw <= 0) return;
 	free(raw_array->raw);
-	raw_array->num_raw = 0;
+	raw_array->num_raw  = 0;
+	raw_array->raw      = NULL;
+	raw_array->capacity = 0;
+}
+
+void cpuid_free_raw_data_compact(struct cpu_raw_data_compact_t* compact)
+{
+	free(compact->bases);
+	free(compact->cpus);
+	free(compact->deltas);
+	cpu_raw_data_compact_t_constructor(compact);
 }
 
 void cpuid_free_system_id(struct system_id_t* system)
 {
+	uint8_t i;
 	if (system->num_cpu_types <= 0) return;
+	for (i = 0; i < system->num_cpu_types; i++)
+		cpuid_affinity_set_free(&system->cpu_types[i].affinity);
 	free(system->cpu_types);
+	cpuid_free_cache_map(system->cache_map);
+	free(system->cache_map);
+	cpuid_free_topology(system->topology);
+	free(system->topology);
+	system->cache_map = NULL;
+	system->topology  = NULL;
 	system->num_cpu_types = 0;
 }
@@ -121,6 +121,12 @@
 /* Include C99 booleans: */
 #include <stdbool.h>
 
+/* Include size_t (not when the Python bindings preprocess this header:
+ * CFFI knows size_t and cannot parse the GNU attributes of stddef.h) */
+#ifndef LIBCPUID_CFFI
+#  include <stddef.h>
+#endif
+
 /* Include some integer type specifications: */
 #include "libcpuid_types.h"
 
@@ -394,6 +400,18 @@ struct cpu_raw_data_t {
 	/** when then CPU is ARM-based and supports ID_AA64ZFR*
 	 * (SVE Feature ID register) */
 	uint64_t arm_id_aa64zfr[MAX_ARM_ID_AA64ZFR_REGS];
+
+	/** bitmask of the x86 leaf groups (\ref cpu_raw_group_t) which were
+	 *  queried by \ref cpuid_get_raw_data_groups. The leaves of the other
+	 *  groups are zeroed and not decoded by \ref cpu_identify.
+	 *  Zero means that all the groups are valid (e.g. for data which was
+	 *  filled by the caller). */
+	uint32_t valid_groups;
+
+	/** when the CPU is intel and it supports leaf 1Fh (V2 Extended Topology
+	 *  enumeration leaf), this stores the result of CPUID with
+	 *  eax = 0x1F and ecx = 0, 1, 2... */
+	uint32_t intel_fn1fh[MAX_INTELFN1FH_LEVEL][NUM_REGS];
 };
 
 /**
@@ -417,6 +435,68 @@ struct cpu_raw_data_array_t {
 
 	/** array of raw CPUID data */
 	struct cpu_raw_data_t* raw;
+
+	/** number of items allocated in \ref raw, managed by the library */
+	int32_t capacity;
+};
+
+/**
+ * @brief A 32-bit word of a logical CPU, which differs from its base record.
+ * @see cpu_raw_data_compact_t
+ */
+struct cpu_raw_data_delta_t {
+	/** index of the word, if struct cpu_raw_data_t is seen as an array of uint32_t */
+	uint32_t word;
+
+	/** value of the word for this logical CPU */
+	uint32_t value;
+};
+
+/**
+ * @brief Describes a logical CPU in a \ref cpu_raw_data_compact_t.
+ */
+struct cpu_raw_data_compact_cpu_t {
+	/** index of the base record in \ref cpu_raw_data_compact_t::bases */
+	uint16_t base;
+
+	/** number of words which differ from the base record */
+	uint16_t num_deltas;
+
+	/** index of the first delta in \ref cpu_raw_data_compact_t::deltas */
+	uint32_t first_delta;
+};
+
+/**
+ * @brief Contains an array of raw CPUID data, stored without duplication.
+ *
+ * Most of the leaves are identical for all logical CPUs of the same core type.
+ * Here, one base record is kept per core type, and each logical CPU only stores
+ * the words which differ from its base (APIC IDs, topology leaves, ...).
+ * Use \ref cpuid_compact_raw_data_array to build it, and
+ * \ref cpuid_get_compact_raw_data or \ref cpuid_expand_raw_data_compact
+ * to get back the regular records.
+ */
+struct cpu_raw_data_compact_t {
+	/** same as \ref cpu_raw_data_array_t::with_affinity */
+	bool with_affinity;
+
+	/** number of logical CPUs (\ref cpus length) */
+	logical_cpu_t num_raw;
+
+	/** \ref bases length */
+	uint16_t num_bases;
+
+	/** \ref deltas length */
+	uint32_t num_deltas;
+
+	/** one record per core type */
+	struct cpu_raw_data_t* bases;
+
+	/** one item per logical CPU */
+	struct cpu_raw_data_compact_cpu_t* cpus;
+
+	/** words which differ from the base records, grouped by logical CPU */
+	struct cpu_raw_data_delta_t* deltas;
 };
 
 /**
@@ -533,6 +613,42 @@ struct arm_id_t {
 	uint8_t revision;
 };
 
+/** Layout version of struct cpu_affinity_set_t */
+#define CPU_AFFINITY_SET_VERSION 1
+
+/**
+ * @brief CPU affinity mask sized to the actual number of logical CPUs
+ *
+ * Unlike cpu_affinity_mask_t, which always holds 65536 bits, the bits are
+ * allocated by \ref cpuid_affinity_set_init, 64 logical CPUs per word.
+ * Use the cpuid_affinity_set_* functions to handle it.
+ */
+struct cpu_affinity_set_t {
+	/** layout version, set to \ref CPU_AFFINITY_SET_VERSION by \ref cpuid_affinity_set_init */
+	uint32_t version;
+
+	/** number of logical CPUs the set can hold */
+	uint32_t num_cpus;
+
+	/** bits of the set, (num_cpus + 63) / 64 words */
+	uint64_t* words;
+};
+
+/** Number of 64-bit words in struct cpu_feature_set_t */
+#define CPU_FEATURE_SET_WORDS (CPU_FLAGS_MAX / 64)
+
+/**
+ * @brief Packed set of CPU features, one bit per \ref cpu_feature_t
+ *
+ * It holds the same information as \ref cpu_id_t::flags in 48 bytes, so that
+ * many records can be compared with a few word-wide operations. The
+ * identification fills both, see \ref cpu_id_t::features.
+ */
+struct cpu_feature_set_t {
+	/** bit (feature % 64) of words[feature / 64] is set if the feature is present */
+	uint64_t words[CPU_FEATURE_SET_WORDS];
+};
+
 /**
  * @brief This contains the recognized CPU features/info
  */
@@ -563,6 +679,9 @@ struct cpu_id_t {
 	 */
 	uint8_t flags[CPU_FLAGS_MAX];
 
+	/** the features of \ref flags, packed. Both are filled at identification time */
+	struct cpu_feature_set_t features;
+
 #ifndef LIBCPUID_DISABLE_DEPRECATED
 	/**
 	 * CPU family (BaseFamily[3:0])
@@ -760,8 +879,12 @@ struct cpu_id_t {
 	LIBCPUID_DEPRECATED("replace with '.x86.sgx' in your code to fix the warning")
 	struct cpu_sgx_t sgx;
 
-	/** bitmask of the affinity ids this processor type is occupying */
-	cpu_affinity_mask_t affinity_mask;
+	/**
+	 * the affinity ids this processor type is occupying. It is only filled by
+	 * \ref cpu_identify_all, and freed by \ref cpuid_free_system_id
+	 * (empty for \ref cpu_identify and \ref cpu_request_core_type)
+	 */
+	struct cpu_affinity_set_t affinity;
 
 	/** processor type purpose, relevant in case of hybrid CPU (e.g. PURPOSE_PERFORMANCE) */
 	cpu_purpose_t purpose;
@@ -794,6 +917,29 @@ struct system_id_t {
 
 	/** Number of total L4 cache instances. -1 if undetermined */
 	int32_t l4_total_instances;
+
+	/** Number of total dies, in all the packages. -1 if undetermined or if the CPU does not report its dies */
+	int32_t die_total_instances;
+
+	/** Number of total tiles (Intel leaf 1Fh). -1 if undetermined or if the CPU does not report its tiles */
+	int32_t tile_total_instances;
+
+	/** Number of total modules, e.g. groups of E-cores sharing an L2 cache. -1 if undetermined or if the CPU does not report its modules */
+	int32_t module_total_instances;
+
+	/**
+	 * the cache instances with the logical CPUs which share them (see
+	 * \ref cpuid_get_cache_map), NULL if the raw data has no affinity or
+	 * cache topology information
+	 */
+	struct cpu_cache_map_t* cache_map;
+
+	/**
+	 * the topology tree of the logical CPUs, with their NUMA nodes (see
+	 * \ref cpuid_get_topology), NULL if the raw data has no affinity or APIC
+	 * ID information. The NUMA nodes are only read for the current system
+	 */
+	struct cpu_topology_t* topology;
 };
 
 /**
@@ -1203,6 +1349,368 @@ typedef enum {
 	NUM_CPU_FEATURES,
 } cpu_feature_t;
 
+/**
+ * @brief Common capabilities of a group of hosts
+ *
+ * It describes what a binary may assume to run on every host of a fleet.
+ * It is filled by \ref cpuid_compute_baseline or \ref cpuid_compute_baseline_raw,
+ * and must be freed with \ref cpuid_free_baseline.
+ */
+struct cpu_baseline_t {
+	/** number of hosts taken into account */
+	int32_t num_hosts;
+
+	/** architecture of the hosts, ARCHITECTURE_UNKNOWN if they differ */
+	cpu_architecture_t architecture;
+
+	/** highest feature level implied by the level of every host (FEATURE_LEVEL_UNKNOWN if any host level is unknown,
+	 *  or if the hosts have different architectures or ARM profiles) */
+	cpu_feature_level_t feature_level;
+
+	/** features present on every host */
+	struct cpu_feature_set_t features;
+
+	/** features present on some hosts, but not on all of them */
+	struct cpu_feature_set_t missing_features;
+
+	/** smallest L1 data cache size in KB (-1 if undetermined on any host) */
+	int32_t l1_data_cache;
+
+	/** smallest L1 instruction cache size in KB (-1 if undetermined on any host) */
+	int32_t l1_instruction_cache;
+
+	/** smallest L2 cache size in KB (-1 if undetermined on any host) */
+	int32_t l2_cache;
+
+	/** smallest L3 cache size in KB (-1 if undetermined on any host) */
+	int32_t l3_cache;
+
+	/** for each feature of missing_features, the number of hosts lacking it (0 for other features) */
+	int32_t num_lacking_hosts[CPU_FLAGS_MAX];
+
+	/**
+	 * for each feature of missing_features, the position of its hosts in lacking_hosts:
+	 * lacking_hosts[lacking_hosts_start[f] .. lacking_hosts_start[f] + num_lacking_hosts[f] - 1]
+	 */
+	int32_t lacking_hosts_start[CPU_FLAGS_MAX];
+
+	/** indexes of the hosts lacking a feature, grouped by feature, in ascending order */
+	int32_t* lacking_hosts;
+};
+
+/**
+ * @brief Generic function pointer used by \ref cpu_dispatch_t
+ *
+ * Cast the implementations of a kernel to this type when registering them,
+ * and the resolved pointer back to the type of the kernel.
+ */
+typedef void (*cpu_dispatch_fn_t)(void);
+
+/**
+ * @brief One implementation of a kernel, with the CPU requirements to run it
+ */
+struct cpu_dispatch_impl_t {
+	/** the implementation */
+	cpu_dispatch_fn_t fn;
+
+	/** minimum feature level (e.g. FEATURE_LEVEL_X86_64_V3), or FEATURE_LEVEL_UNKNOWN if none is required */
+	cpu_feature_level_t feature_level;
+
+	/** required features, terminated by NUM_CPU_FEATURES, or NULL if none is required */
+	const cpu_feature_t* features;
+
+	/** name of the implementation, used in debug messages (may be NULL) */
+	const char* name;
+};
+
+/**
+ * @brief A kernel with several implementations, resolved by \ref cpuid_dispatch_resolve
+ *
+ * Usage:
+ * @code
+ * static const cpu_feature_t avx512_features[] = { CPU_FEATURE_AVX512F, CPU_FEATURE_AVX512BW, NUM_CPU_FEATURES };
+ * static const struct cpu_dispatch_impl_t sum_impls[] = {
+ *     { (cpu_dispatch_fn_t) sum_avx512,  FEATURE_LEVEL_UNKNOWN,   avx512_features, "avx512" },
+ *     { (cpu_dispatch_fn_t) sum_avx2,    FEATURE_LEVEL_X86_64_V3, NULL,            "avx2" },
+ *     { (cpu_dispatch_fn_t) sum_generic, FEATURE_LEVEL_UNKNOWN,   NULL,            "generic" },
+ * };
+ * static struct cpu_dispatch_t sum_dispatch = CPU_DISPATCH_INIT(sum_impls);
+ * ...
+ * sum_fn_t sum = (sum_fn_t) cpuid_dispatch_resolve(&sum_dispatch);
+ * @endcode
+ */
+struct cpu_dispatch_t {
+	/** implementations, from the most preferred to the least preferred one */
+	const struct cpu_dispatch_impl_t* impls;
+
+	/** number of elements in impls */
+	int num_impls;
+
+	/** set to 1 once the kernel has been resolved, accessed atomically */
+	volatile long resolved;
+
+	/** index of the selected implementation, or -1 if none can run on this CPU */
+	int selected;
+
+	/** the selected implementation, or NULL if none can run on this CPU */
+	cpu_dispatch_fn_t fn;
+};
+
+/** Static initializer of struct cpu_dispatch_t from an array of struct cpu_dispatch_impl_t */
+#define CPU_DISPATCH_INIT(impls) { (impls), (int) (sizeof(impls) / sizeof((impls)[0])), 0, -1, NULL }
+
+/**
+ * @brief Geometry of one cache level
+ */
+struct cpu_cache_geometry_t {
+	/** size in KB, -1 if undetermined */
+	int32_t size;
+
+	/** associativity, -1 if undetermined */
+	int32_t assoc;
+
+	/** cache-line size in bytes, -1 if undetermined */
+	int32_t linesize;
+
+	/** number of instances, -1 if undetermined */
+	int32_t instances;
+};
+
+/**
+ * @brief Description of all the cores of a given purpose (e.g. all P-cores)
+ */
+struct cpu_core_type_t {
+	/** purpose of the cores (e.g. PURPOSE_EFFICIENCY) */
+	cpu_purpose_t purpose;
+
+	/** number of physical cores of this type */
+	int32_t num_cores;
+
+	/** number of logical CPUs of this type */
+	int32_t num_logical_cpus;
+
+	/** logical CPUs of this type (empty if the raw data were collected without affinity) */
+	struct cpu_affinity_set_t affinity;
+
+	/** features supported by the cores of this type */
+	struct cpu_feature_set_t features;
+
+	/** feature level of the cores of this type (the highest one implied by all of them if they differ) */
+	cpu_feature_level_t feature_level;
+
+	/** L1 data cache */
+	struct cpu_cache_geometry_t l1_data;
+
+	/** L1 instruction cache */
+	struct cpu_cache_geometry_t l1_instruction;
+
+	/** L2 cache */
+	struct cpu_cache_geometry_t l2;
+
+	/** L3 cache */
+	struct cpu_cache_geometry_t l3;
+
+	/** L4 cache */
+	struct cpu_cache_geometry_t l4;
+};
+
+/**
+ * @brief Core types of a system, see \ref cpuid_get_core_types
+ */
+struct cpu_core_types_t {
+	/** number of different core types */
+	int32_t num_types;
+
+	/** one element per core type, in the order of \ref system_id_t::cpu_types */
+	struct cpu_core_type_t* types;
+
+	/** features supported by all the core types, safe to use in threads which may migrate */
+	struct cpu_feature_set_t common_features;
+
+	/** highest feature level implied by the level of every core type (FEATURE_LEVEL_UNKNOWN if they have different ARM profiles) */
+	cpu_feature_level_t common_feature_level;
+};
+
+/**
+ * @brief Levels of the CPU topology tree, see \ref cpuid_get_topology
+ */
+typedef enum {
+	TOPOLOGY_PACKAGE = 0,	/*!< physical package (socket) */
+	TOPOLOGY_DIE,		/*!< die of a package, e.g. a CCD on AMD */
+	TOPOLOGY_COMPLEX,	/*!< core complex: the cores which share the last level cache, e.g. a CCX on AMD */
+	TOPOLOGY_TILE,		/*!< tile: a group of modules (Intel leaf 1Fh) */
+	TOPOLOGY_MODULE,	/*!< module: a group of cores, e.g. the E-cores which share an L2 cache (Intel leaf 1Fh) */
+	TOPOLOGY_CORE,		/*!< core */
+	TOPOLOGY_THREAD,	/*!< SMT thread, i.e. one logical CPU */
+	/* termination */
+	NUM_TOPOLOGY_LEVELS,
+} cpu_topology_level_t;
+
+/**
+ * @brief Cache levels
+ */
+typedef enum {
+	CACHE_L1_INSTRUCTION = 0,	/*!< L1 instruction cache */
+	CACHE_L1_DATA,			/*!< L1 data cache */
+	CACHE_L2,			/*!< L2 cache */
+	CACHE_L3,			/*!< L3 cache */
+	CACHE_L4,			/*!< L4 cache */
+	/* termination */
+	NUM_CACHE_LEVELS,
+} cpu_cache_level_t;
+
+/**
+ * @brief One node of the CPU topology tree
+ */
+struct cpu_topology_node_t {
+	/** level of the node */
+	cpu_topology_level_t level;
+
+	/** ID of the node at its level (derived from the APIC ID on x86, from MPIDR on ARM), -1 if the CPU does not report it */
+	int32_t id;
+
+	/** index of the parent node in \ref cpu_topology_t::nodes, -1 for packages */
+	int32_t parent;
+
+	/** index of the first child node in \ref cpu_topology_t::nodes (the children are consecutive), -1 for threads */
+	int32_t first_child;
+
+	/** number of child nodes */
+	int32_t num_children;
+
+	/** index of the first logical CPU of the node in \ref cpu_topology_t::logical_cpus (they are consecutive) */
+	int32_t first_cpu;
+
+	/** number of logical CPUs in the node */
+	int32_t num_cpus;
+
+	/** index of the first cache attached to the node in \ref cpu_topology_t::caches (they are consecutive) */
+	int32_t first_cache;
+
+	/** number of caches attached to the node */
+	int32_t num_caches;
+};
+
+/**
+ * @brief One cache instance of the CPU topology tree
+ */
+struct cpu_topology_cache_t {
+	/** cache level */
+	cpu_cache_level_t level;
+
+	/** cache ID (derived from the APIC ID) */
+	int32_t id;
+
+	/** index in \ref cpu_topology_t::nodes of the smallest node which contains all the logical CPUs sharing the cache */
+	int32_t node;
+
+	/** index of the first logical CPU sharing the cache in \ref cpu_topology_t::logical_cpus (they are consecutive) */
+	int32_t first_cpu;
+
+	/** number of logical CPUs sharing the cache */
+	int32_t num_cpus;
+
+	/** NUMA node of the logical CPUs sharing the cache, -1 if unknown or if they belong to several nodes */
+	int32_t numa_node;
+};
+
+/**
+ * @brief CPU topology tree, see \ref cpuid_get_topology
+ *
+ * The nodes are stored level by level: all the packages, then all the dies,
+ * and so on until the threads. Every level has at least one node per parent,
+ * with the ID -1 if the CPU does not report that level (e.g. dies).
+ */
+struct cpu_topology_t {
+	/** number of nodes */
+	int32_t num_nodes;
+
+	/** the nodes, level by level */
+	struct cpu_topology_node_t* nodes;
+
+	/** index of the first node of each level in \ref nodes */
+	int32_t first_node[NUM_TOPOLOGY_LEVELS];
+
+	/** number of nodes of each level */
+	int32_t num_level_nodes[NUM_TOPOLOGY_LEVELS];
+
+	/** number of logical CPUs */
+	int32_t num_cpus;
+
+	/** the logical CPUs in the order of the tree: the logical CPUs of any node are consecutive */
+	logical_cpu_t* logical_cpus;
+
+	/** index in \ref nodes of the thread node of each logical CPU (indexed by logical CPU) */
+	int32_t* cpu_node;
+
+	/** number of cache instances */
+	int32_t num_caches;
+
+	/** the cache instances, grouped by node */
+	struct cpu_topology_cache_t* caches;
+
+	/** number of NUMA nodes, 0 if unknown (they are only read for the current system, on Linux) */
+	int32_t num_numa_nodes;
+
+	/** the IDs of the NUMA nodes, in increasing order */
+	int32_t* numa_node_ids;
+
+	/** NUMA node ID of each logical CPU, -1 if unknown (indexed by logical CPU) */
+	int32_t* cpu_numa_node;
+
+	/** relative distances between the NUMA nodes, -1 if unknown:
+	 *  numa_distances[i * num_numa_nodes + j] is the distance from numa_node_ids[i] to numa_node_ids[j].
+	 *  See also \ref cpuid_get_numa_distance */
+	int32_t* numa_distances;
+};
+
+/**
+ * @brief One cache instance and the logical CPUs which share it, see \ref cpuid_get_cache_map
+ */
+struct cpu_cache_instance_t {
+	/** cache level */
+	cpu_cache_level_t level;
+
+	/** cache ID (derived from the APIC ID) */
+	int32_t id;
+
+	/** index in \ref system_id_t::cpu_types of the logical CPUs sharing the cache, -1 if unknown */
+	int32_t cpu_type;
+
+	/** NUMA node of the logical CPUs sharing the cache, -1 if unknown or if they belong to several nodes */
+	int32_t numa_node;
+
+	/** size, associativity and line size of the cache; instances is the number of instances of this level */
+	struct cpu_cache_geometry_t geometry;
+
+	/** logical CPUs sharing the cache */
+	struct cpu_affinity_set_t affinity;
+};
+
+/**
+ * @brief Cache instances of a system, see \ref cpuid_get_cache_map
+ */
+struct cpu_cache_map_t {
+	/** number of cache instances */
+	int32_t num_caches;
+
+	/** the cache instances, sorted by level */
+	struct cpu_cache_instance_t* caches;
+
+	/** index of the first instance of each level in \ref caches */
+	int32_t first_cache[NUM_CACHE_LEVELS];
+
+	/** number of instances of each level */
+	int32_t num_level_caches[NUM_CACHE_LEVELS];
+
+	/** number of logical CPUs */
+	int32_t num_cpus;
+
+	/** index in \ref caches of the cache of each logical CPU at each level, -1 if none:
+	 *  cpu_caches[logical_cpu * NUM_CACHE_LEVELS + level] */
+	int32_t* cpu_caches;
+};
+
 /**
  * @brief CPU detection hints identifiers
  *
@@ -1268,8 +1776,35 @@ typedef enum {
 	ERR_NOT_FOUND= -17,	/*!< Requested type not found */
 	ERR_IOCTL    = -18,	/*!< Error on ioctl */
 	ERR_REQUEST  = -19,	/*!< Invalid request */
+	ERR_STALE    = -20,	/*!< Published data is stale */
 } cpu_error_t;
 
+/**
+ * @brief Groups of x86 CPUID leaves in cpu_raw_data_t
+ * @see cpuid_get_raw_data_groups
+ */
+typedef enum {
+	RAW_GROUP_BASIC    = 1 << 0,	/*!< basic_cpuid: vendor, family/model and most feature flags (always queried) */
+	RAW_GROUP_EXT      = 1 << 1,	/*!< ext_cpuid: extended feature flags, brand string, AMD cache and core counts */
+	RAW_GROUP_CACHE    = 1 << 2,	/*!< intel_fn4 and amd_fn8000001dh: deterministic cache parameters */
+	RAW_GROUP_TOPOLOGY = 1 << 3,	/*!< intel_fn11, intel_fn1fh and amd_fn80000026h: extended topology */
+	RAW_GROUP_SGX      = 1 << 4,	/*!< intel_fn12h: SGX capabilities */
+	RAW_GROUP_PT       = 1 << 5,	/*!< intel_fn14h: Processor Trace capabilities */
+	RAW_GROUP_ALL      = (1 << 6) - 1,	/*!< all the groups above */
+} cpu_raw_group_t;
+
+/**
+ * @brief Methods used to read the raw CPUID data of a given logical CPU
+ * @see cpuid_set_raw_data_method
+ */
+typedef enum {
+	RAW_DATA_METHOD_AFFINITY = 0,	/*!< Pin the calling thread to the logical CPU and execute CPUID (default) */
+	RAW_DATA_METHOD_DRIVER,		/*!< Read through the cpuid kernel driver (/dev/cpu/N/cpuid on Linux), without changing the CPU affinity */
+
+	/* termination: */
+	NUM_RAW_DATA_METHODS,
+} cpu_raw_data_method_t;
+
 /**
  * @brief Internal structure, used in cpu_tsc_mark, cpu_tsc_unmark and
  *        cpu_clock_by_mark
@@ -1338,6 +1873,28 @@ int cpuid_get_raw_data(struct cpu_raw_data_t* data);
  */
 int cpuid_get_raw_data_core(struct cpu_raw_data_t* data, logical_cpu_t logical_cpu);
 
+/**
+ * @brief Obtains some groups of the raw CPUID data from a given logical CPU
+ *
+ * Same as \ref cpuid_get_raw_data_core, but only the x86 leaves of the given
+ * groups are queried. The other leaves are zeroed, and the queried groups are
+ * recorded in \ref cpu_raw_data_t::valid_groups, so that \ref cpu_identify
+ * skips the decoders which need the missing leaves.
+ *
+ * @param data - a pointer to cpu_raw_data_t structure
+ * @param logical_cpu - logical CPU number, or -1 for the current CPU
+ * @param groups - a bitmask of \ref cpu_raw_group_t values. RAW_GROUP_BASIC
+ *                 is always added, and so is RAW_GROUP_CACHE on Intel hybrid
+ *                 CPUs, since it tells their E-cores from their LP E-cores.
+ *                 Note that the AMD cache and topology decoders also need
+ *                 RAW_GROUP_EXT.
+ *
+ * @returns zero if successful, and some negative number on error.
+ *          The error message can be obtained by calling \ref cpuid_error.
+ *          @see cpu_error_t
+ */
+int cpuid_get_raw_data_groups(struct cpu_raw_data_t* data, logical_cpu_t logical_cpu, uint32_t groups);
+
 /**
  * @brief Obtains the raw CPUID data from all CPUs
  * @param data - a pointer to cpu_raw_data_array_t structure
@@ -1349,6 +1906,74 @@ int cpuid_get_raw_data_core(struct cpu_raw_data_t* data, logical_cpu_t logical_c
  */
 int cpuid_get_all_raw_data(struct cpu_raw_data_array_t* data);
 
+/**
+ * @brief Sets the number of threads used by cpuid_get_all_raw_data
+ *
+ * By default, cpuid_get_all_raw_data() reads the logical CPUs one after
+ * another from the calling thread. On systems with many logical CPUs, it can
+ * instead start several worker threads, each one taking a disjoint set of
+ * logical CPUs. The resulting cpu_raw_data_array_t is the same in both cases.
+ *
+ * @param workers - the number of worker threads. 1 disables the worker
+ *                  threads (the default), 0 starts one worker per logical CPU.
+ *
+ * @note Worker threads are only supported on Linux, FreeBSD, DragonFly BSD
+ *       and NetBSD. On the other systems, this setting has no effect.
+ *
+ * @returns the previous number of worker threads.
+ */
+int cpuid_set_raw_data_workers(int workers);
+
+/**
+ * @brief Sets how cpuid_get_raw_data_core and cpuid_get_all_raw_data reach a logical CPU
+ *
+ * With RAW_DATA_METHOD_DRIVER, CPUID is executed on the target logical CPU by
+ * the kernel (e.g. through /dev/cpu/N/cpuid on Linux), so the calling thread
+ * keeps its CPU affinity. This also works inside a restricted cpuset.
+ * When the driver is not available for a logical CPU, the CPU affinity
+ * method is used instead.
+ *
+ * @param method - the method to use, see cpu_raw_data_method_t.
+ *                 Invalid values are ignored.
+ *
+ * @note The driver method is only implemented for x86 CPUs on Linux.
+ *
+ * @returns the previous method.
+ */
+cpu_raw_data_method_t cpuid_set_raw_data_method(cpu_raw_data_method_t method);
+
+/**
+ * @brief Enables the lazy enumeration of CPUID leaves
+ *
+ * By default, the raw data functions execute CPUID for all the leaves and
+ * sub-leaves which fit in cpu_raw_data_t. When the lazy enumeration is
+ * enabled, the maximum basic and extended levels are read first; the leaves
+ * beyond them are not queried, and the sub-leaf loops stop at the terminating
+ * sub-leaf (e.g. cache type 0 or level type 0). Everything which is not
+ * queried is zeroed. This matters under a hypervisor, where each CPUID
+ * instruction causes a VM exit.
+ *
+ * The format written by cpuid_serialize_raw_data() is not affected.
+ *
+ * @param enabled - 1 to enable the lazy enumeration, 0 to disable it (default)
+ *
+ * @returns the previous setting.
+ */
+int cpuid_set_raw_data_lazy(int enabled);
+
+/**
+ * @brief Returns the number of CPUID instructions saved by the lazy enumeration
+ *        or by \ref cpuid_get_raw_data_groups
+ *
+ * The counter covers all the raw data functions called by the current thread
+ * since the previous call to cpuid_get_raw_data_skipped(), and is reset
+ * afterwards.
+ * @see cpuid_set_raw_data_lazy
+ *
+ * @returns the number of CPUID instructions which were not executed.
+ */
+int cpuid_get_raw_data_skipped(void);
+
 /**
  * @brief Writes the raw CPUID data to a text file
  * @param data - a pointer to cpu_raw_data_t structure
@@ -1388,14 +2013,46 @@ int cpuid_serialize_raw_data(struct cpu_raw_data_t* data, const char* filename);
 int cpuid_serialize_all_raw_data(struct cpu_raw_data_array_t* data, const char* filename);
 
 /**
- * @brief Reads raw CPUID data from file
- * @param data - a pointer to cpu_raw_data_t structure. The deserialized data will
- *               be written here.
- * @param filename - the path of the file, containing the serialized raw data.
- *                   If empty, stdin will be used.
- * @note This function may fail, if the file is created by different version of
- *       the library. Also, see the notes on cpuid_serialize_raw_data.
- * @returns zero if successful, and some negative number on error.
+ * @brief Writes the raw CPUID data to a binary file
+ * @param data - a pointer to cpu_raw_data_t structure
+ * @param filename - the path of the file, where the serialized data should be
+ *                   written. If empty, stdout will be used.
+ * @note The binary format has a versioned header, an index of the logical CPUs
+ *       and fixed-width blocks of registers, so it is read without any parsing
+ *       (and mapped in memory where possible). It uses the byte order of the
+ *       machine which wrote it.
+ *       cpuid_deserialize_raw_data and cpuid_deserialize_all_raw_data
+ *       recognize binary files automatically, so a dump can be converted
+ *       between the text and binary formats by reading and writing it again.
+ * @returns zero if successful, and some negative number on error.
+ *          The error message can be obtained by calling \ref cpuid_error.
+ *          @see cpu_error_t
+ */
+int cpuid_serialize_raw_data_binary(struct cpu_raw_data_t* data, const char* filename);
+
+/**
+ * @brief Writes all the raw CPUID data to a binary file
+ * @param data - a pointer to cpu_raw_data_array_t structure
+ * @param filename - the path of the file, where the serialized data for all CPUs
+ *                   should be written. If empty, stdout will be used.
+ * @note See the notes on cpuid_serialize_raw_data_binary.
+ * @returns zero if successful, and some negative number on error.
+ *          The error message can be obtained by calling \ref cpuid_error.
+ *          @see cpu_error_t
+ */
+int cpuid_serialize_all_raw_data_binary(struct cpu_raw_data_array_t* data, const char* filename);
+
+/**
+ * @brief Reads raw CPUID data from file
+ * @param data - a pointer to cpu_raw_data_t structure. The deserialized data will
+ *               be written here.
+ * @param filename - the path of the file, containing the serialized raw data.
+ *                   If empty, stdin will be used.
+ * @note This function may fail, if the file is created by different version of
+ *       the library. Also, see the notes on cpuid_serialize_raw_data.
+ *       Binary files (see cpuid_serialize_raw_data_binary) are also accepted,
+ *       the first logical CPU is read from them.
+ * @returns zero if successful, and some negative number on error.
  *          The error message can be obtained by calling \ref cpuid_error.
  *          @see cpu_error_t
 */
@@ -1409,6 +2066,7 @@ int cpuid_deserialize_raw_data(struct cpu_raw_data_t* data, const char* filename
  *                   If empty, stdin will be used.
  * @note This function may fail, if the file is created by different version of
  *       the library. Also, see the notes on cpuid_serialize_all_raw_data.
+ *       Binary files (see cpuid_serialize_all_raw_data_binary) are also accepted.
  * @note As the memory is dynamically allocated, be sure to call
  *       cpuid_free_raw_data_array() after you're done with the data
  * @returns zero if successful, and some negative number on error.
@@ -1417,6 +2075,126 @@ int cpuid_deserialize_raw_data(struct cpu_raw_data_t* data, const char* filename
 */
 int cpuid_deserialize_all_raw_data(struct cpu_raw_data_array_t* data, const char* filename);
 
+/**
+ * @brief Type of the callback, which receives the output of \ref cpuid_serialize_raw_data_cb
+ * @param data - a chunk of the serialized text (not NUL-terminated)
+ * @param size - the length of the chunk, in bytes
+ * @param userdata - the pointer given to the serialization function
+ * @returns the number of bytes consumed; anything less than size aborts the output.
+ */
+typedef size_t (*libcpuid_write_fn_t) (const void* data, size_t size, void* userdata);
+
+/**
+ * @brief Writes the raw CPUID data through a callback
+ * @param data - a pointer to cpu_raw_data_t structure
+ * @param write_fn - the function which receives the serialized text, by chunks
+ * @param userdata - passed as is to write_fn
+ * @note The output is the same as the one of cpuid_serialize_raw_data, it can
+ *       be collected in memory, sent over a socket, compressed, etc. without
+ *       going through a temporary file.
+ * @returns zero if successful, and some negative number on error (ERR_OPEN if
+ *          write_fn did not consume all the data).
+ *          The error message can be obtained by calling \ref cpuid_error.
+ *          @see cpu_error_t
+ */
+int cpuid_serialize_raw_data_cb(struct cpu_raw_data_t* data, libcpuid_write_fn_t write_fn, void* userdata);
+
+/**
+ * @brief Writes all the raw CPUID data through a callback
+ * @param data - a pointer to cpu_raw_data_array_t structure
+ * @param write_fn - the function which receives the serialized text, by chunks
+ * @param userdata - passed as is to write_fn
+ * @note The output is the same as the one of cpuid_serialize_all_raw_data.
+ * @returns zero if successful, and some negative number on error (ERR_OPEN if
+ *          write_fn did not consume all the data).
+ *          The error message can be obtained by calling \ref cpuid_error.
+ *          @see cpu_error_t
+ */
+int cpuid_serialize_all_raw_data_cb(struct cpu_raw_data_array_t* data, libcpuid_write_fn_t write_fn, void* userdata);
+
+/**
+ * @brief Reads raw CPUID data from a memory buffer
+ * @param buf - the serialized raw data, in any format accepted by
+ *              cpuid_deserialize_raw_data (it does not need to be NUL-terminated)
+ * @param size - the length of buf, in bytes
+ * @param data - a pointer to cpu_raw_data_t structure. The deserialized data will
+ *               be written here.
+ * @note The buffer is read in place and is not retained after the call.
+ * @returns zero if successful, and some negative number on error.
+ *          The error message can be obtained by calling \ref cpuid_error.
+ *          @see cpu_error_t
+ */
+int cpuid_deserialize_raw_data_buf(const char* buf, size_t size, struct cpu_raw_data_t* data);
+
+/**
+ * @brief Reads all raw CPUID data from a memory buffer
+ * @param buf - the serialized raw data, in any format accepted by
+ *              cpuid_deserialize_all_raw_data (it does not need to be NUL-terminated)
+ * @param size - the length of buf, in bytes
+ * @param data - a pointer to cpu_raw_data_array_t structure. The deserialized array data will
+ *               be written here.
+ * @note The buffer is read in place and is not retained after the call.
+ * @note As the memory is dynamically allocated, be sure to call
+ *       cpuid_free_raw_data_array() after you're done with the data
+ * @returns zero if successful, and some negative number on error.
+ *          The error message can be obtained by calling \ref cpuid_error.
+ *          @see cpu_error_t
+ */
+int cpuid_deserialize_all_raw_data_buf(const char* buf, size_t size, struct cpu_raw_data_array_t* data);
+
+/**
+ * @brief Builds the compact form of a raw array
+ * @param raw_array - a pointer to cpu_raw_data_array_t structure, as obtained by
+ *                    cpuid_get_all_raw_data or cpuid_deserialize_all_raw_data.
+ * @param compact - a pointer to cpu_raw_data_compact_t structure. The compact
+ *                  data will be written here.
+ * @note As the memory is dynamically allocated, be sure to call
+ *       cpuid_free_raw_data_compact() after you're done with the data
+ * @returns zero if successful, and some negative number on error.
+ *          The error message can be obtained by calling \ref cpuid_error.
+ *          @see cpu_error_t
+ */
+int cpuid_compact_raw_data_array(const struct cpu_raw_data_array_t* raw_array, struct cpu_raw_data_compact_t* compact);
+
+/**
+ * @brief Gets the raw CPUID data of a logical CPU from a compact array
+ * @param compact - a pointer to cpu_raw_data_compact_t structure
+ * @param logical_cpu - logical CPU number
+ * @param data - a pointer to cpu_raw_data_t structure, where the data is written
+ * @returns zero if successful, and some negative number on error (ERR_INVCNB
+ *          if the logical CPU is not in the array).
+ *          The error message can be obtained by calling \ref cpuid_error.
+ *          @see cpu_error_t
+ */
+int cpuid_get_compact_raw_data(const struct cpu_raw_data_compact_t* compact, logical_cpu_t logical_cpu, struct cpu_raw_data_t* data);
+
+/**
+ * @brief Converts a compact array back to a regular raw array
+ * @param compact - a pointer to cpu_raw_data_compact_t structure
+ * @param raw_array - a pointer to cpu_raw_data_array_t structure. It can be
+ *                    passed to cpu_identify_all afterwards.
+ * @note As the memory is dynamically allocated, be sure to call
+ *       cpuid_free_raw_data_array() after you're done with the data
+ * @returns zero if successful, and some negative number on error.
+ *          The error message can be obtained by calling \ref cpuid_error.
+ *          @see cpu_error_t
+ */
+int cpuid_expand_raw_data_compact(const struct cpu_raw_data_compact_t* compact, struct cpu_raw_data_array_t* raw_array);
+
+/**
+ * @brief Writes a compact raw array to a text file
+ * @param compact - a pointer to cpu_raw_data_compact_t structure
+ * @param filename - the path of the file, where the serialized data should be
+ *                   written. If empty, stdout will be used.
+ * @note The base records are written first, then each logical CPU only lists
+ *       the lines which differ from its base. Such files can be read back by
+ *       cpuid_deserialize_all_raw_data.
+ * @returns zero if successful, and some negative number on error.
+ *          The error message can be obtained by calling \ref cpuid_error.
+ *          @see cpu_error_t
+ */
+int cpuid_serialize_raw_data_compact(const struct cpu_raw_data_compact_t* compact, const char* filename);
+
 /**
  * @brief Identifies the CPU
  * @param raw - Input - a pointer to the raw CPUID data, which is obtained
@@ -1449,6 +2227,10 @@ int cpu_identify(struct cpu_raw_data_t* raw, struct cpu_id_t* data);
  *              Can also be NULL, in which case the functions calls
  *              cpuid_get_all_raw_data itself.
  * @param system - Output - the decoded CPU features/info is written here for each CPU type.
+ *              When the raw data has the affinity and the cache topology of the logical CPUs,
+ *              system_id_t::cache_map lists the cache instances and the logical CPUs sharing them,
+ *              and system_id_t::topology is their topology tree. When raw_array is NULL, the
+ *              NUMA nodes are read as in \ref cpuid_get_topology.
  * @note The function is similar to cpu_identify. Refer to cpu_identify notes.
  * @note As the memory is dynamically allocated, be sure to call
  *       cpuid_free_raw_data_array() and cpuid_free_system_id() after you're done with the data
@@ -1472,6 +2254,120 @@ int cpu_identify_all(struct cpu_raw_data_array_t* raw_array, struct system_id_t*
  */
 int cpu_request_core_type(cpu_purpose_t purpose, struct cpu_raw_data_array_t* raw_array, struct cpu_id_t* data);
 
+/**
+ * @brief Enables the process-wide cache of the current CPU identification
+ *
+ * When the cache is enabled, the first cpu_identify(NULL, ...),
+ * cpu_identify_all(NULL, ...) and cpuid_get_topology(NULL, ...) calls collect
+ * the raw data and identify the CPUs as usual, then keep the result. The
+ * topology is kept in its \ref system_id_t, with the cache map and the NUMA
+ * nodes, so that they always come from the same identification. The next calls copy the kept result
+ * instead of executing CPUID again. Calls with raw data are not affected.
+ * On hybrid CPUs, cpu_identify(NULL, ...) identifies the core type which runs
+ * the calling thread, so its result is not cached.
+ *
+ * On Linux, the cache is dropped when /sys/devices/system/cpu/online or
+ * /sys/devices/system/node/online changes (they are checked at most every
+ * 100 ms). Call \ref cpuid_refresh_identify_cache to drop it immediately,
+ * e.g. after a CPU hotplug event. These paths are prefixed with the
+ * LIBCPUID_SYSFS_ROOT environment variable, as in \ref cpuid_get_topology.
+ *
+ * @param enabled - 1 to enable the cache, 0 to disable it and free the cached data (default)
+ *
+ * @returns the previous setting.
+ */
+int cpuid_set_identify_cache(int enabled);
+
+/**
+ * @brief Drops the cached identification, see \ref cpuid_set_identify_cache
+ *
+ * The next cpu_identify(NULL, ...) or cpu_identify_all(NULL, ...) call
+ * identifies the CPUs again.
+ */
+void cpuid_refresh_identify_cache(void);
+
+/**
+ * @brief Keeps the identifications in a file, to reuse them in later runs
+ *
+ * When a file is set, cpu_identify(), cpu_identify_all() and the other
+ * identification functions look for the raw data in the file before decoding
+ * it, and append the new identifications to it. This saves most of the time
+ * spent on classifying many raw dumps of the same CPU models.
+ *
+ * The key is the raw data without the IDs of the logical CPU (APIC IDs,
+ * MPIDR), so all the logical CPUs of the same type share an entry.
+ *
+ * Several processes can share the file: it is locked while it is read and
+ * while an entry is appended. A file that cannot be written is only read.
+ * A file written by another version of the library is replaced by a new one
+ * (it is never truncated, other processes may still use it).
+ *
+ * @param filename - the path to the cache file, created if needed, or NULL to
+ *                   stop using it (default)
+ *
+ * @returns zero if successful, and some negative number on error (ERR_OPEN if
+ *          the file cannot be read, or was written by another version of the
+ *          library and cannot be replaced).
+ */
+int cpuid_set_identify_cache_file(const char* filename);
+
+/**
+ * @brief Publishes the identification of the CPUs in shared memory
+ *
+ * Identifies all CPUs (see \ref cpu_identify_all) and writes the result to a
+ * read-only shared memory segment (/dev/shm/<name>). Other processes read it
+ * with \ref cpuid_read_published_system_id, or with \ref cpu_identify_all after
+ * calling \ref cpuid_use_published_system_id, without probing the CPUs.
+ *
+ * The published data is only used on the same boot, while the same CPUs are
+ * online, and by the same version of libcpuid. Publish again after a CPU
+ * hotplug event (`cpuid_tool --publish' does it from a script or a service).
+ * Readers never block the publisher: a reader which sees an update in progress
+ * copies the data again.
+ *
+ * @param name - the name of the segment, without any '/', e.g. "libcpuid"
+ * @param raw_array - the raw CPUID data of this machine, or NULL to read it
+ *
+ * @returns zero if successful, and some negative number on error (ERR_INVRANGE
+ *          for an invalid name, ERR_OPEN if the segment cannot be written or
+ *          is not trusted (see \ref cpuid_read_published_system_id),
+ *          ERR_NOT_IMP on systems other than Linux).
+ */
+int cpuid_publish_system_id(const char* name, struct cpu_raw_data_array_t* raw_array);
+
+/**
+ * @brief Reads the identification published by \ref cpuid_publish_system_id
+ *
+ * @param name - the name of the segment
+ * @param system - output: the identification of the CPUs. Free it with
+ *                 \ref cpuid_free_system_id.
+ *
+ * @returns zero if successful, and some negative number on error: ERR_OPEN if
+ *          nothing is published under this name (or if the segment is a symbolic
+ *          link, is not owned by root or the current user, or can be written by
+ *          other users), ERR_BADFMT if the data is
+ *          corrupted (wrong checksum) or written by an incompatible library,
+ *          ERR_STALE if it was published on another boot or for other online CPUs.
+ */
+int cpuid_read_published_system_id(const char* name, struct system_id_t* system);
+
+/**
+ * @brief Uses the published identification instead of probing the CPUs
+ *
+ * After this call, cpu_identify_all(NULL, ...) returns the identification
+ * published under the given name, when it is valid (see
+ * \ref cpuid_read_published_system_id). cpu_identify(NULL, ...) does the same
+ * when all logical CPUs have the same type. Otherwise they probe the CPUs, as
+ * usual. This suits short-lived processes, which would spend most of their
+ * startup time in the identification.
+ *
+ * @param name - the name given to \ref cpuid_publish_system_id, or NULL to
+ *               probe the CPUs again (default)
+ *
+ * @returns zero if successful, ERR_INVRANGE for an invalid name.
+ */
+int cpuid_use_published_system_id(const char* name);
+
 /**
  * @brief Returns the short textual representation of a CPU architecture
  * @param architecture - the architecture, whose textual representation is wanted.
@@ -1510,6 +2406,96 @@ char* affinity_mask_str_r(cpu_affinity_mask_t* affinity_mask, char* buffer, uint
  */
 char* affinity_mask_str(cpu_affinity_mask_t *affinity_mask);
 
+/**
+ * @brief Initializes an empty CPU affinity set
+ * @param set - the set to initialize
+ * @param num_cpus - the number of logical CPUs the set can hold.
+ *                   If 0, cpuid_get_total_cpus() is used.
+ * @note Be sure to call cpuid_affinity_set_free() after you're done with the set
+ * @returns zero if successful, and some negative number on error.
+ *          The error message can be obtained by calling \ref cpuid_error.
+ *          @see cpu_error_t
+ */
+int cpuid_affinity_set_init(struct cpu_affinity_set_t* set, uint32_t num_cpus);
+
+/**
+ * @brief Frees a CPU affinity set
+ * @param set - the set, initialized by \ref cpuid_affinity_set_init
+ */
+void cpuid_affinity_set_free(struct cpu_affinity_set_t* set);
+
+/**
+ * @brief Adds a logical CPU to a CPU affinity set
+ * @param set - the set
+ * @param logical_cpu - logical CPU number
+ * @returns zero if successful, and some negative number on error (ERR_INVRANGE
+ *          if the set cannot hold this logical CPU).
+ *          The error message can be obtained by calling \ref cpuid_error.
+ *          @see cpu_error_t
+ */
+int cpuid_affinity_set_add(struct cpu_affinity_set_t* set, logical_cpu_t logical_cpu);
+
+/**
+ * @brief Checks if a logical CPU is in a CPU affinity set
+ * @param set - the set
+ * @param logical_cpu - logical CPU number
+ * @returns true if the logical CPU is in the set.
+ */
+bool cpuid_affinity_set_contains(const struct cpu_affinity_set_t* set, logical_cpu_t logical_cpu);
+
+/**
+ * @brief Counts the logical CPUs in a CPU affinity set
+ * @param set - the set
+ * @returns the number of logical CPUs in the set.
+ */
+uint32_t cpuid_affinity_set_count(const struct cpu_affinity_set_t* set);
+
+/**
+ * @brief Iterates over the logical CPUs of a CPU affinity set, in ascending order
+ * @param set - the set
+ * @param logical_cpu - the previous logical CPU returned, or -1 to get the first one
+ *
+ * @code
+ * for (cpu = cpuid_affinity_set_next(&set, -1); cpu >= 0; cpu = cpuid_affinity_set_next(&set, cpu))
+ *     ...
+ * @endcode
+ *
+ * @returns the next logical CPU of the set, or -1 if there is none.
+ */
+int32_t cpuid_affinity_set_next(const struct cpu_affinity_set_t* set, int32_t logical_cpu);
+
+/**
+ * @brief Intersects two CPU affinity sets
+ * @param dest - the set to update, only the logical CPUs also present in src are kept
+ * @param src - the other set
+ * @returns zero if successful, and some negative number on error.
+ *          The error message can be obtained by calling \ref cpuid_error.
+ *          @see cpu_error_t
+ */
+int cpuid_affinity_set_intersect(struct cpu_affinity_set_t* dest, const struct cpu_affinity_set_t* src);
+
+/**
+ * @brief Converts a fixed-size CPU affinity mask to a CPU affinity set
+ * @param set - the set to initialize. It holds the logical CPUs of the system
+ *              (see cpuid_get_total_cpus()), or more if the mask needs it.
+ * @param affinity_mask - the mask, e.g. from \ref cpuid_affinity_set_to_mask
+ * @note Be sure to call cpuid_affinity_set_free() after you're done with the set
+ * @returns zero if successful, and some negative number on error.
+ *          The error message can be obtained by calling \ref cpuid_error.
+ *          @see cpu_error_t
+ */
+int cpuid_affinity_set_from_mask(struct cpu_affinity_set_t* set, const cpu_affinity_mask_t* affinity_mask);
+
+/**
+ * @brief Converts a CPU affinity set to a fixed-size CPU affinity mask
+ * @param set - the set, e.g. \ref cpu_id_t::affinity
+ * @param affinity_mask - the mask to fill, e.g. for \ref affinity_mask_str
+ * @returns zero if successful, and some negative number on error.
+ *          The error message can be obtained by calling \ref cpuid_error.
+ *          @see cpu_error_t
+ */
+int cpuid_affinity_set_to_mask(const struct cpu_affinity_set_t* set, cpu_affinity_mask_t* affinity_mask);
+
 /**
  * @brief Returns the short textual representation of a CPU flag
  * @param feature - the feature, whose textual representation is wanted.
@@ -1519,6 +2505,327 @@ char* affinity_mask_str(cpu_affinity_mask_t *affinity_mask);
  */
 const char* cpu_feature_str(cpu_feature_t feature);
 
+/**
+ * @brief Returns the packed features of a CPU
+ * @param id - the CPU, as filled by cpu_identify() or cpu_identify_all()
+ * @param set - Output - the features present in id->flags, i.e. a copy of id->features
+ */
+void cpuid_get_feature_set(const struct cpu_id_t* id, struct cpu_feature_set_t* set);
+
+/**
+ * @brief Empties a feature set
+ * @param set - the set
+ */
+void cpuid_feature_set_clear(struct cpu_feature_set_t* set);
+
+/**
+ * @brief Adds a feature to a feature set
+ * @param set - the set
+ * @param feature - the feature to add
+ */
+void cpuid_feature_set_add(struct cpu_feature_set_t* set, cpu_feature_t feature);
+
+/**
+ * @brief Checks if a feature is in a feature set
+ * @param set - the set
+ * @param feature - the feature
+ * @returns true if the feature is present.
+ */
+bool cpuid_feature_set_contains(const struct cpu_feature_set_t* set, cpu_feature_t feature);
+
+/**
+ * @brief Computes the features present in both sets
+ * @param dest - Output - a & b (can be the same as a or b)
+ * @param a - the first set
+ * @param b - the second set
+ */
+void cpuid_feature_set_and(struct cpu_feature_set_t* dest, const struct cpu_feature_set_t* a, const struct cpu_feature_set_t* b);
+
+/**
+ * @brief Computes the features present in any of the sets
+ * @param dest - Output - a | b (can be the same as a or b)
+ * @param a - the first set
+ * @param b - the second set
+ */
+void cpuid_feature_set_or(struct cpu_feature_set_t* dest, const struct cpu_feature_set_t* a, const struct cpu_feature_set_t* b);
+
+/**
+ * @brief Computes the features present in a set but not in another one
+ * @param dest - Output - a & ~b (can be the same as a or b)
+ * @param a - the first set
+ * @param b - the features to remove from a
+ */
+void cpuid_feature_set_andnot(struct cpu_feature_set_t* dest, const struct cpu_feature_set_t* a, const struct cpu_feature_set_t* b);
+
+/**
+ * @brief Checks if all the features of a set are in another one
+ * @param subset - e.g. the features required by an application
+ * @param set - e.g. the features of a CPU
+ * @returns true if every feature of subset is in set.
+ */
+bool cpuid_feature_set_is_subset(const struct cpu_feature_set_t* subset, const struct cpu_feature_set_t* set);
+
+/**
+ * @brief Counts the features in a feature set
+ * @param set - the set
+ * @returns the number of features in the set.
+ */
+int cpuid_feature_set_count(const struct cpu_feature_set_t* set);
+
+/**
+ * @brief Iterates over the features of a feature set, in ascending order
+ * @param set - the set
+ * @param feature - the previous feature returned, or -1 to get the first one
+ *
+ * @code
+ * for (f = cpuid_feature_set_next(&set, -1); f >= 0; f = cpuid_feature_set_next(&set, f))
+ *     printf("%s ", cpu_feature_str(f));
+ * @endcode
+ *
+ * @returns the next feature of the set, or -1 if there is none.
+ */
+int cpuid_feature_set_next(const struct cpu_feature_set_t* set, int feature);
+
+/**
+ * @brief Computes the common capabilities of a fleet of hosts
+ * @param ids - array of CPU descriptions, one per host, as filled by cpu_identify()
+ * @param count - number of elements in ids
+ * @param baseline - Output - the features and cache sizes common to all hosts,
+ *                   and the hosts lacking each feature that some other host has.
+ *
+ * @code
+ * for (f = cpuid_feature_set_next(&baseline.missing_features, -1); f >= 0;
+ *      f = cpuid_feature_set_next(&baseline.missing_features, f))
+ *     printf("%s is missing on %i hosts, e.g. #%i\n", cpu_feature_str(f),
+ *            baseline.num_lacking_hosts[f], baseline.lacking_hosts[baseline.lacking_hosts_start[f]]);
+ * @endcode
+ *
+ * @returns zero if successful, and some negative number on error.
+ *          The error message can be obtained by calling \ref cpuid_error.
+ *          @see cpu_error_t
+ */
+int cpuid_compute_baseline(const struct cpu_id_t* ids, int count, struct cpu_baseline_t* baseline);
+
+/**
+ * @brief Computes the common capabilities of a fleet of hosts from raw CPUID data
+ * @param raws - array of raw CPUID data, one per host
+ *               (e.g. the first element of each dump loaded with cpuid_deserialize_all_raw_data())
+ * @param count - number of elements in raws
+ * @param baseline - Output - see \ref cpuid_compute_baseline
+ *
+ * Identical raw data are identified only once, so a large fleet built from
+ * a few CPU models is processed quickly.
+ *
+ * @returns zero if successful, and some negative number on error.
+ *          The error message can be obtained by calling \ref cpuid_error.
+ *          @see cpu_error_t
+ */
+int cpuid_compute_baseline_raw(struct cpu_raw_data_t* raws, int count, struct cpu_baseline_t* baseline);
+
+/**
+ * @brief Frees the memory allocated by \ref cpuid_compute_baseline or \ref cpuid_compute_baseline_raw
+ * @param baseline - the baseline to free
+ */
+void cpuid_free_baseline(struct cpu_baseline_t* baseline);
+
+/**
+ * @brief Checks whether an implementation of a kernel can run on the current CPU
+ * @param impl - the implementation
+ *
+ * The current CPU is identified once, on the first call of this function or
+ * \ref cpuid_dispatch_resolve.
+ *
+ * @returns true if the CPU has the feature level and all the features required by impl,
+ *          and if the OS enabled their register state (see \ref cpuid_dispatch_supported_by).
+ */
+bool cpuid_dispatch_supported(const struct cpu_dispatch_impl_t* impl);
+
+/**
+ * @brief Checks whether an implementation of a kernel can run on a given CPU
+ * @param impl - the implementation
+ * @param id - the CPU, as identified by \ref cpu_identify (e.g. from the raw data of another host)
+ * @param xcr0 - the register states enabled by the OS on this CPU, see \ref cpuid_get_xcr0
+ *
+ * On x86, the AVX, XOP, FMA, F16C and AVX2 features (and x86-64-v3) require the
+ * SSE and AVX states (bits 1 and 2 of XCR0). The AVX-512 features (and x86-64-v4)
+ * also require the opmask and ZMM states (bits 5 to 7). Without these states,
+ * the instructions raise an invalid opcode exception even if the CPU has them.
+ * No state is enabled if id lacks CPU_FEATURE_OSXSAVE. xcr0 is ignored on the
+ * other architectures.
+ *
+ * @returns true if the CPU has the feature level and all the features required by impl,
+ *          with their register states enabled.
+ */
+bool cpuid_dispatch_supported_by(const struct cpu_dispatch_impl_t* impl, const struct cpu_id_t* id, uint64_t xcr0);
+
+/**
+ * @brief Reads the XCR0 register of the current CPU
+ *
+ * XCR0 tells which register states the OS saves and restores on context
+ * switches, i.e. which instruction sets (AVX, AVX-512...) it enabled.
+ *
+ * @returns the value of XCR0, or 0 if this is not a x86 CPU or if the OS did
+ *          not enable XGETBV (CPU_FEATURE_OSXSAVE is not set).
+ */
+uint64_t cpuid_get_xcr0(void);
+
+/**
+ * @brief Selects the implementation of a kernel to use on the current CPU
+ * @param dispatch - the kernel, see \ref cpu_dispatch_t
+ *
+ * The first implementation which can run on the current CPU is selected on
+ * the first call. Next calls return the same pointer, so it can be stored and
+ * called directly afterwards. This function is thread-safe.
+ *
+ * @returns the selected implementation, or NULL if none can run on this CPU
+ *          (\ref cpuid_error then reports ERR_NOT_FOUND).
+ */
+cpu_dispatch_fn_t cpuid_dispatch_resolve(struct cpu_dispatch_t* dispatch);
+
+/**
+ * @brief Describes each core type of a system
+ * @param system - the system, as filled by cpu_identify_all()
+ * @param core_types - Output - one element per \ref cpu_purpose_t found in the system,
+ *                     with its logical CPUs, features and caches. The CPU types of
+ *                     several packages with the same purpose are merged.
+ *
+ * On hybrid CPUs, the features of the core types may differ. A thread which
+ * is not bound to a core type should only rely on core_types->common_features.
+ *
+ * @note As the memory is dynamically allocated, be sure to call
+ *       cpuid_free_core_types() after you're done with the data
+ * @returns zero if successful, and some negative number on error.
+ *          The error message can be obtained by calling \ref cpuid_error.
+ *          @see cpu_error_t
+ */
+int cpuid_get_core_types(const struct system_id_t* system, struct cpu_core_types_t* core_types);
+
+/**
+ * @brief Looks up a core type by purpose
+ * @param core_types - the core types, as filled by cpuid_get_core_types()
+ * @param purpose - the purpose to look for (e.g. PURPOSE_PERFORMANCE)
+ * @returns the core type, or NULL if there is no core of this purpose.
+ */
+const struct cpu_core_type_t* cpuid_find_core_type(const struct cpu_core_types_t* core_types, cpu_purpose_t purpose);
+
+/**
+ * @brief Frees the memory allocated by \ref cpuid_get_core_types
+ * @param core_types - the core types to free
+ */
+void cpuid_free_core_types(struct cpu_core_types_t* core_types);
+
+/**
+ * @brief Identifies all the CPUs and builds their topology tree
+ *
+ * It does the same as \ref cpu_identify_all, and also keeps the IDs of each
+ * logical CPU to build a tree of packages, dies, core complexes, cores and
+ * SMT threads, with the cache instances attached to the nodes. This is useful
+ * for placing threads, e.g. on the cores which share a cache.
+ *
+ * When raw_array is NULL, the NUMA nodes of the logical CPUs and caches and
+ * the distances between the nodes are also read, from /sys/devices/system/node
+ * on Linux. Otherwise (or if they are not available), num_numa_nodes is 0 and
+ * all the NUMA node IDs are -1.
+ *
+ * If the LIBCPUID_SYSFS_ROOT environment variable is set, it is prepended to
+ * the sysfs paths, so that the tests can use a fake tree. It is ignored in
+ * setuid and setgid programs (see secure_getenv(3)).
+ *
+ * @param raw_array - Input - a pointer to the array of raw CPUID data, which is obtained
+ *              either by cpuid_get_all_raw_data or cpuid_deserialize_all_raw_data.
+ *              Can also be NULL, in which case the functions calls
+ *              cpuid_get_all_raw_data itself.
+ * @param system - output: the same data as \ref cpu_identify_all (free it with
+ *              \ref cpuid_free_system_id), or NULL if not needed. Its
+ *              system_id_t::topology is a copy of the tree.
+ * @param topology - output: the topology tree
+ *
+ * @note As the memory is dynamically allocated, be sure to call
+ *       cpuid_free_topology() after you're done with the data
+ * @returns zero if successful, and some negative number on error (ERR_NOT_IMP
+ *          if the raw data has no affinity or APIC ID information).
+ */
+int cpuid_get_topology(struct cpu_raw_data_array_t* raw_array, struct system_id_t* system, struct cpu_topology_t* topology);
+
+/**
+ * @brief Returns the node of a logical CPU at a given level of the topology tree
+ * @param topology - the topology tree
+ * @param logical_cpu - the logical CPU
+ * @param level - the level, e.g. TOPOLOGY_CORE for the core of the logical CPU
+ * @returns the node, or NULL if the logical CPU is not in the tree.
+ */
+const struct cpu_topology_node_t* cpuid_get_topology_node(const struct cpu_topology_t* topology, logical_cpu_t logical_cpu, cpu_topology_level_t level);
+
+/**
+ * @brief Frees the memory allocated by \ref cpuid_get_topology
+ * @param topology - the topology tree to free
+ */
+void cpuid_free_topology(struct cpu_topology_t* topology);
+
+/**
+ * @brief Returns the relative distance between two NUMA nodes
+ *
+ * The distances come from the ACPI SLIT table: 10 is the distance of a node to
+ * itself, and the other values are relative to it (e.g. 21 for a remote node
+ * with about twice the latency).
+ *
+ * @param topology - the topology tree, as filled by \ref cpuid_get_topology
+ *                   (or \ref system_id_t::topology)
+ * @param node_a - the ID of the first NUMA node, e.g. from \ref cpu_topology_t::cpu_numa_node
+ * @param node_b - the ID of the second NUMA node
+ * @returns the distance, or -1 if it is unknown.
+ */
+int cpuid_get_numa_distance(const struct cpu_topology_t* topology, int32_t node_a, int32_t node_b);
+
+/**
+ * @brief Lists the cache instances with the logical CPUs which share them
+ *
+ * For every L1, L2, L3 and L4 cache instance, gives the set of logical CPUs
+ * which share it, with its size, associativity and line size. This is useful
+ * e.g. to run a producer and its consumer on the same L2 cache, or to
+ * partition the work by L3 cache.
+ *
+ * \ref cpu_identify_all already fills \ref system_id_t::cache_map, so this
+ * function is only needed for a system and a topology of your own, e.g.:
+ *
+ * @code
+ * struct system_id_t system;
+ * struct cpu_topology_t topology;
+ * struct cpu_cache_map_t map;
+ * if ((cpuid_get_topology(NULL, &system, &topology) == 0) && (cpuid_get_cache_map(&system, &topology, &map) == 0)) {
+ *     const struct cpu_cache_instance_t* l2 = cpuid_get_cpu_cache(&map, 0, CACHE_L2);
+ *     // l2->affinity: the logical CPUs which share the L2 cache of logical CPU 0
+ *     ...
+ *     cpuid_free_cache_map(&map);
+ * }
+ * @endcode
+ *
+ * @param system - the identification returned by \ref cpuid_get_topology
+ * @param topology - the topology returned by \ref cpuid_get_topology
+ * @param map - output: the cache instances
+ *
+ * @note As the memory is dynamically allocated, be sure to call
+ *       cpuid_free_cache_map() after you're done with the data
+ * @returns zero if successful, and some negative number on error (ERR_NOT_FOUND
+ *          if the CPU does not report its cache topology).
+ */
+int cpuid_get_cache_map(const struct system_id_t* system, const struct cpu_topology_t* topology, struct cpu_cache_map_t* map);
+
+/**
+ * @brief Returns the cache of a logical CPU at a given level
+ * @param map - the cache instances
+ * @param logical_cpu - the logical CPU
+ * @param level - the cache level
+ * @returns the cache instance, or NULL if the logical CPU has no such cache.
+ */
+const struct cpu_cache_instance_t* cpuid_get_cpu_cache(const struct cpu_cache_map_t* map, logical_cpu_t logical_cpu, cpu_cache_level_t level);
+
+/**
+ * @brief Frees the memory allocated by \ref cpuid_get_cache_map
+ * @param map - the cache instances to free
+ */
+void cpuid_free_cache_map(struct cpu_cache_map_t* map);
+
 /**
  * @brief Returns textual description of the last error
  *
@@ -1885,6 +3192,16 @@ void cpuid_free_cpu_list(struct cpu_list_t* list);
  */
 void cpuid_free_raw_data_array(struct cpu_raw_data_array_t* raw_array);
 
+/**
+ * @brief Frees a compact raw array
+ *
+ * This function deletes all the memory associated with a compact raw array,
+ * as obtained by cpuid_compact_raw_data_array()
+ *
+ * @param compact - the compact raw array to be free()'d.
+ */
+void cpuid_free_raw_data_compact(struct cpu_raw_data_compact_t* compact);
+
 /**
  * @brief Frees a system ID type
  *
@@ -2003,8 +3320,9 @@ int cpu_rdmsr_range(struct msr_driver_t* handle, uint32_t msr_index, uint8_t hig
  *           processor model, the respective value is returned.
  *           if no information is available, or the CPU doesn't support
  *           the query, the special value CPU_INVALID_VALUE is returned
- * @note This function is not MT-safe. If you intend to call it from multiple
- *       threads, guard it through a mutex or a similar primitive.
+ * @note The CPU information needed by this function is decoded once per handle.
+ *       It can be called from several threads, each with its own handle or
+ *       with a shared one.
  */
 int cpu_msrinfo(struct msr_driver_t* handle, cpu_msrinfo_request_t which);
 #define CPU_INVALID_VALUE 0x3fffffff
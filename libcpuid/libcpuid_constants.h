@@ -43,6 +43,7 @@
 #define MAX_INTELFN11_LEVEL	4
 #define MAX_INTELFN12H_LEVEL	4
 #define MAX_INTELFN14H_LEVEL	4
+#define MAX_INTELFN1FH_LEVEL	6
 #define MAX_AMDFN8000001DH_LEVEL 4
 #define MAX_AMDFN80000026H_LEVEL 4
 #define MAX_ARM_ID_AFR_REGS			1
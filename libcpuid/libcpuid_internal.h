@@ -32,6 +32,7 @@
 
 #define EXTRACTS_BIT(reg, bit)              ((reg >> bit)    & 0x1)
 #define EXTRACTS_BITS(reg, highbit, lowbit) ((reg >> lowbit) & ((1ULL << (highbit - lowbit + 1)) - 1))
+#define RAW_HAS_GROUP(raw, group)           (((raw)->valid_groups == 0) || ((raw)->valid_groups & (group)))
 
 enum _cache_type_t {
 	L1I,
@@ -51,39 +52,39 @@ struct internal_id_info_t {
 struct internal_topology_t {
 	int32_t apic_id;
 	int32_t package_id;
+	int32_t die_id;
+	int32_t complex_id;
+	int32_t tile_id;
+	int32_t module_id;
 	int32_t core_id;
 	int32_t smt_id;
 	int32_t cache_id[NUM_CACHE_TYPES];
 	logical_cpu_t logical_cpu;
 };
 
-struct internal_core_id_t {
-	logical_cpu_t num_logical_cpu;
-	int32_t core_id;
-};
-
-struct internal_cache_id_t {
-	logical_cpu_t num_logical_cpu;
-	int32_t cache_id;
+/* Number of logical CPUs for each core or cache ID, in an open-addressing hash table
+   which is resized as needed (num_logical_cpu is 0 for free slots) */
+struct internal_instance_t {
+	int32_t id;
+	uint32_t num_logical_cpu;
 };
 
-#define CORES_HTABLE_SIZE 256
-struct internal_core_instances_t {
-	uint8_t instances;
-	struct internal_core_id_t htable[CORES_HTABLE_SIZE];
+struct internal_instances_t {
+	uint32_t instances;
+	uint32_t capacity;
+	uint8_t capacity_bits;
+	struct internal_instance_t* htable;
 };
 
-#define CACHES_HTABLE_SIZE 256
 struct internal_cache_instances_t {
-	uint8_t instances[NUM_CACHE_TYPES];
-	struct internal_cache_id_t htable[NUM_CACHE_TYPES][CACHES_HTABLE_SIZE];
+	struct internal_instances_t levels[NUM_CACHE_TYPES];
 };
 
 struct internal_type_info_t {
 	cpu_purpose_t purpose;
 	int32_t package_id;
 	struct internal_id_info_t id_info;
-	struct internal_core_instances_t core_instances;
+	struct internal_instances_t core_instances;
 	struct internal_cache_instances_t cache_instances;
 };
 
@@ -35,15 +35,166 @@
 #include "libcpuid.h"
 #include "libcpuid_util.h"
 #include "libcpuid_internal.h"
+#if defined(_WIN32)
+#include <windows.h>
+#elif defined linux || defined __linux__ || defined __FreeBSD__ || defined __DragonFly__ || defined __NetBSD__ || defined __APPLE__
+#include <pthread.h>
+#include <sched.h>
+#define LIBCPUID_PTHREAD_LOCK
+#endif
 
 int _current_verboselevel;
 
+/* Atomic operations on the state shared by threads */
+#if defined(_WIN32)
+long cpuid_atomic_load(volatile long* ptr)
+{
+	return InterlockedCompareExchange(ptr, 0, 0);
+}
+
+void cpuid_atomic_store(volatile long* ptr, long value)
+{
+	InterlockedExchange(ptr, value);
+}
+
+static bool cpuid_atomic_cas(volatile long* ptr, long expected, long desired)
+{
+	return InterlockedCompareExchange(ptr, desired, expected) == expected;
+}
+
+static void cpuid_yield(void)
+{
+	Sleep(0);
+}
+
+void cpuid_memory_barrier(void)
+{
+	MemoryBarrier();
+}
+#elif defined(__GNUC__)
+long cpuid_atomic_load(volatile long* ptr)
+{
+#if defined(__ATOMIC_ACQUIRE)
+	return __atomic_load_n(ptr, __ATOMIC_ACQUIRE);
+#else
+	return __sync_fetch_and_add(ptr, 0);
+#endif
+}
+
+void cpuid_atomic_store(volatile long* ptr, long value)
+{
+#if defined(__ATOMIC_RELEASE)
+	__atomic_store_n(ptr, value, __ATOMIC_RELEASE);
+#else
+	__sync_synchronize();
+	*ptr = value;
+#endif
+}
+
+static bool cpuid_atomic_cas(volatile long* ptr, long expected, long desired)
+{
+	return __sync_bool_compare_and_swap(ptr, expected, desired);
+}
+
+static void cpuid_yield(void)
+{
+#if defined(LIBCPUID_PTHREAD_LOCK)
+	sched_yield();
+#endif
+}
+
+void cpuid_memory_barrier(void)
+{
+	__sync_synchronize();
+}
+#else
+/* No known atomic operations: the shared state is not thread-safe */
+long cpuid_atomic_load(volatile long* ptr)
+{
+	return *ptr;
+}
+
+void cpuid_atomic_store(volatile long* ptr, long value)
+{
+	*ptr = value;
+}
+
+static bool cpuid_atomic_cas(volatile long* ptr, long expected, long desired)
+{
+	if (*ptr != expected)
+		return false;
+	*ptr = desired;
+	return true;
+}
+
+static void cpuid_yield(void)
+{
+}
+
+void cpuid_memory_barrier(void)
+{
+}
+#endif
+
+#if defined(LIBCPUID_PTHREAD_LOCK)
+static pthread_mutex_t _libcpuid_lock = PTHREAD_MUTEX_INITIALIZER;
+
+void cpuid_lock(void)
+{
+	pthread_mutex_lock(&_libcpuid_lock);
+}
+
+void cpuid_unlock(void)
+{
+	pthread_mutex_unlock(&_libcpuid_lock);
+}
+#else
+static volatile long _libcpuid_lock = 0;
+
+void cpuid_lock(void)
+{
+	while (!cpuid_atomic_cas(&_libcpuid_lock, 0, 1))
+		cpuid_yield();
+}
+
+void cpuid_unlock(void)
+{
+	cpuid_atomic_store(&_libcpuid_lock, 0);
+}
+#endif
+
+#define ONCE_PENDING 0
+#define ONCE_RUNNING 1
+#define ONCE_DONE    2
+
+void cpuid_call_once(cpuid_once_t* once, void (*init)(void))
+{
+	if (cpuid_atomic_load(once) == ONCE_DONE)
+		return;
+	if (cpuid_atomic_cas(once, ONCE_PENDING, ONCE_RUNNING)) {
+		init();
+		cpuid_atomic_store(once, ONCE_DONE);
+		return;
+	}
+	while (cpuid_atomic_load(once) != ONCE_DONE)
+		cpuid_yield();
+}
+
 void match_features(const struct feature_map_t* matchtable, int count, uint32_t reg, struct cpu_id_t* data)
 {
 	int i;
 	for (i = 0; i < count; i++)
 		if (reg & (1u << matchtable[i].bit))
-			data->flags[matchtable[i].feature] = 1;
+			set_feature(data, matchtable[i].feature, true);
+}
+
+void set_feature(struct cpu_id_t* data, cpu_feature_t feature, bool present)
+{
+	data->flags[feature] = present ? 1 : 0;
+	if (present)
+		data->features.words[feature / 64] |= UINT64_C(1) << (feature % 64);
+	else
+		data->features.words[feature / 64] &= ~(UINT64_C(1) << (feature % 64));
 }
 
 static void default_warn(const char *msg)
@@ -80,10 +231,10 @@ void debugf(int verboselevel, const char* format, ...)
 	_warn_fun(buff);
 }
 
-static int score(const struct match_entry_t* entry, const struct cpu_id_t* data)
+/* brand_matches holds the result of match_pattern() for each entry, or is NULL to call it */
+static int score(const struct match_entry_t* entry, int entry_index, const struct cpu_id_t* data, const char* brand_str, const uint32_t* brand_matches)
 {
 	int i, res = 0;
-	char brand_str[BRAND_STR_MAX];
 	const struct { const char *field; int entry; int data; int score; } array[] = {
 		{ "family",     entry->family,     data->x86.family,     2 },
 		{ "model",      entry->model,      data->x86.model,      2 },
@@ -101,15 +252,10 @@ static int score(const struct match_entry_t* entry, const struct cpu_id_t* data)
 		}
 	}
 
-	if ((entry->brand.score > 0) && (strlen(entry->brand.pattern) > 0)) {
-		/* Remove useless substrings in brand_str */
-		strncpy(brand_str, data->brand_str, BRAND_STR_MAX);
-		remove_substring(brand_str, "CPU");
-		remove_substring(brand_str, "Processor");
-		collapse_spaces(brand_str);
+	if ((entry->brand.score > 0) && (entry->brand.pattern[0] != '\0')) {
 		/* Test pattern */
 		debugf(5, "Test if '%s' brand pattern matches '%s'...\n", entry->brand.pattern, brand_str);
-		if (match_pattern(brand_str, entry->brand.pattern)) {
+		if ((brand_matches != NULL) ? (((brand_matches[entry_index / 32] >> (entry_index % 32)) & 1) != 0) : (match_pattern(brand_str, entry->brand.pattern) != 0)) {
 			res += entry->brand.score;
 			debugf(4, "Score: %-12s matches, adding %2i (current score for this entry: %2i)\n", "brand", entry->brand.score, res);
 		}
@@ -118,25 +264,370 @@ static int score(const struct match_entry_t* entry, const struct cpu_id_t* data)
 	return res;
 }
 
+/* Highest score an entry can get, i.e. when all of its fields match */
+static int max_score(const struct match_entry_t* entry)
+{
+	int res = 0;
+	res += (entry->family     >= 0) ? 2 : 0;
+	res += (entry->model      >= 0) ? 2 : 0;
+	res += (entry->stepping   >= 0) ? 2 : 0;
+	res += (entry->ext_family >= 0) ? 2 : 0;
+	res += (entry->ext_model  >= 0) ? 2 : 0;
+	res += (entry->ncores     >= 0) ? 2 : 0;
+	res += (entry->l2cache    >= 0) ? 1 : 0;
+	res += (entry->l3cache    >= 0) ? 1 : 0;
+	if ((entry->brand.score > 0) && (entry->brand.pattern[0] != '\0'))
+		res += entry->brand.score;
+	return res;
+}
+
+/*
+ * The match tables are indexed by (family, ext_family, ext_model): each bucket holds
+ * the entries which have the same values for these fields (-1 included), in table order.
+ * Only the buckets which agree with the CPU need to be scored in full; for the other ones,
+ * each mismatching field costs 2 points, so they are skipped as soon as they cannot beat
+ * the best entry found so far. The result is the same as scoring the whole table.
+ */
+struct match_bucket_t {
+	int family, ext_family, ext_model;
+	int first, count;  /* range in match_index_t.entries */
+	int max_score;     /* highest max_score() of the entries of the bucket */
+};
+
+/*
+ * The brand patterns of a table are compiled in a trie. Each pattern element ('.', '#',
+ * '[<chars>]' or a single character) is turned into the set of characters it accepts,
+ * and the patterns which start with the same elements share the same nodes. A brand
+ * string is matched against all the patterns by walking the trie from each position.
+ */
+struct pattern_node_t {
+	uint32_t accept[8];  /* characters accepted to reach this node from its parent */
+	int first_child;
+	int next_sibling;
+	int first_entry;     /* entries whose pattern ends here, chained by pattern_trie_t.next_entry */
+};
+
+struct pattern_trie_t {
+	int num_nodes;
+	int capacity;
+	struct pattern_node_t* nodes;
+	int* next_entry;
+};
+
+struct match_index_t {
+	const struct match_entry_t* matchtable;
+	int count;
+	int num_buckets;
+	int* entries;      /* entry numbers, sorted by bucket */
+	int* max_scores;   /* max_score() of each entry, by entry number */
+	struct match_bucket_t* buckets;
+	struct pattern_trie_t trie;
+};
+
+#define MAX_MATCH_INDEXES 8
+static struct match_index_t match_indexes[MAX_MATCH_INDEXES];
+static volatile long num_match_indexes = 0; /* incremented with cpuid_atomic_store() once an index is built */
+
+/* Same rules as xmatch_entry(), for all the characters at once; returns the length of the element */
+static int compile_pattern_element(const char* p, uint32_t accept[8])
+{
+	int i, j = 0, len = 1;
+	int v;
+	char c;
+
+	if (p[0] == '[') {
+		j = 1;
+		while (p[j] && p[j] != ']') j++;
+		if (p[j])
+			len = j + 1;
+		else
+			j = 0;
+	}
+	memset(accept, 0, sizeof(uint32_t) * 8);
+	for (v = 1; v < 256; v++) {
+		c = (char) v;
+		if ((tolower(c) == tolower(p[0])) || (p[0] == '.') || ((p[0] == '#') && isdigit(c)))
+			accept[v / 32] |= 1u << (v % 32);
+		for (i = 1; i < j; i++)
+			if (tolower(p[i]) == tolower(c))
+				accept[v / 32] |= 1u << (v % 32);
+	}
+	return len;
+}
+
+static int add_pattern_node(struct pattern_trie_t* trie, const uint32_t accept[8])
+{
+	int capacity;
+	struct pattern_node_t* nodes;
+
+	if (trie->num_nodes >= trie->capacity) {
+		capacity = (trie->capacity > 0) ? trie->capacity * 2 : 256;
+		nodes = (struct pattern_node_t*) realloc(trie->nodes, sizeof(struct pattern_node_t) * capacity);
+		if (nodes == NULL)
+			return -1;
+		trie->nodes    = nodes;
+		trie->capacity = capacity;
+	}
+	memcpy(trie->nodes[trie->num_nodes].accept, accept, sizeof(uint32_t) * 8);
+	trie->nodes[trie->num_nodes].first_child  = -1;
+	trie->nodes[trie->num_nodes].next_sibling = -1;
+	trie->nodes[trie->num_nodes].first_entry  = -1;
+	return trie->num_nodes++;
+}
+
+static bool build_pattern_trie(struct pattern_trie_t* trie, const struct match_entry_t* matchtable, int count)
+{
+	int i, node, child;
+	const char* p;
+	uint32_t accept[8] = { 0 };
+
+	trie->num_nodes  = 0;
+	trie->capacity   = 0;
+	trie->nodes      = NULL;
+	trie->next_entry = (int*) malloc(sizeof(int) * count);
+	if ((trie->next_entry == NULL) || (add_pattern_node(trie, accept) < 0))
+		return false;
+
+	/* Insert the patterns backwards, so that the chains of entries are in table order */
+	for (i = count - 1; i >= 0; i--) {
+		if ((matchtable[i].brand.score <= 0) || (matchtable[i].brand.pattern[0] == '\0'))
+			continue;
+		node = 0;
+		for (p = matchtable[i].brand.pattern; *p; ) {
+			p += compile_pattern_element(p, accept);
+			for (child = trie->nodes[node].first_child; child >= 0; child = trie->nodes[child].next_sibling)
+				if (!memcmp(trie->nodes[child].accept, accept, sizeof(accept)))
+					break;
+			if (child < 0) {
+				child = add_pattern_node(trie, accept);
+				if (child < 0)
+					return false;
+				trie->nodes[child].next_sibling = trie->nodes[node].first_child;
+				trie->nodes[node].first_child   = child;
+			}
+			node = child;
+		}
+		trie->next_entry[i] = trie->nodes[node].first_entry;
+		trie->nodes[node].first_entry = i;
+	}
+	return true;
+}
+
+static void free_pattern_trie(struct pattern_trie_t* trie)
+{
+	free(trie->nodes);
+	free(trie->next_entry);
+	trie->nodes      = NULL;
+	trie->next_entry = NULL;
+}
+
+/* Sets the bit of each entry whose pattern is found in s, like match_pattern() would do */
+static void match_pattern_trie(const struct pattern_trie_t* trie, const char* s, uint32_t* matches)
+{
+	int i, k, node, entry;
+	int stack[BRAND_STR_MAX], depth;
+	const int n = (int) strlen(s);
+	unsigned char c;
+
+	for (i = 0; i < n; i++) {
+		/* Depth-first walk, stack[k] is the node which matched s[i + k - 1] */
+		stack[0] = trie->nodes[0].first_child;
+		depth = 0;
+		while (depth >= 0) {
+			node = stack[depth];
+			if (node < 0) {
+				depth--;
+				if (depth >= 0)
+					stack[depth] = trie->nodes[stack[depth]].next_sibling;
+				continue;
+			}
+			k = i + depth;
+			c = (unsigned char) s[k];
+			if ((c != 0) && ((trie->nodes[node].accept[c / 32] >> (c % 32)) & 1)) {
+				for (entry = trie->nodes[node].first_entry; entry >= 0; entry = trie->next_entry[entry])
+					matches[entry / 32] |= 1u << (entry % 32);
+				if ((trie->nodes[node].first_child >= 0) && (depth + 1 < BRAND_STR_MAX)) {
+					stack[++depth] = trie->nodes[node].first_child;
+					continue;
+				}
+			}
+			stack[depth] = trie->nodes[node].next_sibling;
+		}
+	}
+}
+
+static int compare_match_buckets(const void* a, const void* b)
+{
+	const struct match_bucket_t* ba = (const struct match_bucket_t*) a;
+	const struct match_bucket_t* bb = (const struct match_bucket_t*) b;
+	if (ba->family     != bb->family)     return (ba->family     < bb->family)     ? -1 : 1;
+	if (ba->ext_family != bb->ext_family) return (ba->ext_family < bb->ext_family) ? -1 : 1;
+	if (ba->ext_model  != bb->ext_model)  return (ba->ext_model  < bb->ext_model)  ? -1 : 1;
+	return (ba->first < bb->first) ? -1 : (ba->first > bb->first);
+}
+
+static struct match_index_t* find_match_index(const struct match_entry_t* matchtable, int count, long num_indexes)
+{
+	long i;
+
+	for (i = 0; i < num_indexes; i++)
+		if ((match_indexes[i].matchtable == matchtable) && (match_indexes[i].count == count))
+			return &match_indexes[i];
+	return NULL;
+}
+
+/* Must be called with cpuid_lock() held */
+static struct match_index_t* get_match_index_locked(const struct match_entry_t* matchtable, int count)
+{
+	int i, n;
+	struct match_bucket_t* bucket = NULL;
+	struct match_index_t* index;
+
+	if ((index = find_match_index(matchtable, count, num_match_indexes)) != NULL)
+		return index;
+	if (num_match_indexes >= MAX_MATCH_INDEXES)
+		return NULL;
+
+	index = &match_indexes[num_match_indexes];
+	index->entries    = (int*) malloc(sizeof(int) * count);
+	index->max_scores = (int*) malloc(sizeof(int) * count);
+	index->buckets    = (struct match_bucket_t*) malloc(sizeof(struct match_bucket_t) * count);
+	if (!index->entries || !index->max_scores || !index->buckets || !build_pattern_trie(&index->trie, matchtable, count)) {
+		free(index->entries);
+		free(index->max_scores);
+		free(index->buckets);
+		free_pattern_trie(&index->trie);
+		return NULL;
+	}
+
+	/* Sort one single-entry bucket per entry, then merge the buckets with the same key in place */
+	for (i = 0; i < count; i++) {
+		index->max_scores[i]         = max_score(&matchtable[i]);
+		index->buckets[i].family     = matchtable[i].family;
+		index->buckets[i].ext_family = matchtable[i].ext_family;
+		index->buckets[i].ext_model  = matchtable[i].ext_model;
+		index->buckets[i].first      = i;
+	}
+	qsort(index->buckets, count, sizeof(struct match_bucket_t), compare_match_buckets);
+	for (i = 0; i < count; i++)
+		index->entries[i] = index->buckets[i].first;
+
+	for (i = 0, n = 0; i < count; i++) {
+		if ((bucket == NULL) || (bucket->family != index->buckets[i].family) ||
+		    (bucket->ext_family != index->buckets[i].ext_family) || (bucket->ext_model != index->buckets[i].ext_model)) {
+			bucket = &index->buckets[n++];
+			*bucket = index->buckets[i];
+			bucket->first     = i;
+			bucket->count     = 0;
+			bucket->max_score = 0;
+		}
+		bucket->count++;
+		if (index->max_scores[index->entries[i]] > bucket->max_score)
+			bucket->max_score = index->max_scores[index->entries[i]];
+	}
+	index->matchtable  = matchtable;
+	index->count       = count;
+	index->num_buckets = n;
+	debugf(3, "Indexed %d match table entries in %d buckets, %d brand pattern nodes\n", count, n, index->trie.num_nodes);
+	cpuid_atomic_store(&num_match_indexes, num_match_indexes + 1);
+	return index;
+}
+
+/* The indexes are built on first use, then never modified, so they can be looked up without the lock */
+static struct match_index_t* get_match_index(const struct match_entry_t* matchtable, int count)
+{
+	struct match_index_t* index;
+
+	if ((index = find_match_index(matchtable, count, cpuid_atomic_load(&num_match_indexes))) != NULL)
+		return index;
+	cpuid_lock();
+	index = get_match_index_locked(matchtable, count);
+	cpuid_unlock();
+	return index;
+}
+
+/* Points lost by all the entries of a bucket, because of the fields which do not match the CPU */
+static int bucket_penalty(const struct match_bucket_t* bucket, const struct cpu_id_t* data)
+{
+	int res = 0;
+	res += ((bucket->family     >= 0) && (bucket->family     != data->x86.family))     ? 2 : 0;
+	res += ((bucket->ext_family >= 0) && (bucket->ext_family != data->x86.ext_family)) ? 2 : 0;
+	res += ((bucket->ext_model  >= 0) && (bucket->ext_model  != data->x86.ext_model))  ? 2 : 0;
+	return res;
+}
+
+/* Entries are compared by score, then by position in the table (the first one wins) */
+static bool can_beat(int score, int i, int bestscore, int bestindex)
+{
+	return (score > bestscore) || ((score == bestscore) && (i < bestindex));
+}
+
 int match_cpu_codename(const struct match_entry_t* matchtable, int count, struct cpu_id_t* data)
 {
 	int bestscore = -1;
-	int bestindex = 0;
-	int i, t;
+	int bestindex = count;
+	int i, j, k, t, pass, penalty;
+	char brand_str[BRAND_STR_MAX];
+	uint32_t* brand_matches = NULL;
+	const struct match_bucket_t* bucket;
+	struct match_index_t* index;
 
 	debugf(3, "Matching cpu f:%d, m:%d, s:%d, xf:%d, xm:%d, ncore:%d, l2:%d, l3:%d\n",
 		data->x86.family, data->x86.model, data->x86.stepping, data->x86.ext_family,
 		data->x86.ext_model, data->num_cores, data->l2_cache, data->l3_cache);
 
-	for (i = 0; i < count; i++) {
-		t = score(&matchtable[i], data);
-		debugf(3, "Entry %d, `%s', score %d\n", i, matchtable[i].name, t);
-		if (t > bestscore) {
-			debugf(2, "Entry `%s' selected - best score so far (%d)\n", matchtable[i].name, t);
-			bestscore = t;
-			bestindex = i;
+	/* Remove useless substrings in brand_str */
+	strncpy(brand_str, data->brand_str, BRAND_STR_MAX);
+	brand_str[BRAND_STR_MAX - 1] = '\0';
+	remove_substring(brand_str, "CPU");
+	remove_substring(brand_str, "Processor");
+	collapse_spaces(brand_str);
+
+	index = get_match_index(matchtable, count);
+	if (index == NULL) {
+		for (i = 0; i < count; i++) {
+			t = score(&matchtable[i], i, data, brand_str, NULL);
+			debugf(3, "Entry %d, `%s', score %d\n", i, matchtable[i].name, t);
+			if (t > bestscore) {
+				debugf(2, "Entry `%s' selected - best score so far (%d)\n", matchtable[i].name, t);
+				bestscore = t;
+				bestindex = i;
+			}
 		}
 	}
+	else {
+		/* Match all the brand patterns at once. A '[' in the brand string is taken literally by
+		   match_pattern() even at the start of a [<chars>] element, leave this case to it */
+		if (strchr(brand_str, '[') == NULL) {
+			brand_matches = (uint32_t*) calloc((count + 31) / 32, sizeof(uint32_t));
+			if (brand_matches != NULL)
+				match_pattern_trie(&index->trie, brand_str, brand_matches);
+		}
+		/* Score the buckets which agree with the CPU first, so that the other ones are likely to be skipped */
+		for (pass = 0; pass < 2; pass++) {
+			for (j = 0; j < index->num_buckets; j++) {
+				bucket  = &index->buckets[j];
+				penalty = bucket_penalty(bucket, data);
+				if (((pass == 0) != (penalty == 0)) || !can_beat(bucket->max_score - penalty, index->entries[bucket->first], bestscore, bestindex))
+					continue;
+				for (k = bucket->first; k < bucket->first + bucket->count; k++) {
+					i = index->entries[k];
+					if (!can_beat(index->max_scores[i] - penalty, i, bestscore, bestindex))
+						continue;
+					t = score(&matchtable[i], i, data, brand_str, brand_matches);
+					debugf(3, "Entry %d, `%s', score %d\n", i, matchtable[i].name, t);
+					if (can_beat(t, i, bestscore, bestindex)) {
+						debugf(2, "Entry `%s' selected - best score so far (%d)\n", matchtable[i].name, t);
+						bestscore = t;
+						bestindex = i;
+					}
+				}
+			}
+		}
+	}
+	free(brand_matches);
+	if (bestindex >= count)
+		bestindex = 0;
 	strncpy(data->cpu_codename,    matchtable[bestindex].name,       CODENAME_STR_MAX);
 	strncpy(data->technology_node, matchtable[bestindex].technology, TECHNOLOGY_STR_MAX);
 	return bestscore;
@@ -251,18 +742,23 @@ void collapse_spaces(char* string)
 	string[j] = '\0';
 }
 
-struct cpu_id_t* get_cached_cpuid(void)
+static cpuid_once_t cached_cpuid_once = CPUID_ONCE_INIT;
+static struct cpu_id_t cached_cpuid;
+
+static void init_cached_cpuid(void)
 {
-	static int initialized = 0;
-	static struct cpu_id_t id;
-	if (initialized) return &id;
-	if (cpu_identify(NULL, &id) != ERR_OK) {
-		memset(&id, 0, sizeof(id));
-		id.architecture = ARCHITECTURE_UNKNOWN;
-		id.vendor       = VENDOR_UNKNOWN;
+	if (cpu_identify(NULL, &cached_cpuid) != ERR_OK) {
+		memset(&cached_cpuid, 0, sizeof(cached_cpuid));
+		cached_cpuid.architecture  = ARCHITECTURE_UNKNOWN;
+		cached_cpuid.vendor        = VENDOR_UNKNOWN;
+		cached_cpuid.feature_level = FEATURE_LEVEL_UNKNOWN;
 	}
-	initialized = 1;
-	return &id;
+}
+
+struct cpu_id_t* get_cached_cpuid(void)
+{
+	cpuid_call_once(&cached_cpuid_once, init_cached_cpuid);
+	return &cached_cpuid;
 }
 
 int match_all(uint64_t bits, uint64_t mask)
@@ -310,7 +806,7 @@ void clear_affinity_mask_bit(logical_cpu_t logical_cpu, cpu_affinity_mask_t *aff
 }
 
 /* https://github.com/torvalds/linux/blob/3e5c673f0d75bc22b3c26eade87e4db4f374cd34/include/linux/bitops.h#L210-L216 */
-static int get_count_order(unsigned int x)
+int get_count_order(unsigned int x)
 {
 	int r = 32;
 
@@ -395,7 +891,7 @@ void decode_number_of_cores_x86(struct cpu_raw_data_t* raw, struct cpu_id_t* dat
 			data->num_cores = 1;
 			data->num_logical_cpus = (logical_cpus >= 1 ? logical_cpus : 1);
 			if (data->num_logical_cpus == 1)
-				data->flags[CPU_FEATURE_HT] = 0;
+				set_feature(data, CPU_FEATURE_HT, false);
 		}
 	} else {
 		data->num_cores = data->num_logical_cpus = (logical_cpus >= 1 ? logical_cpus : 1);
@@ -438,7 +934,7 @@ void decode_deterministic_cache_info_x86(uint32_t cache_regs[][NUM_REGS],
 		sets                    = EXTRACTS_BITS(cache_regs[i][ECX], 31,  0) + 1;
 		size                    = ways * partitions * linesize * sets / 1024;
 		index_msb               = get_count_order(num_sharing_cache);
-		internal->cache_mask[i] = ~((1 << index_msb) - 1);
+		internal->cache_mask[type] = ~((1 << index_msb) - 1);
 		assign_cache_data(1, type, size, ways, linesize, data);
 	}
 }
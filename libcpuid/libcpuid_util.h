@@ -39,6 +39,9 @@ struct feature_map_t {
 void match_features(const struct feature_map_t* matchtable, int count,
                     uint32_t reg, struct cpu_id_t* data);
 
+/* Sets or clears a feature in both cpu_id_t::flags and cpu_id_t::features */
+void set_feature(struct cpu_id_t* data, cpu_feature_t feature, bool present);
+
 
 struct match_entry_t {
 	int family, model, stepping, ext_family, ext_model;
@@ -93,9 +96,37 @@ void collapse_spaces(char* string);
 /*
  * Gets an initialized cpu_id_t. It is cached, so that internal libcpuid
  * machinery doesn't need to issue cpu_identify more than once.
+ * It is initialized once, even if several threads call it at the same time.
  */
 struct cpu_id_t* get_cached_cpuid(void);
 
+/*
+ * Library-wide lock, guarding the state which is initialized on first use.
+ * It is not recursive: do not call other libcpuid functions while holding it.
+ */
+void cpuid_lock(void);
+void cpuid_unlock(void);
+
+/*
+ * One-time initialization: the first caller runs `init', the other threads
+ * wait until it returns. `init' may call other libcpuid functions, but must not
+ * use the same cpuid_once_t.
+ */
+typedef volatile long cpuid_once_t;
+#define CPUID_ONCE_INIT 0
+void cpuid_call_once(cpuid_once_t* once, void (*init)(void));
+
+/*
+ * Atomic load with acquire semantics, and store with release semantics.
+ */
+long cpuid_atomic_load(volatile long* ptr);
+void cpuid_atomic_store(volatile long* ptr, long value);
+
+/*
+ * Full memory barrier, also between processes which share memory.
+ */
+void cpuid_memory_barrier(void);
+
 
 /* returns true if all bits of mask are present in `bits'. */
 int match_all(uint64_t bits, uint64_t mask);
@@ -135,6 +166,9 @@ bool get_affinity_mask_bit(logical_cpu_t logical_cpu, cpu_affinity_mask_t *affin
 /* set bit corresponding to 'logical_cpu' to '0' */
 void clear_affinity_mask_bit(logical_cpu_t logical_cpu, cpu_affinity_mask_t *affinity_mask);
 
+/* number of bits needed to count up to x, i.e. ceil(log2(x)); -1 for 0 */
+int get_count_order(unsigned int x);
+
 /* assign cache values in cpu_id_t type */
 void assign_cache_data(uint8_t on, cache_type_t cache, int size, int assoc, int linesize, struct cpu_id_t* data);
 
@@ -38,6 +38,9 @@
 
 #define MSR_PATH_LEN 32
 
+/* Decoded CPU information of a handle, used by cpu_msrinfo() */
+struct msr_info_t;
+
 #if defined (__linux__) || defined (__gnu_linux__)
 /* Assuming linux with /dev/cpu/x/msr: */
 #include <unistd.h>
@@ -45,7 +48,7 @@
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <errno.h>
-struct msr_driver_t { int fd; };
+struct msr_driver_t { int fd; struct msr_info_t* info; };
 static int rdmsr_supported(void);
 static int load_driver(char *msr_path)
 {
@@ -99,7 +102,8 @@ struct msr_driver_t* cpu_msr_driver_open_core(unsigned core_num)
 		close(fd);
 		return NULL;
 	}
-	handle->fd = fd;
+	handle->fd   = fd;
+	handle->info = NULL;
 	return handle;
 }
 
@@ -119,6 +123,7 @@ int cpu_msr_driver_close(struct msr_driver_t* drv)
 {
 	if (drv && drv->fd >= 0) {
 		close(drv->fd);
+		free(drv->info);
 		free(drv);
 	}
 	return 0;
@@ -134,7 +139,7 @@ int cpu_msr_driver_close(struct msr_driver_t* drv)
 #include <sys/ioctl.h>
 #include <sys/cpuctl.h>
 
-struct msr_driver_t { int fd; };
+struct msr_driver_t { int fd; struct msr_info_t* info; };
 static int rdmsr_supported(void);
 static int load_driver(char *msr_path)
 {
@@ -187,7 +192,8 @@ struct msr_driver_t* cpu_msr_driver_open_core(unsigned core_num)
 		cpuid_set_error(ERR_NO_MEM);
 		return NULL;
 	}
-	handle->fd = fd;
+	handle->fd   = fd;
+	handle->info = NULL;
 	return handle;
 }
 
@@ -210,6 +216,7 @@ int cpu_msr_driver_close(struct msr_driver_t* drv)
 {
 	if (drv && drv->fd >= 0) {
 		close(drv->fd);
+		free(drv->info);
 		free(drv);
 	}
 	return 0;
@@ -234,6 +241,7 @@ struct msr_driver_t {
 	HANDLE hhDriver;
 	OVERLAPPED ovl;
 	int errorcode;
+	struct msr_info_t* info;
 };
 
 static int rdmsr_supported(void);
@@ -458,6 +466,8 @@ int cpu_msr_driver_close(struct msr_driver_t* drv)
 {
 	SERVICE_STATUS srvStatus = {0};
 	if (drv == NULL) return 0;
+	free(drv->info);
+	drv->info = NULL;
 	if(drv->scDriver != NULL){
 		if (drv->hhDriver) CancelIo(drv->hhDriver);
 		if(drv->ovl.hEvent != NULL)
@@ -633,12 +643,33 @@ static const uint32_t intel_msr[] = {
 };
 
 struct msr_info_t {
-	int cpu_clock;
 	struct msr_driver_t *handle;
 	struct cpu_id_t *id;
 	struct internal_id_info_t *internal;
+	/* Cached results, -1 (or 0 for the address) until computed */
+	int platform_info_supported;
+	int intel_core_supported;
+	uint32_t amd_last_pstate_addr;
+	/* Storage for id and internal */
+	struct cpu_id_t id_data;
+	struct internal_id_info_t internal_data;
 };
 
+/* The measure takes 250 ms: it is done once, when a request needs the clock */
+static cpuid_once_t cpu_clock_once = CPUID_ONCE_INIT;
+static int measured_cpu_clock = -1;
+
+static void measure_cpu_clock(void)
+{
+	measured_cpu_clock = cpu_clock_measure(250, 1);
+}
+
+static int get_cpu_clock(void)
+{
+	cpuid_call_once(&cpu_clock_once, measure_cpu_clock);
+	return measured_cpu_clock;
+}
+
 static int rdmsr_supported(void)
 {
 	struct cpu_id_t* id = get_cached_cpuid();
@@ -663,11 +694,10 @@ static int perfmsr_measure(struct msr_driver_t* handle, int msr)
 static int msr_platform_info_supported(struct msr_info_t *info)
 {
 	int i;
-	static int supported = -1;
 
 	/* Return cached result */
-	if(supported >= 0)
-		return supported;
+	if(info->platform_info_supported >= 0)
+		return info->platform_info_supported;
 
 	/* List of microarchitectures that provide both "Maximum Non-Turbo Ratio" and "Maximum Efficiency Ratio" values
 	Please note Silvermont does not report "Maximum Efficiency Ratio" */
@@ -754,25 +784,24 @@ static int msr_platform_info_supported(struct msr_info_t *info)
 		for(i = 0; i < COUNT_OF(msr_platform_info); i++) {
 			if((info->id->x86.ext_family == msr_platform_info[i].ext_family) && (info->id->x86.ext_model == msr_platform_info[i].ext_model)) {
 				debugf(2, "Intel CPU with CPUID signature %02X_%02XH supports MSR_PLATFORM_INFO.\n", info->id->x86.ext_family, info->id->x86.ext_model);
-				supported = 1;
-				return supported;
+				info->platform_info_supported = 1;
+				return info->platform_info_supported;
 			}
 		}
 		debugf(2, "Intel CPU with CPUID signature %02X_%02XH does not support MSR_PLATFORM_INFO.\n", info->id->x86.ext_family, info->id->x86.ext_model);
 	}
 
-	supported = 0;
-	return supported;
+	info->platform_info_supported = 0;
+	return info->platform_info_supported;
 }
 
 static int msr_intel_core_supported(struct msr_info_t *info)
 {
 	int i;
-	static int supported = -1;
 
 	/* Return cached result */
-	if(supported >= 0)
-		return supported;
+	if(info->intel_core_supported >= 0)
+		return info->intel_core_supported;
 
 	/* List of microarchitectures that provide "Core Voltage" values */
 	const struct { int32_t ext_family; int32_t ext_model; } msr_perf_status[] = {
@@ -844,15 +873,15 @@ static int msr_intel_core_supported(struct msr_info_t *info)
 		for(i = 0; i < COUNT_OF(msr_perf_status); i++) {
 			if((info->id->x86.ext_family == msr_perf_status[i].ext_family) && (info->id->x86.ext_model == msr_perf_status[i].ext_model)) {
 				debugf(2, "Intel CPU with CPUID signature %02X_%02XH supports MSR_PERF_STATUS.\n", info->id->x86.ext_family, info->id->x86.ext_model);
-				supported = 1;
-				return supported;
+				info->intel_core_supported = 1;
+				return info->intel_core_supported;
 			}
 		}
 		debugf(2, "Intel CPU with CPUID signature %02X_%02XH does not support MSR_PERF_STATUS.\n", info->id->x86.ext_family, info->id->x86.ext_model);
 	}
 
-	supported = 0;
-	return supported;
+	info->intel_core_supported = 0;
+	return info->intel_core_supported;
 }
 
 static int get_amd_multipliers(struct msr_info_t *info, uint32_t pstate, double *multiplier)
@@ -911,7 +940,7 @@ static int get_amd_multipliers(struct msr_info_t *info, uint32_t pstate, double
 			Note: This family contains only APUs */
 			err  = cpu_rdmsr_range(info->handle, pstate, 8, 4, &CpuDid);
 			err += cpu_rdmsr_range(info->handle, pstate, 3, 0, &CpuDidLSD);
-			*multiplier = (double) (((info->cpu_clock + 5) / 100 + magic_constant) / (CpuDid + CpuDidLSD * 0.25 + 1));
+			*multiplier = (double) (((get_cpu_clock() + 5) / 100 + magic_constant) / (CpuDid + CpuDidLSD * 0.25 + 1));
 			break;
 		case 0x10: /* K10 */
 			/* BKDG 10h, page 429
@@ -974,12 +1003,12 @@ static int get_amd_multipliers(struct msr_info_t *info, uint32_t pstate, double
 
 static uint32_t get_amd_last_pstate_addr(struct msr_info_t *info)
 {
-	static uint32_t last_addr = 0x0;
+	uint32_t last_addr;
 	uint64_t reg = 0x0;
 
 	/* The result is cached, need to be computed once */
-	if(last_addr != 0x0)
-		return last_addr;
+	if(info->amd_last_pstate_addr != 0x0)
+		return info->amd_last_pstate_addr;
 
 	/* Refer links above
 	MSRC001_00[6B:64][63] is PstateEn
@@ -989,6 +1018,7 @@ static uint32_t get_amd_last_pstate_addr(struct msr_info_t *info)
 		last_addr--;
 		cpu_rdmsr_range(info->handle, last_addr, 63, 63, &reg);
 	}
+	info->amd_last_pstate_addr = last_addr;
 	return last_addr;
 }
 
@@ -1177,7 +1207,7 @@ static double get_info_bus_clock(struct msr_info_t *info)
 		Table 35-40.  Selected MSRs Supported by Next Generation Intel® Xeon Phi™ Processors with DisplayFamily_DisplayModel Signature 06_57H
 		MSR_PLATFORM_INFO[15:8] is Maximum Non-Turbo Ratio */
 		err = cpu_rdmsr_range(info->handle, MSR_PLATFORM_INFO, 15, 8, &reg);
-		if (!err) return (double) info->cpu_clock / reg;
+		if (!err) return (double) get_cpu_clock() / reg;
 	}
 	else if(info->id->vendor == VENDOR_AMD || info->id->vendor == VENDOR_HYGON) {
 		/* Refer links above
@@ -1186,7 +1216,7 @@ static double get_info_bus_clock(struct msr_info_t *info)
 		addr = get_amd_last_pstate_addr(info);
 		err  = cpu_rdmsr_range(info->handle, MSR_PSTATE_L, 6, 4, &reg);
 		err += get_amd_multipliers(info, addr - (uint32_t) reg, &mult);
-		if (!err) return (double) info->cpu_clock / mult;
+		if (!err) return (double) get_cpu_clock() / mult;
 	}
 
 	return (double) CPU_INVALID_VALUE / 100;
@@ -1212,30 +1242,63 @@ int cpu_rdmsr_range(struct msr_driver_t* handle, uint32_t msr_index, uint8_t hig
 	return err;
 }
 
-int cpu_msrinfo(struct msr_driver_t* handle, cpu_msrinfo_request_t which)
+/* The decoded CPU information is computed on the first use of a handle, then kept in it */
+static struct msr_info_t* get_msr_info(struct msr_driver_t* handle)
 {
-	static int err = 0, init = 0;
 	struct cpu_raw_data_t raw;
-	static struct cpu_id_t id;
-	static struct internal_id_info_t internal;
-	static struct msr_info_t info;
+	struct msr_info_t* info;
+
+	/* A handle can be shared by several threads: the information is decoded without holding the lock,
+	   and the first one published in the handle is kept */
+	cpuid_lock();
+	info = handle->info;
+	cpuid_unlock();
+	if (info != NULL)
+		return info;
+	info = (struct msr_info_t*) calloc(1, sizeof(struct msr_info_t));
+	if (!info) {
+		cpuid_set_error(ERR_NO_MEM);
+		return NULL;
+	}
+	if ((cpuid_get_raw_data(&raw) != ERR_OK) || (cpu_ident_internal(&raw, &info->id_data, &info->internal_data) != ERR_OK)) {
+		free(info);
+		return NULL;
+	}
+	info->handle                  = handle;
+	info->id                      = &info->id_data;
+	info->internal                = &info->internal_data;
+	info->platform_info_supported = -1;
+	info->intel_core_supported    = -1;
+	info->amd_last_pstate_addr    = 0x0;
+
+	/* Compute the cached results now, so that they are not written after the publication */
+	msr_platform_info_supported(info);
+	msr_intel_core_supported(info);
+	if ((info->id->vendor == VENDOR_AMD) || (info->id->vendor == VENDOR_HYGON))
+		get_amd_last_pstate_addr(info);
+
+	cpuid_lock();
+	if (handle->info == NULL)
+		handle->info = info;
+	else {
+		free(info);
+		info = handle->info;
+	}
+	cpuid_unlock();
+	return info;
+}
+
+int cpu_msrinfo(struct msr_driver_t* handle, cpu_msrinfo_request_t which)
+{
+	struct msr_info_t* info;
 
 	if (handle == NULL) {
 		cpuid_set_error(ERR_HANDLE);
 		return CPU_INVALID_VALUE;
 	}
 
-	info.handle = handle;
-	if (!init) {
-		err  = cpuid_get_raw_data(&raw);
-		err += cpu_ident_internal(&raw, &id, &internal);
-		info.cpu_clock = cpu_clock_measure(250, 1);
-		info.id = &id;
-		info.internal = &internal;
-		init = 1;
-	}
-
-	if (err)
+	info = get_msr_info(handle);
+	if (info == NULL)
 		return CPU_INVALID_VALUE;
 
 	switch (which) {
@@ -1244,20 +1307,20 @@ int cpu_msrinfo(struct msr_driver_t* handle, cpu_msrinfo_request_t which)
 		case INFO_APERF:
 			return perfmsr_measure(handle, IA32_APERF);
 		case INFO_MIN_MULTIPLIER:
-			return (int) (get_info_min_multiplier(&info) * 100);
+			return (int) (get_info_min_multiplier(info) * 100);
 		case INFO_CUR_MULTIPLIER:
-			return (int) (get_info_cur_multiplier(&info) * 100);
+			return (int) (get_info_cur_multiplier(info) * 100);
 		case INFO_MAX_MULTIPLIER:
-			return (int) (get_info_max_multiplier(&info) * 100);
+			return (int) (get_info_max_multiplier(info) * 100);
 		case INFO_TEMPERATURE:
-			return get_info_temperature(&info);
+			return get_info_temperature(info);
 		case INFO_THROTTLING:
 			return CPU_INVALID_VALUE;
 		case INFO_VOLTAGE:
-			return (int) (get_info_voltage(&info) * 100);
+			return (int) (get_info_voltage(info) * 100);
 		case INFO_BCLK:
 		case INFO_BUS_CLOCK:
-			return (int) (get_info_bus_clock(&info) * 100);
+			return (int) (get_info_bus_clock(info) * 100);
 		default:
 			return CPU_INVALID_VALUE;
 	}
@@ -1269,8 +1332,8 @@ int msr_serialize_raw_data(struct msr_driver_t* handle, const char* filename)
 	FILE *f;
 	uint64_t reg;
 	const uint32_t *msr;
+	struct msr_info_t* info;
 	struct cpu_id_t* id;
-	static int cpu_clock = 0;
 
 	/* Check if MSR driver is initialized */
 	if (handle == NULL)
@@ -1281,19 +1344,17 @@ int msr_serialize_raw_data(struct msr_driver_t* handle, const char* filename)
 	if (!f)
 		return cpuid_set_error(ERR_OPEN);
 
-	/* Get cached decoded CPUID information */
-	id = get_cached_cpuid();
-	if (id->vendor == VENDOR_UNKNOWN) {
-		fclose(f);
+	/* Get decoded CPUID information, cached in the handle */
+	info = get_msr_info(handle);
+	if (info == NULL) {
+		if (f != stdout)
+			fclose(f);
 		return cpuid_get_error();
 	}
-
-	/* Get CPU stock speed */
-	if (cpu_clock == 0)
-		cpu_clock = cpu_clock_measure(250, 1);
+	id = info->id;
 
 	/* Check if CPU vendor is supported */
-	fprintf(f, "vendor_str=%s\nbrand_str=%s\ncpu_clock_measure=%dMHz\n", id->vendor_str, id->brand_str, cpu_clock);
+	fprintf(f, "vendor_str=%s\nbrand_str=%s\ncpu_clock_measure=%dMHz\n", id->vendor_str, id->brand_str, get_cpu_clock());
 	switch (id->vendor) {
 		case VENDOR_HYGON:
 		case VENDOR_AMD:   msr = amd_msr;   break;
@@ -619,7 +619,7 @@ static void decode_amd_number_of_cores(struct cpu_raw_data_t* raw, struct cpu_id
 int cpuid_identify_amd(struct cpu_raw_data_t* raw, struct cpu_id_t* data, struct internal_id_info_t* internal)
 {
 	load_amd_features(raw, data);
-	if ((EXTRACTS_BIT(raw->ext_cpuid[1][ECX], 22) == 1) && (EXTRACTS_BITS(raw->amd_fn8000001dh[0][EAX], 4, 0) != 0)) /* TopologyExtensions supported */
+	if ((EXTRACTS_BIT(raw->ext_cpuid[1][ECX], 22) == 1) && RAW_HAS_GROUP(raw, RAW_GROUP_CACHE) && (EXTRACTS_BITS(raw->amd_fn8000001dh[0][EAX], 4, 0) != 0)) /* TopologyExtensions supported */
 		decode_deterministic_cache_info_x86(raw->amd_fn8000001dh, MAX_AMDFN8000001DH_LEVEL, data, internal);
 	else
 		decode_amd_cache_info(raw, data);
@@ -641,7 +641,7 @@ cpu_purpose_t cpuid_identify_purpose_amd(struct cpu_raw_data_t* raw)
 	int i;
 
 	/* Check if Extended CPU Topology is supported */
-	if (raw->amd_fn80000026h[0][EAX] == 0x0)
+	if (!RAW_HAS_GROUP(raw, RAW_GROUP_TOPOLOGY) || (raw->amd_fn80000026h[0][EAX] == 0x0))
 		return PURPOSE_GENERAL;
 
 	/* Check for heterogeneous cores
@@ -670,3 +670,83 @@ cpu_purpose_t cpuid_identify_purpose_amd(struct cpu_raw_data_t* raw)
 
 	return PURPOSE_GENERAL;
 }
+
+bool cpuid_identify_topology_amd(struct cpu_raw_data_t* raw, struct internal_topology_t* topology)
+{
+	int i, family, model;
+	uint8_t level_type;
+	uint32_t apic_id, shift, smt_shift, core_shift;
+
+	/* From AMD64 Architecture Programmer’s Manual - Volume 3: General-Purpose and System Instructions
+	Available at https://www.amd.com/content/dam/amd/en/documents/processor-tech-docs/programmer-references/24594.pdf
+
+	- CPUID_Fn8000001E_EAX [Extended APIC ID] is the APIC ID of the logical CPU.
+	- CPUID_Fn8000001E_EBX [Compute Unit Identifiers][7:0] is ComputeUnitId, [15:8] is ThreadsPerComputeUnit.
+	- CPUID_Fn8000001E_ECX [Node Identifiers][7:0] is NodeId.
+	- CPUID_Fn80000026_EAX [Extended CPU Topology][4:0] is MaskWidth.
+	  Number of bits to shift the extended APIC ID right to get a unique topology ID of the current hierarchy level.
+	- CPUID_Fn80000026_ECX [Extended CPU Topology][15:8] is LevelType.
+	  LevelType 01h is Core, 02h is Complex, 03h is Die and 04h is Socket.
+
+	Unlike leaves 0Bh and 1Fh, where the shift of a level gives the ID of the next level up, MaskWidth gives the ID
+	of its own level: e.g. on the Ryzen 9 7900X, the Core level has MaskWidth 1 and 2 logical CPUs, the Complex and
+	Die levels have MaskWidth 4 and 12 logical CPUs (one complex of 6 cores per die). This is also how Linux maps
+	them (Core to its SMT domain, whose shift gives the core ID). The IDs below keep the APIC ID bits above MaskWidth.
+	*/
+	const bool has_topology_extensions = RAW_HAS_GROUP(raw, RAW_GROUP_EXT) && (raw->ext_cpuid[0][EAX] >= 0x8000001E) && (EXTRACTS_BIT(raw->ext_cpuid[1][ECX], 22) == 1);
+	const bool has_extended_topology   = RAW_HAS_GROUP(raw, RAW_GROUP_TOPOLOGY) && (raw->ext_cpuid[0][EAX] >= 0x80000026) && (EXTRACTS_BITS(raw->amd_fn80000026h[0][EBX], 15, 0) != 0);
+
+	family = EXTRACTS_BITS(raw->basic_cpuid[1][EAX], 11, 8);
+	model  = EXTRACTS_BITS(raw->basic_cpuid[1][EAX], 7, 4);
+	if (family == 0xF) {
+		family += EXTRACTS_BITS(raw->basic_cpuid[1][EAX], 27, 20);
+		model  += EXTRACTS_BITS(raw->basic_cpuid[1][EAX], 19, 16) << 4;
+	}
+
+	/* Without leaf 0Bh, the SMT, core and package IDs are derived from the extended APIC ID */
+	if (topology->apic_id < 0) {
+		/* The cache instances come from leaf 8000001Dh, which older dumps do not have */
+		if (!has_topology_extensions || !RAW_HAS_GROUP(raw, RAW_GROUP_CACHE) || (EXTRACTS_BITS(raw->amd_fn8000001dh[0][EAX], 4, 0) == 0))
+			return false;
+		apic_id    = raw->ext_cpuid[0x1e][EAX];
+		/* The compute units of the Bulldozer family are pairs of cores, not of SMT threads */
+		smt_shift  = (family >= 0x17) ? (uint32_t) get_count_order(EXTRACTS_BITS(raw->ext_cpuid[0x1e][EBX], 15, 8) + 1) : 0;
+		core_shift = EXTRACTS_BITS(raw->ext_cpuid[8][ECX], 15, 12);
+		if (core_shift == 0)
+			core_shift = (uint32_t) get_count_order(EXTRACTS_BITS(raw->ext_cpuid[8][ECX], 7, 0) + 1);
+		topology->apic_id    = (int32_t) apic_id;
+		topology->smt_id     = (int32_t) (apic_id & ~(UINT32_MAX << smt_shift));
+		topology->core_id    = (int32_t) (apic_id & ~(UINT32_MAX << core_shift) & (UINT32_MAX << smt_shift));
+		topology->package_id = (int32_t) (apic_id & (UINT32_MAX << core_shift));
+	}
+	apic_id = (uint32_t) topology->apic_id;
+
+	/* A compute unit of the Bulldozer family shares the front-end, the FPU and the L2 cache between two cores */
+	if (has_topology_extensions && (family == 0x15))
+		topology->module_id = EXTRACTS_BITS(raw->ext_cpuid[0x1e][EBX], 7, 0);
+
+	if (has_extended_topology) {
+		/* Core complexes (CCX), dies (CCD) and sockets */
+		for (i = 0; (i < MAX_AMDFN80000026H_LEVEL) && ((level_type = EXTRACTS_BITS(raw->amd_fn80000026h[i][ECX], 15, 8)) != 0); i++) {
+			shift = EXTRACTS_BITS(raw->amd_fn80000026h[i][EAX], 4, 0);
+			switch (level_type) {
+				case 0x02: topology->complex_id = (int32_t) (apic_id & (UINT32_MAX << shift)); break;
+				case 0x03: topology->die_id     = (int32_t) (apic_id & (UINT32_MAX << shift)); break;
+				case 0x04: topology->package_id = (int32_t) (apic_id & (UINT32_MAX << shift)); break;
+				default: break;
+			}
+		}
+	}
+	else if (has_topology_extensions && ((family == 0x15) || ((family == 0x17) && (model < 0x30)))) {
+		/* Up to Zen+, each die of a package is a node; later nodes are NUMA partitions of the I/O die,
+		   so the dies are unknown and the core complexes are only given by the L3 cache */
+		topology->die_id = EXTRACTS_BITS(raw->ext_cpuid[0x1e][ECX], 7, 0);
+		/* The cores of a Bulldozer node share its L3 cache, but their APIC IDs are not aligned on a power of two */
+		if ((family == 0x15) && (EXTRACTS_BITS(raw->ext_cpuid[6][EDX], 31, 18) != 0))
+			topology->complex_id = topology->die_id;
+	}
+	debugf(3, "Logical CPU %u: extended APIC ID %08x, package %08x, die %08x, complex %08x, compute unit %08x\n", topology->logical_cpu,
+		apic_id, topology->package_id, topology->die_id, topology->complex_id, topology->module_id);
+
+	return true;
+}
@@ -29,5 +29,6 @@
 int cpuid_identify_amd(struct cpu_raw_data_t* raw, struct cpu_id_t* data, struct internal_id_info_t* internal);
 void cpuid_get_list_amd(struct cpu_list_t* list);
 cpu_purpose_t cpuid_identify_purpose_amd(struct cpu_raw_data_t* raw);
+bool cpuid_identify_topology_amd(struct cpu_raw_data_t* raw, struct internal_topology_t* topology);
 
 #endif /* __RECOG_AMD_H__ */
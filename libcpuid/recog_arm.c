@@ -582,7 +582,7 @@ static void set_feature_status(struct cpu_id_t* data, struct arm_arch_extension_
 		ext_status->total[mandatory_from].mandatory++;
 
 	if (is_present) {
-		data->flags[feature] = 1;
+		set_feature(data, feature, true);
 		debugf(3, "feature %s is present", cpu_feature_str(feature));
 		if (optional_from >= 0) {
 			ext_status->present[optional_from].optional++;
@@ -87,7 +87,7 @@ const struct match_entry_t cpudb_centaur[] = {
 
 int cpuid_identify_centaur(struct cpu_raw_data_t* raw, struct cpu_id_t* data, struct internal_id_info_t* internal)
 {
-	if (raw->basic_cpuid[0][EAX] >= 4)
+	if ((raw->basic_cpuid[0][EAX] >= 4) && RAW_HAS_GROUP(raw, RAW_GROUP_CACHE))
 		decode_deterministic_cache_info_x86(raw->intel_fn4, MAX_INTELFN4_LEVEL, data, internal);
 	decode_number_of_cores_x86(raw, data);
 	decode_architecture_version_x86(data);
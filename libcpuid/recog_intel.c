@@ -887,19 +887,19 @@ struct cpu_epc_t cpuid_get_epc(int index, const struct cpu_raw_data_t* raw)
 int cpuid_identify_intel(struct cpu_raw_data_t* raw, struct cpu_id_t* data, struct internal_id_info_t* internal)
 {
 	load_intel_features(raw, data);
-	if (raw->basic_cpuid[0][EAX] >= 4) {
+	if ((raw->basic_cpuid[0][EAX] >= 4) && RAW_HAS_GROUP(raw, RAW_GROUP_CACHE)) {
 		/* Deterministic way is preferred, being more generic */
 		decode_deterministic_cache_info_x86(raw->intel_fn4, MAX_INTELFN4_LEVEL, data, internal);
 	} else if (raw->basic_cpuid[0][EAX] >= 2) {
 		decode_intel_oldstyle_cache_info(raw, data);
 	}
-	if ((raw->basic_cpuid[0][EAX] < 11) || (decode_intel_extended_topology(raw, data) == 0))
+	if ((raw->basic_cpuid[0][EAX] < 11) || !RAW_HAS_GROUP(raw, RAW_GROUP_TOPOLOGY) || (decode_intel_extended_topology(raw, data) == 0))
 		decode_number_of_cores_x86(raw, data);
 	decode_architecture_version_x86(data);
 	data->purpose = cpuid_identify_purpose_intel(raw);
 	internal->score = match_cpu_codename(cpudb_intel, COUNT_OF(cpudb_intel), data);
 
-	if (data->flags[CPU_FEATURE_SGX]) {
+	if (data->flags[CPU_FEATURE_SGX] && RAW_HAS_GROUP(raw, RAW_GROUP_SGX)) {
 		debugf(2, "SGX seems to be present, decoding...\n");
 		// if SGX is indicated by the CPU, verify its presence:
 		decode_intel_sgx_features(raw, data);
@@ -933,6 +933,8 @@ cpu_purpose_t cpuid_identify_purpose_intel(struct cpu_raw_data_t* raw)
 				   https://community.intel.com/t5/Processors/Detecting-LP-E-Cores-on-Meteor-Lake-in-software/m-p/1584555/highlight/true#M70732
 				   If sub-leaf 3 is set, it is an E-Cores.
 				*/
+				if (!RAW_HAS_GROUP(raw, RAW_GROUP_CACHE))
+					return PURPOSE_GENERAL; /* unknown without leaf 4, see cpuid_get_raw_data_groups() */
 				return (EXTRACTS_BITS(raw->intel_fn4[3][EAX], 31, 0)) ? PURPOSE_EFFICIENCY : PURPOSE_LP_EFFICIENCY;
 			case 0x40: /* Core */
 				return PURPOSE_PERFORMANCE;
@@ -22,7 +22,7 @@ def preprocess_header(header_path):
     """
     try:
         return subprocess.check_output(
-            ["gcc", "-U __GNUC__", "-E", header_path]
+            ["gcc", "-U __GNUC__", "-D LIBCPUID_CFFI", "-E", header_path]
         ).decode()
     except subprocess.CalledProcessError as e:
         if e.returncode == 127:
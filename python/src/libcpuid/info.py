@@ -24,6 +24,12 @@ class CPUInfo:  # pylint: disable=too-many-public-methods
         self._c_cpu_id = c_cpu_id
         self._features = None
         self._detection_hints = None
+        # The words of the affinity set belong to the system_id_t, which may be freed first
+        c_affinity = c_cpu_id.affinity
+        value = 0
+        for i in range((c_affinity.num_cpus + 63) // 64):
+            value |= c_affinity.words[i] << (64 * i)
+        self._affinity_mask = value.to_bytes((value.bit_length() + 7) // 8, "big")
 
     @classmethod
     def from_c(cls, c_cpu_id):
@@ -253,10 +259,7 @@ class CPUInfo:  # pylint: disable=too-many-public-methods
     @property
     def affinity_mask(self) -> bytes:
         """A bit mask of the affinity IDs that this processor type is occupying."""
-        bit_mask = getattr(self._c_cpu_id.affinity_mask, "__bits")
-        return b"".join(reversed([byte.to_bytes(1) for byte in bit_mask])).lstrip(
-            b"\x00"
-        )
+        return self._affinity_mask
 
     @property
     def purpose(self) -> enums.CPUPurpose:
@@ -375,6 +378,8 @@ class SystemInfo:
                 new_c_cpu_id, ffi.addressof(c_cpu_id), ffi.sizeof("struct cpu_id_t")
             )
             cpu_id_list.append(CPUInfo.from_c(new_c_cpu_id))
+            new_c_cpu_id.affinity.num_cpus = 0
+            new_c_cpu_id.affinity.words = ffi.NULL
         return cls(c_system_id, cpu_id_list)
 
     @classmethod
@@ -417,3 +422,18 @@ class SystemInfo:
     def l4_total_instances(self) -> Optional[int]:
         """The number of total L4 cache instances. :const:`None` if not undetermined"""
         return optional_int(self._c_system_id.l4_total_instances)
+
+    @property
+    def die_total_instances(self) -> Optional[int]:
+        """The number of total dies. :const:`None` if not determined."""
+        return optional_int(self._c_system_id.die_total_instances)
+
+    @property
+    def tile_total_instances(self) -> Optional[int]:
+        """The number of total tiles. :const:`None` if not determined."""
+        return optional_int(self._c_system_id.tile_total_instances)
+
+    @property
+    def module_total_instances(self) -> Optional[int]:
+        """The number of total modules. :const:`None` if not determined."""
+        return optional_int(self._c_system_id.module_total_instances)
@@ -0,0 +1,88 @@
+#!/usr/bin/env python3
+
+
+import argparse, textwrap, os, sys, re, lzma
+from pathlib import Path, PurePath
+from test_utils import make_tempname
+
+
+### Constants:
+os.environ["LIBCPUID_NO_WARN"] = "1"
+delimiter = "-" * 80
+
+def bench_file(binary, test_file_name):
+	if test_file_name.suffixes[-1] == ".xz":
+		f = lzma.open(test_file_name, "rt")
+	else:
+		f = open(test_file_name, "rt")
+	inp = []
+	for line in f.readlines():
+		if line.strip() == delimiter:
+			break
+		inp.append(line)
+	f.close()
+	fninp = make_tempname("benchin")
+	with open(fninp, "wt") as f:
+		f.writelines(inp)
+	output = os.popen(f"{binary} --load={fninp} --bench-load").read()
+	os.unlink(fninp)
+	text = re.search(r"text\s*:\s*([0-9.]+) ms", output)
+	bin = re.search(r"binary\s*:\s*([0-9.]+) ms", output)
+	same = re.search(r"same data: (\w+)", output)
+	if not text or not bin or not same:
+		return None
+	return float(text.group(1)), float(bin.group(1)), same.group(1) == "yes"
+
+# Parse arguments
+parser = argparse.ArgumentParser(formatter_class=argparse.RawDescriptionHelpFormatter,
+	description=textwrap.dedent("""
+
+Compare the loading times of the text and binary raw dump formats.
+
+Each test file is converted to the binary format by cpuid_tool, then both files are loaded (best of 20 rounds).
+If a directory is given, process all *.test files there, subdirectories included.
+"""))
+parser.add_argument("cpuid_tool",
+	nargs='?',
+	default="./build/cpuid_tool/cpuid_tool",
+	help="path to the cpuid_tool binary")
+parser.add_argument("input_test_files",
+	nargs='+',
+	default=["./tests"],
+	help="test file or directory containing test files")
+args = parser.parse_args()
+
+# Create test files list
+filelist = []
+for input_test_file in args.input_test_files:
+	if Path(input_test_file).is_dir():
+		for dirpath, dirnames, filenames in os.walk(input_test_file):
+			filelist += [PurePath(dirpath).joinpath(fn) for fn in filenames if ".test" in Path(fn).suffixes]
+	else:
+		filelist.append(input_test_file)
+
+# Run benchmark
+total_text = total_binary = 0.0
+num_files = 0
+errors = False
+for test_file_name_raw in filelist:
+	test_file_name = Path(test_file_name_raw)
+	try:
+		result = bench_file(args.cpuid_tool, test_file_name)
+	except (OSError, EOFError, lzma.LZMAError):
+		result = None
+	if result is None:
+		print(f"Benchmark [{test_file_name.name}]: cannot load")
+		continue
+	text, binary, same = result
+	if not same:
+		print(f"Benchmark [{test_file_name.name}]: binary data differs from text data")
+		errors = True
+	total_text += text
+	total_binary += binary
+	num_files += 1
+
+print(f"Loaded {num_files} raw dumps")
+print(f"  text   : {total_text:10.3f} ms")
+print(f"  binary : {total_binary:10.3f} ms ({total_text / total_binary if total_binary > 0 else 0:.1f}x faster)")
+sys.exit(1 if errors else 0)
@@ -1,8 +1,9 @@
 #!/usr/bin/env python3
 
 
-import argparse, textwrap, os, sys, re, random, lzma
+import argparse, textwrap, os, sys, re, lzma
 from pathlib import Path, PurePath
+from test_utils import make_tempname
 
 
 ### Constants:
@@ -20,19 +21,6 @@ fields_arm = [ "architecture", "feature-level", "purpose",
 	   "cores", "logical",
 	   "codename", "technology", "flags" ]
 
-# One would usually use os.tempnam, but libc gives off hell a lot of
-# warnings when you attempt to use that :(
-def make_tempname(prefix):
-	chars = ""
-	for i in range(26):
-		chars += chr(97+i)
-		chars += chr(65+i)
-	for i in range(10):
-		chars += chr(48+i)
-	for i in range(6):
-		prefix += random.choice(chars)
-	return prefix
-
 def fmt_error(err):
 	pfix = f"  {err[0]}: "
 	return "{} expected `{}'\n{} got      `{}'".format(pfix, err[1], ' '*len(pfix), err[2])
@@ -0,0 +1,171 @@
+/*
+ * Copyright 2026  Veselin Georgiev,
+ * anrieffNOSPAM @ mgail_DOT.com (convert to gmail)
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Calls libcpuid from many threads at once, and checks that all of them get
+ * the same results. Build the library with -fsanitize=thread to detect data
+ * races as well.
+ *
+ * Usage: stress_threads [number of threads] [number of iterations]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "libcpuid.h"
+
+#define DEFAULT_THREADS    16
+#define DEFAULT_ITERATIONS 50
+
+static int num_iterations = DEFAULT_ITERATIONS;
+static struct msr_driver_t* shared_handle = NULL;
+
+static void kernel_generic(void) {}
+static void kernel_x86_64_v2(void) {}
+static const struct cpu_dispatch_impl_t kernel_impls[] = {
+	{ kernel_x86_64_v2, FEATURE_LEVEL_X86_64_V2, NULL, "x86-64-v2" },
+	{ kernel_generic,   FEATURE_LEVEL_UNKNOWN,   NULL, "generic" },
+};
+static struct cpu_dispatch_t kernel_dispatch = CPU_DISPATCH_INIT(kernel_impls);
+
+struct thread_result_t {
+	pthread_t thread;
+	int index;
+	int errors;
+	int msr_values;
+	char codename[CODENAME_STR_MAX];
+	int num_features;
+	cpu_dispatch_fn_t kernel;
+};
+
+static void* stress_thread(void* arg)
+{
+	int i;
+	struct thread_result_t* result = (struct thread_result_t*) arg;
+	struct cpu_id_t id;
+	struct cpu_feature_set_t features;
+	struct msr_driver_t* handle;
+	const char* expected_error;
+
+	handle = cpu_msr_driver_open();
+	for (i = 0; i < num_iterations; i++) {
+		/* Half of the threads fail on purpose, the others succeed: errors must not leak between threads */
+		if ((result->index % 2) == 0) {
+			if (cpu_identify(NULL, &id) != 0) {
+				fprintf(stderr, "Thread %d: cpu_identify() failed: %s\n", result->index, cpuid_error());
+				result->errors++;
+				continue;
+			}
+			expected_error = "No error";
+			cpuid_get_feature_set(&id, &features);
+			if (i == 0) {
+				strncpy(result->codename, id.cpu_codename, CODENAME_STR_MAX - 1);
+				result->num_features = cpuid_feature_set_count(&features);
+			}
+			else if (strcmp(result->codename, id.cpu_codename) || (result->num_features != cpuid_feature_set_count(&features))) {
+				fprintf(stderr, "Thread %d: the CPU identification changed\n", result->index);
+				result->errors++;
+			}
+		}
+		else {
+			struct cpu_raw_data_t raw;
+			if (cpuid_deserialize_raw_data(&raw, "/nonexistent/raw.txt") == 0) {
+				result->errors++;
+				continue;
+			}
+			expected_error = "File open operation failed";
+		}
+		if (strcmp(cpuid_error(), expected_error)) {
+			fprintf(stderr, "Thread %d: cpuid_error() returned \"%s\" instead of \"%s\"\n", result->index, cpuid_error(), expected_error);
+			result->errors++;
+		}
+
+		/* Some threads drop the identification cache while the others use it */
+		if ((result->index % 4) == 2)
+			cpuid_refresh_identify_cache();
+		result->kernel = cpuid_dispatch_resolve(&kernel_dispatch);
+		if ((handle != NULL) && (cpu_msrinfo(handle, INFO_MAX_MULTIPLIER) != CPU_INVALID_VALUE))
+			result->msr_values++;
+		if ((shared_handle != NULL) && (cpu_msrinfo(shared_handle, INFO_MAX_MULTIPLIER) != CPU_INVALID_VALUE))
+			result->msr_values++;
+	}
+	cpu_msr_driver_close(handle);
+	return NULL;
+}
+
+int main(int argc, char** argv)
+{
+	int i, num_threads = DEFAULT_THREADS, errors = 0, msr_values = 0, num_started;
+	struct thread_result_t* results;
+
+	if (argc > 1)
+		num_threads = atoi(argv[1]);
+	if (argc > 2)
+		num_iterations = atoi(argv[2]);
+	if ((num_threads <= 0) || (num_iterations <= 0)) {
+		fprintf(stderr, "Usage: %s [number of threads] [number of iterations]\n", argv[0]);
+		return 1;
+	}
+	if (!cpuid_present()) {
+		printf("CPUID is not present, skipping the test\n");
+		return 0;
+	}
+
+	cpuid_set_identify_cache(1);
+	/* Besides their own handle, all the threads use this one, which decodes the CPU on first use */
+	shared_handle = cpu_msr_driver_open();
+	results = (struct thread_result_t*) calloc(num_threads, sizeof(struct thread_result_t));
+	if (!results) {
+		fprintf(stderr, "Memory allocation failed\n");
+		return 1;
+	}
+	for (num_started = 0; num_started < num_threads; num_started++) {
+		results[num_started].index = num_started;
+		if (pthread_create(&results[num_started].thread, NULL, stress_thread, &results[num_started]) != 0) {
+			fprintf(stderr, "Cannot start thread %d\n", num_started);
+			errors++;
+			break;
+		}
+	}
+	for (i = 0; i < num_started; i++) {
+		pthread_join(results[i].thread, NULL);
+		errors     += results[i].errors;
+		msr_values += results[i].msr_values;
+		if ((i % 2 == 0) && (strcmp(results[i].codename, results[0].codename) || (results[i].num_features != results[0].num_features))) {
+			fprintf(stderr, "Thread %d identified the CPU differently than thread 0\n", i);
+			errors++;
+		}
+		if (results[i].kernel != results[0].kernel) {
+			fprintf(stderr, "Thread %d resolved another kernel than thread 0\n", i);
+			errors++;
+		}
+	}
+	printf("%d threads, %d iterations: CPU \"%s\" with %d features, %d MSR values, %d errors\n",
+		num_started, num_iterations, results[0].codename, results[0].num_features, msr_values, errors);
+	cpu_msr_driver_close(shared_handle);
+	free(results);
+	return (errors > 0) ? 1 : 0;
+}
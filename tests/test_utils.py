@@ -0,0 +1,15 @@
+import random
+
+
+# One would usually use os.tempnam, but libc gives off hell a lot of
+# warnings when you attempt to use that :(
+def make_tempname(prefix):
+	chars = ""
+	for i in range(26):
+		chars += chr(97+i)
+		chars += chr(65+i)
+	for i in range(10):
+		chars += chr(48+i)
+	for i in range(6):
+		prefix += random.choice(chars)
+	return prefix
@@ -0,0 +1,1188 @@
+/*
+ * Copyright 2026  Veselin Georgiev,
+ * anrieffNOSPAM @ mgail_DOT.com (convert to gmail)
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Checks the behavior of the library functions which the test dumps do not
+ * cover (run_tests.py only compares the cpu_id_t fields of each dump).
+ *
+ * Usage: unit_tests [tests directory]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#if defined linux || defined __linux__
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#endif
+#include "libcpuid.h"
+
+static int num_checks   = 0;
+static int num_failures = 0;
+static const char* tests_dir = ".";
+
+#define CHECK(cond) do { \
+	num_checks++; \
+	if (!(cond)) { \
+		fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+		num_failures++; \
+	} \
+} while (0)
+
+static int load_dump(struct cpu_raw_data_array_t* raw_array, const char* name)
+{
+	char path[1024];
+
+	snprintf(path, sizeof(path), "%s/%s", tests_dir, name);
+	if (cpuid_deserialize_all_raw_data(raw_array, path) < 0) {
+		fprintf(stderr, "Cannot load `%s': %s\n", path, cpuid_error());
+		num_failures++;
+		return 0;
+	}
+	return 1;
+}
+
+struct text_buffer_t {
+	char data[65536];
+	size_t size;
+};
+
+static size_t write_to_buffer(const void* data, size_t size, void* userdata)
+{
+	struct text_buffer_t* buffer = (struct text_buffer_t*) userdata;
+
+	if (buffer->size + size > sizeof(buffer->data))
+		return 0;
+	memcpy(buffer->data + buffer->size, data, size);
+	buffer->size += size;
+	return size;
+}
+
+/* Raw arrays and their compact form */
+static void test_raw_array(void)
+{
+	logical_cpu_t i;
+	struct cpu_raw_data_array_t raw_array, expanded;
+	struct cpu_raw_data_compact_t compact;
+	struct cpu_raw_data_t raw;
+
+	if (!load_dump(&raw_array, "amd/zen4/amd-ryzen-9-7900x-12-core-processor.test"))
+		return;
+	CHECK(raw_array.num_raw == 24);
+	CHECK(raw_array.capacity >= raw_array.num_raw);
+	CHECK(cpuid_compact_raw_data_array(&raw_array, &compact) == 0);
+	CHECK(cpuid_get_compact_raw_data(&compact, raw_array.num_raw, &raw) == ERR_INVCNB);
+	CHECK(cpuid_expand_raw_data_compact(&compact, &expanded) == 0);
+	CHECK(expanded.num_raw == raw_array.num_raw);
+	CHECK(expanded.capacity >= expanded.num_raw);
+	for (i = 0; i < expanded.num_raw; i++)
+		CHECK(!memcmp(&expanded.raw[i], &raw_array.raw[i], sizeof(struct cpu_raw_data_t)));
+	cpuid_free_raw_data_array(&expanded);
+	CHECK((expanded.raw == NULL) && (expanded.capacity == 0));
+	cpuid_free_raw_data_compact(&compact);
+	cpuid_free_raw_data_array(&raw_array);
+}
+
+/* Raw data with some groups of leaves only, see cpuid_get_raw_data_groups() */
+static void test_raw_groups(void)
+{
+	logical_cpu_t i;
+	struct cpu_raw_data_array_t raw_array;
+	struct cpu_raw_data_t raw, copy;
+	struct cpu_id_t id;
+	struct text_buffer_t* buffer;
+
+	/* The LP E-cores of Arrow Lake-H only differ from the E-cores by their L3 cache (leaf 4) */
+	if (!load_dump(&raw_array, "intel/x86-64/lion-cove/intel-core-ultra-9-285h.test"))
+		return;
+	for (i = 0; (i < raw_array.num_raw) && ((cpu_identify(&raw_array.raw[i], &id) < 0) || (id.purpose != PURPOSE_LP_EFFICIENCY)); i++);
+	CHECK(i < raw_array.num_raw);
+	if (i < raw_array.num_raw) {
+		raw = raw_array.raw[i];
+		raw.valid_groups = RAW_GROUP_BASIC | RAW_GROUP_EXT | RAW_GROUP_TOPOLOGY;
+		memset(raw.intel_fn4, 0, sizeof(raw.intel_fn4));
+		CHECK(cpu_identify(&raw, &id) == 0);
+		CHECK(id.purpose == PURPOSE_GENERAL);
+		CHECK(id.l3_cache <= 0);
+
+		/* The valid groups are kept by the serialization */
+		buffer = calloc(1, sizeof(struct text_buffer_t));
+		CHECK(buffer != NULL);
+		if (buffer != NULL) {
+			CHECK(cpuid_serialize_raw_data_cb(&raw, write_to_buffer, buffer) == 0);
+			CHECK(cpuid_deserialize_raw_data_buf(buffer->data, buffer->size, &copy) == 0);
+			CHECK(copy.valid_groups == raw.valid_groups);
+			free(buffer);
+		}
+	}
+	cpuid_free_raw_data_array(&raw_array);
+
+	/* Live data: the basic leaves are always queried */
+	if (cpuid_present() && (cpuid_get_raw_data_groups(&raw, 0, RAW_GROUP_SGX) == 0)) {
+		CHECK((raw.valid_groups & RAW_GROUP_BASIC) != 0);
+		CHECK((raw.valid_groups & RAW_GROUP_TOPOLOGY) == 0);
+		CHECK(raw.intel_fn11[0][EBX] == 0);
+		CHECK(cpu_identify(&raw, &id) == 0);
+	}
+}
+
+/* CPU affinity sets, see cpuid_affinity_set_init() */
+static void test_affinity_sets(void)
+{
+	int32_t cpu;
+	struct cpu_affinity_set_t set, other;
+	cpu_affinity_mask_t mask;
+
+	/* Three words, the last one partially used */
+	CHECK(cpuid_affinity_set_init(&set, 130) == 0);
+	CHECK((set.version == CPU_AFFINITY_SET_VERSION) && (set.num_cpus == 130));
+	CHECK(cpuid_affinity_set_count(&set) == 0);
+	CHECK(cpuid_affinity_set_next(&set, -1) == -1);
+	CHECK(cpuid_affinity_set_add(&set, 0) == 0);
+	CHECK(cpuid_affinity_set_add(&set, 63) == 0);
+	CHECK(cpuid_affinity_set_add(&set, 64) == 0);
+	CHECK(cpuid_affinity_set_add(&set, 129) == 0);
+	CHECK(cpuid_affinity_set_add(&set, 64) == 0);
+	CHECK(cpuid_affinity_set_add(&set, 130) == ERR_INVRANGE);
+	CHECK(cpuid_affinity_set_contains(&set, 63) && cpuid_affinity_set_contains(&set, 64));
+	CHECK(!cpuid_affinity_set_contains(&set, 1) && !cpuid_affinity_set_contains(&set, 130));
+	CHECK(cpuid_affinity_set_count(&set) == 4);
+	cpu = cpuid_affinity_set_next(&set, -1);
+	CHECK(cpu == 0);
+	cpu = cpuid_affinity_set_next(&set, cpu);
+	CHECK(cpu == 63);
+	cpu = cpuid_affinity_set_next(&set, cpu);
+	CHECK(cpu == 64);
+	cpu = cpuid_affinity_set_next(&set, cpu);
+	CHECK(cpu == 129);
+	CHECK(cpuid_affinity_set_next(&set, cpu) == -1);
+
+	/* The intersection with a smaller set clears the words it does not have */
+	CHECK(cpuid_affinity_set_init(&other, 100) == 0);
+	CHECK(cpuid_affinity_set_add(&other, 64) == 0);
+	CHECK(cpuid_affinity_set_add(&other, 99) == 0);
+	CHECK(cpuid_affinity_set_intersect(&set, &other) == 0);
+	CHECK(cpuid_affinity_set_count(&set) == 1);
+	CHECK(cpuid_affinity_set_next(&set, -1) == 64);
+	CHECK(!cpuid_affinity_set_contains(&set, 129));
+	cpuid_affinity_set_free(&other);
+	cpuid_affinity_set_free(&set);
+	CHECK((set.words == NULL) && (set.num_cpus == 0));
+	CHECK(cpuid_affinity_set_add(&set, 0) == ERR_INVRANGE);
+	CHECK(cpuid_affinity_set_count(&set) == 0);
+
+	/* Conversion from the fixed-size mask */
+	memset(&mask, 0, sizeof(mask));
+	mask.__bits[0] = 0x81;
+	mask.__bits[300 / 8] = 1 << (300 % 8);
+	CHECK(cpuid_affinity_set_from_mask(&set, &mask) == 0);
+	CHECK(set.num_cpus > 300);
+	CHECK(cpuid_affinity_set_count(&set) == 3);
+	CHECK(cpuid_affinity_set_contains(&set, 0) && cpuid_affinity_set_contains(&set, 7) && cpuid_affinity_set_contains(&set, 300));
+
+	/* And back */
+	memset(&mask, 0xff, sizeof(mask));
+	CHECK(cpuid_affinity_set_to_mask(&set, &mask) == 0);
+	CHECK((mask.__bits[0] == 0x81) && (mask.__bits[300 / 8] == 1 << (300 % 8)) && (mask.__bits[1] == 0x00));
+	CHECK(mask.__bits[sizeof(mask.__bits) - 1] == 0x00);
+	cpuid_affinity_set_free(&set);
+	CHECK(cpuid_affinity_set_to_mask(&set, &mask) == 0);
+	CHECK(mask.__bits[0] == 0x00);
+}
+
+/* Packed feature sets, see cpuid_get_feature_set() */
+static void test_feature_sets(void)
+{
+	const char* dumps[] = {
+		"intel/x86-64/golden-cove/12th-gen-intel-core-i9-12900k.test",
+		"intel/ia-32/netburst/intel-celeron-cpu-1.70ghz.test",
+		"arm/armv9a/neoverse-n2.test",
+	};
+	size_t i;
+	int f, prev, count;
+	struct cpu_raw_data_array_t raw_array;
+	struct cpu_id_t id;
+	struct cpu_feature_set_t a, b, c;
+
+	cpuid_feature_set_clear(&a);
+	CHECK(cpuid_feature_set_count(&a) == 0);
+	CHECK(cpuid_feature_set_next(&a, -1) == -1);
+	cpuid_feature_set_add(&a, CPU_FEATURE_FPU);
+	cpuid_feature_set_add(&a, (cpu_feature_t) 63);
+	cpuid_feature_set_add(&a, (cpu_feature_t) 64);
+	cpuid_feature_set_add(&a, (cpu_feature_t) (NUM_CPU_FEATURES - 1));
+	CHECK(cpuid_feature_set_count(&a) == 4);
+	CHECK(cpuid_feature_set_contains(&a, (cpu_feature_t) 63) && cpuid_feature_set_contains(&a, (cpu_feature_t) 64));
+	CHECK(!cpuid_feature_set_contains(&a, (cpu_feature_t) 62));
+	CHECK(cpuid_feature_set_next(&a, -1) == CPU_FEATURE_FPU);
+	CHECK(cpuid_feature_set_next(&a, CPU_FEATURE_FPU) == 63);
+	CHECK(cpuid_feature_set_next(&a, 63) == 64);
+	CHECK(cpuid_feature_set_next(&a, 64) == NUM_CPU_FEATURES - 1);
+	CHECK(cpuid_feature_set_next(&a, NUM_CPU_FEATURES - 1) == -1);
+
+	cpuid_feature_set_clear(&b);
+	cpuid_feature_set_add(&b, (cpu_feature_t) 64);
+	cpuid_feature_set_add(&b, CPU_FEATURE_SSE2);
+	CHECK(cpuid_feature_set_is_subset(&b, &a) == false);
+	cpuid_feature_set_and(&c, &a, &b);
+	CHECK((cpuid_feature_set_count(&c) == 1) && cpuid_feature_set_contains(&c, (cpu_feature_t) 64));
+	CHECK(cpuid_feature_set_is_subset(&c, &a) && cpuid_feature_set_is_subset(&c, &b));
+	cpuid_feature_set_or(&c, &a, &b);
+	CHECK((cpuid_feature_set_count(&c) == 5) && cpuid_feature_set_contains(&c, CPU_FEATURE_SSE2));
+	CHECK(cpuid_feature_set_is_subset(&a, &c) && cpuid_feature_set_is_subset(&b, &c));
+	cpuid_feature_set_andnot(&c, &a, &b);
+	CHECK((cpuid_feature_set_count(&c) == 3) && !cpuid_feature_set_contains(&c, (cpu_feature_t) 64));
+	/* The output can be one of the inputs */
+	cpuid_feature_set_andnot(&a, &a, &c);
+	CHECK((cpuid_feature_set_count(&a) == 1) && cpuid_feature_set_contains(&a, (cpu_feature_t) 64));
+
+	/* The identification packs exactly the flags of a CPU, including the cleared ones (HT of a single-thread Netburst) */
+	for (i = 0; i < sizeof(dumps) / sizeof(dumps[0]); i++) {
+		if (!load_dump(&raw_array, dumps[i]))
+			continue;
+		CHECK(cpu_identify(&raw_array.raw[0], &id) == 0);
+		cpuid_free_raw_data_array(&raw_array);
+		cpuid_get_feature_set(&id, &a);
+		CHECK(memcmp(&a, &id.features, sizeof(a)) == 0);
+		count = 0;
+		for (f = 0; f < NUM_CPU_FEATURES; f++) {
+			CHECK(cpuid_feature_set_contains(&a, (cpu_feature_t) f) == (id.flags[f] != 0));
+			count += (id.flags[f] != 0);
+		}
+		CHECK(count > 0);
+		CHECK(cpuid_feature_set_count(&a) == count);
+		for (prev = -1, f = cpuid_feature_set_next(&a, -1); f >= 0; prev = f, f = cpuid_feature_set_next(&a, f)) {
+			CHECK((f > prev) && id.flags[f]);
+			count--;
+		}
+		CHECK(count == 0);
+	}
+}
+
+/* Identifies the first logical CPU of a dump */
+static int identify_dump(struct cpu_id_t* id, const char* name)
+{
+	int r;
+	struct cpu_raw_data_array_t raw_array;
+
+	if (!load_dump(&raw_array, name))
+		return 0;
+	r = cpu_identify(&raw_array.raw[0], id);
+	cpuid_free_raw_data_array(&raw_array);
+	CHECK(r == 0);
+	return r == 0;
+}
+
+/* Lists the hosts lacking a feature in a string, e.g. "2,3" */
+static const char* lacking_hosts_str(const struct cpu_baseline_t* baseline, cpu_feature_t feature, char* buffer, size_t size)
+{
+	int32_t i;
+	size_t len = 0;
+
+	buffer[0] = '\0';
+	for (i = 0; i < baseline->num_lacking_hosts[feature]; i++)
+		len += snprintf(buffer + len, size - len, "%s%d", (i > 0) ? "," : "", baseline->lacking_hosts[baseline->lacking_hosts_start[feature] + i]);
+	return buffer;
+}
+
+/* Common feature level of two hosts */
+static cpu_feature_level_t baseline_level(const struct cpu_id_t* host, cpu_feature_level_t a, cpu_feature_level_t b)
+{
+	struct cpu_id_t ids[2];
+	struct cpu_baseline_t baseline;
+
+	ids[0] = ids[1] = *host;
+	ids[0].feature_level = a;
+	ids[1].feature_level = b;
+	if (cpuid_compute_baseline(ids, 2, &baseline) < 0)
+		return NUM_FEATURE_LEVELS;
+	cpuid_free_baseline(&baseline);
+	return baseline.feature_level;
+}
+
+/* Fleet baselines, see cpuid_compute_baseline() */
+static void test_baseline(void)
+{
+	char buffer[64];
+	struct cpu_id_t ids[4];
+	struct cpu_baseline_t baseline;
+
+	if (!identify_dump(&ids[0], "amd/zen4/amd-ryzen-9-7900x-12-core-processor.test") ||
+	    !identify_dump(&ids[1], "intel/x86-64/golden-cove/12th-gen-intel-core-i9-12900k.test") ||
+	    !identify_dump(&ids[2], "arm/armv8a/cortex-a53.test") ||
+	    !identify_dump(&ids[3], "arm/armv9a/neoverse-n2.test"))
+		return;
+	CHECK(ids[0].feature_level == FEATURE_LEVEL_X86_64_V4);
+	CHECK(ids[1].feature_level == FEATURE_LEVEL_X86_64_V3);
+	CHECK(ids[2].feature_level == FEATURE_LEVEL_ARM_V8_0_A);
+	CHECK(ids[3].feature_level == FEATURE_LEVEL_ARM_V9_0_A);
+
+	/* x86 hosts */
+	CHECK(cpuid_compute_baseline(ids, 2, &baseline) == 0);
+	CHECK(baseline.architecture == ARCHITECTURE_X86);
+	CHECK(baseline.feature_level == FEATURE_LEVEL_X86_64_V3);
+	CHECK(cpuid_feature_set_contains(&baseline.features, CPU_FEATURE_AVX2));
+	CHECK(cpuid_feature_set_contains(&baseline.missing_features, CPU_FEATURE_AVX512F));
+	CHECK(!strcmp(lacking_hosts_str(&baseline, CPU_FEATURE_AVX512F, buffer, sizeof(buffer)), "1"));
+	cpuid_free_baseline(&baseline);
+
+	/* ARM hosts */
+	CHECK(cpuid_compute_baseline(&ids[2], 2, &baseline) == 0);
+	CHECK(baseline.architecture == ARCHITECTURE_ARM);
+	CHECK(baseline.feature_level == FEATURE_LEVEL_ARM_V8_0_A);
+	cpuid_free_baseline(&baseline);
+
+	/* x86 and ARM hosts have no common level, the hosts lacking a feature are listed in order */
+	CHECK(cpuid_compute_baseline(ids, 4, &baseline) == 0);
+	CHECK(baseline.num_hosts == 4);
+	CHECK(baseline.architecture == ARCHITECTURE_UNKNOWN);
+	CHECK(baseline.feature_level == FEATURE_LEVEL_UNKNOWN);
+	CHECK(!cpuid_feature_set_contains(&baseline.features, CPU_FEATURE_SSE2));
+	CHECK(!strcmp(lacking_hosts_str(&baseline, CPU_FEATURE_SSE2, buffer, sizeof(buffer)), "2,3"));
+	CHECK(!strcmp(lacking_hosts_str(&baseline, CPU_FEATURE_AVX512F, buffer, sizeof(buffer)), "1,2,3"));
+	CHECK(baseline.num_lacking_hosts[CPU_FEATURE_IA64] == 0);
+	cpuid_free_baseline(&baseline);
+
+	/* The ARM profiles do not imply each other, ARMv9.x-A only implies ARMv8.(x+5)-A */
+	CHECK(baseline_level(&ids[3], FEATURE_LEVEL_ARM_V9_0_A, FEATURE_LEVEL_ARM_V8_9_A) == FEATURE_LEVEL_ARM_V8_5_A);
+	CHECK(baseline_level(&ids[3], FEATURE_LEVEL_ARM_V8_9_A, FEATURE_LEVEL_ARM_V9_2_A) == FEATURE_LEVEL_ARM_V8_7_A);
+	CHECK(baseline_level(&ids[3], FEATURE_LEVEL_ARM_V9_5_A, FEATURE_LEVEL_ARM_V8_9_A) == FEATURE_LEVEL_ARM_V8_9_A);
+	CHECK(baseline_level(&ids[3], FEATURE_LEVEL_ARM_V9_3_A, FEATURE_LEVEL_ARM_V9_1_A) == FEATURE_LEVEL_ARM_V9_1_A);
+	CHECK(baseline_level(&ids[3], FEATURE_LEVEL_ARM_V8_0_A, FEATURE_LEVEL_ARM_V7_A) == FEATURE_LEVEL_ARM_V7_A);
+	CHECK(baseline_level(&ids[3], FEATURE_LEVEL_ARM_V8_1_A, FEATURE_LEVEL_ARM_V8_0_M) == FEATURE_LEVEL_UNKNOWN);
+	CHECK(baseline_level(&ids[3], FEATURE_LEVEL_ARM_V8_0_R, FEATURE_LEVEL_ARM_V8_0_A) == FEATURE_LEVEL_UNKNOWN);
+	CHECK(baseline_level(&ids[3], FEATURE_LEVEL_ARM_V8_1_M, FEATURE_LEVEL_ARM_V7E_M) == FEATURE_LEVEL_ARM_V6_M);
+	CHECK(baseline_level(&ids[3], FEATURE_LEVEL_ARM_V7_A, FEATURE_LEVEL_ARM_V6) == FEATURE_LEVEL_UNKNOWN);
+	CHECK(baseline_level(&ids[0], FEATURE_LEVEL_X86_64_V2, FEATURE_LEVEL_X86_64_V4) == FEATURE_LEVEL_X86_64_V2);
+}
+
+static void kernel_arm(void) {}
+static void kernel_x86(void) {}
+static void kernel_generic(void) {}
+
+/* Kernel selection, see cpuid_dispatch_resolve() */
+static void test_dispatch(void)
+{
+	static const struct cpu_dispatch_impl_t impls[] = {
+		{ (cpu_dispatch_fn_t) kernel_arm,     FEATURE_LEVEL_ARM_V8_0_A, NULL, "arm" },
+		{ (cpu_dispatch_fn_t) kernel_x86,     FEATURE_LEVEL_I386,       NULL, "x86" },
+		{ (cpu_dispatch_fn_t) kernel_generic, FEATURE_LEVEL_UNKNOWN,    NULL, "generic" },
+	};
+	static const cpu_feature_t avx512_features[] = { CPU_FEATURE_AVX512F, CPU_FEATURE_AVX512BW, NUM_CPU_FEATURES };
+	static const cpu_feature_t avx2_features[]   = { CPU_FEATURE_AVX2, CPU_FEATURE_FMA3, NUM_CPU_FEATURES };
+	static const struct cpu_dispatch_impl_t state_impls[] = {
+		{ (cpu_dispatch_fn_t) kernel_x86, FEATURE_LEVEL_UNKNOWN,   avx512_features, "avx512" },
+		{ (cpu_dispatch_fn_t) kernel_x86, FEATURE_LEVEL_X86_64_V4, NULL,            "x86-64-v4" },
+		{ (cpu_dispatch_fn_t) kernel_x86, FEATURE_LEVEL_UNKNOWN,   avx2_features,   "avx2" },
+		{ (cpu_dispatch_fn_t) kernel_x86, FEATURE_LEVEL_X86_64_V3, NULL,            "x86-64-v3" },
+		{ (cpu_dispatch_fn_t) kernel_x86, FEATURE_LEVEL_X86_64_V2, NULL,            "x86-64-v2" },
+	};
+	/* Which of state_impls run with the register states enabled in XCR0 */
+	static const struct { uint64_t xcr0; int osxsave; int supported[5]; } states[] = {
+		{ 0xe7, 1, { 1, 1, 1, 1, 1 } }, /* x87, SSE, AVX, opmask, ZMM_Hi256, Hi16_ZMM */
+		{ 0x07, 1, { 0, 0, 1, 1, 1 } }, /* no AVX-512 state */
+		{ 0x67, 1, { 0, 0, 1, 1, 1 } }, /* no Hi16_ZMM state */
+		{ 0xe3, 1, { 0, 0, 0, 0, 1 } }, /* no AVX state */
+		{ 0x03, 1, { 0, 0, 0, 0, 1 } },
+		{ 0xe7, 0, { 0, 0, 0, 0, 1 } }, /* XCR0 is not enabled without OSXSAVE */
+	};
+	int i, j;
+	struct cpu_dispatch_t dispatch = CPU_DISPATCH_INIT(impls);
+	struct cpu_id_t id;
+
+	if (identify_dump(&id, "amd/zen4/amd-ryzen-9-7900x-12-core-processor.test")) {
+		CHECK((id.feature_level == FEATURE_LEVEL_X86_64_V4) && id.flags[CPU_FEATURE_OSXSAVE]);
+		for (i = 0; i < (int) (sizeof(states) / sizeof(states[0])); i++) {
+			id.flags[CPU_FEATURE_OSXSAVE] = (uint8_t) states[i].osxsave;
+			for (j = 0; j < (int) (sizeof(state_impls) / sizeof(state_impls[0])); j++)
+				CHECK(cpuid_dispatch_supported_by(&state_impls[j], &id, states[i].xcr0) == (states[i].supported[j] != 0));
+		}
+		CHECK(!cpuid_dispatch_supported_by(NULL, &id, 0xe7) && !cpuid_dispatch_supported_by(&state_impls[0], NULL, 0xe7));
+	}
+	/* XCR0 is x86 only */
+	if (identify_dump(&id, "arm/armv8a/cortex-a53.test"))
+		CHECK(cpuid_dispatch_supported_by(&impls[0], &id, 0));
+
+	if (!cpuid_present())
+		return;
+	if ((cpu_identify(NULL, &id) == 0) && (id.architecture == ARCHITECTURE_X86) && (id.feature_level != FEATURE_LEVEL_UNKNOWN)) {
+		/* x87 state is always enabled */
+		CHECK((cpuid_get_xcr0() & 1) == (id.flags[CPU_FEATURE_OSXSAVE] ? 1 : 0));
+		for (j = 0; j < (int) (sizeof(state_impls) / sizeof(state_impls[0])); j++)
+			CHECK(cpuid_dispatch_supported(&state_impls[j]) == cpuid_dispatch_supported_by(&state_impls[j], &id, cpuid_get_xcr0()));
+		CHECK(!cpuid_dispatch_supported(&impls[0]));
+		CHECK(cpuid_dispatch_supported(&impls[1]));
+		CHECK(cpuid_dispatch_resolve(&dispatch) == (cpu_dispatch_fn_t) kernel_x86);
+		CHECK((dispatch.resolved == 1) && (dispatch.selected == 1));
+		/* Resolved once */
+		CHECK(cpuid_dispatch_resolve(&dispatch) == (cpu_dispatch_fn_t) kernel_x86);
+	}
+}
+
+/* Core types of hybrid systems, see cpuid_get_core_types() */
+static void test_core_types(void)
+{
+	int i;
+	struct cpu_raw_data_array_t raw_array;
+	struct system_id_t system;
+	struct cpu_id_t ids[3];
+	struct cpu_core_types_t core_types;
+	const struct cpu_core_type_t *performance, *efficiency;
+
+	/* Alder Lake: the common features are those of the E-cores */
+	if (!load_dump(&raw_array, "intel/x86-64/golden-cove/12th-gen-intel-core-i9-12900k.test"))
+		return;
+	CHECK(cpu_identify_all(&raw_array, &system) == 0);
+	cpuid_free_raw_data_array(&raw_array);
+	/* The affinity sets of the CPU types are sized to the logical CPUs of the dump */
+	for (i = 0; i < system.num_cpu_types; i++) {
+		CHECK(system.cpu_types[i].affinity.num_cpus == 24);
+		CHECK(cpuid_affinity_set_count(&system.cpu_types[i].affinity) == (uint32_t) system.cpu_types[i].num_logical_cpus);
+	}
+	CHECK(cpuid_get_core_types(&system, &core_types) == 0);
+	CHECK(core_types.num_types == 2);
+	performance = cpuid_find_core_type(&core_types, PURPOSE_PERFORMANCE);
+	efficiency  = cpuid_find_core_type(&core_types, PURPOSE_EFFICIENCY);
+	CHECK((performance != NULL) && (efficiency != NULL));
+	if ((performance != NULL) && (efficiency != NULL)) {
+		CHECK((performance->num_logical_cpus == 16) && (efficiency->num_logical_cpus == 8));
+		CHECK(cpuid_affinity_set_count(&performance->affinity) == 16);
+		CHECK(cpuid_affinity_set_count(&efficiency->affinity) == 8);
+		CHECK(performance->feature_level == FEATURE_LEVEL_X86_64_V3);
+		CHECK(core_types.common_feature_level == FEATURE_LEVEL_X86_64_V3);
+		CHECK(cpuid_feature_set_is_subset(&core_types.common_features, &performance->features));
+		CHECK(cpuid_feature_set_is_subset(&core_types.common_features, &efficiency->features));
+	}
+	cpuid_free_core_types(&core_types);
+	cpuid_free_system_id(&system);
+
+	/* ARM cores with different levels and profiles */
+	if (!identify_dump(&ids[0], "arm/armv8a/cortex-a53.test") ||
+	    !identify_dump(&ids[1], "arm/armv9a/neoverse-n2.test"))
+		return;
+	ids[1].purpose = PURPOSE_PERFORMANCE;
+	ids[2] = ids[1];
+	ids[2].feature_level = FEATURE_LEVEL_ARM_V8_9_A;
+	memset(&system, 0, sizeof(system));
+	system.cpu_types     = ids;
+	system.num_cpu_types = 3;
+	CHECK(cpuid_get_core_types(&system, &core_types) == 0);
+	CHECK(core_types.num_types == 2);
+	performance = cpuid_find_core_type(&core_types, PURPOSE_PERFORMANCE);
+	CHECK((performance != NULL) && (performance->feature_level == FEATURE_LEVEL_ARM_V8_5_A));
+	CHECK(core_types.common_feature_level == FEATURE_LEVEL_ARM_V8_0_A);
+	cpuid_free_core_types(&core_types);
+	ids[0].feature_level = FEATURE_LEVEL_ARM_V8_0_R;
+	CHECK(cpuid_get_core_types(&system, &core_types) == 0);
+	CHECK(core_types.common_feature_level == FEATURE_LEVEL_UNKNOWN);
+	cpuid_free_core_types(&core_types);
+}
+
+/* Links between the nodes, the logical CPUs and the caches of a topology tree */
+static int topology_is_consistent(const struct cpu_topology_t* topology)
+{
+	int32_t i, j, num_cpus;
+	const struct cpu_topology_node_t* node;
+	const struct cpu_topology_cache_t* cache;
+
+	for (i = 0; i < topology->num_nodes; i++) {
+		node = &topology->nodes[i];
+		if ((i < topology->first_node[node->level]) || (i >= topology->first_node[node->level] + topology->num_level_nodes[node->level]))
+			return 0;
+		if ((node->parent >= 0) && ((topology->nodes[node->parent].level + 1 != node->level) || (node->parent >= i)))
+			return 0;
+		if ((node->level == TOPOLOGY_THREAD) != (node->num_children == 0))
+			return 0;
+		num_cpus = 0;
+		for (j = node->first_child; j < node->first_child + node->num_children; j++) {
+			if ((topology->nodes[j].parent != i) || (topology->nodes[j].first_cpu != node->first_cpu + num_cpus))
+				return 0;
+			num_cpus += topology->nodes[j].num_cpus;
+		}
+		if ((node->num_children > 0) && (num_cpus != node->num_cpus))
+			return 0;
+		for (j = node->first_cache; j < node->first_cache + node->num_caches; j++) {
+			cache = &topology->caches[j];
+			if ((cache->node != i) || (cache->first_cpu < node->first_cpu) || (cache->first_cpu + cache->num_cpus > node->first_cpu + node->num_cpus))
+				return 0;
+		}
+	}
+	for (i = 0; i < topology->num_cpus; i++) {
+		node = &topology->nodes[topology->cpu_node[i]];
+		if ((node->level != TOPOLOGY_THREAD) || (node->num_cpus != 1) || (topology->logical_cpus[node->first_cpu] != (logical_cpu_t) i))
+			return 0;
+	}
+	return 1;
+}
+
+/* Cache of a given level attached to a node */
+static const struct cpu_topology_cache_t* topology_node_cache(const struct cpu_topology_t* topology, const struct cpu_topology_node_t* node, cpu_cache_level_t level)
+{
+	int32_t i;
+
+	for (i = node->first_cache; i < node->first_cache + node->num_caches; i++)
+		if (topology->caches[i].level == level)
+			return &topology->caches[i];
+	return NULL;
+}
+
+/* Topology trees of multi-socket and hybrid dumps, see cpuid_get_topology() */
+static int topologies_are_equal(const struct cpu_topology_t* a, const struct cpu_topology_t* b)
+{
+	return (a->num_nodes == b->num_nodes) && (a->num_cpus == b->num_cpus) && (a->num_caches == b->num_caches) &&
+	       (a->num_numa_nodes == b->num_numa_nodes) &&
+	       !memcmp(a->first_node, b->first_node, sizeof(a->first_node)) &&
+	       !memcmp(a->nodes, b->nodes, sizeof(struct cpu_topology_node_t) * a->num_nodes) &&
+	       !memcmp(a->logical_cpus, b->logical_cpus, sizeof(logical_cpu_t) * a->num_cpus) &&
+	       !memcmp(a->cpu_node, b->cpu_node, sizeof(int32_t) * a->num_cpus) &&
+	       !memcmp(a->caches, b->caches, sizeof(struct cpu_topology_cache_t) * a->num_caches) &&
+	       !memcmp(a->cpu_numa_node, b->cpu_numa_node, sizeof(int32_t) * a->num_cpus);
+}
+
+static void test_topology(void)
+{
+	int32_t i, j;
+	int num_ok;
+	struct cpu_raw_data_array_t raw_array;
+	struct system_id_t system;
+	struct cpu_topology_t topology;
+	const struct cpu_topology_node_t* node;
+	const struct cpu_topology_cache_t* cache;
+
+	/* Two Bulldozer packages of two nodes, each with three compute units and an L3 cache */
+	if (load_dump(&raw_array, "amd/bulldozer/amd-opteron-processor-6238-dual.test")) {
+		CHECK(cpuid_get_topology(&raw_array, &system, &topology) == 0);
+		CHECK(topology_is_consistent(&topology));
+		CHECK(topology.num_level_nodes[TOPOLOGY_PACKAGE] == 2);
+		CHECK(topology.num_level_nodes[TOPOLOGY_DIE] == 4);
+		CHECK(topology.num_level_nodes[TOPOLOGY_COMPLEX] == 4);
+		CHECK(topology.num_level_nodes[TOPOLOGY_MODULE] == 12);
+		CHECK(topology.num_level_nodes[TOPOLOGY_CORE] == 24);
+		CHECK(topology.num_level_nodes[TOPOLOGY_THREAD] == 24);
+		CHECK((system.die_total_instances == 4) && (system.tile_total_instances == -1) && (system.module_total_instances == 12));
+		CHECK((system.topology != NULL) && topologies_are_equal(system.topology, &topology) && (system.topology->num_numa_nodes == 0));
+		num_ok = 0;
+		for (i = topology.first_node[TOPOLOGY_COMPLEX]; i < topology.first_node[TOPOLOGY_COMPLEX] + 4; i++) {
+			node  = &topology.nodes[i];
+			cache = topology_node_cache(&topology, node, CACHE_L3);
+			num_ok += (node->num_cpus == 6) && (cache != NULL) && (cache->num_cpus == 6) &&
+			          (topology.nodes[node->parent].num_children == 1);
+		}
+		CHECK(num_ok == 4);
+		num_ok = 0;
+		for (i = topology.first_node[TOPOLOGY_MODULE]; i < topology.first_node[TOPOLOGY_MODULE] + 12; i++) {
+			cache = topology_node_cache(&topology, &topology.nodes[i], CACHE_L2);
+			num_ok += (topology.nodes[i].num_children == 2) && (cache != NULL) && (cache->num_cpus == 2);
+		}
+		CHECK(num_ok == 12);
+		CHECK(cpuid_get_topology_node(&topology, 6, TOPOLOGY_DIE) == cpuid_get_topology_node(&topology, 11, TOPOLOGY_DIE));
+		CHECK(cpuid_get_topology_node(&topology, 5, TOPOLOGY_DIE) != cpuid_get_topology_node(&topology, 6, TOPOLOGY_DIE));
+		CHECK(cpuid_get_topology_node(&topology, 11, TOPOLOGY_PACKAGE) != cpuid_get_topology_node(&topology, 12, TOPOLOGY_PACKAGE));
+		CHECK(cpuid_get_topology_node(&topology, 24, TOPOLOGY_PACKAGE) == NULL);
+		cpuid_free_topology(&topology);
+		cpuid_free_system_id(&system);
+		cpuid_free_raw_data_array(&raw_array);
+	}
+
+	/* Two packages of 32 core complexes, each with 8 cores of 2 threads */
+	if (load_dump(&raw_array, "amd/zen5/synthetic-amd-2x256-core-1024-threads.test")) {
+		CHECK(cpuid_get_topology(&raw_array, NULL, &topology) == 0);
+		CHECK(topology_is_consistent(&topology));
+		CHECK(topology.num_cpus == 1024);
+		CHECK(topology.num_level_nodes[TOPOLOGY_PACKAGE] == 2);
+		CHECK(topology.num_level_nodes[TOPOLOGY_COMPLEX] == 64);
+		CHECK(topology.num_level_nodes[TOPOLOGY_CORE] == 512);
+		CHECK(topology.num_level_nodes[TOPOLOGY_THREAD] == 1024);
+		num_ok = 0;
+		for (i = topology.first_node[TOPOLOGY_COMPLEX]; i < topology.first_node[TOPOLOGY_COMPLEX] + 64; i++) {
+			cache = topology_node_cache(&topology, &topology.nodes[i], CACHE_L3);
+			num_ok += (topology.nodes[i].num_cpus == 16) && (cache != NULL) && (cache->num_cpus == 16);
+		}
+		CHECK(num_ok == 64);
+		CHECK(topology.nodes[topology.first_node[TOPOLOGY_PACKAGE]].num_cpus == 512);
+		cpuid_free_topology(&topology);
+		cpuid_free_raw_data_array(&raw_array);
+	}
+
+	/* Leaf 80000026h: one complex per die on the Ryzen 9 7900X and 9950X, two complexes in one die on the Ryzen AI 9 HX 370 */
+	for (j = 0; j < 3; j++) {
+		static const char* const zen_dumps[3] = {
+			"amd/zen4/amd-ryzen-9-7900x-12-core-processor.test",
+			"amd/zen5/amd-ryzen-9-9950x-16-core-processor.test",
+			"amd/zen5/amd-ryzen-ai-9-hx-370-with-radeon-890m.test",
+		};
+		static const int32_t num_dies[3] = { 2, 2, 1 }, complex_cpus[3][2] = { { 12, 12 }, { 16, 16 }, { 8, 16 } };
+		if (!load_dump(&raw_array, zen_dumps[j]))
+			continue;
+		CHECK(cpuid_get_topology(&raw_array, NULL, &topology) == 0);
+		CHECK(topology_is_consistent(&topology));
+		CHECK(topology.num_level_nodes[TOPOLOGY_PACKAGE] == 1);
+		CHECK(topology.num_level_nodes[TOPOLOGY_DIE] == num_dies[j]);
+		CHECK(topology.num_level_nodes[TOPOLOGY_COMPLEX] == 2);
+		num_ok = 0;
+		for (i = 0; i < 2; i++) {
+			node  = &topology.nodes[topology.first_node[TOPOLOGY_COMPLEX] + i];
+			cache = topology_node_cache(&topology, node, CACHE_L3);
+			num_ok += (node->id == 16 * i) && (node->num_cpus == complex_cpus[j][i]) && (cache != NULL) && (cache->num_cpus == node->num_cpus);
+		}
+		CHECK(num_ok == 2);
+		if (num_dies[j] == 2)
+			CHECK((topology.nodes[topology.first_node[TOPOLOGY_DIE]].id == 0) && (topology.nodes[topology.first_node[TOPOLOGY_DIE] + 1].id == 16));
+		cpuid_free_topology(&topology);
+		cpuid_free_raw_data_array(&raw_array);
+	}
+
+	/* Leaf 1Fh: two packages of two dies with four cores, one L3 cache per package (synthetic) */
+	if (load_dump(&raw_array, "intel/x86-64/golden-cove/synthetic-intel-2x2-die-32-threads.test")) {
+		CHECK((raw_array.raw[9].intel_fn1fh[2][2] == 0x502) && (raw_array.raw[9].intel_fn1fh[2][3] == 9));
+		CHECK(cpuid_get_topology(&raw_array, &system, &topology) == 0);
+		CHECK(topology_is_consistent(&topology));
+		CHECK(topology.num_level_nodes[TOPOLOGY_PACKAGE] == 2);
+		CHECK(topology.num_level_nodes[TOPOLOGY_DIE] == 4);
+		CHECK(topology.num_level_nodes[TOPOLOGY_CORE] == 16);
+		CHECK((system.die_total_instances == 4) && (system.module_total_instances == -1));
+		CHECK(topology.num_level_nodes[TOPOLOGY_THREAD] == 32);
+		num_ok = 0;
+		for (i = topology.first_node[TOPOLOGY_PACKAGE]; i < topology.first_node[TOPOLOGY_PACKAGE] + 2; i++) {
+			cache = topology_node_cache(&topology, &topology.nodes[i], CACHE_L3);
+			num_ok += (topology.nodes[i].num_children == 2) && (cache != NULL) && (cache->num_cpus == 16);
+		}
+		CHECK(num_ok == 2);
+		CHECK(cpuid_get_topology_node(&topology, 7, TOPOLOGY_DIE) != cpuid_get_topology_node(&topology, 8, TOPOLOGY_DIE));
+		CHECK(cpuid_get_topology_node(&topology, 8, TOPOLOGY_DIE) == cpuid_get_topology_node(&topology, 15, TOPOLOGY_DIE));
+		cpuid_free_topology(&topology);
+		cpuid_free_system_id(&system);
+		cpuid_free_raw_data_array(&raw_array);
+	}
+
+	/* Leaf 1Fh on Arrow Lake: 8 P-cores in their own module, 12 E-cores in modules of 4 sharing an L2 cache */
+	if (load_dump(&raw_array, "intel/x86-64/lion-cove/intel-core-ultra-7-265k.test")) {
+		CHECK(cpuid_get_topology(&raw_array, &system, &topology) == 0);
+		CHECK(topology_is_consistent(&topology));
+		CHECK(system.num_cpu_types == 2);
+		CHECK(topology.num_level_nodes[TOPOLOGY_PACKAGE] == 1);
+		CHECK(topology.num_level_nodes[TOPOLOGY_MODULE] == 11);
+		CHECK(topology.num_level_nodes[TOPOLOGY_CORE] == 20);
+		CHECK((system.die_total_instances == -1) && (system.module_total_instances == 11));
+		CHECK(topology.num_level_nodes[TOPOLOGY_THREAD] == 20);
+		num_ok = 0;
+		for (i = topology.first_node[TOPOLOGY_MODULE]; i < topology.first_node[TOPOLOGY_MODULE] + 11; i++) {
+			cache = topology_node_cache(&topology, &topology.nodes[i], CACHE_L2);
+			num_ok += (topology.nodes[i].num_cpus == 1) || ((topology.nodes[i].num_cpus == 4) && (cache != NULL) && (cache->num_cpus == 4));
+		}
+		CHECK(num_ok == 11);
+		CHECK(cpuid_get_topology_node(&topology, 0, TOPOLOGY_MODULE)->num_cpus == 1);
+		CHECK(cpuid_get_topology_node(&topology, 2, TOPOLOGY_MODULE) == cpuid_get_topology_node(&topology, 5, TOPOLOGY_MODULE));
+		CHECK(cpuid_get_topology_node(&topology, 5, TOPOLOGY_MODULE) != cpuid_get_topology_node(&topology, 6, TOPOLOGY_MODULE));
+		cpuid_free_topology(&topology);
+		cpuid_free_system_id(&system);
+		cpuid_free_raw_data_array(&raw_array);
+	}
+
+	/* Leaf 1Fh on Meteor Lake: the two low-power E-cores are outside the L3 cache */
+	if (load_dump(&raw_array, "intel/x86-64/redwood-cove/intel-core-ultra-7-155h.test")) {
+		CHECK(cpuid_get_topology(&raw_array, &system, &topology) == 0);
+		CHECK(topology_is_consistent(&topology));
+		CHECK(system.num_cpu_types == 3);
+		CHECK(topology.num_level_nodes[TOPOLOGY_COMPLEX] == 2);
+		CHECK(topology.num_level_nodes[TOPOLOGY_MODULE] == 9);
+		CHECK(topology.num_level_nodes[TOPOLOGY_CORE] == 16);
+		CHECK(topology.num_level_nodes[TOPOLOGY_THREAD] == 22);
+		node  = cpuid_get_topology_node(&topology, 20, TOPOLOGY_COMPLEX);
+		CHECK((node != NULL) && (node->num_cpus == 2) && (topology_node_cache(&topology, node, CACHE_L3) == NULL));
+		node  = cpuid_get_topology_node(&topology, 0, TOPOLOGY_COMPLEX);
+		cache = (node != NULL) ? topology_node_cache(&topology, node, CACHE_L3) : NULL;
+		CHECK((cache != NULL) && (cache->num_cpus == 20));
+		node  = cpuid_get_topology_node(&topology, 21, TOPOLOGY_MODULE);
+		cache = (node != NULL) ? topology_node_cache(&topology, node, CACHE_L2) : NULL;
+		CHECK((cache != NULL) && (cache->num_cpus == 2) && (node->num_children == 2));
+		cpuid_free_topology(&topology);
+		cpuid_free_system_id(&system);
+		cpuid_free_raw_data_array(&raw_array);
+	}
+
+	/* Alder Lake: 8 P-cores with 2 threads, then 8 E-cores, in one package and one L3 cache */
+	if (load_dump(&raw_array, "intel/x86-64/golden-cove/12th-gen-intel-core-i9-12900k.test")) {
+		CHECK(cpuid_get_topology(&raw_array, &system, &topology) == 0);
+		CHECK(topology_is_consistent(&topology));
+		CHECK(system.num_cpu_types == 2);
+		CHECK(topology.num_level_nodes[TOPOLOGY_PACKAGE] == 1);
+		CHECK(topology.num_level_nodes[TOPOLOGY_CORE] == 16);
+		CHECK(topology.num_level_nodes[TOPOLOGY_THREAD] == 24);
+		node = cpuid_get_topology_node(&topology, 0, TOPOLOGY_COMPLEX);
+		cache = (node != NULL) ? topology_node_cache(&topology, node, CACHE_L3) : NULL;
+		CHECK((cache != NULL) && (cache->num_cpus == 24));
+		num_ok = 0;
+		for (i = topology.first_node[TOPOLOGY_CORE]; i < topology.first_node[TOPOLOGY_CORE] + 16; i++) {
+			j = topology.logical_cpus[topology.nodes[i].first_cpu];
+			num_ok += (topology.nodes[i].num_children == ((j < 16) ? 2 : 1));
+		}
+		CHECK(num_ok == 16);
+		for (i = 0; i < 24; i++) {
+			node  = cpuid_get_topology_node(&topology, (logical_cpu_t) i, TOPOLOGY_CORE);
+			cache = (node != NULL) ? topology_node_cache(&topology, node, CACHE_L1_DATA) : NULL;
+			if (cache == NULL)
+				cache = topology_node_cache(&topology, &topology.nodes[topology.cpu_node[i]], CACHE_L1_DATA);
+			CHECK((cache != NULL) && (cache->num_cpus == ((i < 16) ? 2 : 1)));
+		}
+		cpuid_free_topology(&topology);
+		cpuid_free_system_id(&system);
+		cpuid_free_raw_data_array(&raw_array);
+	}
+}
+
+/* Checks that cpuid_get_cpu_cache() finds each logical CPU sharing a cache, and that each level covers all the logical CPUs */
+static int cache_map_is_consistent(const struct cpu_cache_map_t* map)
+{
+	int32_t i, level, num_cpus[NUM_CACHE_LEVELS] = { 0 };
+	logical_cpu_t logical_cpu;
+	const struct cpu_cache_instance_t* instance;
+
+	for (i = 0; i < map->num_caches; i++) {
+		instance = &map->caches[i];
+		if ((i < map->first_cache[instance->level]) || (i >= map->first_cache[instance->level] + map->num_level_caches[instance->level]) ||
+		    (instance->geometry.instances != map->num_level_caches[instance->level]))
+			return 0;
+		for (logical_cpu = 0; logical_cpu < map->num_cpus; logical_cpu++)
+			if (cpuid_affinity_set_contains(&instance->affinity, logical_cpu) != (cpuid_get_cpu_cache(map, logical_cpu, instance->level) == instance))
+				return 0;
+		num_cpus[instance->level] += (int32_t) cpuid_affinity_set_count(&instance->affinity);
+	}
+	for (level = CACHE_L1_DATA; level <= CACHE_L4; level++)
+		if ((map->num_level_caches[level] > 0) && (num_cpus[level] != map->num_cpus))
+			return 0;
+	return 1;
+}
+
+static int cache_maps_are_equal(const struct cpu_cache_map_t* a, const struct cpu_cache_map_t* b)
+{
+	int32_t i;
+	logical_cpu_t logical_cpu;
+
+	if ((a->num_caches != b->num_caches) || (a->num_cpus != b->num_cpus) ||
+	    memcmp(a->first_cache, b->first_cache, sizeof(a->first_cache)) ||
+	    memcmp(a->cpu_caches, b->cpu_caches, sizeof(int32_t) * a->num_cpus * NUM_CACHE_LEVELS))
+		return 0;
+	for (i = 0; i < a->num_caches; i++) {
+		if ((a->caches[i].level != b->caches[i].level) || (a->caches[i].id != b->caches[i].id) ||
+		    (a->caches[i].cpu_type != b->caches[i].cpu_type) || (a->caches[i].numa_node != b->caches[i].numa_node) ||
+		    memcmp(&a->caches[i].geometry, &b->caches[i].geometry, sizeof(a->caches[i].geometry)))
+			return 0;
+		for (logical_cpu = 0; logical_cpu < a->num_cpus; logical_cpu++)
+			if (cpuid_affinity_set_contains(&a->caches[i].affinity, logical_cpu) != cpuid_affinity_set_contains(&b->caches[i].affinity, logical_cpu))
+				return 0;
+	}
+	return 1;
+}
+
+static void test_cache_map(void)
+{
+	struct cpu_raw_data_array_t raw_array;
+	struct system_id_t system, other;
+	struct cpu_topology_t topology, empty;
+	struct cpu_cache_map_t map;
+	const struct cpu_cache_instance_t* cache;
+
+	/* Hybrid: the E-cores share their L2 cache by 4, the P-cores have their own (shared by 2 threads) */
+	if (load_dump(&raw_array, "intel/x86-64/golden-cove/12th-gen-intel-core-i9-12900k.test")) {
+		CHECK(cpuid_get_topology(&raw_array, &system, &topology) == 0);
+		CHECK(cpuid_get_cache_map(&system, &topology, &map) == 0);
+		CHECK(cache_map_is_consistent(&map));
+		CHECK(map.num_cpus == 24);
+		CHECK((map.num_level_caches[CACHE_L1_INSTRUCTION] == 16) && (map.num_level_caches[CACHE_L1_DATA] == 16));
+		CHECK((map.num_level_caches[CACHE_L2] == 10) && (map.num_level_caches[CACHE_L3] == 1) && (map.num_level_caches[CACHE_L4] == 0));
+
+		cache = cpuid_get_cpu_cache(&map, 0, CACHE_L2);
+		CHECK((cache != NULL) && (cpuid_affinity_set_count(&cache->affinity) == 2) && cpuid_affinity_set_contains(&cache->affinity, 1));
+		CHECK((cache != NULL) && (cache->geometry.size == 1280) && (cache->geometry.assoc == 10) && (cache->geometry.linesize == 64));
+		CHECK((cache != NULL) && (cache->cpu_type >= 0) && (system.cpu_types[cache->cpu_type].purpose == PURPOSE_PERFORMANCE));
+		cache = cpuid_get_cpu_cache(&map, 16, CACHE_L2);
+		CHECK((cache != NULL) && (cpuid_affinity_set_count(&cache->affinity) == 4) && cpuid_affinity_set_contains(&cache->affinity, 19));
+		CHECK((cache != NULL) && (cache->geometry.size == 2048) && (cache->geometry.assoc == 16) && (cache->geometry.instances == 10));
+		CHECK((cache != NULL) && (cache->cpu_type >= 0) && (system.cpu_types[cache->cpu_type].purpose == PURPOSE_EFFICIENCY));
+		CHECK(cpuid_get_cpu_cache(&map, 19, CACHE_L2) == cache);
+		CHECK(cpuid_get_cpu_cache(&map, 20, CACHE_L2) != cache);
+		cache = cpuid_get_cpu_cache(&map, 0, CACHE_L1_DATA);
+		CHECK((cache != NULL) && (cache->geometry.size == 48) && (cache->geometry.assoc == 12));
+		cache = cpuid_get_cpu_cache(&map, 23, CACHE_L1_DATA);
+		CHECK((cache != NULL) && (cache->geometry.size == 32) && (cache->geometry.assoc == 8) && (cpuid_affinity_set_count(&cache->affinity) == 1));
+		cache = cpuid_get_cpu_cache(&map, 23, CACHE_L3);
+		CHECK((cache != NULL) && (cache == cpuid_get_cpu_cache(&map, 0, CACHE_L3)) && (cpuid_affinity_set_count(&cache->affinity) == 24));
+		CHECK((cache != NULL) && (cache->geometry.size == 30720) && (cache->numa_node == -1));
+
+		/* The identification has the same map */
+		CHECK((system.cache_map != NULL) && cache_maps_are_equal(system.cache_map, &map));
+		CHECK(cpu_identify_all(&raw_array, &other) == 0);
+		CHECK((other.cache_map != NULL) && cache_maps_are_equal(other.cache_map, &map));
+		cpuid_free_system_id(&other);
+		CHECK(other.cache_map == NULL);
+		/* Not without the affinity of the raw data */
+		raw_array.with_affinity = false;
+		CHECK(cpu_identify_all(&raw_array, &other) == 0);
+		CHECK(other.cache_map == NULL);
+		cpuid_free_system_id(&other);
+		raw_array.with_affinity = true;
+
+		/* Out of range */
+		CHECK(cpuid_get_cpu_cache(&map, 0, CACHE_L4) == NULL);
+		CHECK(cpuid_get_cpu_cache(&map, 24, CACHE_L2) == NULL);
+		CHECK(cpuid_get_cpu_cache(&map, 0, NUM_CACHE_LEVELS) == NULL);
+		CHECK(cpuid_get_cpu_cache(&map, 0, (cpu_cache_level_t) -1) == NULL);
+		CHECK(cpuid_get_cpu_cache(NULL, 0, CACHE_L2) == NULL);
+
+		/* NULL and empty inputs */
+		CHECK(cpuid_get_cache_map(NULL, &topology, &map) < 0);
+		CHECK(map.num_caches == 16 + 16 + 10 + 1); /* untouched by the failed call */
+		cpuid_free_cache_map(&map);
+		CHECK((map.caches == NULL) && (map.cpu_caches == NULL) && (map.num_caches == 0));
+		cpuid_free_cache_map(&map);
+		cpuid_free_cache_map(NULL);
+		CHECK(cpuid_get_cache_map(&system, NULL, &map) < 0);
+		CHECK(cpuid_get_cache_map(&system, &topology, NULL) < 0);
+		memset(&empty, 0, sizeof(empty));
+		CHECK(cpuid_get_cache_map(&system, &empty, &map) == ERR_NOT_FOUND);
+		CHECK((map.caches == NULL) && (map.num_caches == 0));
+		cpuid_free_topology(&topology);
+		cpuid_free_system_id(&system);
+		cpuid_free_raw_data_array(&raw_array);
+	}
+
+	/* Two packages of two nodes: one L3 cache per node, L1I and L2 caches shared by the two cores of a compute unit */
+	if (load_dump(&raw_array, "amd/bulldozer/amd-opteron-processor-6238-dual.test")) {
+		CHECK(cpuid_get_topology(&raw_array, &system, &topology) == 0);
+		CHECK(cpuid_get_cache_map(&system, &topology, &map) == 0);
+		CHECK(cache_map_is_consistent(&map));
+		CHECK((map.num_cpus == 24) && (map.num_level_caches[CACHE_L1_INSTRUCTION] == 12) && (map.num_level_caches[CACHE_L1_DATA] == 24));
+		CHECK((map.num_level_caches[CACHE_L2] == 12) && (map.num_level_caches[CACHE_L3] == 4));
+		cache = cpuid_get_cpu_cache(&map, 6, CACHE_L3);
+		CHECK((cache != NULL) && (cpuid_affinity_set_count(&cache->affinity) == 6) && cpuid_affinity_set_contains(&cache->affinity, 11));
+		CHECK((cache != NULL) && (cache->geometry.size == 6144) && (cache->geometry.instances == 4) && (cache->cpu_type == 0));
+		CHECK(cpuid_get_cpu_cache(&map, 5, CACHE_L3) != cache);
+		CHECK(cpuid_get_cpu_cache(&map, 11, CACHE_L3) != cpuid_get_cpu_cache(&map, 12, CACHE_L3));
+		cache = cpuid_get_cpu_cache(&map, 12, CACHE_L2);
+		CHECK((cache != NULL) && (cpuid_affinity_set_count(&cache->affinity) == 2) && cpuid_affinity_set_contains(&cache->affinity, 13));
+		CHECK((cache != NULL) && (cache->geometry.size == 2048) && (cache->geometry.assoc == 16));
+		CHECK(cpuid_get_cpu_cache(&map, 12, CACHE_L1_INSTRUCTION) != NULL);
+		CHECK(cpuid_get_cpu_cache(&map, 12, CACHE_L1_DATA) != cpuid_get_cpu_cache(&map, 13, CACHE_L1_DATA));
+		cpuid_free_cache_map(&map);
+		cpuid_free_topology(&topology);
+		cpuid_free_system_id(&system);
+		cpuid_free_raw_data_array(&raw_array);
+	}
+}
+
+#if defined linux || defined __linux__
+/* Writes a file of a fake sysfs tree, see read_sysfs_file() */
+static void write_sysfs_file(const char* root, const char* path, const char* contents)
+{
+	char full_path[256];
+	char* slash;
+	FILE* f;
+
+	snprintf(full_path, sizeof(full_path), "%s%s", root, path);
+	for (slash = strchr(full_path + strlen(root) + 1, '/'); slash != NULL; slash = strchr(slash + 1, '/')) {
+		*slash = '\0';
+		mkdir(full_path, 0755);
+		*slash = '/';
+	}
+	CHECK((f = fopen(full_path, "w")) != NULL);
+	if (f != NULL) {
+		fputs(contents, f);
+		fclose(f);
+	}
+}
+#endif
+
+/* NUMA nodes of the current system, read from a fake sysfs tree */
+static void test_numa_nodes(void)
+{
+#if defined linux || defined __linux__
+	int i;
+	char root[64], path[320];
+	struct system_id_t system;
+	struct cpu_topology_t topology;
+	static const char* const files[] = {
+		"/sys/devices/system/node/online",
+		"/sys/devices/system/node/node0/cpulist", "/sys/devices/system/node/node0/distance",
+		"/sys/devices/system/node/node2/cpulist", "/sys/devices/system/node/node2/distance",
+		"/sys/devices/system/node/node3/cpulist", "/sys/devices/system/node/node3/distance",
+	};
+	static const char* const dirs[] = {
+		"/sys/devices/system/node/node0", "/sys/devices/system/node/node2", "/sys/devices/system/node/node3",
+		"/sys/devices/system/node", "/sys/devices/system", "/sys/devices", "/sys", "",
+	};
+
+	snprintf(root, sizeof(root), "/tmp/libcpuid-unit-tests-%d-sysfs", (int) getpid());
+	mkdir(root, 0755);
+	write_sysfs_file(root, files[0], " 0,2-3\n");
+	write_sysfs_file(root, files[1], "0\n");
+	write_sysfs_file(root, files[2], "10 20 30\n");
+	write_sysfs_file(root, files[3], "1-4095\n");
+	write_sysfs_file(root, files[4], "20 10 25\n");
+	write_sysfs_file(root, files[5], "\n");
+	write_sysfs_file(root, files[6], "30 25\n");
+	setenv("LIBCPUID_SYSFS_ROOT", root, 1);
+
+	if (cpuid_get_topology(NULL, NULL, &topology) == 0) {
+		CHECK(topology.num_numa_nodes == 3);
+		CHECK((topology.num_numa_nodes == 3) && (topology.numa_node_ids[0] == 0) && (topology.numa_node_ids[1] == 2) && (topology.numa_node_ids[2] == 3));
+		CHECK(topology.cpu_numa_node[0] == 0);
+		CHECK((topology.num_cpus < 2) || (topology.cpu_numa_node[1] == 2));
+		CHECK((topology.num_caches == 0) || (topology.caches[0].numa_node == topology.cpu_numa_node[topology.logical_cpus[topology.caches[0].first_cpu]]) ||
+		      (topology.caches[0].numa_node == -1));
+		CHECK(cpuid_get_numa_distance(&topology, 0, 0) == 10);
+		CHECK(cpuid_get_numa_distance(&topology, 0, 3) == 30);
+		CHECK(cpuid_get_numa_distance(&topology, 2, 3) == 25);
+		CHECK(cpuid_get_numa_distance(&topology, 3, 2) == 25);
+		CHECK(cpuid_get_numa_distance(&topology, 3, 3) == -1); /* missing from node3/distance */
+		CHECK(cpuid_get_numa_distance(&topology, 1, 0) == -1); /* not online */
+		CHECK(cpuid_get_numa_distance(NULL, 0, 0) == -1);
+		cpuid_free_topology(&topology);
+
+		/* cpu_identify_all keeps the same NUMA nodes in the system, and in its cache map */
+		if (cpu_identify_all(NULL, &system) == 0) {
+			CHECK((system.topology != NULL) && (system.topology->num_numa_nodes == 3));
+			CHECK((system.topology != NULL) && (cpuid_get_numa_distance(system.topology, 2, 3) == 25));
+			CHECK((system.topology != NULL) && (system.topology->cpu_numa_node[0] == 0));
+			CHECK((system.cache_map == NULL) || (system.cache_map->num_caches == 0) || (system.cache_map->caches[0].numa_node == 0) ||
+			      (system.cache_map->caches[0].numa_node == -1));
+			cpuid_free_system_id(&system);
+		}
+
+		/* The identification cache keeps the first result (even if the distances changed meanwhile),
+		   and follows the online NUMA nodes */
+		cpuid_set_identify_cache(1);
+		CHECK((cpuid_get_topology(NULL, NULL, &topology) == 0) && (topology.num_numa_nodes == 3));
+		cpuid_free_topology(&topology);
+		write_sysfs_file(root, files[2], "11 20 30\n");
+		CHECK((cpuid_get_topology(NULL, NULL, &topology) == 0) && (cpuid_get_numa_distance(&topology, 0, 0) == 10));
+		cpuid_free_topology(&topology);
+		write_sysfs_file(root, files[0], "0\n");
+		usleep(150000);
+		CHECK((cpuid_get_topology(NULL, NULL, &topology) == 0) && (topology.num_numa_nodes == 1) && (cpuid_get_numa_distance(&topology, 0, 0) == 11));
+		cpuid_free_topology(&topology);
+		write_sysfs_file(root, files[2], "12\n");
+		CHECK((cpuid_get_topology(NULL, NULL, &topology) == 0) && (cpuid_get_numa_distance(&topology, 0, 0) == 11));
+		cpuid_free_topology(&topology);
+		cpuid_set_identify_cache(0);
+
+		/* Malformed lists */
+		write_sysfs_file(root, files[0], "3-1\n");
+		CHECK((cpuid_get_topology(NULL, NULL, &topology) == 0) && (topology.num_numa_nodes == 0) && (topology.cpu_numa_node[0] == -1));
+		cpuid_free_topology(&topology);
+		write_sysfs_file(root, files[0], "0,x,2\n");
+		CHECK((cpuid_get_topology(NULL, NULL, &topology) == 0) && (topology.num_numa_nodes == 1));
+		cpuid_free_topology(&topology);
+	}
+
+	unsetenv("LIBCPUID_SYSFS_ROOT");
+	for (i = 0; i < (int) (sizeof(files) / sizeof(files[0])); i++) {
+		snprintf(path, sizeof(path), "%s%s", root, files[i]);
+		unlink(path);
+	}
+	for (i = 0; i < (int) (sizeof(dirs) / sizeof(dirs[0])); i++) {
+		snprintf(path, sizeof(path), "%s%s", root, dirs[i]);
+		rmdir(path);
+	}
+#endif
+}
+
+/* Identification published in shared memory, see cpuid_publish_system_id() */
+static void test_published_system_id(void)
+{
+#if defined linux || defined __linux__
+	int fd;
+	char name[64], path[96], link_name[72], link_path[104];
+	const unsigned char garbage = 0xff;
+	struct cpu_raw_data_array_t raw_array;
+	struct system_id_t system, identified;
+
+	snprintf(name, sizeof(name), "libcpuid-unit-tests-%d", (int) getpid());
+	snprintf(path, sizeof(path), "/dev/shm/%s", name);
+	snprintf(link_name, sizeof(link_name), "%s-link", name);
+	snprintf(link_path, sizeof(link_path), "/dev/shm/%s", link_name);
+	if (!load_dump(&raw_array, "amd/zen4/amd-ryzen-9-7900x-12-core-processor.test"))
+		return;
+	CHECK(cpuid_publish_system_id(name, &raw_array) == 0);
+	CHECK(cpu_identify_all(&raw_array, &identified) == 0);
+	cpuid_free_raw_data_array(&raw_array);
+	CHECK(cpuid_read_published_system_id(name, &system) == 0);
+	CHECK(system.num_cpu_types == 1);
+	/* The arrays which follow the payload */
+	CHECK(cpuid_affinity_set_count(&system.cpu_types[0].affinity) == 24);
+	CHECK((system.cache_map != NULL) && (identified.cache_map != NULL) && cache_maps_are_equal(system.cache_map, identified.cache_map));
+	CHECK((system.topology != NULL) && (identified.topology != NULL) && topologies_are_equal(system.topology, identified.topology));
+	cpuid_free_system_id(&identified);
+	cpuid_free_system_id(&system);
+
+	/* Segments which someone else may have written are ignored */
+	CHECK(chmod(path, 0666) == 0);
+	CHECK(cpuid_read_published_system_id(name, &system) == ERR_OPEN);
+	CHECK(cpuid_publish_system_id(name, NULL) == ERR_OPEN);
+	CHECK(chmod(path, 0644) == 0);
+	if (geteuid() == 0) {
+		CHECK(chown(path, 1, 1) == 0);
+		CHECK(cpuid_read_published_system_id(name, &system) == ERR_OPEN);
+		CHECK(chown(path, 0, 0) == 0);
+	}
+	CHECK(symlink(path, link_path) == 0);
+	CHECK(cpuid_read_published_system_id(link_name, &system) == ERR_OPEN);
+	unlink(link_path);
+
+	/* Forged payload: the checksum does not match */
+	CHECK(cpuid_read_published_system_id(name, &system) == 0);
+	cpuid_free_system_id(&system);
+	fd = open(path, O_WRONLY);
+	CHECK(fd >= 0);
+	if (fd >= 0) {
+		CHECK(pwrite(fd, &garbage, 1, 64) == 1);
+		close(fd);
+	}
+	CHECK(cpuid_read_published_system_id(name, &system) == ERR_BADFMT);
+	unlink(path);
+	CHECK(cpuid_read_published_system_id(name, &system) == ERR_OPEN);
+#endif
+}
+
+#if defined linux || defined __linux__
+static long file_size(const char* path)
+{
+	struct stat st;
+	return (stat(path, &st) == 0) ? (long) st.st_size : -1;
+}
+#endif
+
+/* Identifications kept in a file, see cpuid_set_identify_cache_file() */
+static void test_identify_cache_file(void)
+{
+#if defined linux || defined __linux__
+	enum { NUM_CHILDREN = 4 };
+	int i, fd, status;
+	long header_size, entry_size;
+	char path[64];
+	pid_t pids[NUM_CHILDREN];
+	struct stat st;
+	struct cpu_raw_data_array_t raw_array;
+	struct cpu_raw_data_t raw;
+	struct cpu_id_t id, cached;
+
+	snprintf(path, sizeof(path), "/tmp/libcpuid-unit-tests-%d.cache", (int) getpid());
+	unlink(path);
+	if (!load_dump(&raw_array, "amd/zen4/amd-ryzen-9-7900x-12-core-processor.test"))
+		return;
+	raw = raw_array.raw[0];
+	CHECK(cpuid_set_identify_cache_file(path) == 0);
+	header_size = file_size(path);
+	CHECK(header_size > 0);
+	CHECK(cpu_identify(&raw, &id) == 0);
+	entry_size = file_size(path) - header_size;
+	CHECK(entry_size > 0);
+
+	/* The IDs of the logical CPU share the entry, ThreadsPerComputeUnit does not */
+	for (i = 1; i < (int) raw_array.num_raw; i++)
+		CHECK(cpu_identify(&raw_array.raw[i], &cached) == 0);
+	CHECK(file_size(path) == header_size + entry_size);
+	cpuid_free_raw_data_array(&raw_array);
+	raw.basic_cpuid[0x01][1] ^= 0x0c000000;
+	raw.basic_cpuid[0x0b][3] ^= 0x0c;
+	for (i = 0; i < MAX_AMDFN80000026H_LEVEL; i++)
+		raw.amd_fn80000026h[i][3] ^= 0x0c;
+	raw.ext_cpuid[0x1e][0]   ^= 0x0c;
+	raw.ext_cpuid[0x1e][1]   ^= 0x06;
+	raw.ext_cpuid[0x1e][2]   ^= 0x01;
+	CHECK(cpu_identify(&raw, &cached) == 0);
+	CHECK(file_size(path) == header_size + entry_size);
+	CHECK(!strcmp(cached.brand_str, id.brand_str) && (cached.num_cores == id.num_cores));
+	raw.ext_cpuid[0x1e][1] ^= 0x0100;
+	CHECK(cpu_identify(&raw, &cached) == 0);
+	CHECK(file_size(path) == header_size + 2 * entry_size);
+	raw.ext_cpuid[0x1e][1] ^= 0x0100;
+
+	/* Entries of the other processes */
+	CHECK(cpuid_set_identify_cache_file(NULL) == 0);
+	for (i = 0; i < NUM_CHILDREN; i++) {
+		if ((pids[i] = fork()) == 0) {
+			raw.ext_cpuid[0x1e][1] ^= (uint32_t) (i + 2) << 8;
+			_exit((cpuid_set_identify_cache_file(path) == 0) && (cpu_identify(&raw, &cached) == 0) ? 0 : 1);
+		}
+		CHECK(pids[i] > 0);
+	}
+	for (i = 0; i < NUM_CHILDREN; i++)
+		CHECK((pids[i] > 0) && (waitpid(pids[i], &status, 0) == pids[i]) && WIFEXITED(status) && (WEXITSTATUS(status) == 0));
+	CHECK(file_size(path) == header_size + (2 + NUM_CHILDREN) * entry_size);
+	CHECK(cpuid_set_identify_cache_file(path) == 0);
+	CHECK(cpu_identify(&raw, &cached) == 0);
+	CHECK(file_size(path) == header_size + (2 + NUM_CHILDREN) * entry_size);
+	CHECK(!strcmp(cached.brand_str, id.brand_str) && (cached.num_cores == id.num_cores));
+	CHECK(cpuid_set_identify_cache_file(NULL) == 0);
+
+	/* A file of another version is replaced, not truncated under its readers */
+	fd = open(path, O_WRONLY);
+	CHECK(fd >= 0);
+	if (fd >= 0) {
+		CHECK(pwrite(fd, "0", 1, header_size - 1) == 1);
+		CHECK(cpuid_set_identify_cache_file(path) == 0);
+		CHECK((fstat(fd, &st) == 0) && (st.st_size == header_size + (2 + NUM_CHILDREN) * entry_size));
+		CHECK(file_size(path) == header_size);
+		close(fd);
+	}
+	CHECK(cpu_identify(&raw, &cached) == 0);
+	CHECK(file_size(path) == header_size + entry_size);
+	CHECK(cpuid_set_identify_cache_file(NULL) == 0);
+
+	/* A file which cannot be written is only read */
+	if (geteuid() != 0) {
+		CHECK(chmod(path, 0444) == 0);
+		CHECK(cpuid_set_identify_cache_file(path) == 0);
+		raw.ext_cpuid[0x1e][1] ^= 0x0100;
+		CHECK(cpu_identify(&raw, &cached) == 0);
+		CHECK(file_size(path) == header_size + entry_size);
+		CHECK(cpuid_set_identify_cache_file(NULL) == 0);
+	}
+	unlink(path);
+#endif
+}
+
+int main(int argc, char** argv)
+{
+	if (argc > 1)
+		tests_dir = argv[1];
+	test_raw_array();
+	test_raw_groups();
+	test_affinity_sets();
+	test_feature_sets();
+	test_baseline();
+	test_dispatch();
+	test_core_types();
+	test_topology();
+	test_cache_map();
+	test_numa_nodes();
+	test_published_system_id();
+	test_identify_cache_file();
+	printf("%d checks, %d failures\n", num_checks, num_failures);
+	return (num_failures > 0) ? 1 : 0;
+}